@@ -92,6 +92,40 @@ pub fn build(b: *std.Build) !void {
         break :blk exe;
     });
 
+    // bench exe, also run by the bench step below
+    const bench = blk: {
+        var engine_options = default_engine_options;
+        engine_options.window = false;
+        engine_options.gui = false;
+        const engine = makeEngineModule(b, vulkan, engine_options, target);
+        const exe = b.addExecutable(.{
+            .name = "bench",
+            .root_source_file = b.path("src/bin/bench.zig"),
+            .target = target,
+            .optimize = optimize,
+        });
+        exe.root_module.addImport("vulkan", vulkan);
+        exe.root_module.addImport("engine", engine);
+        tinyexr.add(&exe.root_module);
+        tinyexr.add(engine);
+        wuffs.add(&exe.root_module);
+        wuffs.add(engine);
+
+        break :blk exe;
+    };
+    try compiles.append(bench);
+
+    // renders the bundled scenes, `zig build bench -- --update-references` to accept the current renders
+    {
+        const run = b.addRunArtifact(bench);
+        run.addDirectoryArg(b.path("assets"));
+        if (b.args) |args| run.addArgs(args);
+        run.has_side_effects = true; // timings differ every run
+
+        const step = b.step("bench", "Run render benchmarks");
+        step.dependOn(&run.step);
+    }
+
     // hydra shared lib
     if (target.result.os.tag == .linux) {
         var engine_options = default_engine_options;
@@ -129,6 +163,7 @@ pub fn build(b: *std.Build) !void {
                 "hydra/camera.cpp",
                 "hydra/instancer.cpp",
                 "hydra/material.cpp",
+                "hydra/textureCache.cpp",
             },
         });
         lib.linkLibrary(zig_lib);
@@ -146,8 +181,13 @@ pub fn build(b: *std.Build) !void {
             lib.linkSystemLibrary("usd_hd");
             lib.linkSystemLibrary("usd_sdr");
             lib.linkSystemLibrary("usd_hio");
+            lib.linkSystemLibrary("usd_work");
         }
 
+        // work's parallel loops are templates over tbb
+        if (tbb_dir) |dir| lib.addLibraryPath(.{ .cwd_relative = b.pathJoin(&.{ dir, "lib/" }) });
+        lib.linkSystemLibrary("tbb");
+
         // include headers necessary for usd
         lib.addSystemIncludePath(.{ .cwd_relative = b.pathJoin(&.{ usd_dir, "include/" }) });
         if (tbb_dir) |dir| lib.addSystemIncludePath(.{ .cwd_relative = b.pathJoin(&.{ dir, "include/" }) });
@@ -341,12 +381,19 @@ fn makeEngineModule(b: *std.Build, vk: *std.Build.Module, options: EngineOptions
     imports.appendSlice(&.{
         compileShader(b, .ray_tracing, "hrtsystem/input.hlsl"),
         compileShader(b, .ray_tracing, "hrtsystem/main_pt.hlsl"),
+        compileShader(b, .ray_tracing, "hrtsystem/main_pt_reorder.hlsl"),
         compileShader(b, .ray_tracing, "hrtsystem/main_direct.hlsl"),
+        compileShader(b, .ray_tracing, "hrtsystem/wavefront/trace.hlsl"),
+        compileShader(b, .compute, "hrtsystem/wavefront/generate.hlsl"),
+        compileShader(b, .compute, "hrtsystem/wavefront/shade.hlsl"),
+        compileShader(b, .compute, "hrtsystem/wavefront/accumulate.hlsl"),
+        compileShader(b, .compute, "hrtsystem/convergence.hlsl"),
         compileShader(b, .compute, "hrtsystem/background/equirectangular_to_equal_area.hlsl"),
         compileShader(b, .compute, "hrtsystem/background/luminance.hlsl"),
         compileShader(b, .compute, "hrtsystem/background/fold.hlsl"),
         compileShader(b, .compute, "hrtsystem/mesh_sampling/power.hlsl"),
         compileShader(b, .compute, "hrtsystem/mesh_sampling/fold.hlsl"),
+        compileShader(b, .compute, "hrtsystem/mesh_sampling/leaves.hlsl"),
     }) catch @panic("OOM");
 
     const module = b.createModule(.{
@@ -0,0 +1,240 @@
+// renders the bundled scenes at fixed settings and prints what it took as json lines,
+// one per scene, so that performance and correctness can be tracked across revisions
+//
+//   bench ASSETS_DIR [--update-references]
+//
+// renders are compared against ASSETS_DIR/references/SCENE.exr, which
+// --update-references overwrites with the current results; otherwise a scene
+// without a reference still has its timings printed, with a null rmse, and
+// the run fails once all scenes are done, so a regression cannot go unnoticed
+
+const std = @import("std");
+const vk = @import("vulkan");
+
+const engine = @import("engine");
+
+const core = engine.core;
+const VulkanContext = core.VulkanContext;
+const Encoder = core.Encoder;
+const Profiler = core.Profiler;
+const Pipeline = engine.hrtsystem.pipeline.PathTracing;
+const Scene = engine.hrtsystem.Scene;
+
+const exr = engine.fileformats.exr;
+
+const Benchmark = struct {
+    name: []const u8, // of the reference
+    scene_filename: []const u8, // must be gltf/glb
+    skybox_filename: []const u8 = "lightprobe.exr",
+    extent: vk.Extent2D = .{ .width = 640, .height = 360 },
+    spp: u32 = 64,
+};
+
+// these must not change, or earlier results and references are no longer comparable
+const benchmarks = [_]Benchmark {
+    .{ .name = "cornellBox", .scene_filename = "cornellBox.gltf" },
+    .{ .name = "cornellBoxLucy", .scene_filename = "cornellBoxLucy.gltf" },
+    .{ .name = "dragon-glass", .scene_filename = "dragon-glass.gltf" },
+    .{ .name = "lux-balls", .scene_filename = "lux-balls.gltf" },
+    .{ .name = "dispersion", .scene_filename = "dispersion.glb" },
+};
+
+const constants = Pipeline.SpecConstants {
+    .max_bounces = 1024,
+    .env_samples_per_bounce = 1,
+    .mesh_samples_per_bounce = 1,
+};
+
+// same as offline, so that no submit runs long enough for the driver to give up on it
+const samples_per_submit = 16;
+
+const Config = struct {
+    assets_dirpath: []const u8,
+    update_references: bool,
+
+    fn fromCli(allocator: std.mem.Allocator) !Config {
+        const args = try std.process.argsAlloc(allocator);
+        defer std.process.argsFree(allocator, args);
+        if (args.len < 2 or args.len > 3) return error.BadArgs;
+
+        const update_references = args.len == 3;
+        if (update_references and !std.mem.eql(u8, args[2], "--update-references")) return error.BadArgs;
+
+        return Config {
+            .assets_dirpath = try allocator.dupe(u8, args[1]),
+            .update_references = update_references,
+        };
+    }
+
+    fn destroy(self: Config, allocator: std.mem.Allocator) void {
+        allocator.free(self.assets_dirpath);
+    }
+};
+
+const Result = struct {
+    scene: []const u8,
+    width: u32,
+    height: u32,
+    spp: u32,
+    load_ms: f64, // host time to parse and upload the scene, including the initial builds
+    accel_build_ms: f64, // device time of BLAS and TLAS builds and compaction
+    pipeline_ms: f64, // host time to create the pipeline
+    mrays_per_second: f64, // camera rays
+    ms_per_spp: f64, // device time
+    rmse: ?f64, // against the reference, zero when updating it, null without one
+};
+
+fn msSince(start: std.time.Instant) !f64 {
+    const elapsed = (try std.time.Instant.now()).since(start);
+    return @as(f64, @floatFromInt(elapsed)) / std.time.ns_per_ms;
+}
+
+// root mean square error over the color channels, ignoring alpha
+fn rmse(image: []const [4]f32, reference: []const [4]f32) f64 {
+    std.debug.assert(image.len == reference.len);
+    var sum: f64 = 0;
+    for (image, reference) |pixel, reference_pixel| {
+        for (pixel[0..3], reference_pixel[0..3]) |channel, reference_channel| {
+            const difference: f64 = channel - reference_channel;
+            sum += difference * difference;
+        }
+    }
+    return @sqrt(sum / @as(f64, @floatFromInt(image.len * 3)));
+}
+
+fn deviceMs(profiler: *const Profiler, names: []const []const u8) f64 {
+    var duration_ns: f64 = 0;
+    for (names) |name| {
+        if (profiler.totals.get(name)) |stat| duration_ns += stat.duration_ns;
+    }
+    return duration_ns / std.time.ns_per_ms;
+}
+
+fn run(allocator: std.mem.Allocator, vc: *const VulkanContext, encoder: *Encoder, profiler: *Profiler, config: Config, benchmark: Benchmark) !Result {
+    profiler.reset();
+
+    const scene_filepath = try std.fs.path.join(allocator, &.{ config.assets_dirpath, benchmark.scene_filename });
+    defer allocator.free(scene_filepath);
+    const skybox_filepath = try std.fs.path.join(allocator, &.{ config.assets_dirpath, benchmark.skybox_filename });
+    defer allocator.free(skybox_filepath);
+
+    const load_start = try std.time.Instant.now();
+    try encoder.begin();
+    var scene = try Scene.fromGltfExr(vc, allocator, encoder, scene_filepath, skybox_filepath, benchmark.extent);
+    defer scene.destroy(vc, allocator);
+    try encoder.submitAndIdleUntilDone(vc);
+
+    // BLAS compacted sizes are known now that loading is done
+    try encoder.begin();
+    try scene.world.accel.recordCommit(vc, allocator, encoder, scene.world.meshes, scene.world.materials);
+    try encoder.submitAndIdleUntilDone(vc);
+    const load_ms = try msSince(load_start);
+    _ = try profiler.resolve(vc);
+
+    const pipeline_start = try std.time.Instant.now();
+    try encoder.begin();
+    var pipeline = try Pipeline.create(vc, allocator, encoder, .{ scene.world.materials.textures.descriptor_layout.handle, scene.world.constant_specta.descriptor_layout.handle }, constants, .{ scene.background.sampler });
+    defer pipeline.destroy(vc);
+    try encoder.submitAndIdleUntilDone(vc);
+    const pipeline_ms = try msSince(pipeline_start);
+
+    const output_buffer = try core.mem.DownloadBuffer([4]f32).create(vc, benchmark.extent.width * benchmark.extent.height, "output");
+    defer output_buffer.destroy(vc);
+
+    const sensor = &scene.camera.sensors.items[0];
+    while (sensor.sample_count < benchmark.spp) {
+        try encoder.begin();
+
+        sensor.recordPrepareForCapture(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{});
+        pipeline.recordBindPipeline(encoder.buffer);
+        pipeline.recordBindAdditionalDescriptorSets(encoder.buffer, .{ scene.world.materials.textures.descriptor_set, scene.world.constant_specta.descriptor_set });
+        pipeline.recordPushDescriptors(encoder.buffer, scene.pushDescriptors(0, 0));
+
+        const sample_count = @min(samples_per_submit, benchmark.spp - sensor.sample_count);
+        for (0..sample_count) |i| {
+            pipeline.recordPushConstants(encoder.buffer, .{ .lens = scene.camera.lenses.items[0], .sample_count = sensor.sample_count });
+
+            const scope = encoder.beginScope("trace rays");
+            pipeline.recordTraceRays(encoder.buffer, benchmark.extent);
+            encoder.endScope(scope, benchmark.extent.width * benchmark.extent.height); // camera rays
+
+            if (i + 1 != sample_count) sensor.recordCaptureBarrier(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true });
+            sensor.sample_count += 1;
+        }
+
+        sensor.recordPrepareForCopy(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{ .copy_bit = true });
+        if (sensor.sample_count == benchmark.spp) encoder.copyImageToBuffer(sensor.image.handle, .transfer_src_optimal, benchmark.extent, output_buffer.handle);
+
+        try encoder.submitAndIdleUntilDone(vc);
+        _ = try profiler.resolve(vc);
+    }
+
+    const trace = profiler.totals.get("trace rays").?;
+
+    const reference_filename = try std.fmt.allocPrint(allocator, "{s}.exr", .{ benchmark.name });
+    defer allocator.free(reference_filename);
+    const reference_filepath = try std.fs.path.join(allocator, &.{ config.assets_dirpath, "references", reference_filename });
+    defer allocator.free(reference_filepath);
+
+    const image = exr.helpers.Rgba2D {
+        .ptr = output_buffer.slice.ptr,
+        .extent = benchmark.extent,
+    };
+    const error_to_reference: ?f64 = if (config.update_references) blk: {
+        try std.fs.cwd().makePath(std.fs.path.dirname(reference_filepath).?);
+        try image.save(allocator, reference_filepath);
+        break :blk 0;
+    } else if (exr.helpers.Rgba2D.load(allocator, reference_filepath)) |reference| blk: {
+        defer allocator.free(reference.asSlice());
+        if (!std.meta.eql(reference.extent, image.extent)) return error.ReferenceExtentMismatch;
+        break :blk rmse(image.asSlice(), reference.asSlice());
+    } else |err| blk: {
+        if (err != error.FileNotFound) return err;
+        std.log.err("no reference at {s}, run with --update-references to create it", .{ reference_filepath });
+        break :blk null;
+    };
+
+    return Result {
+        .scene = benchmark.name,
+        .width = benchmark.extent.width,
+        .height = benchmark.extent.height,
+        .spp = benchmark.spp,
+        .load_ms = load_ms,
+        .accel_build_ms = deviceMs(profiler, &.{ "blas build", "blas compaction", "tlas build" }),
+        .pipeline_ms = pipeline_ms,
+        .mrays_per_second = trace.throughput() / 1e6,
+        .ms_per_spp = trace.duration_ns / std.time.ns_per_ms / @as(f64, @floatFromInt(benchmark.spp)),
+        .rmse = error_to_reference,
+    };
+}
+
+pub const required_vulkan_functions = engine.hrtsystem.required_vulkan_functions;
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}) {};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const config = try Config.fromCli(allocator);
+    defer config.destroy(allocator);
+
+    const context = try VulkanContext.create(allocator, "bench", &.{}, &engine.hrtsystem.required_device_extensions, &engine.hrtsystem.optional_device_extensions, &engine.hrtsystem.required_device_features, null);
+    defer context.destroy(allocator);
+
+    var encoder = try Encoder.create(&context, "main");
+    defer encoder.destroy(&context);
+
+    var profiler = try Profiler.create(&context);
+    defer profiler.destroy(&context);
+    encoder.profiler = &profiler;
+
+    const stdout = std.io.getStdOut().writer();
+    var missing_references = false;
+    for (benchmarks) |benchmark| {
+        const result = try run(allocator, &context, &encoder, &profiler, config, benchmark);
+        try std.json.stringify(result, .{}, stdout);
+        try stdout.writeByte('\n');
+        if (result.rmse == null) missing_references = true;
+    }
+    if (missing_references) return error.MissingReferences;
+}
@@ -6,6 +6,8 @@ const engine = @import("engine");
 const core = engine.core;
 const VulkanContext = core.VulkanContext;
 const Encoder = core.Encoder;
+const Profiler = core.Profiler;
+const vk_helpers = core.vk_helpers;
 
 const hrtsystem = engine.hrtsystem;
 const Scene = hrtsystem.Scene;
@@ -17,6 +19,7 @@ const MaterialManager = hrtsystem.MaterialManager;
 const TextureManager = MaterialManager.TextureManager;
 const Accel = hrtsystem.Accel;
 const Pipeline = hrtsystem.pipeline.PathTracing;
+const Convergence = hrtsystem.Convergence;
 
 const vector = engine.vector;
 const F32x2 = vector.Vec2(f32);
@@ -37,6 +40,7 @@ pub const Material = extern struct {
     normal: TextureManager.Handle,
     emissive: TextureManager.Handle,
     standard_pbr: MaterialManager.StandardPBR,
+    may_emit: bool, // see HdMoonshineSetMaterialMayEmit
 };
 
 pub const TextureFormat = enum(c_int) {
@@ -45,6 +49,13 @@ pub const TextureFormat = enum(c_int) {
     u8x2,
     u8x4,
     u8x4_srgb,
+    bc1,
+    bc1_srgb,
+    bc4,
+    bc5,
+    bc6h,
+    bc7,
+    bc7_srgb,
 
     fn toVk(self: TextureFormat) vk.Format {
         switch (self) {
@@ -53,50 +64,180 @@ pub const TextureFormat = enum(c_int) {
             .u8x2 => return .r8g8_unorm,
             .u8x4 => return .r8g8b8a8_unorm,
             .u8x4_srgb => return .r8g8b8a8_srgb,
+            .bc1 => return .bc1_rgba_unorm_block,
+            .bc1_srgb => return .bc1_rgba_srgb_block,
+            .bc4 => return .bc4_unorm_block,
+            .bc5 => return .bc5_unorm_block,
+            .bc6h => return .bc6h_ufloat_block,
+            .bc7 => return .bc7_unorm_block,
+            .bc7_srgb => return .bc7_srgb_block,
         }
     }
 
-    fn pixelSizeInBytes(self: TextureFormat) usize {
-        switch (self) {
-            .f16x4 => return @sizeOf(f16) * 4,
-            .u8x1 => return @sizeOf(u8) * 1,
-            .u8x2 => return @sizeOf(u8) * 2,
-            .u8x4 => return @sizeOf(u8) * 4,
-            .u8x4_srgb => return @sizeOf(u8) * 4,
-        }
+    fn sizeInBytes(self: TextureFormat, extent: vk.Extent2D, mip_level_count: u32) usize {
+        var size: vk.DeviceSize = 0;
+        for (0..mip_level_count) |level| size += vk_helpers.mipLevelSize(self.toVk(), extent, @intCast(level));
+        return @intCast(size);
     }
 };
 
+// host-visible staging memory for a mesh, written directly by the caller
+// a null attribute is not uploaded
+pub const MeshUpload = extern struct {
+    positions: [*]F32x3,
+    normals: ?[*]F32x3,
+    texcoords: ?[*]F32x2,
+    indices: ?[*]U32x3, // null for unindexed meshes
+    vertex_count: usize,
+    triangle_count: usize,
+    recorder: *Encoder, // owns the staging memory until the upload is ended
+    compact: bool, // whether normals and texcoords are stored at lower precision, in less memory
+};
+
+// device time of a profiled scope in the latest finished frame
+pub const ProfilerStat = extern struct {
+    name: [*:0]const u8,
+    duration_ms: f64,
+    work: u64,
+    throughput: f64, // work per second, e.g., rays per second of "trace rays"
+};
+
 pub const HdMoonshine = struct {
     allocator: Allocator,
     vc: VulkanContext,
     encoder: Encoder,
+    profiler: Profiler, // of `encoder`, which along with those of frames takes turns recording
 
     world: World,
     camera: Camera,
     background: Background,
 
     pipeline: Pipeline,
+    pipeline_settings: Pipeline.SpecConstants,
+    convergence: Convergence,
+
+    // `encoder` is always recording and collects scene edits until the next render,
+    // at which point it is submitted and swapped with the encoder of a finished frame
+    frames: [frames_in_flight]Frame,
+    frame_index: u8,
 
-    output_buffers: std.ArrayListUnmanaged(core.mem.DownloadBuffer([4]f32)),
+    // smoothed device time of a single camera ray, taken from the "trace rays" scope of finished frames
+    // null until the first frame is finished
+    camera_ray_time_ns: ?f64,
 
-    // as a temporary hack, while the resource system is not yet streamlined,
-    // force it to all be singlethreaded
+    readbacks: std.ArrayListUnmanaged(SensorReadback),
+
+    // guards everything but recorders, which let threads create resources at the same time,
+    // so this only needs to be held for the short bookkeeping afterwards
     mutex: std.Thread.Mutex,
 
+    // encoders threads record resource uploads into, one thread per recorder at a time
+    // ready ones are submitted in one batch ahead of `encoder` in the next render
+    // and become ready again once that frame is finished, while ones still being
+    // recorded into are left out until they are released
+    recorder_mutex: std.Thread.Mutex,
+    recorders: std.ArrayListUnmanaged(*Encoder), // all of them, for destruction
+    ready_recorders: std.ArrayListUnmanaged(*Encoder),
+
     material_updates: std.AutoArrayHashMapUnmanaged(MaterialManager.Handle, MaterialUpdate),
 
-    instance_to_mesh: std.ArrayListUnmanaged(MeshManager.Handle),
+    // textures destroyed since the last render, whose handles cannot be reused yet
+    // as frames in flight may still sample them through materials not updated until that render
+    destroyed_textures: std.ArrayListUnmanaged(TextureManager.Handle),
+
+    // renders are submitted without waiting on them, and the host only blocks
+    // once it gets more than this many renders ahead of the device
+    const frames_in_flight = 2;
+
+    // readbacks must cover every frame in flight, the latest finished frame,
+    // and one the host may currently have mapped
+    const readbacks_per_sensor = frames_in_flight + 2;
+
+    // upper bound on samples traced by a single adaptive render
+    // so a bad time estimate cannot stall the device for long
+    const max_adaptive_samples = 64;
+
+    const Frame = struct {
+        encoder: Encoder,
+        fence: vk.Fence,
+        readback: ?PendingReadback = null, // only set while submitted
+        recorders: std.ArrayListUnmanaged(*Encoder) = .{}, // submitted ahead of this frame
+        destroyed_textures: std.ArrayListUnmanaged(TextureManager.Handle) = .{}, // freed once this frame, which stopped using them, is finished
+
+        fn create(vc: *const VulkanContext, name: [*:0]const u8) !Frame {
+            var encoder = try Encoder.create(vc, name);
+            errdefer encoder.destroy(vc);
+
+            // start signaled so the first wait on this frame goes through
+            const fence = try vc.device.createFence(&.{
+                .flags = .{ .signaled_bit = true },
+            }, null);
+
+            return Frame {
+                .encoder = encoder,
+                .fence = fence,
+            };
+        }
+
+        // frame must not be in use
+        // leaves the fence alone, see prepareForSubmit
+        fn reset(self: *Frame, vc: *const VulkanContext) !void {
+            try vc.device.resetCommandPool(self.encoder.pool, .{});
+            self.encoder.clearResources(vc);
+        }
+
+        // only done right before the submit that signals the fence again,
+        // as a render returning early before it would otherwise leave the next wait on this frame hanging
+        fn prepareForSubmit(self: *Frame, vc: *const VulkanContext) !void {
+            try vc.device.resetFences(1, @ptrCast(&self.fence));
+        }
 
-    power_updates: std.ArrayListUnmanaged(PowerUpdate),
+        fn destroy(self: *Frame, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
+            self.destroyed_textures.deinit(allocator);
+            self.recorders.deinit(allocator);
+            vc.device.destroyFence(self.fence, null);
+            self.encoder.destroy(vc);
+        }
+    };
 
-    // only keep a single bit for deciding if we should update all --
-    // could technically be more granular
-    need_instance_update: bool,
+    const PendingReadback = struct {
+        sensor: Camera.SensorHandle,
+        index: u8,
+    };
 
-    const PowerUpdate = struct {
-        instance: u32,
-        mesh: u32,
+    const SensorReadback = struct {
+        buffers: [readbacks_per_sensor]core.mem.DownloadBuffer([4]f32),
+        pending: [readbacks_per_sensor]bool = [_]bool { false } ** readbacks_per_sensor,
+        latest: ?u8 = null, // most recent finished frame
+        mapped: ?u8 = null, // host is reading this, so device must not write it
+
+        fn create(vc: *const VulkanContext, extent: vk.Extent2D) !SensorReadback {
+            var buffers: [readbacks_per_sensor]core.mem.DownloadBuffer([4]f32) = undefined;
+            var created: usize = 0;
+            errdefer for (buffers[0..created]) |buffer| buffer.destroy(vc);
+            for (&buffers) |*buffer| {
+                buffer.* = try core.mem.DownloadBuffer([4]f32).create(vc, extent.width * extent.height, "output");
+                // sensors mapped before their first frame finishes show black
+                @memset(buffer.slice, .{ 0.0, 0.0, 0.0, 0.0 });
+                created += 1;
+            }
+
+            return SensorReadback {
+                .buffers = buffers,
+            };
+        }
+
+        // a readback the device may write into
+        fn acquire(self: *SensorReadback) u8 {
+            for (0..readbacks_per_sensor) |i| {
+                const index: u8 = @intCast(i);
+                if (!self.pending[index] and self.latest != index and self.mapped != index) return index;
+            } else unreachable; // there are enough readbacks for all frames in flight
+        }
+
+        fn destroy(self: *SensorReadback, vc: *const VulkanContext) void {
+            for (self.buffers) |buffer| buffer.destroy(vc);
+        }
     };
 
     const MaterialUpdate = struct {
@@ -106,9 +247,12 @@ pub const HdMoonshine = struct {
         metalness: ?TextureManager.Handle = null,
         roughness: ?TextureManager.Handle = null,
         ior: ?f32 = null,
+        may_emit: ?bool = null,
     };
 
-    const pipeline_settings = Pipeline.SpecConstants {
+    // direct light resampling is off until turned on through HdMoonshineSetDirectLightResampling,
+    // as reuse between samples and pixels is biased
+    const default_pipeline_settings = Pipeline.SpecConstants {
         .max_bounces = 1024,
         .env_samples_per_bounce = 0,
         .mesh_samples_per_bounce = 1,
@@ -122,11 +266,26 @@ pub const HdMoonshine = struct {
         errdefer allocator.allocator().destroy(self);
 
         self.allocator = allocator;
-        self.vc = VulkanContext.create(self.allocator.allocator(), "hdMoonshine", &.{}, &hrtsystem.required_device_extensions, &hrtsystem.required_device_features, null) catch return null;
+        self.vc = VulkanContext.create(self.allocator.allocator(), "hdMoonshine", &.{}, &hrtsystem.required_device_extensions, &hrtsystem.optional_device_extensions, &hrtsystem.required_device_features, null) catch return null;
         errdefer self.vc.destroy(self.allocator.allocator());
 
+        self.profiler = Profiler.create(&self.vc) catch return null;
+        errdefer self.profiler.destroy(&self.vc);
+
         self.encoder = Encoder.create(&self.vc, "main") catch return null;
         errdefer self.encoder.destroy(&self.vc);
+        self.encoder.profiler = &self.profiler;
+        self.encoder.begin() catch return null;
+
+        var frames_created: usize = 0;
+        errdefer for (self.frames[0..frames_created]) |*frame| frame.destroy(&self.vc, self.allocator.allocator());
+        for (&self.frames) |*frame| {
+            frame.* = Frame.create(&self.vc, "frame") catch return null;
+            frame.encoder.profiler = &self.profiler;
+            frames_created += 1;
+        }
+        self.frame_index = 0;
+        self.camera_ray_time_ns = null;
 
         self.world = World.createEmpty(&self.vc, self.allocator.allocator(), &self.encoder) catch return null;
         errdefer self.world.destroy(&self.vc, self.allocator.allocator());
@@ -138,191 +297,176 @@ pub const HdMoonshine = struct {
         errdefer self.background.destroy(&self.vc, self.allocator.allocator());
         self.background.addDefaultBackground(&self.vc, self.allocator.allocator(), &self.encoder) catch return null;
 
-        self.pipeline = Pipeline.create(&self.vc, self.allocator.allocator(), &self.encoder, .{ self.world.materials.textures.descriptor_layout.handle, self.world.constant_specta.descriptor_layout.handle }, pipeline_settings, .{ self.background.sampler }) catch return null;
+        self.pipeline_settings = default_pipeline_settings;
+        self.pipeline = Pipeline.create(&self.vc, self.allocator.allocator(), &self.encoder, .{ self.world.materials.textures.descriptor_layout.handle, self.world.constant_specta.descriptor_layout.handle }, self.pipeline_settings, .{ self.background.sampler }) catch return null;
         errdefer self.pipeline.destroy(&self.vc);
 
-        self.output_buffers = .{};
+        self.convergence = Convergence.create(&self.vc, self.allocator.allocator()) catch return null;
+        errdefer self.convergence.destroy(&self.vc);
+
+        self.readbacks = .{};
         self.mutex = .{};
+        self.recorder_mutex = .{};
+        self.recorders = .{};
+        self.ready_recorders = .{};
         self.material_updates = .{};
-        self.power_updates = .{};
-        self.instance_to_mesh = .{};
-        self.need_instance_update = false;
+        self.destroyed_textures = .{};
+
+        // DCC hosts often exit without destroying render delegates
+        self.vc.savePipelineCache(self.allocator.allocator());
 
         return self;
     }
 
-    pub export fn HdMoonshineRender(self: *HdMoonshine, sensor: Camera.SensorHandle, lens: Camera.LensHandle) bool {
+    // an encoder for the calling thread alone to record uploads into until it releases it
+    fn acquireRecorder(self: *HdMoonshine) !*Encoder {
+        self.recorder_mutex.lock();
+        defer self.recorder_mutex.unlock();
+
+        const recorder = if (self.ready_recorders.items.len != 0) self.ready_recorders.pop() else blk: {
+            try self.recorders.ensureUnusedCapacity(self.allocator.allocator(), 1);
+            try self.ready_recorders.ensureTotalCapacity(self.allocator.allocator(), self.recorders.items.len + 1);
+            for (&self.frames) |*frame| try frame.recorders.ensureTotalCapacity(self.allocator.allocator(), self.recorders.items.len + 1);
+
+            const recorder = try self.allocator.allocator().create(Encoder);
+            errdefer self.allocator.allocator().destroy(recorder);
+            recorder.* = try Encoder.create(&self.vc, "recorder");
+            errdefer recorder.destroy(&self.vc);
+            try recorder.begin();
+
+            self.recorders.appendAssumeCapacity(recorder);
+            break :blk recorder;
+        };
+        return recorder;
+    }
+
+    // whatever was recorded will be submitted with the next render, ahead of `encoder`
+    fn releaseRecorder(self: *HdMoonshine, recorder: *Encoder) void {
+        self.recorder_mutex.lock();
+        defer self.recorder_mutex.unlock();
+        self.ready_recorders.appendAssumeCapacity(recorder);
+    }
+
+    // frame must have finished
+    fn recycleRecorders(self: *HdMoonshine, frame: *Frame) !void {
+        self.recorder_mutex.lock();
+        defer self.recorder_mutex.unlock();
+        while (frame.recorders.items.len != 0) {
+            const recorder = frame.recorders.pop();
+            try self.vc.device.resetCommandPool(recorder.pool, .{});
+            recorder.clearResources(&self.vc);
+            try recorder.begin();
+            self.ready_recorders.appendAssumeCapacity(recorder);
+        }
+    }
+
+    // marks the readback of a frame as the latest of its sensor
+    // frame must have finished
+    fn retireFrame(self: *HdMoonshine, frame: *Frame) void {
+        if (frame.readback) |readback| {
+            const sensor = &self.readbacks.items[readback.sensor];
+            sensor.pending[readback.index] = false;
+            sensor.latest = readback.index;
+            frame.readback = null;
+        }
+    }
+
+    // retires frames the device has finished without blocking
+    fn pollFrames(self: *HdMoonshine) !void {
+        if (try self.profiler.resolve(&self.vc)) {
+            if (self.profiler.latest.get("trace rays")) |stat| {
+                if (stat.work != 0) {
+                    const ray_time_ns = stat.duration_ns / @as(f64, @floatFromInt(stat.work));
+                    // smooth a little so that noisy timings do not make the sample count jump around
+                    self.camera_ray_time_ns = if (self.camera_ray_time_ns) |old| std.math.lerp(old, ray_time_ns, 0.25) else ray_time_ns;
+                }
+            }
+        }
+
+        // frames finish in submission order, and frame_index is the oldest one
+        for (0..frames_in_flight) |i| {
+            const frame = &self.frames[(self.frame_index + i) % frames_in_flight];
+            if (frame.readback == null) continue;
+            if (try self.vc.device.getFenceStatus(frame.fence) != .success) break;
+            self.retireFrame(frame);
+        }
+    }
+
+    // how many samples of this extent to trace to roughly take up the target frame time
+    fn adaptiveSampleCount(self: *const HdMoonshine, extent: vk.Extent2D, target_frame_time_ms: f32) u32 {
+        const ray_time_ns = self.camera_ray_time_ns orelse return 1;
+        const sample_time_ns = ray_time_ns * @as(f64, @floatFromInt(@as(u64, extent.width) * extent.height));
+        const samples = @as(f64, target_frame_time_ms) * std.time.ns_per_ms / @max(sample_time_ns, 1.0);
+        return @intFromFloat(std.math.clamp(@floor(samples), 1, max_adaptive_samples));
+    }
+
+    // submits `samples` samples for this sensor and returns without waiting for them to finish
+    // if `samples` is zero, picks the amount of samples that should take about `target_frame_time_ms` on the device
+    // results become visible through HdMoonshineMapSensor once the device is done
+    // pixels whose relative error is below `noise_threshold` stop being sampled, 0 to keep sampling all of them
+    pub export fn HdMoonshineRender(self: *HdMoonshine, sensor: Camera.SensorHandle, lens: Camera.LensHandle, samples: u32, target_frame_time_ms: f32, noise_threshold: f32) bool {
         self.mutex.lock();
         defer self.mutex.unlock();
-        self.encoder.begin() catch return false;
+
+        // wait for the oldest frame so we have somewhere to put this one
+        const frame = &self.frames[self.frame_index];
+        _ = self.vc.device.waitForFences(1, @ptrCast(&frame.fence), vk.TRUE, std.math.maxInt(u64)) catch return false;
+        self.pollFrames() catch return false;
+        frame.reset(&self.vc) catch return false;
+        self.recycleRecorders(frame) catch return false;
+        for (frame.destroyed_textures.items) |texture| {
+            self.world.materials.textures.destroyTexture(self.allocator.allocator(), &self.encoder, texture) catch return false;
+        }
+        frame.destroyed_textures.clearRetainingCapacity();
+
+        // only released recorders are submitted, ones other threads are still
+        // recording into, e.g., for open mesh uploads, go with a later render
+        // nothing can refer to what those upload yet, as it only gets a handle once they are released
+        self.recorder_mutex.lock();
+        defer self.recorder_mutex.unlock();
+
+        // uploads in recorders are submitted ahead of this, but only executed in order with it after this
+        if (self.ready_recorders.items.len != 0) self.encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+            .memory_barrier_count = 1,
+            .p_memory_barriers = &[1]vk.MemoryBarrier2 {
+                .{
+                    .src_stage_mask = .{ .copy_bit = true },
+                    .src_access_mask = .{ .transfer_write_bit = true },
+                    .dst_stage_mask = .{ .all_commands_bit = true },
+                    .dst_access_mask = .{ .memory_read_bit = true, .memory_write_bit = true },
+                }
+            },
+        });
 
         // update instance transforms
         {
             if (self.material_updates.count() != 0) {
+                const materials = &self.world.materials;
+                const allocator = self.allocator.allocator();
+
                 var iter = self.material_updates.iterator();
                 while (iter.next()) |update| {
-                    // since only standard pbr materials are supported
-                    // the material index and variant index should be identical
                     const index = update.key_ptr.*;
-
-                    // TODO: can merge some of these cmdUpdateBuffers sometimes
-                    if (update.value_ptr.normal) |normal| {
-                        const offset = index * @sizeOf(MaterialManager.GpuMaterial) + @offsetOf(MaterialManager.GpuMaterial, "normal");
-                        const bytes = std.mem.asBytes(&normal);
-                        self.encoder.buffer.updateBuffer(self.world.materials.materials.handle, offset, bytes.len, bytes.ptr);
-                    }
-                    if (update.value_ptr.emissive) |emissive| {
-                        const offset = index * @sizeOf(MaterialManager.GpuMaterial) + @offsetOf(MaterialManager.GpuMaterial, "emissive");
-                        const bytes = std.mem.asBytes(&emissive);
-                        self.encoder.buffer.updateBuffer(self.world.materials.materials.handle, offset, bytes.len, bytes.ptr);
-                    }
-                    if (update.value_ptr.color) |color| {
-                        const offset = index * @sizeOf(MaterialManager.StandardPBR) + @offsetOf(MaterialManager.StandardPBR, "color");
-                        const bytes = std.mem.asBytes(&color);
-                        self.encoder.buffer.updateBuffer(self.world.materials.variant_buffers.standard_pbr.buffer.handle, offset, bytes.len, bytes.ptr);
-                    }
-                    if (update.value_ptr.metalness) |metalness| {
-                        const offset = index * @sizeOf(MaterialManager.StandardPBR) + @offsetOf(MaterialManager.StandardPBR, "metalness");
-                        const bytes = std.mem.asBytes(&metalness);
-                        self.encoder.buffer.updateBuffer(self.world.materials.variant_buffers.standard_pbr.buffer.handle, offset, bytes.len, bytes.ptr);
-                    }
-                    if (update.value_ptr.roughness) |roughness| {
-                        const offset = index * @sizeOf(MaterialManager.StandardPBR) + @offsetOf(MaterialManager.StandardPBR, "roughness");
-                        const bytes = std.mem.asBytes(&roughness);
-                        self.encoder.buffer.updateBuffer(self.world.materials.variant_buffers.standard_pbr.buffer.handle, offset, bytes.len, bytes.ptr);
-                    }
-                    if (update.value_ptr.ior) |ior| {
-                        const offset = index * @sizeOf(MaterialManager.StandardPBR) + @offsetOf(MaterialManager.StandardPBR, "ior");
-                        const bytes = std.mem.asBytes(&ior);
-                        self.encoder.buffer.updateBuffer(self.world.materials.variant_buffers.standard_pbr.buffer.handle, offset, bytes.len, bytes.ptr);
-                    }
+                    // only standard pbr materials are created here, so this is where in that variant buffer this one lives
+                    const variant_index = materials.variantIndex(index);
+
+                    if (update.value_ptr.normal) |normal| materials.updateMaterialField(allocator, index, .normal, normal) catch return false;
+                    if (update.value_ptr.emissive) |emissive| materials.updateMaterialField(allocator, index, .emissive, emissive) catch return false;
+                    if (update.value_ptr.color) |color| materials.updateVariantField(allocator, MaterialManager.StandardPBR, variant_index, .color, color) catch return false;
+                    if (update.value_ptr.metalness) |metalness| materials.updateVariantField(allocator, MaterialManager.StandardPBR, variant_index, .metalness, metalness) catch return false;
+                    if (update.value_ptr.roughness) |roughness| materials.updateVariantField(allocator, MaterialManager.StandardPBR, variant_index, .roughness, roughness) catch return false;
+                    if (update.value_ptr.ior) |ior| materials.updateVariantField(allocator, MaterialManager.StandardPBR, variant_index, .ior, ior) catch return false;
+                    if (update.value_ptr.may_emit) |may_emit| materials.setMayEmit(index, may_emit);
+
+                    // light sampling data of geometries using this material depends on these
+                    if (update.value_ptr.emissive != null or update.value_ptr.may_emit != null) self.world.accel.markMaterialUpdated(allocator, index) catch return false;
                 }
-
-                // could be more granular with this and instance updates below
-                const update_barriers = [_]vk.BufferMemoryBarrier2 {
-                    .{
-                        .src_stage_mask = .{ .clear_bit = true }, // cmdUpdateBuffer seems to be clear for some reason
-                        .src_access_mask = .{ .transfer_write_bit = true },
-                        .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-                        .dst_access_mask = .{ .shader_storage_read_bit = true },
-                        .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                        .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                        .buffer = self.world.materials.materials.handle,
-                        .offset = 0,
-                        .size = vk.WHOLE_SIZE,
-                    },
-                    .{
-                        .src_stage_mask = .{ .clear_bit = true }, // cmdUpdateBuffer seems to be clear for some reason
-                        .src_access_mask = .{ .transfer_write_bit = true },
-                        .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-                        .dst_access_mask = .{ .shader_storage_read_bit = true },
-                        .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                        .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                        .buffer = self.world.materials.variant_buffers.standard_pbr.buffer.handle,
-                        .offset = 0,
-                        .size = vk.WHOLE_SIZE,
-                    },
-                };
-                self.encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-                    .buffer_memory_barrier_count = update_barriers.len,
-                    .p_buffer_memory_barriers = &update_barriers,
-                });
+                materials.recordUpdates(allocator, &self.encoder) catch return false;
 
                 self.material_updates.clearRetainingCapacity();
             }
 
-        //     if (self.need_instance_update) {
-        //         var actual_size_instances = self.world.accel.instances_host;
-        //         actual_size_instances.data.len = self.world.accel.instance_count;
-        //         var actual_size_world_to_instance = self.world.accel.world_to_instance_host;
-        //         actual_size_world_to_instance.data.len = self.world.accel.instance_count;
-        //         self.encoder.uploadBuffer(vk.AccelerationStructureInstanceKHR, self.world.accel.instances_device, actual_size_instances);
-        //         self.encoder.uploadBuffer(Mat3x4, self.world.accel.world_to_instance_device, actual_size_world_to_instance);
-
-        //         const update_barriers = [_]vk.BufferMemoryBarrier2 {
-        //             .{
-        //                 .src_stage_mask = .{ .copy_bit = true },
-        //                 .src_access_mask = .{ .transfer_write_bit = true },
-        //                 .dst_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
-        //                 .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true, .shader_storage_read_bit = true },
-        //                 .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-        //                 .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-        //                 .buffer = self.world.accel.instances_device.handle,
-        //                 .offset = 0,
-        //                 .size = vk.WHOLE_SIZE,
-        //             },
-        //             .{
-        //                 .src_stage_mask = .{ .copy_bit = true },
-        //                 .src_access_mask = .{ .transfer_write_bit = true },
-        //                 .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-        //                 .dst_access_mask = .{ .shader_storage_read_bit = true },
-        //                 .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-        //                 .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-        //                 .buffer = self.world.accel.world_to_instance_device.handle,
-        //                 .offset = 0,
-        //                 .size = vk.WHOLE_SIZE,
-        //             },
-        //         };
-        //         self.encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-        //             .buffer_memory_barrier_count = update_barriers.len,
-        //             .p_buffer_memory_barriers = &update_barriers,
-        //         });
-
-        //         const geometry = vk.AccelerationStructureGeometryKHR {
-        //             .geometry_type = .instances_khr,
-        //             .flags = .{ .opaque_bit_khr = true },
-        //             .geometry = .{
-        //                 .instances = .{
-        //                     .array_of_pointers = vk.FALSE,
-        //                     .data = .{
-        //                         .device_address = self.world.accel.instances_address,
-        //                     }
-        //                 }
-        //             },
-        //         };
-
-        //         const geometry_info = vk.AccelerationStructureBuildGeometryInfoKHR {
-        //             .type = .top_level_khr,
-        //             .flags = .{ .prefer_fast_trace_bit_khr = true, .allow_update_bit_khr = true },
-        //             .mode = .update_khr,
-        //             .src_acceleration_structure = self.world.accel.tlas_handle,
-        //             .dst_acceleration_structure = self.world.accel.tlas_handle,
-        //             .geometry_count = 1,
-        //             .p_geometries = @ptrCast(&geometry),
-        //             .scratch_data = .{
-        //                 .device_address = self.world.accel.tlas_update_scratch_address,
-        //             },
-        //         };
-
-        //         const build_info = vk.AccelerationStructureBuildRangeInfoKHR {
-        //             .primitive_count = self.world.accel.instance_count,
-        //             .first_vertex = 0,
-        //             .primitive_offset = 0,
-        //             .transform_offset = 0,
-        //         };
-
-        //         self.encoder.buildAccelerationStructures(&.{ geometry_info }, &.{ @ptrCast(&build_info) });
-
-        //         const ray_trace_barriers = [_]vk.MemoryBarrier2 {
-        //             .{
-        //                 .src_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
-        //                 .src_access_mask = .{ .acceleration_structure_write_bit_khr = true },
-        //                 .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-        //                 .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true },
-        //             }
-        //         };
-        //         self.encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-        //             .memory_barrier_count = ray_trace_barriers.len,
-        //             .p_memory_barriers = &ray_trace_barriers,
-        //         });
-        //     }
-
-            self.need_instance_update = false;
-        }
-
-        while (self.power_updates.items.len != 0) {
-            const update = self.power_updates.pop();
-            self.world.accel.recordUpdatePower(&self.encoder, self.world.meshes, self.world.materials, update.instance, 0, update.mesh);
+            self.world.accel.recordCommit(&self.vc, self.allocator.allocator(), &self.encoder, self.world.meshes, self.world.materials) catch return false;
         }
 
         // TODO: this memory barrier is a little more extreme than neccessary
@@ -346,83 +490,283 @@ pub const HdMoonshine = struct {
         self.pipeline.recordBindAdditionalDescriptorSets(self.encoder.buffer, .{ self.world.materials.textures.descriptor_set, self.world.constant_specta.descriptor_set });
         self.pipeline.recordPushDescriptors(self.encoder.buffer, (Scene { .background = self.background, .camera = self.camera, .world = self.world }).pushDescriptors(sensor, 0));
 
-        // push our stuff
-        self.pipeline.recordPushConstants(self.encoder.buffer, .{ .lens = self.camera.lenses.items[lens], .sample_count = self.camera.sensors.items[sensor].sample_count });
+        const readback = &self.readbacks.items[sensor];
+        const extent = self.camera.sensors.items[sensor].extent;
+        const sample_count = if (samples != 0) samples else self.adaptiveSampleCount(extent, target_frame_time_ms);
+
+        const trace_scope = self.encoder.beginScope("trace rays");
+        for (0..sample_count) |i| {
+            // push our stuff
+            self.pipeline.recordPushConstants(self.encoder.buffer, .{ .lens = self.camera.lenses.items[lens], .sample_count = self.camera.sensors.items[sensor].sample_count });
 
-        // trace our stuff
-        self.pipeline.recordTraceRays(self.encoder.buffer, self.camera.sensors.items[sensor].extent);
+            // trace our stuff
+            self.pipeline.recordTraceRays(self.encoder.buffer, self.camera.sensors.items[sensor].extent);
+
+            // if not last invocation, need barrier cuz we write to images
+            if (i + 1 != sample_count) self.camera.sensors.items[sensor].recordCaptureBarrier(self.encoder.buffer, .{ .ray_tracing_shader_bit_khr = true });
+
+            self.camera.sensors.items[sensor].sample_count += 1;
+        }
+        self.encoder.endScope(trace_scope, @as(u64, extent.width) * extent.height * sample_count); // camera rays
+
+        // once per frame is often enough, as frames are short
+        if (noise_threshold > 0 and self.camera.sensors.items[sensor].sample_count >= Convergence.default_min_sample_count) {
+            self.convergence.recordUpdate(self.encoder.buffer, &self.camera.sensors.items[sensor], self.camera.sensors.items[sensor].extent, .{ .ray_tracing_shader_bit_khr = true }, noise_threshold, Convergence.default_min_sample_count);
+        }
 
         // copy our stuff
         self.camera.sensors.items[sensor].recordPrepareForCopy(self.encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{ .copy_bit = true });
 
         // copy rendered image to host-visible staging buffer
-        self.encoder.copyImageToBuffer(self.camera.sensors.items[sensor].image.handle, .transfer_src_optimal, self.camera.sensors.items[sensor].extent, self.output_buffers.items[sensor].handle);
+        const readback_index = readback.acquire();
+        const readback_scope = self.encoder.beginScope("readback");
+        self.encoder.copyImageToBuffer(self.camera.sensors.items[sensor].image.handle, .transfer_src_optimal, extent, readback.buffers[readback_index].handle);
+        self.encoder.endScope(readback_scope, @as(u64, extent.width) * extent.height * @sizeOf([4]f32)); // bytes
+
+        frame.prepareForSubmit(&self.vc) catch return false;
+        self.encoder.submitAfter(self.vc.queue, self.ready_recorders.items, .{ .fence = frame.fence }) catch return false;
+        frame.recorders.appendSliceAssumeCapacity(self.ready_recorders.items);
+        self.ready_recorders.clearRetainingCapacity();
+        std.mem.swap(std.ArrayListUnmanaged(TextureManager.Handle), &frame.destroyed_textures, &self.destroyed_textures);
+        readback.pending[readback_index] = true;
+        frame.readback = PendingReadback {
+            .sensor = sensor,
+            .index = readback_index,
+        };
 
-        self.encoder.submitAndIdleUntilDone(&self.vc) catch return false;
+        // the finished encoder of this frame takes over recording scene edits
+        std.mem.swap(Encoder, &self.encoder, &frame.encoder);
+        self.frame_index = (self.frame_index + 1) % frames_in_flight;
+        self.encoder.begin() catch return false;
 
-        self.camera.sensors.items[sensor].sample_count += 1;
+        return true;
+    }
 
+    fn rebuildPipeline(self: *HdMoonshine) !void {
+        const old_pipeline = try self.pipeline.recreate(&self.vc, self.allocator.allocator(), &self.encoder, self.pipeline_settings);
+
+        // frames in flight may still be using it
+        self.encoder.attachResource(old_pipeline) catch {
+            try self.vc.device.deviceWaitIdle();
+            self.vc.device.destroyPipeline(old_pipeline, null);
+        };
+        self.camera.clearAllSensors();
+        self.vc.savePipelineCache(self.allocator.allocator());
+    }
+
+    // recompiles shaders, only ever taking long if they changed as the rest comes from the pipeline cache
+    pub export fn HdMoonshineRebuildPipeline(self: *HdMoonshine) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.rebuildPipeline() catch return false;
         return true;
     }
 
-    // pub export fn HdMoonshineRebuildPipeline(self: *HdMoonshine) bool {
-    //     self.mutex.lock();
-    //     defer self.mutex.unlock();
-    //     const old_pipeline = self.pipeline.recreate(&self.vc, self.allocator.allocator(), &self.encoder, pipeline_settings) catch return false;
-    //     self.vc.device.destroyPipeline(old_pipeline, null);
-    //     self.camera.clearAllSensors();
-    //     return true;
-    // }
-
-    // pub export fn HdMoonshineCreateMesh(self: *HdMoonshine, positions: [*]const F32x3, maybe_normals: ?[*]const F32x3, maybe_texcoords: ?[*]const F32x2, attribute_count: usize) MeshManager.Handle {
-    //     self.mutex.lock();
-    //     defer self.mutex.unlock();
-    //     const mesh = MeshManager.Mesh {
-    //         .name = "hydra",
-    //         .positions = positions[0..attribute_count],
-    //         .normals = if (maybe_normals) |normals| normals[0..attribute_count] else null,
-    //         .texcoords = if (maybe_texcoords) |texcoords| texcoords[0..attribute_count] else null,
-    //         .indices = null,
-    //     };
-    //     return self.world.meshes.upload(&self.vc, self.allocator.allocator(), &self.encoder, mesh) catch unreachable; // TODO: error handling
-    // }
-
-    // pub export fn HdMoonshineCreateSolidTexture1(self: *HdMoonshine, source: f32, name: [*:0]const u8) TextureManager.Handle {
-    //     self.mutex.lock();
-    //     defer self.mutex.unlock();
-    //     return self.world.materials.textures.upload(&self.vc, self.allocator.allocator(), &self.encoder, TextureManager.Source {
-    //         .f32x1 = source,
-    //     }, std.mem.span(name)) catch unreachable; // TODO: error handling
-    // }
-
-    // pub export fn HdMoonshineCreateSolidTexture2(self: *HdMoonshine, source: F32x2, name: [*:0]const u8) TextureManager.Handle {
-    //     self.mutex.lock();
-    //     defer self.mutex.unlock();
-    //     return self.world.materials.textures.upload(&self.vc, self.allocator.allocator(), &self.encoder, TextureManager.Source {
-    //         .f32x2 = source,
-    //     }, std.mem.span(name)) catch unreachable; // TODO: error handling
-    // }
-
-    // pub export fn HdMoonshineCreateSolidTexture3(self: *HdMoonshine, source: F32x3, name: [*:0]const u8) TextureManager.Handle {
-    //     self.mutex.lock();
-    //     defer self.mutex.unlock();
-    //     return self.world.materials.textures.upload(&self.vc, self.allocator.allocator(), &self.encoder, TextureManager.Source {
-    //         .f32x3 = source,
-    //     }, std.mem.span(name)) catch unreachable; // TODO: error handling
-    // }
-
-    // pub export fn HdMoonshineCreateRawTexture(self: *HdMoonshine, data: [*]u8, extent: vk.Extent2D, format: TextureFormat, name: [*:0]const u8) TextureManager.Handle {
-    //     self.mutex.lock();
-    //     defer self.mutex.unlock();
-    //     const bytes = std.mem.sliceAsBytes(data[0..extent.width * extent.height * format.pixelSizeInBytes()]);
-    //     return self.world.materials.textures.upload(&self.vc, self.allocator.allocator(), &self.encoder, TextureManager.Source {
-    //         .raw = TextureManager.Source.Raw {
-    //             .bytes = bytes,
-    //             .extent = extent,
-    //             .format = format.toVk(),
-    //         },
-    //     }, std.mem.span(name)) catch unreachable; // TODO: error handling
-    // }
+    // resample direct light from `candidates` candidates rather than taking independent samples, zero to not
+    // resampled primary hits may reuse reservoirs of the last sample of their pixel and of `spatial_reuse_neighbours` nearby pixels,
+    // which converges faster but to a biased image
+    // rebuilds the pipeline and clears all sensors, but only if anything changed
+    // returns false and keeps the old settings if that did not work
+    pub export fn HdMoonshineSetDirectLightResampling(self: *HdMoonshine, candidates: u32, temporal_reuse: bool, spatial_reuse_neighbours: u32) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        var settings = self.pipeline_settings;
+        settings.direct_light_candidates = candidates;
+        // reuse only exists for resampled hits
+        settings.temporal_reuse = if (candidates != 0 and temporal_reuse) vk.TRUE else vk.FALSE;
+        settings.spatial_reuse_neighbours = if (candidates != 0) spatial_reuse_neighbours else 0;
+        if (std.meta.eql(settings, self.pipeline_settings)) return true;
+
+        self.setPipelineSettings(settings) catch return false;
+        return true;
+    }
+
+    // everything that can fail comes before the settings are committed, and is undone if it does
+    fn setPipelineSettings(self: *HdMoonshine, settings: Pipeline.SpecConstants) !void {
+        // sensors get reservoirs before a pipeline that uses them, and only lose them once it is replaced
+        const adds_reservoirs = settings.reusesLight() and !self.pipeline_settings.reusesLight();
+        var added: usize = 0;
+        // nothing has captured with these yet, so they can go right away
+        errdefer for (self.camera.sensors.items[0..added]) |*sensor| {
+            sensor.light_reservoirs.destroy(&self.vc);
+            sensor.light_reservoirs = .{};
+        };
+        if (adds_reservoirs) for (self.camera.sensors.items) |*sensor| {
+            try sensor.setLightReservoirs(&self.vc, &self.encoder, true);
+            added += 1;
+        };
+
+        const old_settings = self.pipeline_settings;
+        self.pipeline_settings = settings;
+        errdefer self.pipeline_settings = old_settings;
+        try self.rebuildPipeline();
+
+        // keeping them if this fails only costs memory until the next change
+        if (!settings.reusesLight()) for (self.camera.sensors.items) |*sensor| sensor.setLightReservoirs(&self.vc, &self.encoder, false) catch {};
+    }
+
+    pub export fn HdMoonshineCreateMesh(self: *HdMoonshine, positions: [*]const F32x3, maybe_normals: ?[*]const F32x3, maybe_texcoords: ?[*]const F32x2, attribute_count: usize, out_mesh: *MeshManager.Handle) bool {
+        return HdMoonshineCreateIndexedMesh(self, positions, maybe_normals, maybe_texcoords, attribute_count, null, 0, out_mesh);
+    }
+
+    // attributes are per vertex and shared between triangles through indices
+    // everything is copied, so need not outlive this call
+    // returns false if the mesh could not be created
+    pub export fn HdMoonshineCreateIndexedMesh(self: *HdMoonshine, positions: [*]const F32x3, maybe_normals: ?[*]const F32x3, maybe_texcoords: ?[*]const F32x2, vertex_count: usize, maybe_indices: ?[*]const U32x3, triangle_count: usize, out_mesh: *MeshManager.Handle) bool {
+        var upload: MeshUpload = undefined;
+        if (!HdMoonshineBeginMeshUpload(self, vertex_count, maybe_normals != null, maybe_texcoords != null, if (maybe_indices != null) triangle_count else 0, &upload)) return false;
+        @memcpy(upload.positions[0..vertex_count], positions[0..vertex_count]);
+        if (maybe_normals) |normals| @memcpy(upload.normals.?[0..vertex_count], normals[0..vertex_count]);
+        if (maybe_texcoords) |texcoords| @memcpy(upload.texcoords.?[0..vertex_count], texcoords[0..vertex_count]);
+        if (maybe_indices) |indices| @memcpy(upload.indices.?[0..triangle_count], indices[0..triangle_count]);
+        return HdMoonshineEndMeshUpload(self, upload, out_mesh);
+    }
+
+    // hands out staging memory for a mesh that the caller fills in before HdMoonshineEndMeshUpload
+    // a zero triangle_count means the mesh is unindexed
+    // many threads may have uploads open at once, also while another renders
+    // returns false if there is no memory for it, in which case it must not be ended
+    pub export fn HdMoonshineBeginMeshUpload(self: *HdMoonshine, vertex_count: usize, with_normals: bool, with_texcoords: bool, triangle_count: usize, out_upload: *MeshUpload) bool {
+        const recorder = self.acquireRecorder() catch return false;
+        out_upload.* = allocateMeshUpload(recorder, vertex_count, with_normals, with_texcoords, triangle_count) catch {
+            // whatever staging memory was allocated is freed along with the rest of the recorder
+            self.releaseRecorder(recorder);
+            return false;
+        };
+        return true;
+    }
+
+    fn allocateMeshUpload(recorder: *Encoder, vertex_count: usize, with_normals: bool, with_texcoords: bool, triangle_count: usize) !MeshUpload {
+        const upload_allocator = recorder.uploadAllocator();
+        return MeshUpload {
+            .positions = (try upload_allocator.alloc(F32x3, vertex_count)).ptr,
+            .normals = if (with_normals) (try upload_allocator.alloc(F32x3, vertex_count)).ptr else null,
+            .texcoords = if (with_texcoords) (try upload_allocator.alloc(F32x2, vertex_count)).ptr else null,
+            .indices = if (triangle_count != 0) (try upload_allocator.alloc(U32x3, triangle_count)).ptr else null,
+            .vertex_count = vertex_count,
+            .triangle_count = triangle_count,
+            .recorder = recorder,
+            .compact = false,
+        };
+    }
+
+    // records the copy of staged mesh data to the device
+    // only takes the lock once the mesh is created, to give it a handle
+    // returns false if the mesh could not be created, the upload is ended either way
+    pub export fn HdMoonshineEndMeshUpload(self: *HdMoonshine, upload: MeshUpload, out_mesh: *MeshManager.Handle) bool {
+        const recorder = upload.recorder;
+        const normals: ?[]const F32x3 = if (upload.normals) |nonnull| nonnull[0..upload.vertex_count] else null;
+        const texcoords: ?[]const F32x2 = if (upload.texcoords) |nonnull| nonnull[0..upload.vertex_count] else null;
+        const compact = upload.compact and (normals != null or texcoords != null);
+        const attributes: ?MeshManager.CompactAttributes = if (compact) MeshManager.encodeAttributes(recorder, upload.vertex_count, normals, texcoords) catch {
+            self.releaseRecorder(recorder);
+            return false;
+        } else null;
+        const mesh = MeshManager.Mesh {
+            .name = "hydra",
+            .positions = recorder.upload_allocator.getBufferSlice(upload.positions[0..upload.vertex_count]),
+            .normals = if (compact) null else if (normals) |n| recorder.upload_allocator.getBufferSlice(n) else null,
+            .texcoords = if (compact) null else if (texcoords) |t| recorder.upload_allocator.getBufferSlice(t) else null,
+            .attributes = attributes,
+            .indices = if (upload.indices) |indices| recorder.upload_allocator.getBufferSlice(indices[0..upload.triangle_count]) else null,
+        };
+        const gpu_mesh = MeshManager.createMesh(&self.vc, self.allocator.allocator(), recorder, mesh) catch {
+            self.releaseRecorder(recorder);
+            return false;
+        };
+        self.releaseRecorder(recorder);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        out_mesh.* = self.world.meshes.insert(&self.vc, self.allocator.allocator(), &self.encoder, gpu_mesh) catch {
+            // the recorder may already hold copies into it, and is submitted ahead of `encoder`
+            MeshManager.attachGpuMesh(&self.encoder, gpu_mesh) catch {}; // leaks it if not even that works
+            return false;
+        };
+        return true;
+    }
+
+    // overwrites the positions of an existing mesh in place and refits its BLASes on the next render
+    // vertex count and layout must match what the mesh was created with
+    // light sampling data of this mesh is rebuilt too if any material it is used with may emit
+    pub export fn HdMoonshineUpdateMeshPositions(self: *HdMoonshine, mesh: MeshManager.Handle, positions: [*]const F32x3, vertex_count: usize) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        const host_positions = self.encoder.uploadAllocator().dupe(F32x3, positions[0..vertex_count]) catch unreachable; // TODO: error handling
+        self.world.meshes.recordUpdatePositions(&self.encoder, mesh, self.encoder.upload_allocator.getBufferSlice(host_positions));
+        self.world.accel.markMeshUpdated(self.allocator.allocator(), mesh) catch unreachable; // TODO: error handling
+        self.camera.clearAllSensors();
+    }
+
+    // instances of this mesh must have been destroyed already
+    pub export fn HdMoonshineDestroyMesh(self: *HdMoonshine, mesh: MeshManager.Handle) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.world.meshes.destroyMesh(self.allocator.allocator(), &self.encoder, mesh) catch unreachable; // TODO: error handling
+    }
+
+    // texture creation returns false if the texture could not be created, e.g., as there are too many
+    fn createSolidTexture(self: *HdMoonshine, comptime T: type, source: T, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        out_texture.* = self.uploadTexture(std.mem.asBytes(&source), vk_helpers.typeToFormat(T, false), vk.Extent2D { .width = 1, .height = 1 }, 1, std.mem.span(name)) catch return false;
+        return true;
+    }
+
+    pub export fn HdMoonshineCreateSolidTexture1(self: *HdMoonshine, source: f32, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        return self.createSolidTexture(f32, source, name, out_texture);
+    }
+
+    pub export fn HdMoonshineCreateSolidTexture2(self: *HdMoonshine, source: F32x2, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        return self.createSolidTexture(F32x2, source, name, out_texture);
+    }
+
+    pub export fn HdMoonshineCreateSolidTexture3(self: *HdMoonshine, source: F32x3, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        return self.createSolidTexture(F32x3, source, name, out_texture);
+    }
+
+    pub export fn HdMoonshineCreateRawTexture(self: *HdMoonshine, data: [*]const u8, extent: vk.Extent2D, format: TextureFormat, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        return HdMoonshineCreateRawTextureMips(self, data, extent, format, 1, name, out_texture);
+    }
+
+    // `data` holds `mip_level_count` levels tightly packed one after the other, starting with the largest
+    pub export fn HdMoonshineCreateRawTextureMips(self: *HdMoonshine, data: [*]const u8, extent: vk.Extent2D, format: TextureFormat, mip_level_count: u32, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        out_texture.* = self.uploadTexture(data[0..format.sizeInBytes(extent, mip_level_count)], format.toVk(), extent, mip_level_count, std.mem.span(name)) catch return false;
+        return true;
+    }
+
+    // block-compressed DDS with its mips as is, returning false if it could not be loaded
+    pub export fn HdMoonshineCreateDdsTexture(self: *HdMoonshine, filepath: [*:0]const u8, srgb: bool, name: [*:0]const u8, out_texture: *TextureManager.Handle) bool {
+        const bytes = std.fs.cwd().readFileAlloc(self.allocator.allocator(), std.mem.span(filepath), std.math.maxInt(usize)) catch return false;
+        defer self.allocator.allocator().free(bytes);
+        const texture = (engine.fileformats.dds.Texture.fromBytes(bytes) catch return false).withSrgb(srgb);
+        out_texture.* = self.uploadTexture(texture.data, texture.format, texture.extent, texture.mip_level_count, std.mem.span(name)) catch return false;
+        return true;
+    }
+
+    // materials using this texture must have been changed or destroyed already
+    // the handle is only reused once the render that applies those changes is finished
+    pub export fn HdMoonshineDestroyTexture(self: *HdMoonshine, texture: TextureManager.Handle) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.destroyed_textures.append(self.allocator.allocator(), texture) catch unreachable; // TODO: error handling
+    }
+
+    // only takes the lock once the texture is created, to give it a handle
+    fn uploadTexture(self: *HdMoonshine, bytes: []const u8, format: vk.Format, extent: vk.Extent2D, mip_level_count: u32, name: [:0]const u8) !TextureManager.Handle {
+        const image = blk: {
+            const recorder = try self.acquireRecorder();
+            defer self.releaseRecorder(recorder);
+            const staging = try recorder.uploadAllocator().alignedAlloc(u8, 16, bytes.len);
+            @memcpy(staging, bytes);
+            break :blk try TextureManager.createTexture(&self.vc, recorder, recorder.upload_allocator.getBufferSlice(staging), format, extent, mip_level_count, name);
+        };
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        // the copy into it is already recorded, so it must outlive that, and the recorder is submitted ahead of `encoder`
+        errdefer self.encoder.attachResource(image) catch {}; // leaks it if not even that works
+        return try self.world.materials.textures.insert(&self.vc, self.allocator.allocator(), &self.encoder, image);
+    }
 
     pub export fn HdMoonshineCreateMaterial(self: *HdMoonshine, material: Material) MaterialManager.Handle {
         self.mutex.lock();
@@ -433,9 +777,18 @@ pub const HdMoonshine = struct {
             .bsdf = MaterialManager.PolymorphicBSDF {
                 .standard_pbr = material.standard_pbr,
             },
+            .may_emit = material.may_emit,
         }, "hydra") catch unreachable; // TODO: error handling
     }
 
+    // instances using this material must have been destroyed already
+    pub export fn HdMoonshineDestroyMaterial(self: *HdMoonshine, material: MaterialManager.Handle) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        _ = self.material_updates.swapRemove(material);
+        self.world.materials.destroyMaterial(self.allocator.allocator(), material) catch unreachable; // TODO: error handling
+    }
+
     pub export fn HdMoonshineSetMaterialNormal(self: *HdMoonshine, material: MaterialManager.Handle, image: TextureManager.Handle) void {
         self.mutex.lock();
         defer self.mutex.unlock();
@@ -452,6 +805,16 @@ pub const HdMoonshine = struct {
         result.value_ptr.emissive = image;
     }
 
+    // whether the emissive of this material may be anything other than black,
+    // geometries using it are only considered for light sampling if so
+    pub export fn HdMoonshineSetMaterialMayEmit(self: *HdMoonshine, material: MaterialManager.Handle, may_emit: bool) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        const result = self.material_updates.getOrPut(self.allocator.allocator(), material) catch unreachable; // TODO: error handling
+        if (!result.found_existing) result.value_ptr.* = .{};
+        result.value_ptr.may_emit = may_emit;
+    }
+
     pub export fn HdMoonshineSetMaterialColor(self: *HdMoonshine, material: MaterialManager.Handle, image: TextureManager.Handle) void {
         self.mutex.lock();
         defer self.mutex.unlock();
@@ -484,67 +847,137 @@ pub const HdMoonshine = struct {
         result.value_ptr.ior = ior;
     }
 
-    pub export fn HdMoonshineCreateInstance(self: *HdMoonshine, transform: Mat3x4, mesh: MeshManager.Handle, material: MaterialManager.Handle, visible: bool) Accel.Handle {
+    pub export fn HdMoonshineCreateInstance(self: *HdMoonshine, transform: Mat3x4, mesh: MeshManager.Handle, material: MaterialManager.Handle, visible: bool, fast_build: bool, out_handle: *Accel.Handle) bool {
+        return HdMoonshineCreateInstances(self, @ptrCast(&transform), 1, mesh, material, visible, fast_build, @ptrCast(out_handle));
+    }
+
+    // creates count instances of the same mesh and material, writing their handles to `handles`
+    // handles of destroyed instances are reused, so they need not be contiguous
+    //
+    // nothing is built until the next render, so this is cheap to call many times
+    // `fast_build` trades trace performance for cheaper refits, for meshes that deform often
+    // returns false if they could not be created, e.g., as the scene would hold too many geometries
+    pub export fn HdMoonshineCreateInstances(self: *HdMoonshine, transforms: [*]const Mat3x4, count: usize, mesh: MeshManager.Handle, material: MaterialManager.Handle, visible: bool, fast_build: bool, handles: [*]Accel.Handle) bool {
         self.mutex.lock();
         defer self.mutex.unlock();
-        const instance = Accel.Instance {
-            .transform = transform,
-            .visible = visible,
-            .geometries = &[1]Accel.Geometry {
-                .{
-                    .mesh = mesh,
-                    .material = material,
-                }
-            },
+        const geometries = [1]Accel.Geometry {
+            .{
+                .mesh = mesh,
+                .material = material,
+            }
         };
+        self.world.accel.queueInstances(self.allocator.allocator(), &geometries, transforms[0..count], visible, if (fast_build) .fast_build else .fast_trace, handles[0..count]) catch return false;
         self.camera.clearAllSensors();
-        self.power_updates.append(self.allocator.allocator(), PowerUpdate {
-            .instance = self.world.accel.instance_count,
-            .mesh = mesh,
-        }) catch unreachable;
-        self.instance_to_mesh.append(self.allocator.allocator(), mesh) catch unreachable;
-        return self.world.accel.uploadInstance(&self.vc, self.allocator.allocator(), &self.encoder, self.world.meshes, self.world.materials, instance) catch unreachable; // TODO: error handling
+        return true;
     }
 
+    // the handle may be handed out again by later instance creation
     pub export fn HdMoonshineDestroyInstance(self: *HdMoonshine, handle: Accel.Handle) void {
-        HdMoonshineSetInstanceVisibility(self, handle, false); // sike. TODO: proper destruction
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.world.accel.destroyInstance(self.allocator.allocator(), &self.encoder, handle) catch unreachable; // TODO: error handling
+        self.camera.clearAllSensors();
     }
 
     pub export fn HdMoonshineSetInstanceVisibility(self: *HdMoonshine, handle: Accel.Handle, visible: bool) void {
         self.mutex.lock();
         defer self.mutex.unlock();
-        self.world.accel.instances_host.slice[handle].instance_custom_index_and_mask.mask = if (visible) 0xFF else 0x00;
-        self.need_instance_update = true;
+        self.world.accel.setVisibility(handle, visible);
         self.camera.clearAllSensors();
     }
 
     pub export fn HdMoonshineSetInstanceTransform(self: *HdMoonshine, handle: Accel.Handle, new_transform: Mat3x4) void {
         self.mutex.lock();
         defer self.mutex.unlock();
-        const old_transform: Mat3x4 = @bitCast(self.world.accel.instances_host.slice[handle].transform);
-        if (!std.math.approxEqRel(f32, @abs(old_transform.truncate().determinant()), @abs(new_transform.truncate().determinant()), 0.001)) {
-            // should tell us if this matrix was scaled
-            // though may run into precision issues and rotation might seem like a scale
-            // TODO: this could theoretically slip away if an object is veeeerrry slowly scaled
-            self.power_updates.append(self.allocator.allocator(), PowerUpdate {
-                .instance = handle,
-                .mesh = self.instance_to_mesh.items[handle],
-            }) catch unreachable;
-        }
-        self.world.accel.instances_host.slice[handle].transform = @bitCast(new_transform);
-        self.need_instance_update = true;
+        self.setInstanceTransform(handle, new_transform);
+        self.camera.clearAllSensors();
+    }
+
+    // same as setting each transform on its own, but only takes the lock once
+    pub export fn HdMoonshineSetInstanceTransforms(self: *HdMoonshine, handles: [*]const Accel.Handle, new_transforms: [*]const Mat3x4, count: usize) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        for (handles[0..count], new_transforms[0..count]) |handle, new_transform| self.setInstanceTransform(handle, new_transform);
         self.camera.clearAllSensors();
     }
 
-    pub export fn HdMoonshineCreateSensor(self: *HdMoonshine, extent: vk.Extent2D) Camera.SensorHandle {
+    // light sampling data follows along on the next commit, if this instance emits
+    fn setInstanceTransform(self: *HdMoonshine, handle: Accel.Handle, new_transform: Mat3x4) void {
+        self.world.accel.setTransform(handle, new_transform);
+    }
+
+    // returns false if the sensor could not be created
+    pub export fn HdMoonshineCreateSensor(self: *HdMoonshine, extent: vk.Extent2D, out_sensor: *Camera.SensorHandle) bool {
         self.mutex.lock();
         defer self.mutex.unlock();
-        self.output_buffers.append(self.allocator.allocator(), core.mem.DownloadBuffer([4]f32).create(&self.vc, extent.width * extent.height, "output") catch unreachable) catch unreachable;
-        return self.camera.appendSensor(&self.vc, self.allocator.allocator(), extent) catch unreachable; // TODO: error handling
+        out_sensor.* = self.createSensor(extent) catch return false;
+        return true;
     }
 
-    pub export fn HdMoonshineGetSensorData(self: *const HdMoonshine, sensor: Camera.SensorHandle) [*][4]f32 {
-        return self.output_buffers.items[sensor].slice.ptr;
+    // every sensor has a readback at the same index
+    fn createSensor(self: *HdMoonshine, extent: vk.Extent2D) !Camera.SensorHandle {
+        var readback = try SensorReadback.create(&self.vc, extent);
+        errdefer readback.destroy(&self.vc);
+        try self.readbacks.ensureUnusedCapacity(self.allocator.allocator(), 1);
+
+        const sensor = try self.camera.appendSensor(&self.vc, self.allocator.allocator(), extent);
+        // nothing has captured into it yet, so it can go right away
+        errdefer {
+            var removed = self.camera.sensors.pop();
+            removed.destroy(&self.vc);
+        }
+        try self.camera.sensors.items[sensor].setLightReservoirs(&self.vc, &self.encoder, self.pipeline_settings.reusesLight());
+
+        self.readbacks.appendAssumeCapacity(readback);
+        return sensor;
+    }
+
+    // makes the results of finished renders available to the host without blocking
+    // returns false if the device could not be queried, e.g., as it was lost
+    pub export fn HdMoonshinePollFrames(self: *HdMoonshine) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.pollFrames() catch return false;
+        return true;
+    }
+
+    // copies the device timings of the latest finished frame into `stats`, up to `capacity` of them
+    // returns how many there are, which may be more than were copied, or 0 if the device could not be queried
+    pub export fn HdMoonshineGetStats(self: *HdMoonshine, stats: [*]ProfilerStat, capacity: usize) usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.pollFrames() catch return 0;
+        const latest = self.profiler.latest.slice();
+        const count = @min(latest.len, capacity);
+        for (latest[0..count], stats[0..count]) |stat, *out| {
+            out.* = ProfilerStat {
+                .name = stat.name.ptr,
+                .duration_ms = stat.duration_ns / std.time.ns_per_ms,
+                .work = stat.work,
+                .throughput = stat.throughput(),
+            };
+        }
+        return latest.len;
+    }
+
+    // returns the latest finished frame of this sensor, or null if the device could not be queried
+    // it is not written to by the device until HdMoonshineUnmapSensor is called
+    pub export fn HdMoonshineMapSensor(self: *HdMoonshine, sensor: Camera.SensorHandle) ?[*][4]f32 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.pollFrames() catch return null;
+        const readback = &self.readbacks.items[sensor];
+        // keep handing out the same readback while it is mapped,
+        // and if nothing finished yet, hand out a black one
+        const index = readback.mapped orelse readback.latest orelse readback.acquire();
+        readback.mapped = index;
+        return readback.buffers[index].slice.ptr;
+    }
+
+    pub export fn HdMoonshineUnmapSensor(self: *HdMoonshine, sensor: Camera.SensorHandle) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.readbacks.items[sensor].mapped = null;
     }
 
     pub export fn HdMoonshineCreateLens(self: *HdMoonshine, info: Camera.Lens) Camera.LensHandle {
@@ -564,18 +997,29 @@ pub const HdMoonshine = struct {
     }
 
     pub export fn HdMoonshineDestroy(self: *HdMoonshine) void {
-        self.power_updates.deinit(self.allocator.allocator());
+        self.vc.device.deviceWaitIdle() catch {};
         self.material_updates.deinit(self.allocator.allocator());
-        self.instance_to_mesh.deinit(self.allocator.allocator());
-        for (self.output_buffers.items) |output_buffer| {
-            output_buffer.destroy(&self.vc);
+        self.destroyed_textures.deinit(self.allocator.allocator());
+        for (self.readbacks.items) |*readback| {
+            readback.destroy(&self.vc);
         }
-        self.output_buffers.deinit(self.allocator.allocator());
+        self.readbacks.deinit(self.allocator.allocator());
+        self.convergence.destroy(&self.vc);
         self.pipeline.destroy(&self.vc);
         self.world.destroy(&self.vc, self.allocator.allocator());
         self.background.destroy(&self.vc, self.allocator.allocator());
         self.camera.destroy(&self.vc, self.allocator.allocator());
+        for (&self.frames) |*frame| {
+            frame.destroy(&self.vc, self.allocator.allocator());
+        }
+        for (self.recorders.items) |recorder| {
+            recorder.destroy(&self.vc);
+            self.allocator.allocator().destroy(recorder);
+        }
+        self.recorders.deinit(self.allocator.allocator());
+        self.ready_recorders.deinit(self.allocator.allocator());
         self.encoder.destroy(&self.vc);
+        self.profiler.destroy(&self.vc);
         self.vc.destroy(self.allocator.allocator());
         var alloc = self.allocator;
         alloc.allocator().destroy(self);
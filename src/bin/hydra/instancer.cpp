@@ -8,6 +8,7 @@
 #include "pxr/base/gf/matrix4d.h"
 #include "pxr/base/gf/rotation.h"
 #include "pxr/base/gf/quaternion.h"
+#include "pxr/base/work/loops.h"
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -15,6 +16,13 @@ HdMoonshineInstancer::HdMoonshineInstancer(HdSceneDelegate* delegate, SdfPath co
 
 HdMoonshineInstancer::~HdMoonshineInstancer() {}
 
+template<typename T>
+static void CastPrimvar(VtValue const& value, T& dst) {
+    if (value.CanCast<T>()) {
+        dst = value.Cast<T>().template UncheckedGet<T>();
+    }
+}
+
 void HdMoonshineInstancer::Sync(HdSceneDelegate* delegate, HdRenderParam* renderParam, HdDirtyBits* dirtyBits) {
     _UpdateInstancer(delegate, dirtyBits);
 
@@ -25,86 +33,97 @@ void HdMoonshineInstancer::Sync(HdSceneDelegate* delegate, HdRenderParam* render
         for (HdPrimvarDescriptor const& pv: primvars) {
             if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, pv.name)) {
                 VtValue value = delegate->Get(id, pv.name);
-                if (!value.IsEmpty()) {
-                    primvarMap_[pv.name] = value;
+                if (value.IsEmpty()) continue;
+
+                if (pv.name == HdInstancerTokens->instanceTranslations) {
+                    CastPrimvar(value, translations_);
+                } else if (pv.name == HdInstancerTokens->instanceRotations) {
+                    CastPrimvar(value, rotations_);
+                } else if (pv.name == HdInstancerTokens->instanceScales) {
+                    CastPrimvar(value, scales_);
+                } else if (pv.name == HdInstancerTokens->instanceTransforms) {
+                    CastPrimvar(value, transforms_);
                 }
             }
         }
     }
+
+    // we are only synced when something is dirty, and dirty parents dirty us too,
+    // so whatever the cached transforms were composed from may have changed
+    std::lock_guard<std::mutex> lock(transformCacheMutex_);
+    transformCache_.clear();
 }
 
- VtMatrix4dArray HdMoonshineInstancer::ComputeInstanceTransforms(SdfPath const &prototypeId) {
-    GfMatrix4d instancerTransform = GetDelegate()->GetInstancerTransform(GetId());
-    VtIntArray instanceIndices = GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
+VtMatrix4dArray HdMoonshineInstancer::ComputeLocalInstanceTransforms(SdfPath const &prototypeId) const {
+    const GfMatrix4d instancerTransform = GetDelegate()->GetInstancerTransform(GetId());
+    const VtIntArray instanceIndices = GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
 
     VtMatrix4dArray instanceTransforms(instanceIndices.size());
+    GfMatrix4d* dst = instanceTransforms.data();
 
-    VtValue translationsValue = primvarMap_[HdInstancerTokens->instanceTranslations];
-    VtValue rotationsValue = primvarMap_[HdInstancerTokens->instanceRotations];
-    VtValue scalesValue = primvarMap_[HdInstancerTokens->instanceScales];
-    VtValue transformsValue = primvarMap_[HdInstancerTokens->instanceTransforms];
-
-    VtVec3dArray translations;
-    if (translationsValue.CanCast<VtVec3dArray>()) {
-        translations = translationsValue.Cast<VtVec3dArray>().UncheckedGet<VtVec3dArray>();
-    }
-
-    VtQuatdArray rotations;
-    if (rotationsValue.CanCast<VtQuatdArray>()) {
-        rotations = rotationsValue.Cast<VtQuatdArray>().UncheckedGet<VtQuatdArray>();
-    }
-
-    VtVec3dArray scales;
-    if (scalesValue.CanCast<VtVec3dArray>()) {
-        scales = scalesValue.Cast<VtVec3dArray>().UncheckedGet<VtVec3dArray>();
-    }
-
-    VtMatrix4dArray transforms;
-    if (transformsValue.CanCast<VtMatrix4dArray>()) {
-        transforms = transformsValue.Cast<VtMatrix4dArray>().UncheckedGet<VtMatrix4dArray>();
-    }
+    WorkParallelForN(instanceIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const size_t instanceIndex = instanceIndices[i];
 
-    for (size_t i = 0; i < instanceIndices.size(); i++) {
-        int instanceIndex = instanceIndices[i];
+            GfMatrix4d out = instancerTransform;
 
-        GfMatrix4d out = instancerTransform;
+            GfMatrix4d temp;
+            if (instanceIndex < translations_.size()) {
+                temp.SetTranslate(translations_[instanceIndex]);
+                out = temp * out;
+            }
+            if (instanceIndex < rotations_.size()) {
+                temp.SetRotate(rotations_[instanceIndex]);
+                out = temp * out;
+            }
+            if (instanceIndex < scales_.size()) {
+                temp.SetScale(scales_[instanceIndex]);
+                out = temp * out;
+            }
+            if (instanceIndex < transforms_.size()) {
+                temp = transforms_[instanceIndex];
+                out = temp * out;
+            }
 
-        GfMatrix4d temp;
-        if (i < translations.size()) {
-            temp.SetTranslate(translations[instanceIndex]);
-            out = temp * out;
-        }
-        if (i < rotations.size()) {
-            temp.SetRotate(rotations[instanceIndex]);
-            out = temp * out;
-        }
-        if (i < scales.size()) {
-            temp.SetScale(scales[instanceIndex]);
-            out = temp * out;
-        }
-        if (i < transforms.size()) {
-            temp = transforms[instanceIndex];
-            out = temp * out;
+            dst[i] = out;
         }
+    });
 
-        instanceTransforms[i] = out;
-    }
+    return instanceTransforms;
+}
 
-    if (GetParentId().IsEmpty()) {
-        return instanceTransforms;
+VtMatrix4dArray HdMoonshineInstancer::ComputeInstanceTransforms(SdfPath const &prototypeId) {
+    {
+        std::lock_guard<std::mutex> lock(transformCacheMutex_);
+        const auto cached = transformCache_.find(prototypeId);
+        if (cached != transformCache_.end()) return cached->second;
     }
 
-    HdInstancer *parentInstancer = GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
-    VtMatrix4dArray parentTransforms = static_cast<HdMoonshineInstancer*>(parentInstancer)->ComputeInstanceTransforms(GetId());
-
-    VtMatrix4dArray final(parentTransforms.size() * instanceTransforms.size());
-    for (size_t i = 0; i < parentTransforms.size(); ++i) {
-        for (size_t j = 0; j < instanceTransforms.size(); ++j) {
-            final[i * instanceTransforms.size() + j] = instanceTransforms[j] * parentTransforms[i];
-        }
+    // computed outside the lock so that prototypes do not wait on each other,
+    // at worst one is computed twice
+    VtMatrix4dArray instanceTransforms = ComputeLocalInstanceTransforms(prototypeId);
+
+    if (!GetParentId().IsEmpty()) {
+        // parents cache these too, so siblings share them
+        HdInstancer *parentInstancer = GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
+        const VtMatrix4dArray parentTransforms = static_cast<HdMoonshineInstancer*>(parentInstancer)->ComputeInstanceTransforms(GetId());
+
+        const size_t localCount = instanceTransforms.size();
+        VtMatrix4dArray final(parentTransforms.size() * localCount);
+        GfMatrix4d* dst = final.data();
+        const GfMatrix4d* local = instanceTransforms.cdata();
+        const GfMatrix4d* parent = parentTransforms.cdata();
+        WorkParallelForN(final.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                dst[i] = local[i % localCount] * parent[i / localCount];
+            }
+        });
+        instanceTransforms = final;
     }
 
-    return final;
+    std::lock_guard<std::mutex> lock(transformCacheMutex_);
+    transformCache_[prototypeId] = instanceTransforms;
+    return instanceTransforms;
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -4,6 +4,10 @@
 
 #include "pxr/pxr.h"
 #include "pxr/imaging/hd/instancer.h"
+#include "pxr/base/vt/types.h"
+#include "pxr/base/tf/hashmap.h"
+
+#include <mutex>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -13,9 +17,21 @@ public:
     ~HdMoonshineInstancer();
 
     void Sync(HdSceneDelegate *sceneDelegate, HdRenderParam *renderParam, HdDirtyBits *dirtyBits) override;
+
+    // composed with those of parent instancers, cached per prototype until the next sync
+    // safe to call from many prims syncing at once
     VtMatrix4dArray ComputeInstanceTransforms(const SdfPath& prototypeId);
 private:
-    TfHashMap<TfToken, VtValue, TfToken::HashFunctor> primvarMap_;
+    VtMatrix4dArray ComputeLocalInstanceTransforms(const SdfPath& prototypeId) const;
+
+    // primvars, cast once when they are dirtied rather than on every compute
+    VtVec3dArray translations_;
+    VtQuatdArray rotations_;
+    VtVec3dArray scales_;
+    VtMatrix4dArray transforms_;
+
+    std::mutex transformCacheMutex_;
+    TfHashMap<SdfPath, VtMatrix4dArray, SdfPath::Hash> transformCache_;
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
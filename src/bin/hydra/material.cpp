@@ -5,6 +5,7 @@
 #include <pxr/usd/sdr/shaderProperty.h>
 #include <pxr/usd/sdr/registry.h>
 
+#include <pxr/base/tf/stringUtils.h>
 #include <pxr/imaging/hio/image.h>
 
 #include "material.hpp"
@@ -36,11 +37,21 @@ HdMoonshineMaterial::HdMoonshineMaterial(const SdfPath& id, const HdMoonshineRen
         .metalness = renderParam._black1,
         .roughness = renderParam._white1,
         .ior = 1.5,
+        .may_emit = false,
     });
 }
 
 HdMoonshineMaterial::~HdMoonshineMaterial() {}
 
+void HdMoonshineMaterial::Finalize(HdRenderParam* hdRenderParam) {
+    HdMoonshineRenderParam* renderParam = static_cast<HdMoonshineRenderParam*>(hdRenderParam);
+    HdMoonshineDestroyMaterial(renderParam->_moonshine, _handle);
+    for (auto const& [name, texture] : _textures) {
+        renderParam->_textureCache.Release(texture);
+    }
+    _textures.clear();
+}
+
 HdDirtyBits HdMoonshineMaterial::GetInitialDirtyBitsMask() const {
     return DirtyBits::DirtyParams;
 }
@@ -75,7 +86,19 @@ void rgbToRgba(std::unique_ptr<uint8_t[]>& data, size_t pixel_count, size_t src_
 
 std::optional<ImageHandle> makeTexture(HdMoonshine* msne, VtValue value, std::string const& swizzle, TfToken colorSpace, TfToken dst, std::string const& debug_name) {
     if (value.IsHolding<SdfAssetPath>()) {
-        auto image = HioImage::OpenForReading(value.Get<SdfAssetPath>().GetResolvedPath());
+        std::string const path = value.Get<SdfAssetPath>().GetResolvedPath();
+
+        // block-compressed files go straight to the GPU, mips and all, but cannot be swizzled
+        if (swizzle.empty() || swizzle == "rgb") {
+            if (TfStringEndsWith(TfStringToLower(path), ".dds")) {
+                ImageHandle handle;
+                if (HdMoonshineCreateDdsTexture(msne, path.c_str(), colorSpace == _tokens->sRGB, (debug_name + " dds texture").c_str(), &handle)) {
+                    return handle;
+                }
+            }
+        }
+
+        auto image = HioImage::OpenForReading(path);
         auto format = image->GetFormat();
 
         HioImage::StorageSpec spec;
@@ -127,25 +150,43 @@ std::optional<ImageHandle> makeTexture(HdMoonshine* msne, VtValue value, std::st
             .width = static_cast<uint32_t>(spec.width),
             .height = static_cast<uint32_t>(spec.height),
         };
-        return HdMoonshineCreateRawTexture(msne, data.get(), extent, msne_format.value(), (debug_name + " texture").c_str());
+        ImageHandle handle;
+        if (!HdMoonshineCreateRawTexture(msne, data.get(), extent, msne_format.value(), (debug_name + " texture").c_str(), &handle)) {
+            TF_RUNTIME_ERROR("could not create %ux%u texture %s", extent.width, extent.height, debug_name.c_str());
+            return std::nullopt;
+        }
+        return handle;
     } else if (value.IsHolding<GfVec3f>()) {
         GfVec3f vec = value.Get<GfVec3f>();
+        ImageHandle handle;
+        bool created;
         if (dst == _tokens->normal) {
             vec = (vec + GfVec3f(1)) / 2; // convert to [0-1]
-            return HdMoonshineCreateSolidTexture2(msne, F32x2 { .x = vec[0], .y = vec[1] }, (debug_name + " f32x2").c_str());
+            created = HdMoonshineCreateSolidTexture2(msne, F32x2 { .x = vec[0], .y = vec[1] }, (debug_name + " f32x2").c_str(), &handle);
         } else {
-            return HdMoonshineCreateSolidTexture3(msne, F32x3 { .x = vec[0], .y = vec[1], .z = vec[2] }, (debug_name + " f32x3").c_str());
+            created = HdMoonshineCreateSolidTexture3(msne, F32x3 { .x = vec[0], .y = vec[1], .z = vec[2] }, (debug_name + " f32x3").c_str(), &handle);
+        }
+        if (!created) {
+            TF_RUNTIME_ERROR("could not create texture %s", debug_name.c_str());
+            return std::nullopt;
         }
+        return handle;
     } else if (value.IsHolding<float>()) {
         float val = value.Get<float>();
-        return HdMoonshineCreateSolidTexture1(msne, val, (debug_name + " float").c_str());
+        ImageHandle handle;
+        if (!HdMoonshineCreateSolidTexture1(msne, val, (debug_name + " float").c_str(), &handle)) {
+            TF_RUNTIME_ERROR("could not create texture %s", debug_name.c_str());
+            return std::nullopt;
+        }
+        return handle;
     } else {
         TF_CODING_ERROR("unknown value type %s", value.GetTypeName().c_str());
         return std::nullopt;
     }
 }
 
-bool SetTextureBasedOnValueAndName(HdMoonshine* msne, MaterialHandle handle, TfToken name, VtValue value, std::string const& swizzle, TfToken colorSpace, std::string const& debug_name) {
+bool SetTextureBasedOnValueAndName(HdMoonshineRenderParam* renderParam, MaterialHandle handle, HdMoonshineMaterial::TextureMap& textures, TfToken name, VtValue value, std::string const& swizzle, TfToken colorSpace, std::string const& debug_name) {
+    HdMoonshine* msne = renderParam->_moonshine;
     if (name == _tokens->ior) {
         float ior = value.Get<float>();
         HdMoonshineSetMaterialIOR(msne, handle, ior);
@@ -156,7 +197,15 @@ bool SetTextureBasedOnValueAndName(HdMoonshine* msne, MaterialHandle handle, TfT
             return true;
         }
 
-        std::optional<ImageHandle> maybe_texture = makeTexture(msne, value, swizzle, colorSpace, name, debug_name + " " + name.GetString());
+        HdMoonshineTextureCache::Key key = {
+            .source = value.IsHolding<SdfAssetPath>() ? value.UncheckedGet<SdfAssetPath>().GetResolvedPath() : TfStringify(value),
+            .swizzle = swizzle,
+            .colorSpace = colorSpace,
+            .dst = name,
+        };
+        std::optional<ImageHandle> maybe_texture = renderParam->_textureCache.Acquire(key, [&]() {
+            return makeTexture(msne, value, swizzle, colorSpace, name, debug_name + " " + name.GetString());
+        });
         if (!maybe_texture) {
             TF_CODING_ERROR("could not parse texture %s", (debug_name + " " + name.GetString()).c_str());
             return false;
@@ -175,6 +224,16 @@ bool SetTextureBasedOnValueAndName(HdMoonshine* msne, MaterialHandle handle, TfT
             HdMoonshineSetMaterialMetalness(msne, handle, texture);
         }
 
+        // the material only stops referring to the old texture on the next render,
+        // which is why its handle is not reused until that render is finished
+        auto it = textures.find(name);
+        if (it != textures.end()) {
+            renderParam->_textureCache.Release(it->second);
+            it->second = texture;
+        } else {
+            textures.emplace(name, texture);
+        }
+
         return true;
     }
 }
@@ -183,7 +242,6 @@ void HdMoonshineMaterial::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hd
     SdfPath const& id = GetId();
 
     HdMoonshineRenderParam* renderParam = static_cast<HdMoonshineRenderParam*>(hdRenderParam);
-    HdMoonshine* msne = renderParam->_moonshine;
 
     if (*dirtyBits & DirtyBits::DirtyParams) {
         const VtValue& resource = sceneDelegate->GetMaterialResource(id);
@@ -216,9 +274,15 @@ void HdMoonshineMaterial::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hd
 
         SdrRegistry& shaderReg = SdrRegistry::GetInstance();
         SdrShaderNodeConstPtr const sdrNode = shaderReg.GetShaderNodeByIdentifier(node.nodeTypeId);
+        _emissive = false;
         for (TfToken const& inputName : sdrNode->GetInputNames()) {
             auto const& conIt = node.inputConnections.find(inputName);
             auto const& paramIt = node.parameters.find(inputName);
+            if (inputName == _tokens->emissiveColor) {
+                // textures are assumed to emit
+                _emissive = conIt != node.inputConnections.end()
+                    || (paramIt != node.parameters.end() && !(paramIt->second.IsHolding<GfVec3f>() && paramIt->second.UncheckedGet<GfVec3f>() == GfVec3f(0.0f)));
+            }
             if (conIt != node.inputConnections.end()) {
                 HdMaterialConnection2 const& con = conIt->second.front();
 
@@ -232,20 +296,22 @@ void HdMoonshineMaterial::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hd
                     TfToken colorSpace = upstreamNode.parameters.find(_tokens->sourceColorSpace)->second.Get<TfToken>();
                     TfToken fileProperty = upstreamSdr->GetAssetIdentifierInputNames()[0];
                     VtValue value = upstreamNode.parameters.find(fileProperty)->second;
-                    SetTextureBasedOnValueAndName(msne, _handle, inputName, value, swizzle, colorSpace, id.GetString());
+                    SetTextureBasedOnValueAndName(renderParam, _handle, _textures, inputName, value, swizzle, colorSpace, id.GetString());
                 } else {
                     TF_CODING_ERROR("%s unknown connection %s: %s", id.GetText(), inputName.GetText(), upstreamSdr->GetRole().c_str());
                 }
             } else if (paramIt != node.parameters.end()) {
                 VtValue value = paramIt->second;
-                SetTextureBasedOnValueAndName(msne, _handle, inputName, value, "", _tokens->raw, id.GetString() + " parameter");
+                SetTextureBasedOnValueAndName(renderParam, _handle, _textures, inputName, value, "", _tokens->raw, id.GetString() + " parameter");
             } else {
                 SdrShaderPropertyConstPtr const& input = sdrNode->GetShaderInput(inputName);
                 VtValue value = input->GetDefaultValue();
-                SetTextureBasedOnValueAndName(msne, _handle, inputName, value, "", _tokens->raw, id.GetString() + " default");
+                SetTextureBasedOnValueAndName(renderParam, _handle, _textures, inputName, value, "", _tokens->raw, id.GetString() + " default");
             }
         }
 
+        HdMoonshineSetMaterialMayEmit(renderParam->_moonshine, _handle, _emissive);
+
         *dirtyBits = *dirtyBits & ~DirtyBits::DirtyParams;
     }
 
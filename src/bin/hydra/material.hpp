@@ -5,6 +5,8 @@
 
 #include "renderParam.hpp"
 
+#include <unordered_map>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 class HdMoonshineMaterial final : public HdMaterial
@@ -18,7 +20,16 @@ public:
 
     void Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* renderParam, HdDirtyBits* dirtyBits) override;
 
+    void Finalize(HdRenderParam* renderParam) override;
+
     MaterialHandle _handle;
+
+    // whether emissiveColor may be non-black
+    bool _emissive = false;
+
+    // the cached textures currently set on this material, by input
+    using TextureMap = std::unordered_map<TfToken, ImageHandle, TfToken::HashFunctor>;
+    TextureMap _textures;
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
\ No newline at end of file
@@ -11,7 +11,9 @@
 #include <pxr/imaging/hd/extComputationUtils.h>
 #include <pxr/base/gf/vec2f.h>
 #include <pxr/imaging/hd/vtBufferSource.h>
+#include <pxr/base/work/loops.h>
 
+#include <algorithm>
 #include <optional>
 
 PXR_NAMESPACE_OPEN_SCOPE
@@ -22,6 +24,26 @@ TF_DEFINE_PRIVATE_TOKENS(_tokens,
     (normals)
 );
 
+// meshes at least this big, e.g., scans, get compact normals and texcoords to save memory
+constexpr size_t compactAttributeVertexCount = 1 << 20;
+
+// packed for the batch instance API, composed with the transform of the mesh itself
+std::vector<Mat3x4> HdMoonshineMesh::ComposeInstanceMatrices() const {
+    std::vector<Mat3x4> matrices(_instancesTransforms.size());
+    const GfMatrix4d* instancesTransforms = _instancesTransforms.cdata();
+    WorkParallelForN(matrices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const GfMatrix4f instanceTransform = _transform * GfMatrix4f(instancesTransforms[i]);
+            matrices[i] = Mat3x4 {
+                .x = F32x4 { .x = instanceTransform[0][0], .y = instanceTransform[1][0], .z = instanceTransform[2][0], .w = instanceTransform[3][0] },
+                .y = F32x4 { .x = instanceTransform[0][1], .y = instanceTransform[1][1], .z = instanceTransform[2][1], .w = instanceTransform[3][1] },
+                .z = F32x4 { .x = instanceTransform[0][2], .y = instanceTransform[1][2], .z = instanceTransform[2][2], .w = instanceTransform[3][2] },
+            };
+        }
+    });
+    return matrices;
+}
+
 HdMoonshineMesh::HdMoonshineMesh(SdfPath const& id, const HdMoonshineRenderParam& renderParam) : HdMesh(id) {
     _material = renderParam._defaultMaterial;
 }
@@ -69,35 +91,53 @@ constexpr HdType typeToHdType() {
     }
 }
 
+// expands per-vertex data into per-corner data of triangulated faces
+template<typename T>
+static void Deindex(T const* indexed, VtVec3iArray const& indices, T* dst) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        dst[i * 3 + 0] = indexed[indices[i][0]];
+        dst[i * 3 + 1] = indexed[indices[i][1]];
+        dst[i * 3 + 2] = indexed[indices[i][2]];
+    }
+}
+
+// writes count elements of primvar into dst, returning false if that is not possible
+// if deindex is false, dst is per vertex, otherwise it is per triangle corner
+// faceVarying primvars can only be per triangle corner
 template<typename T>
-VtArray<T> HdMoonshineMesh::ComputePrimvar(HdSceneDelegate* sceneDelegate, VtVec3iArray const& indices, TfToken primvarName) const {
-    VtArray<T> primvar;
+bool HdMoonshineMesh::WritePrimvar(HdSceneDelegate* sceneDelegate, VtVec3iArray const& indices, TfToken primvarName, bool deindex, T* dst, size_t count) const {
     VtValue boxedPrimvar = sceneDelegate->Get(GetId(), primvarName);
-    if (boxedPrimvar.IsHolding<VtArray<T>>()) {
-        std::optional<HdInterpolation> maybe_interpolation = FindPrimvarInterpolation(sceneDelegate, primvarName);
-        if (!maybe_interpolation) return primvar;
-        HdInterpolation interpolation = maybe_interpolation.value();
-        if (interpolation == HdInterpolationFaceVarying) {
-            const HdMeshTopology& topology = GetMeshTopology(sceneDelegate);
-            HdMeshUtil meshUtil(&topology, GetId());
-
-            HdVtBufferSource buffer(primvarName, boxedPrimvar);
-            VtValue res;
-            meshUtil.ComputeTriangulatedFaceVaryingPrimvar(buffer.GetData(), buffer.GetNumElements(), typeToHdType<T>(), &res);
-            primvar = res.Get<VtArray<T>>();
-        } else if (interpolation == HdInterpolationVertex) {
-            VtArray<T> indexedPrimvar = boxedPrimvar.Get<VtArray<T>>();
-            for (const auto index : indices) {
-                primvar.push_back(indexedPrimvar[index[0]]);
-                primvar.push_back(indexedPrimvar[index[1]]);
-                primvar.push_back(indexedPrimvar[index[2]]);
-            }
+    if (!boxedPrimvar.IsHolding<VtArray<T>>()) return false;
+
+    std::optional<HdInterpolation> maybe_interpolation = FindPrimvarInterpolation(sceneDelegate, primvarName);
+    if (!maybe_interpolation) return false;
+    HdInterpolation interpolation = maybe_interpolation.value();
+    if (interpolation == HdInterpolationFaceVarying) {
+        TF_VERIFY(deindex);
+        const HdMeshTopology& topology = GetMeshTopology(sceneDelegate);
+        HdMeshUtil meshUtil(&topology, GetId());
+
+        HdVtBufferSource buffer(primvarName, boxedPrimvar);
+        VtValue res;
+        meshUtil.ComputeTriangulatedFaceVaryingPrimvar(buffer.GetData(), buffer.GetNumElements(), typeToHdType<T>(), &res);
+        VtArray<T> const& primvar = res.UncheckedGet<VtArray<T>>();
+        if (primvar.size() != count) return false;
+        std::copy(primvar.cbegin(), primvar.cend(), dst);
+    } else if (interpolation == HdInterpolationVertex || interpolation == HdInterpolationVarying) {
+        VtArray<T> const& primvar = boxedPrimvar.UncheckedGet<VtArray<T>>();
+        if (deindex) {
+            if (indices.size() * 3 != count) return false;
+            Deindex(primvar.cdata(), indices, dst);
         } else {
-            TF_CODING_ERROR("Mesh %s has unknown %s primvar interpolation %s!", GetId().GetText(), primvarName.GetText(), TfEnum::GetDisplayName(interpolation).c_str());
+            if (primvar.size() != count) return false;
+            std::copy(primvar.cbegin(), primvar.cend(), dst);
         }
+    } else {
+        TF_CODING_ERROR("Mesh %s has unknown %s primvar interpolation %s!", GetId().GetText(), primvarName.GetText(), TfEnum::GetDisplayName(interpolation).c_str());
+        return false;
     }
 
-    return primvar;
+    return true;
 }
 
 void HdMoonshineMesh::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hdRenderParam, HdDirtyBits* dirtyBits, TfToken const& reprToken) {
@@ -109,6 +149,10 @@ void HdMoonshineMesh::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hdRend
 
     bool mesh_changed = HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points);
 
+    // replaced mesh, can only be destroyed once the instances using it are
+    std::optional<MeshHandle> staleMesh;
+    bool started_deforming = false;
+
     if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)) {
         const HdMeshTopology& topology = GetMeshTopology(sceneDelegate);
         HdMeshUtil meshUtil(&topology,id);
@@ -136,47 +180,99 @@ void HdMoonshineMesh::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hdRend
             indexedPoints = sceneDelegate->Get(id, HdTokens->points).Get<VtVec3fArray>();
         }
 
-        if (indexedPoints.size() == 0) {
+        if (indexedPoints.size() == 0 || indices.size() == 0) {
             TF_CODING_ERROR("don't know what to do with empty mesh %s", id.GetText());
             return;
         }
 
-        // hydra moonshine uses unindexed everything to support stuff like faceVarying
-        VtVec3fArray points;
-        for (const auto index : indices) {
-            points.push_back(indexedPoints[index[0]]);
-            points.push_back(indexedPoints[index[1]]);
-            points.push_back(indexedPoints[index[2]]);
-        }
-
-        VtVec2fArray texcoords;
+        // there's some way to infer this properly but this works most of the time
+        const TfToken maybeTexcoordNames[] = {
+            _tokens->st,
+            _tokens->st0,
+        };
+        TfToken texcoordName;
+        std::optional<HdInterpolation> texcoordInterpolation;
+        for (const TfToken& name : maybeTexcoordNames)
         {
-            // there's some way to infer this properly but this works most of the time
-            const TfToken maybeTexcoordNames[] = {
-                _tokens->st,
-                _tokens->st0,
-            };
-            TfToken texcoordName;
-            for (const TfToken& name : maybeTexcoordNames)
+            texcoordInterpolation = FindPrimvarInterpolation(sceneDelegate, name);
+            if (texcoordInterpolation)
             {
-                if (FindPrimvarInterpolation(sceneDelegate, name))
-                {
-                    texcoordName = name;
-                    break;
+                texcoordName = name;
+                break;
+            }
+        }
+        const std::optional<HdInterpolation> normalInterpolation = FindPrimvarInterpolation(sceneDelegate, _tokens->normals);
+
+        // faceVarying attributes can't share vertices, so only then fall back to unindexed everything
+        const bool deindex = texcoordInterpolation == HdInterpolationFaceVarying || normalInterpolation == HdInterpolationFaceVarying;
+
+        const size_t vertexCount = deindex ? indices.size() * 3 : indexedPoints.size();
+
+        // a deforming mesh only changes its points, so keep the mesh and its instances
+        // and just overwrite the positions in place
+        const bool onlyPointsChanged = _meshVertexCount != 0
+            && !HdChangeTracker::IsTopologyDirty(*dirtyBits, id)
+            && !HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->normals)
+            && deindex == _meshDeindexed
+            && vertexCount == _meshVertexCount;
+        if (onlyPointsChanged) {
+            if (deindex) {
+                VtVec3fArray points(vertexCount);
+                Deindex(indexedPoints.cdata(), indices, points.data());
+                HdMoonshineUpdateMeshPositions(msne, _mesh, reinterpret_cast<const F32x3*>(points.cdata()), vertexCount);
+            } else {
+                HdMoonshineUpdateMeshPositions(msne, _mesh, reinterpret_cast<const F32x3*>(indexedPoints.cdata()), vertexCount);
+            }
+
+            mesh_changed = false;
+
+            // instances were built expecting a static mesh, remake them once so refits are cheap
+            started_deforming = !_deforming;
+            _deforming = true;
+        } else {
+            // everything below is written directly into staging memory
+            MeshUpload upload;
+            if (!HdMoonshineBeginMeshUpload(msne, vertexCount, normalInterpolation.has_value(), !texcoordName.IsEmpty(), deindex ? 0 : indices.size(), &upload)) {
+                TF_RUNTIME_ERROR("Could not stage %zu vertices of mesh %s", vertexCount, id.GetText());
+                return;
+            }
+
+            GfVec3f* points = reinterpret_cast<GfVec3f*>(upload.positions);
+            if (deindex) {
+                Deindex(indexedPoints.cdata(), indices, points);
+            } else {
+                std::copy(indexedPoints.cbegin(), indexedPoints.cend(), points);
+                for (size_t i = 0; i < indices.size(); i++) {
+                    upload.indices[i] = U32x3 { .x = static_cast<uint32_t>(indices[i][0]), .y = static_cast<uint32_t>(indices[i][1]), .z = static_cast<uint32_t>(indices[i][2]) };
                 }
             }
 
-            if (!texcoordName.IsEmpty()) {
-                texcoords = ComputePrimvar<GfVec2f>(sceneDelegate, indices, texcoordName);
+            if (upload.texcoords && !WritePrimvar(sceneDelegate, indices, texcoordName, deindex, reinterpret_cast<GfVec2f*>(upload.texcoords), vertexCount)) {
+                TF_WARN("Mesh %s texcoords do not match points, ignoring", id.GetText());
+                upload.texcoords = nullptr;
+            }
+            if (upload.normals && !WritePrimvar(sceneDelegate, indices, _tokens->normals, deindex, reinterpret_cast<GfVec3f*>(upload.normals), vertexCount)) {
+                TF_WARN("Mesh %s normals do not match points, ignoring", id.GetText());
+                upload.normals = nullptr;
             }
-        }
 
-        VtVec3fArray normals = ComputePrimvar<GfVec3f>(sceneDelegate, indices, _tokens->normals);
-        
-        // TODO: destroy mesh
-        _mesh = HdMoonshineCreateMesh(msne, reinterpret_cast<const F32x3*>(points.cdata()),  reinterpret_cast<const F32x3*>(normals.cdata()), reinterpret_cast<const F32x2*>(texcoords.cdata()), points.size());
+            upload.compact = vertexCount >= compactAttributeVertexCount;
+
+            // keeps the previous mesh and its instances if this fails
+            MeshHandle mesh;
+            if (!HdMoonshineEndMeshUpload(msne, upload, &mesh)) {
+                TF_RUNTIME_ERROR("Could not create mesh %s", id.GetText());
+                return;
+            }
 
-        *dirtyBits = *dirtyBits & ~HdChangeTracker::DirtyPoints;
+            if (_meshVertexCount != 0) staleMesh = _mesh;
+            _mesh = mesh;
+
+            _meshVertexCount = vertexCount;
+            _meshDeindexed = deindex;
+        }
+
+        *dirtyBits = *dirtyBits & ~(HdChangeTracker::DirtyPoints | HdChangeTracker::DirtyTopology | HdChangeTracker::DirtyNormals);
     }
 
     bool old_visibility = IsVisible();
@@ -217,49 +313,36 @@ void HdMoonshineMesh::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hdRend
 
     if (HdChangeTracker::IsInstancerDirty(*dirtyBits, id)) {
         const size_t old_len = _instancesTransforms.size();
-        _instancesTransforms.clear();
         if (instancerId.IsEmpty()) {
-            _instancesTransforms.push_back(GfMatrix4f(1.0));
+            _instancesTransforms = VtMatrix4dArray(1, GfMatrix4d(1.0));
         } else {
             HdInstancer *instancer = renderIndex.GetInstancer(instancerId);
-            VtMatrix4dArray instanceTransforms = static_cast<HdMoonshineInstancer*>(instancer)->ComputeInstanceTransforms(id);
-            for (size_t i = 0; i < instanceTransforms.size(); i++) {
-                _instancesTransforms.push_back(GfMatrix4f(instanceTransforms[i]));
-            }
+            _instancesTransforms = static_cast<HdMoonshineInstancer*>(instancer)->ComputeInstanceTransforms(id);
         }
         const size_t new_len = _instancesTransforms.size();
-        bool instancer_count_changed = old_len != new_len;
+        instancer_count_changed = old_len != new_len;
         *dirtyBits = *dirtyBits & ~HdChangeTracker::DirtyInstancer;
     }
 
     // TODO: don't actually need to recreate everything on just a material change
-    bool need_to_recreate = mesh_changed || instancer_count_changed || material_changed;
+    bool need_to_recreate = mesh_changed || instancer_count_changed || material_changed || started_deforming;
     if (need_to_recreate) {
         for (const InstanceHandle instance : _instances) {
-            HdMoonshineDestroyInstance(static_cast<HdMoonshineRenderParam*>(renderParam)->_moonshine, instance);
+            HdMoonshineDestroyInstance(msne, instance);
         }
         _instances.clear();
+        if (staleMesh) HdMoonshineDestroyMesh(msne, *staleMesh);
 
-        for (size_t i = 0; i < _instancesTransforms.size(); i++) {
-            GfMatrix4f instanceTransform = _transform * _instancesTransforms[i];
-            const Mat3x4 matrix = Mat3x4 {
-                .x = F32x4 { .x = instanceTransform[0][0], .y = instanceTransform[1][0], .z = instanceTransform[2][0], .w = instanceTransform[3][0] },
-                .y = F32x4 { .x = instanceTransform[0][1], .y = instanceTransform[1][1], .z = instanceTransform[2][1], .w = instanceTransform[3][1] },
-                .z = F32x4 { .x = instanceTransform[0][2], .y = instanceTransform[1][2], .z = instanceTransform[2][2], .w = instanceTransform[3][2] },
-            };
-            _instances.push_back(HdMoonshineCreateInstance(msne, matrix, _mesh, _material, new_visibility));
+        const std::vector<Mat3x4> matrices = ComposeInstanceMatrices();
+        _instances.resize(matrices.size());
+        if (!HdMoonshineCreateInstances(msne, matrices.data(), matrices.size(), _mesh, _material, new_visibility, _deforming, _instances.data())) {
+            TF_RUNTIME_ERROR("Could not create %zu instances of %s", matrices.size(), id.GetText());
+            _instances.clear();
         }
     } else {
         if (transform_changed) {
-            for (size_t i = 0; i < _instancesTransforms.size(); i++) {
-                GfMatrix4f instanceTransform = _transform * _instancesTransforms[i];
-                const Mat3x4 matrix = Mat3x4 {
-                    .x = F32x4 { .x = instanceTransform[0][0], .y = instanceTransform[1][0], .z = instanceTransform[2][0], .w = instanceTransform[3][0] },
-                    .y = F32x4 { .x = instanceTransform[0][1], .y = instanceTransform[1][1], .z = instanceTransform[2][1], .w = instanceTransform[3][1] },
-                    .z = F32x4 { .x = instanceTransform[0][2], .y = instanceTransform[1][2], .z = instanceTransform[2][2], .w = instanceTransform[3][2] },
-                };
-                HdMoonshineSetInstanceTransform(msne, _instances[i], matrix);
-            }
+            const std::vector<Mat3x4> matrices = ComposeInstanceMatrices();
+            HdMoonshineSetInstanceTransforms(msne, _instances.data(), matrices.data(), matrices.size());
         }
 
         if (old_visibility != new_visibility) {
@@ -275,8 +358,14 @@ void HdMoonshineMesh::Sync(HdSceneDelegate* sceneDelegate, HdRenderParam* hdRend
 }
 
 void HdMoonshineMesh::Finalize(HdRenderParam *renderParam) {
+    HdMoonshine* msne = static_cast<HdMoonshineRenderParam*>(renderParam)->_moonshine;
     for (const InstanceHandle instance : _instances) {
-        HdMoonshineDestroyInstance(static_cast<HdMoonshineRenderParam*>(renderParam)->_moonshine, instance);
+        HdMoonshineDestroyInstance(msne, instance);
+    }
+    _instances.clear();
+    if (_meshVertexCount != 0) {
+        HdMoonshineDestroyMesh(msne, _mesh);
+        _meshVertexCount = 0;
     }
 }
 
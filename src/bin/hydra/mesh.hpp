@@ -5,6 +5,7 @@
 #include <pxr/pxr.h>
 #include <pxr/imaging/hd/mesh.h>
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/vt/types.h>
 
 #include "renderParam.hpp"
 
@@ -30,18 +31,23 @@ protected:
     HdMoonshineMesh(const HdMoonshineMesh&) = delete;
     HdMoonshineMesh &operator =(const HdMoonshineMesh&) = delete;
 private:
+    std::vector<Mat3x4> ComposeInstanceMatrices() const;
+
     std::optional<HdInterpolation> FindPrimvarInterpolation(HdSceneDelegate* sceneDelegate, TfToken name) const;
 
     template<typename T>
-    VtArray<T> ComputePrimvar(HdSceneDelegate* sceneDelegate, VtVec3iArray const& indices, TfToken primvarName) const;
+    bool WritePrimvar(HdSceneDelegate* sceneDelegate, VtVec3iArray const& indices, TfToken primvarName, bool deindex, T* dst, size_t count) const;
     
     GfMatrix4f _transform{1.0f};
     MeshHandle _mesh;
+    size_t _meshVertexCount = 0; // zero if no mesh was created yet
+    bool _meshDeindexed = false;
+    bool _deforming = false; // points were updated in place before, so instances prefer fast BLAS builds
     MaterialHandle _material;
 
     // these two have same len
     std::vector<InstanceHandle> _instances = {};
-    std::vector<GfMatrix4f> _instancesTransforms = {};
+    VtMatrix4dArray _instancesTransforms = {}; // shared with the instancer cache
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
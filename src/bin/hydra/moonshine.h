@@ -34,6 +34,17 @@ typedef struct Mat3x4 {
     F32x4 x, y, z;
 } Mat3x4;
 
+typedef struct MeshUpload {
+    F32x3* positions;
+    F32x3* normals;
+    F32x2* texcoords;
+    U32x3* indices;
+    size_t vertex_count;
+    size_t triangle_count;
+    void* recorder;
+    bool compact;
+} MeshUpload;
+
 typedef struct Extent2D {
     uint32_t width;
     uint32_t height;
@@ -55,38 +66,69 @@ typedef struct Material {
     ImageHandle metalness;
     ImageHandle roughness;
     float ior;
+    bool may_emit; // see HdMoonshineSetMaterialMayEmit
 } Material;
 
+typedef struct ProfilerStat {
+    const char* name;
+    double duration_ms;
+    uint64_t work;
+    double throughput;
+} ProfilerStat;
+
 typedef enum TextureFormat {
     f16x4,
     u8x1,
     u8x2,
     u8x4,
     u8x4_srgb,
+    bc1,
+    bc1_srgb,
+    bc4,
+    bc5,
+    bc6h,
+    bc7,
+    bc7_srgb,
 } TextureFormat;
 
 typedef struct HdMoonshine HdMoonshine;
 extern "C" HdMoonshine* HdMoonshineCreate(void);
 extern "C" void HdMoonshineDestroy(HdMoonshine*);
-extern "C" bool HdMoonshineRender(HdMoonshine*, SensorHandle, LensHandle);
+extern "C" bool HdMoonshineRender(HdMoonshine*, SensorHandle, LensHandle, uint32_t, float, float);
 extern "C" bool HdMoonshineRebuildPipeline(HdMoonshine*);
-extern "C" MeshHandle HdMoonshineCreateMesh(HdMoonshine*, const F32x3*, const F32x3*, const F32x2*, size_t);
-extern "C" ImageHandle HdMoonshineCreateSolidTexture1(HdMoonshine*, float, const char*);
-extern "C" ImageHandle HdMoonshineCreateSolidTexture2(HdMoonshine*, F32x2, const char*);
-extern "C" ImageHandle HdMoonshineCreateSolidTexture3(HdMoonshine*, F32x3, const char*);
-extern "C" ImageHandle HdMoonshineCreateRawTexture(HdMoonshine*, uint8_t*, Extent2D, TextureFormat, const char*);
+extern "C" bool HdMoonshineSetDirectLightResampling(HdMoonshine*, uint32_t, bool, uint32_t);
+extern "C" bool HdMoonshineCreateMesh(HdMoonshine*, const F32x3*, const F32x3*, const F32x2*, size_t, MeshHandle*);
+extern "C" bool HdMoonshineCreateIndexedMesh(HdMoonshine*, const F32x3*, const F32x3*, const F32x2*, size_t, const U32x3*, size_t, MeshHandle*);
+extern "C" bool HdMoonshineBeginMeshUpload(HdMoonshine*, size_t, bool, bool, size_t, MeshUpload*);
+extern "C" bool HdMoonshineEndMeshUpload(HdMoonshine*, MeshUpload, MeshHandle*);
+extern "C" void HdMoonshineUpdateMeshPositions(HdMoonshine*, MeshHandle, const F32x3*, size_t);
+extern "C" void HdMoonshineDestroyMesh(HdMoonshine*, MeshHandle);
+extern "C" bool HdMoonshineCreateSolidTexture1(HdMoonshine*, float, const char*, ImageHandle*);
+extern "C" bool HdMoonshineCreateSolidTexture2(HdMoonshine*, F32x2, const char*, ImageHandle*);
+extern "C" bool HdMoonshineCreateSolidTexture3(HdMoonshine*, F32x3, const char*, ImageHandle*);
+extern "C" bool HdMoonshineCreateRawTexture(HdMoonshine*, const uint8_t*, Extent2D, TextureFormat, const char*, ImageHandle*);
+extern "C" bool HdMoonshineCreateRawTextureMips(HdMoonshine*, const uint8_t*, Extent2D, TextureFormat, uint32_t, const char*, ImageHandle*);
+extern "C" bool HdMoonshineCreateDdsTexture(HdMoonshine*, const char*, bool, const char*, ImageHandle*);
+extern "C" void HdMoonshineDestroyTexture(HdMoonshine*, ImageHandle);
 extern "C" MaterialHandle HdMoonshineCreateMaterial(HdMoonshine*, Material);
+extern "C" void HdMoonshineDestroyMaterial(HdMoonshine*, MaterialHandle);
 extern "C" void HdMoonshineSetMaterialNormal(HdMoonshine*, MaterialHandle, ImageHandle);
 extern "C" void HdMoonshineSetMaterialEmissive(HdMoonshine*, MaterialHandle, ImageHandle);
+extern "C" void HdMoonshineSetMaterialMayEmit(HdMoonshine*, MaterialHandle, bool);
 extern "C" void HdMoonshineSetMaterialColor(HdMoonshine*, MaterialHandle, ImageHandle);
 extern "C" void HdMoonshineSetMaterialMetalness(HdMoonshine*, MaterialHandle, ImageHandle);
 extern "C" void HdMoonshineSetMaterialRoughness(HdMoonshine*, MaterialHandle, ImageHandle);
 extern "C" void HdMoonshineSetMaterialIOR(HdMoonshine*, MaterialHandle, float);
-extern "C" InstanceHandle HdMoonshineCreateInstance(HdMoonshine*, Mat3x4, MeshHandle, MaterialHandle, bool);
+extern "C" bool HdMoonshineCreateInstance(HdMoonshine*, Mat3x4, MeshHandle, MaterialHandle, bool, bool, InstanceHandle*);
+extern "C" bool HdMoonshineCreateInstances(HdMoonshine*, const Mat3x4*, size_t, MeshHandle, MaterialHandle, bool, bool, InstanceHandle*);
 extern "C" void HdMoonshineDestroyInstance(HdMoonshine*, InstanceHandle);
 extern "C" void HdMoonshineSetInstanceTransform(HdMoonshine*, InstanceHandle, Mat3x4);
+extern "C" void HdMoonshineSetInstanceTransforms(HdMoonshine*, const InstanceHandle*, const Mat3x4*, size_t);
 extern "C" void HdMoonshineSetInstanceVisibility(HdMoonshine*, InstanceHandle, bool);
-extern "C" SensorHandle HdMoonshineCreateSensor(HdMoonshine*, Extent2D);
-extern "C" float* HdMoonshineGetSensorData(const HdMoonshine*, SensorHandle);
+extern "C" bool HdMoonshineCreateSensor(HdMoonshine*, Extent2D, SensorHandle*);
+extern "C" bool HdMoonshinePollFrames(HdMoonshine*);
+extern "C" size_t HdMoonshineGetStats(HdMoonshine*, ProfilerStat*, size_t);
+extern "C" float* HdMoonshineMapSensor(HdMoonshine*, SensorHandle);
+extern "C" void HdMoonshineUnmapSensor(HdMoonshine*, SensorHandle);
 extern "C" LensHandle HdMoonshineCreateLens(HdMoonshine*, Lens);
 extern "C" void HdMoonshineSetLens(HdMoonshine*, LensHandle, Lens);
@@ -22,12 +22,35 @@ bool HdMoonshineRenderBuffer::Allocate(GfVec3i const& dimensions, HdFormat forma
     _width = dimensions[0];
     _height = dimensions[1];
 
-    _sensor = HdMoonshineCreateSensor(_renderDelegate->_moonshine, Extent2D { .width = _width, .height = _height });
-    _data =  reinterpret_cast<uint8_t*>(HdMoonshineGetSensorData(_renderDelegate->_moonshine, _sensor));
+    if (!HdMoonshineCreateSensor(_renderDelegate->_moonshine, Extent2D { .width = _width, .height = _height }, &_sensor)) {
+        TF_RUNTIME_ERROR("Could not create a %ux%u sensor for %s", _width, _height, GetId().GetText());
+        return false;
+    }
 
     return true;
 }
 
-void HdMoonshineRenderBuffer::Resolve() {}
+// rendering is asynchronous so only ever hand out frames the GPU has finished
+void* HdMoonshineRenderBuffer::Map() {
+    float* data = HdMoonshineMapSensor(_renderDelegate->_moonshine, _sensor);
+    if (data == nullptr) {
+        TF_RUNTIME_ERROR("Could not map %s", GetId().GetText());
+        return nullptr;
+    }
+    _mappers++;
+    return data;
+}
+
+void HdMoonshineRenderBuffer::Unmap() {
+    if (--_mappers == 0) {
+        HdMoonshineUnmapSensor(_renderDelegate->_moonshine, _sensor);
+    }
+}
+
+void HdMoonshineRenderBuffer::Resolve() {
+    if (!HdMoonshinePollFrames(_renderDelegate->_moonshine)) {
+        TF_RUNTIME_ERROR("Could not poll frames for %s", GetId().GetText());
+    }
+}
 
 PXR_NAMESPACE_CLOSE_SCOPE
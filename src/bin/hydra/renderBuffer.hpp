@@ -6,6 +6,8 @@
 #include "pxr/imaging/hd/renderBuffer.h"
 #include "renderDelegate.hpp"
 
+#include <atomic>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 class HdMoonshineRenderBuffer : public HdRenderBuffer
@@ -22,14 +24,12 @@ public:
     HdFormat GetFormat() const override { return HdFormatFloat32Vec4; }
     bool IsMultiSampled() const override { return false; }
 
-    void* Map() override {
-        return _data;
-    }
+    void* Map() override;
 
-    void Unmap() override {}
+    void Unmap() override;
 
     bool IsMapped() const override {
-        return false;
+        return _mappers.load() != 0;
     }
 
     bool IsConverged() const override {
@@ -45,7 +45,7 @@ private:
     HdMoonshineRenderDelegate* _renderDelegate;
     unsigned int _width;
     unsigned int _height;
-    uint8_t* _data = nullptr;
+    std::atomic<int> _mappers{0};
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
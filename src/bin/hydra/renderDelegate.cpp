@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <string>
 
 #include <pxr/imaging/hd/extComputation.h>
 
@@ -16,6 +19,8 @@ TF_DEFINE_PRIVATE_TOKENS(_tokens,
     (rebuildPipeline)
 );
 
+TF_DEFINE_PUBLIC_TOKENS(HdMoonshineRenderSettingsTokens, HDMOONSHINE_RENDER_SETTINGS_TOKENS);
+
 const TfTokenVector HdMoonshineRenderDelegate::SUPPORTED_RPRIM_TYPES = {
     HdPrimTypeTokens->mesh,
 };
@@ -57,6 +62,32 @@ void HdMoonshineRenderDelegate::_Initialize() {
     _moonshine = HdMoonshineCreate();
     _resourceRegistry = std::make_shared<HdResourceRegistry>();
     _renderParam = std::make_unique<HdMoonshineRenderParam>(_moonshine);
+
+    _settingDescriptors.push_back({ "Samples per frame (0 for adaptive)", HdMoonshineRenderSettingsTokens->samplesPerFrame, VtValue(0) });
+    _settingDescriptors.push_back({ "Adaptive sampling target frame time (ms)", HdMoonshineRenderSettingsTokens->targetFrameTime, VtValue(33.0f) });
+    _settingDescriptors.push_back({ "Noise threshold (0 to disable)", HdMoonshineRenderSettingsTokens->noiseThreshold, VtValue(0.0f) });
+    // reuse is biased, so all of these default to off
+    _settingDescriptors.push_back({ "Direct light candidates (0 to disable resampling)", HdMoonshineRenderSettingsTokens->directLightCandidates, VtValue(0) });
+    _settingDescriptors.push_back({ "Reuse direct light across samples (biased)", HdMoonshineRenderSettingsTokens->temporalReuse, VtValue(false) });
+    _settingDescriptors.push_back({ "Direct light reuse neighbours (biased)", HdMoonshineRenderSettingsTokens->spatialReuseNeighbours, VtValue(0) });
+    _PopulateDefaultSettings(_settingDescriptors);
+}
+
+HdRenderSettingDescriptorList HdMoonshineRenderDelegate::GetRenderSettingDescriptors() const {
+    return _settingDescriptors;
+}
+
+VtDictionary HdMoonshineRenderDelegate::GetRenderStats() const {
+    ProfilerStat stats[64];
+    size_t count = std::min(HdMoonshineGetStats(_moonshine, stats, std::size(stats)), std::size(stats));
+
+    VtDictionary dictionary;
+    for (size_t i = 0; i < count; i++) {
+        std::string name = stats[i].name;
+        dictionary[name + " ms"] = VtValue(stats[i].duration_ms);
+        if (name == "trace rays") dictionary["rays per second"] = VtValue(stats[i].throughput);
+    }
+    return dictionary;
 }
 
 HdMoonshineRenderDelegate::~HdMoonshineRenderDelegate() {
@@ -5,6 +5,7 @@
 #include <pxr/pxr.h>
 #include <pxr/imaging/hd/renderDelegate.h>
 #include <pxr/imaging/hd/resourceRegistry.h>
+#include <pxr/base/tf/staticTokens.h>
 
 #include "renderParam.hpp"
 
@@ -12,6 +13,16 @@
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+#define HDMOONSHINE_RENDER_SETTINGS_TOKENS \
+    (samplesPerFrame)                      \
+    (targetFrameTime)                      \
+    (noiseThreshold)                       \
+    (directLightCandidates)                \
+    (temporalReuse)                        \
+    (spatialReuseNeighbours)
+
+TF_DECLARE_PUBLIC_TOKENS(HdMoonshineRenderSettingsTokens, HDMOONSHINE_RENDER_SETTINGS_TOKENS);
+
 class HdMoonshineRenderDelegate final : public HdRenderDelegate
 {
 public:
@@ -50,6 +61,10 @@ public:
     HdRenderParam *GetRenderParam() const override;
 
     HdAovDescriptor GetDefaultAovDescriptor(TfToken const& name) const override;
+
+    HdRenderSettingDescriptorList GetRenderSettingDescriptors() const override;
+
+    VtDictionary GetRenderStats() const override;
     HdMoonshine* _moonshine;
 private:
     static const TfTokenVector SUPPORTED_RPRIM_TYPES;
@@ -59,6 +74,7 @@ private:
     void _Initialize();
 
     HdResourceRegistrySharedPtr _resourceRegistry;
+    HdRenderSettingDescriptorList _settingDescriptors;
     std::unique_ptr<HdMoonshineRenderParam> _renderParam;
 
     HdMoonshineRenderDelegate(const HdMoonshineRenderDelegate &) = delete;
@@ -3,18 +3,19 @@
 #include <pxr/imaging/hd/renderDelegate.h>
 
 #include "moonshine.h"
+#include "textureCache.hpp"
 
 PXR_NAMESPACE_OPEN_SCOPE
 
 class HdMoonshineRenderParam final : public HdRenderParam
 {
 public:
-    HdMoonshineRenderParam(HdMoonshine* moonshine) : _moonshine(moonshine) {
-        _black3 = HdMoonshineCreateSolidTexture3(_moonshine, F32x3 { .x = 0.0f, .y = 0.0f, .z = 0.0f }, "black3");
-        _black1 = HdMoonshineCreateSolidTexture1(_moonshine, 0.0, "black1");
-        _upNormal = HdMoonshineCreateSolidTexture2(_moonshine, F32x2 { .x = 0.5f, .y = 0.5f }, "up normal");
-        _grey3 = HdMoonshineCreateSolidTexture3(_moonshine, F32x3 { .x = 0.5f, .y = 0.5f, .z = 0.5f }, "grey3");
-        _white1 = HdMoonshineCreateSolidTexture1(_moonshine, 1.0, "white1");
+    HdMoonshineRenderParam(HdMoonshine* moonshine) : _moonshine(moonshine), _textureCache(moonshine) {
+        TF_VERIFY(HdMoonshineCreateSolidTexture3(_moonshine, F32x3 { .x = 0.0f, .y = 0.0f, .z = 0.0f }, "black3", &_black3));
+        TF_VERIFY(HdMoonshineCreateSolidTexture1(_moonshine, 0.0, "black1", &_black1));
+        TF_VERIFY(HdMoonshineCreateSolidTexture2(_moonshine, F32x2 { .x = 0.5f, .y = 0.5f }, "up normal", &_upNormal));
+        TF_VERIFY(HdMoonshineCreateSolidTexture3(_moonshine, F32x3 { .x = 0.5f, .y = 0.5f, .z = 0.5f }, "grey3", &_grey3));
+        TF_VERIFY(HdMoonshineCreateSolidTexture1(_moonshine, 1.0, "white1", &_white1));
         _defaultMaterial = HdMoonshineCreateMaterial(_moonshine, Material {
             .normal = _upNormal,
             .emissive = _black3,
@@ -22,17 +23,21 @@ public:
             .metalness = _black1,
             .roughness = _white1,
             .ior = 1.5,
+            .may_emit = false,
         });
     }
 
     HdMoonshine* _moonshine;
 
-    // some defaults
-    ImageHandle _black3;
-    ImageHandle _black1;
-    ImageHandle _upNormal;
-    ImageHandle _grey3;
-    ImageHandle _white1;
+    // textures of materials, the defaults below are not in it
+    HdMoonshineTextureCache _textureCache;
+
+    // some defaults, zero if they could not be created
+    ImageHandle _black3 = 0;
+    ImageHandle _black1 = 0;
+    ImageHandle _upNormal = 0;
+    ImageHandle _grey3 = 0;
+    ImageHandle _white1 = 0;
     MaterialHandle _defaultMaterial;
 };
 
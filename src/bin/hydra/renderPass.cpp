@@ -8,6 +8,8 @@
 #include <pxr/imaging/hd/renderPassState.h>
 #include <pxr/imaging/hd/tokens.h>
 
+#include <algorithm>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 HdMoonshineRenderPass::HdMoonshineRenderPass(HdRenderIndex *index, HdRprimCollection const &collection) : HdRenderPass(index, collection) {}
@@ -21,8 +23,19 @@ void HdMoonshineRenderPass::_Execute(HdRenderPassStateSharedPtr const& renderPas
             HdMoonshineRenderDelegate* renderDelegate = static_cast<HdMoonshineRenderDelegate*>(renderIndex->GetRenderDelegate());
             const HdMoonshineCamera* camera = static_cast<const HdMoonshineCamera*>(renderPassState->GetCamera());
 
+            // zero samples lets moonshine pick how many fit into the target frame time
+            const int samplesPerFrame = renderDelegate->GetRenderSetting<int>(HdMoonshineRenderSettingsTokens->samplesPerFrame, 0);
+            const float targetFrameTime = renderDelegate->GetRenderSetting<float>(HdMoonshineRenderSettingsTokens->targetFrameTime, 33.0f);
+            const float noiseThreshold = renderDelegate->GetRenderSetting<float>(HdMoonshineRenderSettingsTokens->noiseThreshold, 0.0f);
+            const int directLightCandidates = renderDelegate->GetRenderSetting<int>(HdMoonshineRenderSettingsTokens->directLightCandidates, 0);
+            const bool temporalReuse = renderDelegate->GetRenderSetting<bool>(HdMoonshineRenderSettingsTokens->temporalReuse, false);
+            const int spatialReuseNeighbours = renderDelegate->GetRenderSetting<int>(HdMoonshineRenderSettingsTokens->spatialReuseNeighbours, 0);
+
+            // only does anything if these changed
+            HdMoonshineSetDirectLightResampling(renderDelegate->_moonshine, static_cast<uint32_t>(std::max(directLightCandidates, 0)), temporalReuse, static_cast<uint32_t>(std::max(spatialReuseNeighbours, 0)));
+
             HdMoonshineRenderBuffer* renderBuffer = static_cast<HdMoonshineRenderBuffer*>(aov.renderBuffer);
-            HdMoonshineRender(renderDelegate->_moonshine, renderBuffer->_sensor, camera->_handle);
+            HdMoonshineRender(renderDelegate->_moonshine, renderBuffer->_sensor, camera->_handle, static_cast<uint32_t>(std::max(samplesPerFrame, 0)), targetFrameTime, std::max(noiseThreshold, 0.0f));
         }
     }
 }
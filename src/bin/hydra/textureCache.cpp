@@ -0,0 +1,57 @@
+#include "textureCache.hpp"
+
+#include "pxr/base/tf/diagnostic.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+std::optional<ImageHandle> HdMoonshineTextureCache::Acquire(Key const& key, std::function<std::optional<ImageHandle>()> const& create) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        it->second.refCount++;
+        std::shared_future<std::optional<ImageHandle>> pending = it->second.handle;
+        lock.unlock();
+        return pending.get();
+    }
+
+    std::promise<std::optional<ImageHandle>> promise;
+    _entries.emplace(key, Entry { .handle = promise.get_future().share(), .refCount = 1 });
+    lock.unlock();
+
+    // the slow part, so done without holding the lock
+    std::optional<ImageHandle> handle = create();
+
+    lock.lock();
+    if (handle) {
+        _keys.emplace(handle.value(), key);
+    } else {
+        // threads waiting on this get nothing too, and so never release it
+        _entries.erase(key);
+    }
+    lock.unlock();
+
+    // only once it can be released
+    promise.set_value(handle);
+    return handle;
+}
+
+void HdMoonshineTextureCache::Release(ImageHandle handle) {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    auto keyIt = _keys.find(handle);
+    if (keyIt == _keys.end()) {
+        TF_CODING_ERROR("released texture %u that is not in the cache", handle);
+        return;
+    }
+
+    auto entryIt = _entries.find(keyIt->second);
+    if (--entryIt->second.refCount == 0) {
+        // no other thread can be waiting on it, as they would hold a reference
+        HdMoonshineDestroyTexture(_moonshine, handle);
+        _entries.erase(entryIt);
+        _keys.erase(keyIt);
+    }
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
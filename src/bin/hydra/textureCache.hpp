@@ -0,0 +1,65 @@
+#pragma once
+
+#include "moonshine.h"
+
+#include "pxr/pxr.h"
+#include "pxr/base/tf/hash.h"
+#include "pxr/base/tf/token.h"
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// shares textures between materials that read the same source the same way,
+// destroying each once the last material using it lets go
+class HdMoonshineTextureCache
+{
+public:
+    struct Key {
+        std::string source; // resolved asset path, or stringified value for solid textures
+        std::string swizzle;
+        TfToken colorSpace;
+        TfToken dst; // the material input, as e.g., normals are converted differently
+
+        bool operator==(Key const& other) const {
+            return source == other.source && swizzle == other.swizzle && colorSpace == other.colorSpace && dst == other.dst;
+        }
+    };
+
+    HdMoonshineTextureCache(HdMoonshine* moonshine) : _moonshine(moonshine) {}
+
+    // takes a reference to the texture for `key`, only calling `create` if there is none yet
+    // threads may create different textures at the same time, and wait on each other for the same one
+    std::optional<ImageHandle> Acquire(Key const& key, std::function<std::optional<ImageHandle>()> const& create);
+
+    // gives up a reference taken by Acquire, destroying the texture if it was the last one
+    // whatever used the texture must have been changed to not refer to it anymore,
+    // though that change may still be pending until the next render
+    void Release(ImageHandle handle);
+
+private:
+    struct KeyHash {
+        size_t operator()(Key const& key) const {
+            return TfHash::Combine(key.source, key.swizzle, key.colorSpace, key.dst);
+        }
+    };
+
+    struct Entry {
+        std::shared_future<std::optional<ImageHandle>> handle; // ready once created
+        size_t refCount;
+    };
+
+    HdMoonshine* _moonshine;
+
+    std::mutex _mutex;
+    std::unordered_map<Key, Entry, KeyHash> _entries;
+    std::unordered_map<ImageHandle, Key> _keys;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
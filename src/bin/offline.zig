@@ -6,8 +6,14 @@ const engine = @import("engine");
 const core = engine.core;
 const VulkanContext = core.VulkanContext;
 const Encoder = core.Encoder;
+const Profiler = core.Profiler;
 const Pipeline = engine.hrtsystem.pipeline.PathTracing;
+const Wavefront = engine.hrtsystem.Wavefront;
+const Convergence = engine.hrtsystem.Convergence;
+const Sensor = core.Sensor;
 const Scene = engine.hrtsystem.Scene;
+const Region = engine.hrtsystem.pipeline.Region;
+const Lens = engine.hrtsystem.Camera.Lens;
 
 const vk_helpers = core.vk_helpers;
 const exr = engine.fileformats.exr;
@@ -16,12 +22,22 @@ const vector = engine.vector;
 const F32x3 = vector.Vec3(f32);
 const Mat3x4 = vector.Mat3x4(f32);
 
+const Integrator = enum {
+    megakernel,
+    wavefront,
+};
+
 const Config = struct {
     in_filepath: []const u8, // must be gltf/glb
-    out_filepath: []const u8, // must be exr
+    out_filepath: []const u8, // must be exr, or "-" to read a batch of jobs from stdin
     skybox_filepath: []const u8, // must be exr
     spp: u32,
     extent: vk.Extent2D,
+    integrator: Integrator,
+    noise_threshold: f32, // relative error below which pixels stop being sampled, 0 to always take every sample
+    tile_size: u32, // widest square rendered at once, bounding device memory use for large images
+    device_count: u32, // how many devices to render on, 0 for all suitable ones
+    stats_filepath: ?[]const u8, // where to write device timings as json, if anywhere
 
     fn fromCli(allocator: std.mem.Allocator) !Config {
         const args = try std.process.argsAlloc(allocator);
@@ -35,23 +51,130 @@ const Config = struct {
         if (!std.mem.eql(u8, std.fs.path.extension(skybox_filepath), ".exr")) return error.OnlySupportsExrSkybox;
 
         const out_filepath = args[3];
-        if (!std.mem.eql(u8, std.fs.path.extension(out_filepath), ".exr")) return error.OnlySupportsExrOutput;
+        if (!std.mem.eql(u8, out_filepath, "-") and !std.mem.eql(u8, std.fs.path.extension(out_filepath), ".exr")) return error.OnlySupportsExrOutput;
 
         const spp = if (args.len > 4) try std.fmt.parseInt(u32, args[4], 10) else 16;
 
+        const integrator = if (args.len > 5) std.meta.stringToEnum(Integrator, args[5]) orelse return error.UnknownIntegrator else .megakernel;
+
+        const noise_threshold = if (args.len > 6) try std.fmt.parseFloat(f32, args[6]) else 0;
+        if (noise_threshold < 0) return error.NegativeNoiseThreshold;
+
+        const extent = if (args.len > 7) try parseExtent(args[7]) else vk.Extent2D { .width = 1280, .height = 720 };
+
+        const device_count = if (args.len > 9) try std.fmt.parseInt(u32, args[9], 10) else 1;
+        if (device_count > max_device_count) return error.TooManyDevices;
+
+        // devices take tiles as they finish them, so with multiple there should be plenty to go around
+        const tile_size = if (args.len > 8) try std.fmt.parseInt(u32, args[8], 10) else if (device_count == 1) 2048 else 512;
+        if (tile_size == 0) return error.ZeroTileSize;
+
+        const stats_filepath = if (args.len > 10) args[10] else null;
+        if (stats_filepath) |path| if (!std.mem.eql(u8, std.fs.path.extension(path), ".json")) return error.OnlySupportsJsonStats;
+
         return Config {
             .in_filepath = try allocator.dupe(u8, in_filepath),
             .out_filepath = try allocator.dupe(u8, out_filepath),
             .skybox_filepath = try allocator.dupe(u8, skybox_filepath),
             .spp = spp,
-            .extent = vk.Extent2D { .width = 1280, .height = 720 }, // TODO: cli
+            .extent = extent,
+            .integrator = integrator,
+            .noise_threshold = noise_threshold,
+            .tile_size = tile_size,
+            .device_count = device_count,
+            .stats_filepath = if (stats_filepath) |path| try allocator.dupe(u8, path) else null,
         };
     }
 
+    // WIDTHxHEIGHT, e.g. 1920x1080
+    fn parseExtent(arg: []const u8) !vk.Extent2D {
+        var it = std.mem.splitScalar(u8, arg, 'x');
+        const width = try std.fmt.parseInt(u32, it.first(), 10);
+        const height = try std.fmt.parseInt(u32, it.next() orelse return error.BadExtent, 10);
+        if (it.next() != null or width == 0 or height == 0) return error.BadExtent;
+        return vk.Extent2D { .width = width, .height = height };
+    }
+
     fn destroy(self: Config, allocator: std.mem.Allocator) void {
         allocator.free(self.in_filepath);
         allocator.free(self.out_filepath);
         allocator.free(self.skybox_filepath);
+        if (self.stats_filepath) |path| allocator.free(path);
+    }
+};
+
+// one image of a batch, read from a line of stdin as
+//
+//   out.exr [origin.x origin.y origin.z forward.x forward.y forward.z up.x up.y up.z vfov_degrees [aperture focus_distance]]
+//
+// where leaving out the lens renders from the camera of the scene
+const Job = struct {
+    out_filepath: []const u8, // must be exr
+    lens: ?Lens,
+
+    fn parse(allocator: std.mem.Allocator, line: []const u8) !Job {
+        var it = std.mem.tokenizeAny(u8, line, " \t\r");
+        const out_filepath = it.next() orelse return error.EmptyJob;
+        if (!std.mem.eql(u8, std.fs.path.extension(out_filepath), ".exr")) return error.OnlySupportsExrOutput;
+
+        var numbers = std.BoundedArray(f32, 12) {};
+        while (it.next()) |token| numbers.append(try std.fmt.parseFloat(f32, token)) catch return error.BadJobLens;
+
+        const lens = switch (numbers.len) {
+            0 => null,
+            10, 12 => blk: {
+                const n = numbers.slice();
+                const lens = Lens {
+                    .origin = F32x3.new(n[0], n[1], n[2]),
+                    .forward = F32x3.new(n[3], n[4], n[5]).unit(),
+                    .up = F32x3.new(n[6], n[7], n[8]).unit(),
+                    .vfov = n[9] * std.math.pi / 180.0,
+                    .vfov_tan = undefined,
+                    .aperture = if (n.len == 12) n[10] else 0,
+                    .focus_distance = if (n.len == 12) n[11] else 1,
+                    .u = undefined,
+                    .v = undefined,
+                };
+                break :blk lens.prepareCameraPreCalcs();
+            },
+            else => return error.BadJobLens,
+        };
+
+        return Job {
+            .out_filepath = try allocator.dupe(u8, out_filepath),
+            .lens = lens,
+        };
+    }
+};
+
+// where a finished image waits to be written out, which is slow enough
+// to be worth doing on its own thread while the next image renders
+const OutputImage = struct {
+    image: exr.helpers.Rgb2D,
+    writer: ?std.Thread = null,
+    result: anyerror!void = {},
+
+    fn write(self: *OutputImage, allocator: std.mem.Allocator, out_filepath: []const u8) void {
+        defer allocator.free(out_filepath);
+        self.result = self.image.save(allocator, out_filepath);
+    }
+
+    // takes ownership of `out_filepath`
+    fn startWrite(self: *OutputImage, allocator: std.mem.Allocator, out_filepath: []const u8) !void {
+        std.debug.assert(self.writer == null);
+        self.writer = std.Thread.spawn(.{}, write, .{ self, allocator, out_filepath }) catch |err| {
+            allocator.free(out_filepath);
+            return err;
+        };
+    }
+
+    // must be called before the image is rendered into again
+    fn finishWrite(self: *OutputImage) !void {
+        if (self.writer) |writer| {
+            writer.join();
+            self.writer = null;
+            try self.result;
+        }
     }
 };
 
@@ -74,6 +197,338 @@ const IntervalLogger = struct {
     }
 };
 
+// part of the image the sensor is capturing
+//
+// the sensor is as large as the largest tile, so edge tiles only use some of it
+const Tile = struct {
+    region: Region,
+    extent: vk.Extent2D,
+};
+
+// every megakernel sample must finish within a submit, and the driver
+// may give up on a submit that runs too long, so split them up
+// wavefront samples are split further, see recordWavefront
+const samples_per_submit = 16;
+
+// checks for converged tiles every so often, once there are enough samples to tell
+// returns whether it did, which binds another pipeline
+fn recordConvergenceUpdate(convergence: ?*const Convergence, encoder: *Encoder, sensor: *const Sensor, tile: Tile, capture_stage: vk.PipelineStageFlags2, noise_threshold: f32) bool {
+    const c = convergence orelse return false;
+    if (sensor.sample_count < Convergence.default_min_sample_count or sensor.sample_count % Convergence.default_update_interval != 0) return false;
+    c.recordUpdate(encoder.buffer, sensor, tile.extent, capture_stage, noise_threshold, Convergence.default_min_sample_count);
+    return true;
+}
+
+fn recordMegakernel(pipeline: *const Pipeline, convergence: ?*const Convergence, encoder: *Encoder, scene: *Scene, tile: Tile, spp: u32, noise_threshold: f32) void {
+    const sensor = &scene.camera.sensors.items[0];
+
+    // prepare our stuff
+    sensor.recordPrepareForCapture(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{});
+
+    // bind our stuff
+    pipeline.recordBindPipeline(encoder.buffer);
+    pipeline.recordBindAdditionalDescriptorSets(encoder.buffer, .{ scene.world.materials.textures.descriptor_set, scene.world.constant_specta.descriptor_set });
+    pipeline.recordPushDescriptors(encoder.buffer, scene.pushDescriptors(0, 0));
+
+    for (0..spp) |sample_count| {
+        // push our stuff
+        pipeline.recordPushConstants(encoder.buffer, .{ .lens = scene.camera.lenses.items[0], .sample_count = sensor.sample_count, .region = tile.region });
+
+        // trace our stuff
+        const scope = encoder.beginScope("trace rays");
+        pipeline.recordTraceRays(encoder.buffer, tile.extent);
+        encoder.endScope(scope, tile.extent.width * tile.extent.height); // camera rays
+
+        // if not last invocation, need barrier cuz we write to images
+        if (sample_count != spp) sensor.recordCaptureBarrier(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true });
+        sensor.sample_count += 1;
+
+        if (recordConvergenceUpdate(convergence, encoder, sensor, tile, .{ .ray_tracing_shader_bit_khr = true }, noise_threshold)) {
+            pipeline.recordBindPipeline(encoder.buffer);
+            pipeline.recordBindAdditionalDescriptorSets(encoder.buffer, .{ scene.world.materials.textures.descriptor_set, scene.world.constant_specta.descriptor_set });
+            pipeline.recordPushDescriptors(encoder.buffer, scene.pushDescriptors(0, 0));
+        }
+    }
+
+    // copy our stuff
+    sensor.recordPrepareForCopy(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{ .copy_bit = true });
+}
+
+// lets the host record the next chunk of wavefront bounces while the device runs the one before,
+// by taking turns with the encoder of the device
+const ChunkSubmits = struct {
+    submitted: Encoder, // swapped with the encoder being recorded into on every submit
+    submitted_fence: vk.Fence,
+    recording_fence: vk.Fence, // signalled once what is being recorded now has been submitted and run
+    pending: bool = false, // whether `submitted` may still be running
+
+    fn create(vc: *const VulkanContext, profiler: *Profiler) !ChunkSubmits {
+        var submitted = try Encoder.create(vc, "chunk");
+        errdefer submitted.destroy(vc);
+        submitted.profiler = profiler;
+
+        const submitted_fence = try vc.device.createFence(&.{}, null);
+        errdefer vc.device.destroyFence(submitted_fence, null);
+
+        const recording_fence = try vc.device.createFence(&.{}, null);
+        errdefer vc.device.destroyFence(recording_fence, null);
+
+        return ChunkSubmits {
+            .submitted = submitted,
+            .submitted_fence = submitted_fence,
+            .recording_fence = recording_fence,
+        };
+    }
+
+    // submits `encoder` and begins recording into the encoder submitted before it, once the device is done with that
+    // so the host only waits on a submit once the one after it is queued up
+    fn submitAndBeginNext(self: *ChunkSubmits, vc: *const VulkanContext, encoder: *Encoder, profiler: *Profiler) !void {
+        try encoder.submit(vc.queue, .{ .fence = self.recording_fence });
+        std.mem.swap(Encoder, encoder, &self.submitted);
+        std.mem.swap(vk.Fence, &self.recording_fence, &self.submitted_fence);
+
+        if (self.pending) try waitAndReset(vc, encoder, self.recording_fence);
+        self.pending = true;
+        _ = try profiler.resolve(vc);
+        try encoder.begin();
+    }
+
+    // waits for the last submit, so nothing is left running
+    fn finish(self: *ChunkSubmits, vc: *const VulkanContext) !void {
+        if (!self.pending) return;
+        try waitAndReset(vc, &self.submitted, self.submitted_fence);
+        self.pending = false;
+    }
+
+    fn waitAndReset(vc: *const VulkanContext, encoder: *Encoder, fence: vk.Fence) !void {
+        _ = try vc.device.waitForFences(1, @ptrCast(&fence), vk.TRUE, std.math.maxInt(u64));
+        try vc.device.resetFences(1, @ptrCast(&fence));
+        try vc.device.resetCommandPool(encoder.pool, .{});
+        encoder.clearResources(vc);
+    }
+
+    // must not be pending
+    fn destroy(self: *ChunkSubmits, vc: *const VulkanContext) void {
+        vc.device.destroyFence(self.recording_fence, null);
+        vc.device.destroyFence(self.submitted_fence, null);
+        self.submitted.destroy(vc);
+    }
+};
+
+// submits in between chunks of bounces without waiting on them, and leaves recording open for the caller to submit
+//
+// whether paths are left after a chunk is only known once the chunk after it has been submitted,
+// so when there are none, that chunk runs for nothing, but its empty launches are cheap
+fn recordWavefront(wavefront: *Wavefront, submits: *ChunkSubmits, convergence: ?*const Convergence, vc: *const VulkanContext, encoder: *Encoder, profiler: *Profiler, scene: *Scene, tile: Tile, spp: u32, noise_threshold: f32) !void {
+    const sensor = &scene.camera.sensors.items[0];
+    const bindings = scene.pushDescriptors(0, 0);
+    const sets = [2]vk.DescriptorSet { scene.world.materials.textures.descriptor_set, scene.world.constant_specta.descriptor_set };
+
+    // prepare our stuff
+    sensor.recordPrepareForCapture(encoder.buffer, .{ .compute_shader_bit = true, .ray_tracing_shader_bit_khr = true }, .{});
+
+    // each sample is made visible to the next by the barriers within it
+    for (0..spp) |_| {
+        // all stages of a sample, so that rays per second compare to the megakernel
+        // scopes cannot span submits, so there is one per chunk, merged by name
+        var camera_rays = @as(u64, tile.extent.width) * tile.extent.height; // counted in the first scope
+        var scope = encoder.beginScope("trace rays");
+        try wavefront.recordBeginSample(vc, encoder, bindings, sets, scene.camera.lenses.items[0], sensor, tile.region, tile.extent);
+        var next_bounce: ?u32 = 0;
+        var checked_bounce: ?u32 = null; // start of the chunk submitted last, whose path count is known once the one after it is submitted
+        while (next_bounce) |first_bounce| {
+            next_bounce = wavefront.recordBounces(vc, encoder, bindings, sets, first_bounce);
+            if (next_bounce == null) break;
+
+            encoder.endScope(scope, camera_rays);
+            camera_rays = 0;
+            try submits.submitAndBeginNext(vc, encoder, profiler);
+            scope = encoder.beginScope("trace rays");
+
+            // the chunk before the one just submitted is done now
+            if (checked_bounce) |bounce| {
+                if (wavefront.livePathCount(bounce) == 0) break;
+            }
+            checked_bounce = next_bounce;
+        }
+        wavefront.recordEndSample(encoder, bindings, sets, sensor, tile.extent);
+        encoder.endScope(scope, camera_rays);
+        sensor.sample_count += 1;
+
+        // every stage binds its own pipeline anyway
+        _ = recordConvergenceUpdate(convergence, encoder, sensor, tile, .{ .compute_shader_bit = true, .ray_tracing_shader_bit_khr = true }, noise_threshold);
+    }
+
+    // copy our stuff
+    sensor.recordPrepareForCopy(encoder.buffer, .{ .compute_shader_bit = true }, .{ .copy_bit = true });
+
+    // the caller idles after its submit anyway, so this only costs
+    // as much as the megakernel waiting on every submit
+    try submits.finish(vc);
+}
+
+const max_device_count = 16;
+
+// hands out tiles of the image in order, to whichever device asks first
+const TileQueue = struct {
+    next: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+    tile_extent: vk.Extent2D,
+    image_extent: vk.Extent2D,
+
+    fn columnCount(self: *const TileQueue) u32 {
+        return std.math.divCeil(u32, self.image_extent.width, self.tile_extent.width) catch unreachable;
+    }
+
+    fn tileCount(self: *const TileQueue) u32 {
+        return self.columnCount() * (std.math.divCeil(u32, self.image_extent.height, self.tile_extent.height) catch unreachable);
+    }
+
+    fn pop(self: *TileQueue) ?Tile {
+        const index = self.next.fetchAdd(1, .monotonic);
+        if (index >= self.tileCount()) return null;
+
+        const x = (index % self.columnCount()) * self.tile_extent.width;
+        const y = (index / self.columnCount()) * self.tile_extent.height;
+        return Tile {
+            .region = .{
+                .offset = .{ .x = @intCast(x), .y = @intCast(y) },
+                .image_extent = self.image_extent,
+            },
+            .extent = .{
+                .width = @min(self.tile_extent.width, self.image_extent.width - x),
+                .height = @min(self.tile_extent.height, self.image_extent.height - y),
+            },
+        };
+    }
+};
+
+// everything one device needs to render, each having its own copy of the scene
+const Device = struct {
+    context: VulkanContext,
+    encoder: Encoder,
+    profiler: *Profiler, // owned, as the encoder points to it and devices get moved around
+    scene: Scene,
+
+    pipeline: ?Pipeline,
+    wavefront: ?Wavefront,
+    chunk_submits: ?ChunkSubmits, // along with the wavefront
+    convergence: ?Convergence,
+
+    output_buffer: core.mem.DownloadBuffer([4]f32),
+
+    scene_lens: Lens, // from the scene file, for jobs that don't bring their own
+
+    fn create(allocator: std.mem.Allocator, context: VulkanContext, config: Config, sensor_extent: vk.Extent2D, logger: *IntervalLogger) !Device {
+        var encoder = try Encoder.create(&context, "main");
+        errdefer encoder.destroy(&context);
+
+        const profiler = try allocator.create(Profiler);
+        errdefer allocator.destroy(profiler);
+        profiler.* = try Profiler.create(&context);
+        errdefer profiler.destroy(&context);
+        encoder.profiler = profiler;
+
+        try encoder.begin();
+        var scene = try Scene.fromGltfExr(&context, allocator, &encoder, config.in_filepath, config.skybox_filepath, sensor_extent);
+        errdefer scene.destroy(&context, allocator);
+        try encoder.submitAndIdleUntilDone(&context);
+
+        try logger.log("load world");
+
+        // BLAS compacted sizes are known now that loading is done
+        try encoder.begin();
+        try scene.world.accel.recordCommit(&context, allocator, &encoder, scene.world.meshes, scene.world.materials);
+        try encoder.submitAndIdleUntilDone(&context);
+
+        try logger.log("compact world");
+
+        const constants = Pipeline.SpecConstants {
+            .max_bounces = 1024,
+            .env_samples_per_bounce = 1,
+            .mesh_samples_per_bounce = 1,
+        };
+        const additional_descriptor_layouts = .{ scene.world.materials.textures.descriptor_layout.handle, scene.world.constant_specta.descriptor_layout.handle };
+
+        try encoder.begin();
+        var pipeline: ?Pipeline = if (config.integrator == .megakernel) try Pipeline.create(&context, allocator, &encoder, additional_descriptor_layouts, constants, .{ scene.background.sampler }) else null;
+        errdefer if (pipeline) |*p| p.destroy(&context);
+        var wavefront: ?Wavefront = if (config.integrator == .wavefront) try Wavefront.create(&context, allocator, &encoder, additional_descriptor_layouts, constants, scene.background.sampler) else null;
+        errdefer if (wavefront) |*w| w.destroy(&context);
+        var chunk_submits: ?ChunkSubmits = if (wavefront != null) try ChunkSubmits.create(&context, profiler) else null;
+        errdefer if (chunk_submits) |*c| c.destroy(&context);
+        var convergence: ?Convergence = if (config.noise_threshold != 0) try Convergence.create(&context, allocator) else null;
+        errdefer if (convergence) |*c| c.destroy(&context);
+        try encoder.submitAndIdleUntilDone(&context);
+        _ = try profiler.resolve(&context);
+
+        try logger.log("create pipeline");
+        context.savePipelineCache(allocator); // long renders may well be killed before they finish
+
+        const output_buffer = try core.mem.DownloadBuffer([4]f32).create(&context, sensor_extent.width * sensor_extent.height, "output");
+        errdefer output_buffer.destroy(&context);
+
+        return Device {
+            .context = context,
+            .encoder = encoder,
+            .profiler = profiler,
+            .scene = scene,
+            .pipeline = pipeline,
+            .wavefront = wavefront,
+            .chunk_submits = chunk_submits,
+            .convergence = convergence,
+            .output_buffer = output_buffer,
+            .scene_lens = scene.camera.lenses.items[0],
+        };
+    }
+
+    // renders tiles from `tiles` into `output_image` until there are none left
+    fn renderTiles(self: *Device, config: Config, tiles: *TileQueue, output_image: *exr.helpers.Rgb2D) !void {
+        const sensor = &self.scene.camera.sensors.items[0];
+        while (tiles.pop()) |tile| {
+            sensor.clear();
+            while (sensor.sample_count < config.spp) {
+                try self.encoder.begin();
+
+                const sample_count = @min(samples_per_submit, config.spp - sensor.sample_count);
+                switch (config.integrator) {
+                    .megakernel => recordMegakernel(&self.pipeline.?, if (self.convergence) |*c| c else null, &self.encoder, &self.scene, tile, sample_count, config.noise_threshold),
+                    .wavefront => try recordWavefront(&self.wavefront.?, &self.chunk_submits.?, if (self.convergence) |*c| c else null, &self.context, &self.encoder, self.profiler, &self.scene, tile, sample_count, config.noise_threshold),
+                }
+
+                // copy rendered tile to host-visible staging buffer
+                if (sensor.sample_count == config.spp) {
+                    const scope = self.encoder.beginScope("readback");
+                    self.encoder.copyImageToBuffer(sensor.image.handle, .transfer_src_optimal, tile.extent, self.output_buffer.handle);
+                    self.encoder.endScope(scope, @as(u64, tile.extent.width) * tile.extent.height * @sizeOf([4]f32)); // bytes
+                }
+
+                try self.encoder.submitAndIdleUntilDone(&self.context);
+                _ = try self.profiler.resolve(&self.context);
+            }
+
+            // tiles don't overlap, so devices never write the same pixels
+            output_image.writeRegion(tile.region.offset, exr.helpers.Rgba2D { .ptr = self.output_buffer.slice.ptr, .extent = tile.extent });
+        }
+    }
+
+    fn renderTilesReportingErrors(self: *Device, config: Config, tiles: *TileQueue, output_image: *exr.helpers.Rgb2D, result: *anyerror!void) void {
+        result.* = self.renderTiles(config, tiles, output_image);
+    }
+
+    fn destroy(self: *Device, allocator: std.mem.Allocator) void {
+        self.output_buffer.destroy(&self.context);
+        if (self.convergence) |*c| c.destroy(&self.context);
+        if (self.chunk_submits) |*c| c.destroy(&self.context);
+        if (self.wavefront) |*w| w.destroy(&self.context);
+        if (self.pipeline) |*p| p.destroy(&self.context);
+        self.scene.destroy(&self.context, allocator);
+        self.profiler.destroy(&self.context);
+        allocator.destroy(self.profiler);
+        self.encoder.destroy(&self.context);
+        self.context.destroy(allocator);
+    }
+};
+
 pub const required_vulkan_functions = engine.hrtsystem.required_vulkan_functions;
 
 pub fn main() !void {
@@ -86,96 +541,133 @@ pub fn main() !void {
     const config = try Config.fromCli(allocator);
     defer config.destroy(allocator);
 
-    const context = try VulkanContext.create(allocator, "offline", &.{}, &engine.hrtsystem.required_device_extensions, &engine.hrtsystem.required_device_features, null);
-    defer context.destroy(allocator);
+    // the sensor only captures one tile at a time
+    const sensor_extent = vk.Extent2D {
+        .width = @min(config.extent.width, config.tile_size),
+        .height = @min(config.extent.height, config.tile_size),
+    };
+
+    var devices = std.ArrayListUnmanaged(Device) {};
+    defer devices.deinit(allocator);
+    defer for (devices.items) |*device| device.destroy(allocator);
+
+    while (devices.items.len < if (config.device_count == 0) max_device_count else config.device_count) {
+        const device_index: u32 = @intCast(devices.items.len);
+        const context = VulkanContext.createOnDevice(allocator, "offline", &.{}, &engine.hrtsystem.required_device_extensions, &engine.hrtsystem.optional_device_extensions, &engine.hrtsystem.required_device_features, null, device_index) catch |err| {
+            // all suitable devices are in use
+            if (err == error.UnavailableDevices and config.device_count == 0 and device_index != 0) break;
+            return err;
+        };
+        errdefer context.destroy(allocator);
 
-    var encoder = try Encoder.create(&context, "main");
-    defer encoder.destroy(&context);
+        try logger.log("set up initial state");
 
-    try logger.log("set up initial state");
+        try devices.ensureUnusedCapacity(allocator, 1);
+        devices.appendAssumeCapacity(try Device.create(allocator, context, config, sensor_extent, &logger));
+    }
 
-    try encoder.begin();
-    var scene = try Scene.fromGltfExr(&context, allocator, &encoder, config.in_filepath, config.skybox_filepath, config.extent);
-    defer scene.destroy(&context, allocator);
-    try encoder.submitAndIdleUntilDone(&context);
+    // one job, unless reading them from stdin
+    const batch = std.mem.eql(u8, config.out_filepath, "-");
+    var stdin_buffer = std.io.bufferedReader(std.io.getStdIn().reader());
+    const stdin = stdin_buffer.reader();
+
+    // finished tiles are gathered here until the whole image can be written out,
+    // with two of them so one can render while the other is written
+    var output_images: [2]OutputImage = undefined;
+    output_images[0] = .{ .image = try exr.helpers.Rgb2D.create(allocator, config.extent) };
+    defer output_images[0].image.destroy(allocator);
+    output_images[1] = .{ .image = try exr.helpers.Rgb2D.create(allocator, config.extent) };
+    defer output_images[1].image.destroy(allocator);
+    defer for (&output_images) |*output_image| output_image.finishWrite() catch {};
+
+    var job_index: usize = 0;
+    while (true) : (job_index += 1) {
+        const job = if (batch) blk: {
+            const line = try stdin.readUntilDelimiterOrEofAlloc(allocator, '\n', 4096) orelse break;
+            defer allocator.free(line);
+            const trimmed = std.mem.trim(u8, line, " \t\r");
+            if (trimmed.len == 0 or trimmed[0] == '#') continue;
+            break :blk try Job.parse(allocator, trimmed);
+        } else if (job_index == 0) Job {
+            .out_filepath = try allocator.dupe(u8, config.out_filepath),
+            .lens = null,
+        } else break;
+
+        const output_image = &output_images[job_index % output_images.len];
+        output_image.finishWrite() catch |err| {
+            allocator.free(job.out_filepath);
+            return err;
+        };
 
-    try logger.log("load world");
+        renderImage(devices.items, config, job.lens, &output_image.image) catch |err| {
+            allocator.free(job.out_filepath);
+            return err;
+        };
 
-    try encoder.begin();
-    var pipeline = try Pipeline.create(&context, allocator, &encoder, .{ scene.world.materials.textures.descriptor_layout.handle, scene.world.constant_specta.descriptor_layout.handle }, .{
-        .max_bounces = 1024,
-        .env_samples_per_bounce = 1,
-        .mesh_samples_per_bounce = 1,
-    }, .{ scene.background.sampler });
-    defer pipeline.destroy(&context);
-    try encoder.submitAndIdleUntilDone(&context);
+        // now done with GPU stuff for this image; can write out to exr
+        try output_image.startWrite(allocator, job.out_filepath);
 
-    try logger.log("create pipeline");
+        try logger.log("render");
+    }
 
-    const output_buffer = try core.mem.DownloadBuffer([4]f32).create(&context, scene.camera.sensors.items[0].extent.width * scene.camera.sensors.items[0].extent.height, "output");
-    defer output_buffer.destroy(&context);
+    for (&output_images) |*output_image| try output_image.finishWrite();
 
-    // actual ray tracing
-    {
-        try encoder.begin();
+    try logger.log("write exr");
 
-        // prepare our stuff
-        scene.camera.sensors.items[0].recordPrepareForCapture(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{});
-
-        // bind our stuff
-        pipeline.recordBindPipeline(encoder.buffer);
-        pipeline.recordBindAdditionalDescriptorSets(encoder.buffer, .{ scene.world.materials.textures.descriptor_set, scene.world.constant_specta.descriptor_set });
-        pipeline.recordPushDescriptors(encoder.buffer, scene.pushDescriptors(0, 0));
-
-        for (0..config.spp) |sample_count| {
-            // push our stuff
-            pipeline.recordPushConstants(encoder.buffer, .{ .lens = scene.camera.lenses.items[0], .sample_count = scene.camera.sensors.items[0].sample_count });
-
-            // trace our stuff
-            pipeline.recordTraceRays(encoder.buffer, scene.camera.sensors.items[0].extent);
-
-            // if not last invocation, need barrier cuz we write to images
-            if (sample_count != config.spp) {
-                encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-                    .image_memory_barrier_count = 1,
-                    .p_image_memory_barriers = &[_]vk.ImageMemoryBarrier2 {
-                        .{
-                            .src_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-                            .src_access_mask = if (sample_count == 0) .{ .shader_storage_write_bit = true } else .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
-                            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-                            .dst_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
-                            .old_layout = .general,
-                            .new_layout = .general,
-                            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                            .image = scene.camera.sensors.items[0].image.handle,
-                            .subresource_range = .{
-                                .aspect_mask = .{ .color_bit = true },
-                                .base_mip_level = 0,
-                                .level_count = 1,
-                                .base_array_layer = 0,
-                                .layer_count = vk.REMAINING_ARRAY_LAYERS,
-                            },
-                        }
-                    },
-                });
-            }
-            scene.camera.sensors.items[0].sample_count += 1;
+    if (config.stats_filepath) |path| try writeStats(devices.items, path);
+}
+
+// device time of profiled scopes over the whole run, per device
+fn writeStats(devices: []const Device, path: []const u8) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+    var buffered = std.io.bufferedWriter(file.writer());
+
+    var json = std.json.writeStream(buffered.writer(), .{ .whitespace = .indent_2 });
+    try json.beginObject();
+    try json.objectField("devices");
+    try json.beginArray();
+    for (devices) |device| {
+        try json.beginArray();
+        for (device.profiler.totals.slice()) |stat| {
+            try json.write(.{
+                .name = stat.name,
+                .duration_ms = stat.duration_ns / std.time.ns_per_ms,
+                .count = stat.count,
+                .work = stat.work,
+                .throughput = stat.throughput(), // work per second, e.g., rays per second of "trace rays"
+            });
         }
+        try json.endArray();
+    }
+    try json.endArray();
+    try json.endObject();
 
-        // copy our stuff
-        scene.camera.sensors.items[0].recordPrepareForCopy(encoder.buffer, .{ .ray_tracing_shader_bit_khr = true }, .{ .copy_bit = true });
+    try buffered.flush();
+}
 
-        // copy rendered image to host-visible staging buffer
-        encoder.copyImageToBuffer(scene.camera.sensors.items[0].image.handle, .transfer_src_optimal, scene.camera.sensors.items[0].extent, output_buffer.handle);
+// renders an image from `lens` or that of the scene, across all `devices`
+fn renderImage(devices: []Device, config: Config, lens: ?Lens, output_image: *exr.helpers.Rgb2D) !void {
+    for (devices) |*device| device.scene.camera.lenses.items[0] = lens orelse device.scene_lens;
 
-        try encoder.submitAndIdleUntilDone(&context);
-    }
+    var tiles = TileQueue {
+        .tile_extent = devices[0].scene.camera.sensors.items[0].extent,
+        .image_extent = config.extent,
+    };
 
-    try logger.log("render");
+    var results: [max_device_count]anyerror!void = undefined;
+    var threads: [max_device_count - 1]std.Thread = undefined;
 
-    // now done with GPU stuff/all rendering; can write from output buffer to exr
-    try exr.helpers.Rgba2D.save(exr.helpers.Rgba2D { .ptr = output_buffer.slice.ptr, .extent = scene.camera.sensors.items[0].extent }, allocator, config.out_filepath);
+    // the first device renders on this thread
+    var spawned: usize = 0;
+    defer for (threads[0..spawned]) |thread| thread.join();
+    for (threads[0..devices.len - 1], devices[1..], results[1..devices.len]) |*thread, *device, *result| {
+        thread.* = try std.Thread.spawn(.{}, Device.renderTilesReportingErrors, .{ device, config, &tiles, output_image, result });
+        spawned += 1;
+    }
+    devices[0].renderTilesReportingErrors(config, &tiles, output_image, &results[0]);
 
-    try logger.log("write exr");
+    for (threads[0..spawned]) |thread| thread.join();
+    spawned = 0;
+    for (results[0..devices.len]) |result| try result;
 }
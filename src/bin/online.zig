@@ -8,6 +8,7 @@ const Encoder = core.Encoder;
 const DestructionQueue = core.DestructionQueue;
 const vk_helpers = core.vk_helpers;
 const SyncCopier = core.SyncCopier;
+const Profiler = core.Profiler;
 const TextureManager = core.Images.TextureManager;
 
 const hrtsystem = engine.hrtsystem;
@@ -140,7 +141,10 @@ const Integrator = struct {
                 integrator.recordPushConstants(encoder.buffer, .{ .lens = scene.camera.lenses.items[0], .sample_count = scene.camera.sensors.items[active_sensor].sample_count });
 
                 // trace some stuff
-                integrator.recordTraceRays(encoder.buffer, scene.camera.sensors.items[active_sensor].extent);
+                const extent = scene.camera.sensors.items[active_sensor].extent;
+                const scope = encoder.beginScope("trace rays");
+                integrator.recordTraceRays(encoder.buffer, extent);
+                encoder.endScope(scope, extent.width * extent.height); // camera rays
                 break;
             }
         } else unreachable;
@@ -179,7 +183,7 @@ pub fn main() !void {
     const window = try Window.create(config.extent.width, config.extent.height, "online");
     defer window.destroy();
 
-    const context = try VulkanContext.create(allocator, "online", &window.getRequiredInstanceExtensions(), &(displaysystem.required_device_extensions ++ hrtsystem.required_device_extensions), &hrtsystem.required_device_features, queueFamilyAcceptable);
+    const context = try VulkanContext.create(allocator, "online", &window.getRequiredInstanceExtensions(), &(displaysystem.required_device_extensions ++ hrtsystem.required_device_extensions), &hrtsystem.optional_device_extensions, &hrtsystem.required_device_features, queueFamilyAcceptable);
     defer context.destroy(allocator);
 
     const window_extent = window.getExtent();
@@ -192,6 +196,11 @@ pub fn main() !void {
     var sync_copier = try SyncCopier.create(&context, @sizeOf(vk.AccelerationStructureInstanceKHR));
     defer sync_copier.destroy(&context);
 
+    // only frames are profiled, as a profiler may only be recorded into by one encoder at a time
+    var profiler = try Profiler.create(&context);
+    defer profiler.destroy(&context);
+    for (&display.frames) |*frame| frame.encoder.profiler = &profiler;
+
     std.log.info("Set up initial state!", .{});
 
     try encoder.begin();
@@ -203,6 +212,9 @@ pub fn main() !void {
 
     try encoder.begin();
 
+    // BLAS compacted sizes are known now that loading is done
+    try scene.world.accel.recordCommit(&context, allocator, &encoder, scene.world.meshes, scene.world.materials);
+
     var object_picker = try ObjectPicker.create(&context, allocator, &encoder);
     defer object_picker.destroy(&context);
 
@@ -215,6 +227,7 @@ pub fn main() !void {
     try encoder.submitAndIdleUntilDone(&context);
 
     std.log.info("Created pipelines!", .{});
+    context.savePipelineCache(allocator);
 
     // random state we need for gui
     var active_sensor: u32 = 0;
@@ -247,6 +260,13 @@ pub fn main() !void {
         if (imgui.collapsingHeader("Metrics", imgui.ImGuiTreeNodeFlags_DefaultOpen)) {
             try imgui.textFmt("Last frame time: {d:.3}ms", .{display.last_frame_time_ns / std.time.ns_per_ms});
             try imgui.textFmt("Framerate: {d:.2} FPS", .{imgui.getIO().Framerate});
+            const memory_stats = context.memory_allocator.getStats();
+            try imgui.textFmt("Memory blocks: {} ({d:.1} MiB, {d:.1} MiB used by {} allocations)", .{ memory_stats.block_count, @as(f64, @floatFromInt(memory_stats.block_bytes)) / (1024 * 1024), @as(f64, @floatFromInt(memory_stats.allocated_bytes)) / (1024 * 1024), memory_stats.allocation_count });
+            try imgui.textFmt("Dedicated memory: {} ({d:.1} MiB)", .{ memory_stats.dedicated_count, @as(f64, @floatFromInt(memory_stats.dedicated_bytes)) / (1024 * 1024) });
+            if (profiler.latest.get("trace rays")) |trace| try imgui.textFmt("Rays per second: {d:.1}M", .{trace.throughput() / 1e6});
+        }
+        if (imgui.collapsingHeader("Profiler", imgui.ImGuiTreeNodeFlags_None)) {
+            for (profiler.latest.slice()) |stat| try imgui.textFmt("{s}: {d:.3}ms", .{ stat.name, stat.duration_ns / std.time.ns_per_ms });
         }
         if (imgui.collapsingHeader("Sensor", imgui.ImGuiTreeNodeFlags_None)) {
             if (imgui.button("Reset", imgui.Vec2{ .x = imgui.getContentRegionAvail().x - imgui.getFontSize() * 10, .y = 0 })) {
@@ -319,21 +339,21 @@ pub fn main() !void {
                 try imgui.textFmt("Instance index: {d}", .{object.instance_index});
                 try imgui.textFmt("Geometry index: {d}", .{object.geometry_index});
                 // TODO: all of the copying below should be done once, on object pick
-                const instance = try sync_copier.copyBufferItem(&context, vk.AccelerationStructureInstanceKHR, scene.world.accel.instances_device.handle, object.instance_index);
+                const instance = try sync_copier.copyBufferItem(&context, vk.AccelerationStructureInstanceKHR, scene.world.accel.instances_device.buffer.handle, object.instance_index);
                 const accel_geometry_index = instance.instance_custom_index_and_mask.instance_custom_index + object.geometry_index;
-                var geometry = try sync_copier.copyBufferItem(&context, Accel.Geometry, scene.world.accel.geometries.handle, accel_geometry_index);
-                const material = try sync_copier.copyBufferItem(&context, MaterialManager.GpuMaterial, scene.world.materials.materials.handle, geometry.material);
+                var geometry = try sync_copier.copyBufferItem(&context, Accel.Geometry, scene.world.accel.geometries.buffer.handle, accel_geometry_index);
+                const material = try sync_copier.copyBufferItem(&context, MaterialManager.GpuMaterial, scene.world.materials.materials.buffer.handle, geometry.material);
                 try imgui.textFmt("Mesh index: {d}", .{geometry.mesh});
                 if (imgui.inputScalar(u32, "Material index", &geometry.material, null, null) and geometry.material < scene.world.materials.material_count) {
-                    scene.world.accel.recordUpdateSingleMaterial(frame_encoder.buffer, accel_geometry_index, geometry.material);
+                    try scene.world.accel.recordUpdateSingleMaterial(allocator, frame_encoder.buffer, object.instance_index, object.geometry_index, geometry.material);
                     scene.camera.sensors.items[active_sensor].clear();
                 }
                 imgui.separatorText("mesh");
                 const mesh = scene.world.meshes.meshes.get(geometry.mesh);
                 try imgui.textFmt("Vertex count: {d}", .{mesh.vertex_count});
                 try imgui.textFmt("Index count: {d}", .{mesh.index_count});
-                try imgui.textFmt("Has texcoords: {}", .{!mesh.texcoord_buffer.isNull()});
-                try imgui.textFmt("Has normals: {}", .{!mesh.normal_buffer.isNull()});
+                try imgui.textFmt("Has texcoords: {}", .{mesh.hasTexcoords()});
+                try imgui.textFmt("Has normals: {}", .{mesh.hasNormals()});
                 imgui.separatorText("material");
                 try imgui.textFmt("normal: {}", .{material.normal});
                 try imgui.textFmt("emissive: {}", .{material.emissive});
@@ -342,11 +362,11 @@ pub fn main() !void {
                     const VariantType = union_field.type;
                     if (VariantType != void and enum_field.value == @intFromEnum(material.type)) {
                         const material_idx: u32 = @intCast((material.addr - @field(scene.world.materials.variant_buffers, enum_field.name).addr) / @sizeOf(VariantType));
-                        var material_variant = try sync_copier.copyBufferItem(&context, VariantType, @field(scene.world.materials.variant_buffers, enum_field.name).buffer.handle, material_idx);
+                        var material_variant = try sync_copier.copyBufferItem(&context, VariantType, @field(scene.world.materials.variant_buffers, enum_field.name).buffer.buffer.handle, material_idx);
                         inline for (@typeInfo(VariantType).@"struct".fields) |struct_field| {
                             switch (struct_field.type) {
                                 f32 => if (imgui.dragScalar(f32, (struct_field.name[0..struct_field.name.len].* ++ .{ 0 })[0..struct_field.name.len :0], &@field(material_variant, struct_field.name), 0.01, 0, std.math.inf(f32))) {
-                                    scene.world.materials.recordUpdateSingleVariant(VariantType, frame_encoder.buffer, material_idx, material_variant);
+                                    try scene.world.materials.recordUpdateSingleVariant(VariantType, allocator, frame_encoder, material_idx, material_variant);
                                     scene.camera.sensors.items[active_sensor].clear();
                                 },
                                 u32 => try imgui.textFmt("{s}: {}", .{ struct_field.name, @field(material_variant, struct_field.name) }),
@@ -521,6 +541,8 @@ pub fn main() !void {
             active_sensor = try scene.camera.appendSensor(&context, allocator, new_extent);
         } else return err;
 
+        _ = try profiler.resolve(&context);
+
         window.pollEvents();
     }
     try context.device.deviceWaitIdle();
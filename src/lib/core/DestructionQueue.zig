@@ -4,6 +4,7 @@ const vk = @import("vulkan");
 const core = @import("./core.zig");
 const VulkanContext = core.VulkanContext;
 const DeviceBuffer = core.Allocator.DeviceBuffer;
+const MemoryAllocator = core.MemoryAllocator;
 
 // type erased Vulkan object
 const Destruction = struct {
@@ -20,6 +21,8 @@ const Destruction = struct {
             .image => vc.device.destroyImage(@enumFromInt(self.destroyee), null),
             .device_memory => vc.device.freeMemory(@enumFromInt(self.destroyee), null),
             .acceleration_structure_khr => vc.device.destroyAccelerationStructureKHR(@enumFromInt(self.destroyee), null),
+            .descriptor_pool => vc.device.destroyDescriptorPool(@enumFromInt(self.destroyee), null),
+            .query_pool => vc.device.destroyQueryPool(@enumFromInt(self.destroyee), null),
             else => unreachable, // TODO
         }
     }
@@ -28,13 +31,18 @@ const Destruction = struct {
 // TODO: this should be an SoA type of thing like list((tag, list(union)))
 queue: std.ArrayListUnmanaged(Destruction) = .{},
 
+// memory is given back after everything is destroyed, as it may be bound to objects in queue
+allocations: std.ArrayListUnmanaged(MemoryAllocator.Allocation) = .{},
+
 const Self = @This();
 
 // works on any type exclusively made up of Vulkan objects
 pub fn append(self: *Self, allocator: std.mem.Allocator, item: anytype) !void {
     const T = @TypeOf(item);
 
-    if (comptime @typeInfo(T) == .@"struct") {
+    if (T == MemoryAllocator.Allocation) {
+        try self.allocations.append(allocator, item);
+    } else if (comptime @typeInfo(T) == .@"struct") {
         inline for (@typeInfo(T).@"struct".fields) |field| {
             if (field.type != void) {
                 try self.append(allocator, @field(item, field.name));
@@ -51,9 +59,12 @@ pub fn append(self: *Self, allocator: std.mem.Allocator, item: anytype) !void {
 pub fn clear(self: *Self, vc: *const VulkanContext) void {
     for (self.queue.items) |*item| item.destroy(vc);
     self.queue.clearRetainingCapacity();
+    for (self.allocations.items) |allocation| vc.memory_allocator.free(allocation);
+    self.allocations.clearRetainingCapacity();
 }
 
 pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
     self.clear(vc);
     self.queue.deinit(allocator);
+    self.allocations.deinit(allocator);
 }
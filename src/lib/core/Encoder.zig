@@ -15,6 +15,7 @@ buffer: VulkanContext.CommandBuffer,
 destruction_queue: core.DestructionQueue, // use the page allocator for this for now -- the idea that you probably will either want to destroy zero or many
 upload_allocator: core.mem.UploadPageAllocator,
 upload_arena: std.heap.ArenaAllocator, // can't use State as we want to return the allocator but maintain a reference to it
+profiler: ?*core.Profiler = null, // if set, scopes of this encoder are timed
 
 const Self = @This();
 
@@ -79,22 +80,55 @@ pub fn begin(self: Self) !void {
             .one_time_submit_bit = true,
         },
     });
+    if (self.profiler) |profiler| profiler.recordBeginCommands(self.buffer);
 }
 
-// submit recorded work
-pub fn submit(self: Self, queue: VulkanContext.Queue, sync: struct {
+// times the commands recorded until the matching endScope, if profiled
+pub fn beginScope(self: *const Self, name: [:0]const u8) ?core.Profiler.Scope {
+    const profiler = self.profiler orelse return null;
+    return profiler.recordBegin(self.buffer, name);
+}
+
+// `work` is whatever the throughput of the scope should be measured in, e.g., rays traced
+pub fn endScope(self: *const Self, scope: ?core.Profiler.Scope, work: u64) void {
+    const profiler = self.profiler orelse return;
+    profiler.recordEnd(self.buffer, scope, work);
+}
+
+pub const SubmitSync = struct {
     wait_semaphore_infos: []const vk.SemaphoreSubmitInfoKHR = &.{},
     signal_semaphore_infos: []const vk.SemaphoreSubmitInfoKHR = &.{},
     fence: vk.Fence = .null_handle,
-}) !void {
+};
+
+// submit recorded work
+pub fn submit(self: Self, queue: VulkanContext.Queue, sync: SubmitSync) !void {
+    try self.submitAfter(queue, &.{}, sync);
+}
+
+// submit recorded work of `preceding` encoders followed by this one, all in one batch
+pub fn submitAfter(self: Self, queue: VulkanContext.Queue, preceding: []const *const Self, sync: SubmitSync) !void {
+    const max_command_buffers = 256;
+    std.debug.assert(preceding.len < max_command_buffers);
+
+    var command_buffer_infos: [max_command_buffers]vk.CommandBufferSubmitInfo = undefined;
+    for (preceding, command_buffer_infos[0..preceding.len]) |encoder, *info| {
+        try encoder.buffer.endCommandBuffer();
+        info.* = vk.CommandBufferSubmitInfo {
+            .command_buffer = encoder.buffer.handle,
+            .device_mask = 0,
+        };
+    }
+    if (self.profiler) |profiler| profiler.recordEndCommands(self.buffer);
     try self.buffer.endCommandBuffer();
+    command_buffer_infos[preceding.len] = vk.CommandBufferSubmitInfo {
+        .command_buffer = self.buffer.handle,
+        .device_mask = 0,
+    };
 
     const submit_info = vk.SubmitInfo2 {
-        .command_buffer_info_count = 1,
-        .p_command_buffer_infos = @ptrCast(&vk.CommandBufferSubmitInfo {
-            .command_buffer = self.buffer.handle,
-            .device_mask = 0,
-        }),
+        .command_buffer_info_count = @intCast(preceding.len + 1),
+        .p_command_buffer_infos = &command_buffer_infos,
         .wait_semaphore_info_count = @intCast(sync.wait_semaphore_infos.len),
         .p_wait_semaphore_infos = sync.wait_semaphore_infos.ptr,
         .signal_semaphore_info_count = @intCast(sync.signal_semaphore_infos.len),
@@ -102,6 +136,7 @@ pub fn submit(self: Self, queue: VulkanContext.Queue, sync: struct {
     };
 
     try queue.submit2(1, @ptrCast(&submit_info), sync.fence);
+    if (self.profiler) |profiler| profiler.markSubmitted();
 }
 
 pub fn submitAndIdleUntilDone(self: *Self, vc: *const VulkanContext) !void {
@@ -153,6 +188,74 @@ pub fn uploadDataToImage(self: Self, comptime T: type, src_data: core.mem.Buffer
     });
 }
 
+// `src_data` holds each mip level tightly packed one after the other, starting with the largest
+pub fn uploadMipsToImage(self: Self, src_data: core.mem.BufferSlice(u8), dst_image: vk.Image, format: vk.Format, dst_image_extent: vk.Extent2D, mip_level_count: u32, dst_layout: vk.ImageLayout) void {
+    std.debug.assert(mip_level_count <= 16);
+    const subresource_range = vk.ImageSubresourceRange {
+        .aspect_mask = .{ .color_bit = true },
+        .base_mip_level = 0,
+        .level_count = mip_level_count,
+        .base_array_layer = 0,
+        .layer_count = vk.REMAINING_ARRAY_LAYERS,
+    };
+    self.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .image_memory_barrier_count = 1,
+        .p_image_memory_barriers = @ptrCast(&vk.ImageMemoryBarrier2 {
+            .dst_stage_mask = .{ .copy_bit = true },
+            .dst_access_mask = .{ .transfer_write_bit = true },
+            .old_layout = .undefined,
+            .new_layout = .transfer_dst_optimal,
+            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+            .image = dst_image,
+            .subresource_range = subresource_range,
+        }),
+    });
+
+    var copies: [16]vk.BufferImageCopy = undefined;
+    var offset = src_data.offset;
+    for (copies[0..mip_level_count], 0..) |*copy, mip_level| {
+        const level_extent = vk_helpers.mipLevelExtent(dst_image_extent, @intCast(mip_level));
+        copy.* = vk.BufferImageCopy {
+            .buffer_offset = offset,
+            .buffer_row_length = 0,
+            .buffer_image_height = 0,
+            .image_subresource = .{
+                .aspect_mask = .{ .color_bit = true },
+                .mip_level = @intCast(mip_level),
+                .base_array_layer = 0,
+                .layer_count = 1,
+            },
+            .image_offset = .{
+                .x = 0,
+                .y = 0,
+                .z = 0,
+            },
+            .image_extent = .{
+                .width = level_extent.width,
+                .height = level_extent.height,
+                .depth = 1,
+            },
+        };
+        offset += vk_helpers.mipLevelSize(format, dst_image_extent, @intCast(mip_level));
+    }
+    self.buffer.copyBufferToImage(src_data.handle, dst_image, .transfer_dst_optimal, mip_level_count, &copies);
+
+    self.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .image_memory_barrier_count = 1,
+        .p_image_memory_barriers = @ptrCast(&vk.ImageMemoryBarrier2 {
+            .src_stage_mask = .{ .copy_bit = true },
+            .src_access_mask = .{ .transfer_write_bit = true },
+            .old_layout = .transfer_dst_optimal,
+            .new_layout = dst_layout,
+            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+            .image = dst_image,
+            .subresource_range = subresource_range,
+        }),
+    });
+}
+
 // buffers must have appropriate flags
 pub fn copyBuffer(self: Self, src: vk.Buffer, dst: vk.Buffer, regions: []const vk.BufferCopy) void {
     self.buffer.copyBuffer(src, dst, @intCast(regions.len), regions.ptr);
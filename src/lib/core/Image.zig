@@ -10,9 +10,14 @@ const Self = @This();
 
 handle: vk.Image,
 view: vk.ImageView,
-memory: vk.DeviceMemory,
+allocation: core.MemoryAllocator.Allocation,
 
 pub fn create(vc: *const VulkanContext, size: vk.Extent2D, usage: vk.ImageUsageFlags, format: vk.Format, with_mips: bool, name: [:0]const u8) !Self {
+    const mip_levels = if (with_mips) std.math.log2(@max(size.width, size.height)) + 1 else 1;
+    return createWithMipLevels(vc, size, usage, format, mip_levels, name);
+}
+
+pub fn createWithMipLevels(vc: *const VulkanContext, size: vk.Extent2D, usage: vk.ImageUsageFlags, format: vk.Format, mip_levels: u32, name: [:0]const u8) !Self {
     const extent = vk.Extent3D {
         .width = size.width,
         .height = size.height,
@@ -23,7 +28,7 @@ pub fn create(vc: *const VulkanContext, size: vk.Extent2D, usage: vk.ImageUsageF
         .image_type = if (extent.height == 1 and extent.width != 1) .@"1d" else .@"2d",
         .format = format,
         .extent = extent,
-        .mip_levels = if (with_mips) std.math.log2(@max(extent.width, extent.height, extent.depth)) + 1 else 1,
+        .mip_levels = mip_levels,
         .array_layers = 1,
         .samples = .{ .@"1_bit" = true },
         .tiling = .optimal,
@@ -40,13 +45,10 @@ pub fn create(vc: *const VulkanContext, size: vk.Extent2D, usage: vk.ImageUsageF
 
     const mem_requirements = vc.device.getImageMemoryRequirements(handle);
 
-    const memory = try vc.device.allocateMemory(&.{
-        .allocation_size = mem_requirements.size,
-        .memory_type_index = try vc.findMemoryType(mem_requirements.memory_type_bits, .{ .device_local_bit = true }),
-    }, null);
-    errdefer vc.device.freeMemory(memory, null);
+    const allocation = try vc.memory_allocator.allocate(mem_requirements, .{ .device_local_bit = true }, .image, name);
+    errdefer vc.memory_allocator.free(allocation);
 
-    try vc.device.bindImageMemory(handle, memory, 0);
+    try vc.device.bindImageMemory(handle, allocation.memory, allocation.offset);
 
     const view_create_info = vk.ImageViewCreateInfo {
         .flags = .{},
@@ -72,7 +74,7 @@ pub fn create(vc: *const VulkanContext, size: vk.Extent2D, usage: vk.ImageUsageF
     errdefer vc.device.destroyImageView(view, null);
 
     return Self {
-        .memory = memory,
+        .allocation = allocation,
         .handle = handle,
         .view = view,
     };
@@ -81,5 +83,5 @@ pub fn create(vc: *const VulkanContext, size: vk.Extent2D, usage: vk.ImageUsageF
 pub fn destroy(self: Self, vc: *const VulkanContext) void {
     vc.device.destroyImageView(self.view, null);
     vc.device.destroyImage(self.handle, null);
-    vc.device.freeMemory(self.memory, null);
+    vc.memory_allocator.free(self.allocation);
 }
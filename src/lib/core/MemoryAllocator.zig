@@ -0,0 +1,449 @@
+const std = @import("std");
+const vk = @import("vulkan");
+
+const core = @import("../engine.zig").core;
+const VulkanContext = core.VulkanContext;
+const vk_helpers = core.vk_helpers;
+
+// sub-allocates device memory out of large blocks, so that the number of
+// vkAllocateMemory calls stays well below maxMemoryAllocationCount and their
+// per-allocation overhead is paid rarely
+//
+// each memory type has one pool for buffers and one for optimally tiled images,
+// so that bufferImageGranularity never has to be considered. free space within a
+// pool is binned in a two-level segregated fit (TLSF) structure, so both allocating
+// and freeing are constant time. anything bigger than half a block gets its own memory
+//
+// host visible blocks are mapped once when created, as memory may only be mapped once
+//
+// thread safe
+
+pub const Kind = enum(u1) {
+    buffer,
+    image, // optimally tiled
+};
+
+pub const Allocation = struct {
+    memory: vk.DeviceMemory = .null_handle,
+    offset: vk.DeviceSize = 0,
+    size: vk.DeviceSize = 0,
+    mapped: ?[*]u8 = null, // start of this allocation if host visible
+    pool: u8 = 0, // index into pools
+    region: u32 = dedicated, // index into regions of its pool, or dedicated if it has memory to itself
+};
+
+pub const Stats = struct {
+    block_count: u32 = 0,
+    block_bytes: vk.DeviceSize = 0, // allocated from the driver for blocks
+    allocation_count: u32 = 0, // within blocks
+    allocated_bytes: vk.DeviceSize = 0, // in use within blocks, including alignment
+    dedicated_count: u32 = 0,
+    dedicated_bytes: vk.DeviceSize = 0,
+};
+
+const dedicated = std.math.maxInt(u32);
+const none = std.math.maxInt(u32);
+
+// sizes and offsets within a block are multiples of this, so that tiny regions never need tracking
+const min_alignment = 256;
+
+const preferred_block_size = 64 * 1024 * 1024;
+
+// regions are binned first by the highest set bit of their size,
+// then linearly into second_level_count subdivisions of that
+const second_level_log2 = 4;
+const second_level_count = 1 << second_level_log2;
+const min_first_level = std.math.log2(min_alignment);
+const first_level_count = @bitSizeOf(vk.DeviceSize) - min_first_level;
+
+const Region = struct {
+    offset: vk.DeviceSize,
+    size: vk.DeviceSize,
+    block: u32,
+    prev_physical: u32, // neighbours in the block, none at its ends
+    next_physical: u32,
+    prev_free: u32, // neighbours in its free list while free
+    next_free: u32, // also links regions that are not in use at all
+    free: bool,
+};
+
+const Block = struct {
+    memory: vk.DeviceMemory, // null once given back to the driver, so that the slot may be reused
+    size: vk.DeviceSize,
+    mapped: ?[*]u8,
+};
+
+const Pool = struct {
+    memory_type_index: u5,
+    kind: Kind,
+    block_size: vk.DeviceSize,
+
+    blocks: std.ArrayListUnmanaged(Block) = .{},
+    live_block_count: u32 = 0,
+
+    regions: std.ArrayListUnmanaged(Region) = .{},
+    first_unused_region: u32 = none,
+
+    first_level_bitmap: u64 = 0,
+    second_level_bitmaps: [first_level_count]u16 = [_]u16 { 0 } ** first_level_count,
+    free_lists: [first_level_count][second_level_count]u32 = [_][second_level_count]u32 { [_]u32 { none } ** second_level_count } ** first_level_count,
+
+    allocation_count: u32 = 0,
+    allocated_bytes: vk.DeviceSize = 0,
+
+    fn mapping(size: vk.DeviceSize) [2]u32 {
+        const first_level: u32 = std.math.log2_int(vk.DeviceSize, size);
+        const second_level: u32 = @intCast((size >> @intCast(first_level - second_level_log2)) ^ second_level_count);
+        return .{ first_level - min_first_level, second_level };
+    }
+
+    // rounds up to the next subdivision first, so that anything in the list it maps to fits
+    fn mappingSearch(size: vk.DeviceSize) [2]u32 {
+        const first_level: u32 = std.math.log2_int(vk.DeviceSize, size);
+        return mapping(size + (@as(vk.DeviceSize, 1) << @intCast(first_level - second_level_log2)) - 1);
+    }
+
+    fn insertFree(self: *Pool, index: u32) void {
+        const first_level, const second_level = mapping(self.regions.items[index].size);
+        const region = &self.regions.items[index];
+        region.free = true;
+        region.prev_free = none;
+        region.next_free = self.free_lists[first_level][second_level];
+        if (region.next_free != none) self.regions.items[region.next_free].prev_free = index;
+        self.free_lists[first_level][second_level] = index;
+        self.first_level_bitmap |= @as(u64, 1) << @intCast(first_level);
+        self.second_level_bitmaps[first_level] |= @as(u16, 1) << @intCast(second_level);
+    }
+
+    fn removeFree(self: *Pool, index: u32) void {
+        const first_level, const second_level = mapping(self.regions.items[index].size);
+        const region = &self.regions.items[index];
+        if (region.prev_free != none) self.regions.items[region.prev_free].next_free = region.next_free else self.free_lists[first_level][second_level] = region.next_free;
+        if (region.next_free != none) self.regions.items[region.next_free].prev_free = region.prev_free;
+        region.free = false;
+        if (self.free_lists[first_level][second_level] == none) {
+            self.second_level_bitmaps[first_level] &= ~(@as(u16, 1) << @intCast(second_level));
+            if (self.second_level_bitmaps[first_level] == 0) self.first_level_bitmap &= ~(@as(u64, 1) << @intCast(first_level));
+        }
+    }
+
+    fn findFree(self: *const Pool, size: vk.DeviceSize) ?u32 {
+        var first_level, const second_level = mappingSearch(size);
+        if (first_level >= first_level_count) return null;
+
+        var second_level_bitmap = self.second_level_bitmaps[first_level] & (~@as(u16, 0) << @intCast(second_level));
+        if (second_level_bitmap == 0) {
+            if (first_level + 1 >= first_level_count) return null;
+            const first_level_bitmap = self.first_level_bitmap & (~@as(u64, 0) << @intCast(first_level + 1));
+            if (first_level_bitmap == 0) return null;
+            first_level = @ctz(first_level_bitmap);
+            second_level_bitmap = self.second_level_bitmaps[first_level];
+        }
+        return self.free_lists[first_level][@ctz(second_level_bitmap)];
+    }
+
+    // capacity must have been ensured
+    fn newRegion(self: *Pool, region: Region) u32 {
+        if (self.first_unused_region != none) {
+            const index = self.first_unused_region;
+            self.first_unused_region = self.regions.items[index].next_free;
+            self.regions.items[index] = region;
+            return index;
+        } else {
+            self.regions.appendAssumeCapacity(region);
+            return @intCast(self.regions.items.len - 1);
+        }
+    }
+
+    fn releaseRegion(self: *Pool, index: u32) void {
+        self.regions.items[index].next_free = self.first_unused_region;
+        self.first_unused_region = index;
+    }
+
+    fn addBlock(self: *Pool, allocator: std.mem.Allocator, device: VulkanContext.Device, host_visible: bool) !void {
+        try self.blocks.ensureUnusedCapacity(allocator, 1);
+        try self.regions.ensureUnusedCapacity(allocator, 1);
+
+        const memory = try device.allocateMemory(&.{
+            .allocation_size = self.block_size,
+            .memory_type_index = self.memory_type_index,
+            .p_next = if (self.kind == .buffer) &vk.MemoryAllocateFlagsInfo {
+                .device_mask = 0,
+                .flags = .{ .device_address_bit = true },
+            } else null,
+        }, null);
+        errdefer device.freeMemory(memory, null);
+        try vk_helpers.setDebugName(device, memory, if (self.kind == .buffer) "buffer memory block" else "image memory block");
+
+        const mapped: ?[*]u8 = if (host_visible) @ptrCast(try device.mapMemory(memory, 0, vk.WHOLE_SIZE, .{})) else null;
+
+        const block = Block {
+            .memory = memory,
+            .size = self.block_size,
+            .mapped = mapped,
+        };
+        const block_index: u32 = for (self.blocks.items, 0..) |existing, i| {
+            if (existing.memory == .null_handle) {
+                self.blocks.items[i] = block;
+                break @intCast(i);
+            }
+        } else blk: {
+            self.blocks.appendAssumeCapacity(block);
+            break :blk @intCast(self.blocks.items.len - 1);
+        };
+        self.live_block_count += 1;
+
+        self.insertFree(self.newRegion(Region {
+            .offset = 0,
+            .size = self.block_size,
+            .block = block_index,
+            .prev_physical = none,
+            .next_physical = none,
+            .prev_free = none,
+            .next_free = none,
+            .free = true,
+        }));
+    }
+
+    // null if no block has room
+    fn allocate(self: *Pool, allocator: std.mem.Allocator, size: vk.DeviceSize, alignment: vk.DeviceSize) !?u32 {
+        const aligned_size = std.mem.alignForward(vk.DeviceSize, size, min_alignment);
+        const aligned_alignment = @max(alignment, min_alignment);
+
+        // worst case padding, as offsets are already multiples of min_alignment
+        const index = self.findFree(aligned_size + aligned_alignment - min_alignment) orelse return null;
+
+        // up to two regions split off
+        try self.regions.ensureUnusedCapacity(allocator, 2);
+
+        self.removeFree(index);
+
+        const padding = std.mem.alignForward(vk.DeviceSize, self.regions.items[index].offset, aligned_alignment) - self.regions.items[index].offset;
+        if (padding != 0) {
+            const region = self.regions.items[index];
+            const front = self.newRegion(Region {
+                .offset = region.offset,
+                .size = padding,
+                .block = region.block,
+                .prev_physical = region.prev_physical,
+                .next_physical = index,
+                .prev_free = none,
+                .next_free = none,
+                .free = false,
+            });
+            if (region.prev_physical != none) self.regions.items[region.prev_physical].next_physical = front;
+            self.regions.items[index].prev_physical = front;
+            self.regions.items[index].offset += padding;
+            self.regions.items[index].size -= padding;
+            self.insertFree(front);
+        }
+
+        if (self.regions.items[index].size > aligned_size) {
+            const region = self.regions.items[index];
+            const back = self.newRegion(Region {
+                .offset = region.offset + aligned_size,
+                .size = region.size - aligned_size,
+                .block = region.block,
+                .prev_physical = index,
+                .next_physical = region.next_physical,
+                .prev_free = none,
+                .next_free = none,
+                .free = false,
+            });
+            if (region.next_physical != none) self.regions.items[region.next_physical].prev_physical = back;
+            self.regions.items[index].next_physical = back;
+            self.regions.items[index].size = aligned_size;
+            self.insertFree(back);
+        }
+
+        self.allocation_count += 1;
+        self.allocated_bytes += aligned_size;
+
+        return index;
+    }
+
+    // merges with free neighbours, giving the block back to the driver once
+    // it is entirely free unless it is the last one
+    fn free(self: *Pool, device: VulkanContext.Device, region_index: u32) void {
+        var index = region_index;
+        self.allocation_count -= 1;
+        self.allocated_bytes -= self.regions.items[index].size;
+
+        const prev = self.regions.items[index].prev_physical;
+        if (prev != none and self.regions.items[prev].free) {
+            self.removeFree(prev);
+            self.regions.items[prev].size += self.regions.items[index].size;
+            self.regions.items[prev].next_physical = self.regions.items[index].next_physical;
+            if (self.regions.items[prev].next_physical != none) self.regions.items[self.regions.items[prev].next_physical].prev_physical = prev;
+            self.releaseRegion(index);
+            index = prev;
+        }
+
+        const next = self.regions.items[index].next_physical;
+        if (next != none and self.regions.items[next].free) {
+            self.removeFree(next);
+            self.regions.items[index].size += self.regions.items[next].size;
+            self.regions.items[index].next_physical = self.regions.items[next].next_physical;
+            if (self.regions.items[index].next_physical != none) self.regions.items[self.regions.items[index].next_physical].prev_physical = index;
+            self.releaseRegion(next);
+        }
+
+        const region = self.regions.items[index];
+        if (region.prev_physical == none and region.next_physical == none and self.live_block_count > 1) {
+            const block = &self.blocks.items[region.block];
+            device.freeMemory(block.memory, null);
+            block.memory = .null_handle;
+            block.mapped = null;
+            self.live_block_count -= 1;
+            self.releaseRegion(index);
+        } else {
+            self.insertFree(index);
+        }
+    }
+
+    fn destroy(self: *Pool, allocator: std.mem.Allocator, device: VulkanContext.Device) void {
+        for (self.blocks.items) |block| {
+            if (block.memory != .null_handle) device.freeMemory(block.memory, null);
+        }
+        self.blocks.deinit(allocator);
+        self.regions.deinit(allocator);
+    }
+};
+
+mutex: std.Thread.Mutex = .{},
+allocator: std.mem.Allocator, // for bookkeeping
+device: VulkanContext.Device,
+memory_types: std.BoundedArray(vk.MemoryPropertyFlags, vk.MAX_MEMORY_TYPES),
+pools: [vk.MAX_MEMORY_TYPES * 2]Pool, // by memory type index then kind
+
+dedicated_count: u32 = 0,
+dedicated_bytes: vk.DeviceSize = 0,
+
+const Self = @This();
+
+pub fn create(allocator: std.mem.Allocator, device: VulkanContext.Device, properties: vk.PhysicalDeviceMemoryProperties) !*Self {
+    const self = try allocator.create(Self);
+    self.* = Self {
+        .allocator = allocator,
+        .device = device,
+        .memory_types = std.BoundedArray(vk.MemoryPropertyFlags, vk.MAX_MEMORY_TYPES).init(properties.memory_type_count) catch unreachable,
+        .pools = undefined,
+    };
+
+    for (&self.pools, 0..) |*pool, i| {
+        const memory_type_index: u5 = @intCast(i / 2);
+        // small heaps, such as those for resizable BAR, should not be taken up by a few blocks
+        const heap_size = if (memory_type_index < properties.memory_type_count) properties.memory_heaps[properties.memory_types[memory_type_index].heap_index].size else 0;
+        pool.* = Pool {
+            .memory_type_index = memory_type_index,
+            .kind = @enumFromInt(i % 2),
+            .block_size = @max(min_alignment, @min(preferred_block_size, std.math.floorPowerOfTwo(vk.DeviceSize, @max(heap_size / 8, 1)))),
+        };
+    }
+
+    for (properties.memory_types[0..properties.memory_type_count], self.memory_types.slice()) |src, *dst| {
+        dst.* = src.property_flags;
+    }
+
+    return self;
+}
+
+// every allocation must have been freed
+pub fn destroy(self: *Self) void {
+    for (&self.pools) |*pool| pool.destroy(self.allocator, self.device);
+    self.allocator.destroy(self);
+}
+
+fn findMemoryType(self: *const Self, type_filter: u32, required_properties: vk.MemoryPropertyFlags) !u5 {
+    return for (self.memory_types.slice(), 0..) |available_properties, i| {
+        if (type_filter & (@as(u32, 1) << @intCast(i)) != 0 and available_properties.contains(required_properties)) {
+            break @intCast(i);
+        }
+    } else error.UnavailableMemoryType;
+}
+
+pub fn allocate(self: *Self, requirements: vk.MemoryRequirements, properties: vk.MemoryPropertyFlags, kind: Kind, name: [:0]const u8) !Allocation {
+    const memory_type_index = try self.findMemoryType(requirements.memory_type_bits, properties);
+    const host_visible = self.memory_types.get(memory_type_index).contains(.{ .host_visible_bit = true });
+    const pool_index: u8 = @as(u8, memory_type_index) * 2 + @intFromEnum(kind);
+
+    self.mutex.lock();
+    defer self.mutex.unlock();
+
+    const pool = &self.pools[pool_index];
+    if (requirements.size > pool.block_size / 2) {
+        const memory = try self.device.allocateMemory(&.{
+            .allocation_size = requirements.size,
+            .memory_type_index = memory_type_index,
+            .p_next = if (kind == .buffer) &vk.MemoryAllocateFlagsInfo {
+                .device_mask = 0,
+                .flags = .{ .device_address_bit = true },
+            } else null,
+        }, null);
+        errdefer self.device.freeMemory(memory, null);
+        try vk_helpers.setDebugName(self.device, memory, name);
+
+        const mapped: ?[*]u8 = if (host_visible) @ptrCast(try self.device.mapMemory(memory, 0, vk.WHOLE_SIZE, .{})) else null;
+
+        self.dedicated_count += 1;
+        self.dedicated_bytes += requirements.size;
+
+        return Allocation {
+            .memory = memory,
+            .offset = 0,
+            .size = requirements.size,
+            .mapped = mapped,
+            .pool = pool_index,
+            .region = dedicated,
+        };
+    }
+
+    const region_index = try pool.allocate(self.allocator, requirements.size, requirements.alignment) orelse blk: {
+        try pool.addBlock(self.allocator, self.device, host_visible);
+        break :blk (try pool.allocate(self.allocator, requirements.size, requirements.alignment)).?;
+    };
+    const region = pool.regions.items[region_index];
+    const block = pool.blocks.items[region.block];
+
+    return Allocation {
+        .memory = block.memory,
+        .offset = region.offset,
+        .size = region.size,
+        .mapped = if (block.mapped) |mapped| mapped + region.offset else null,
+        .pool = pool_index,
+        .region = region_index,
+    };
+}
+
+// nothing may be bound to this memory anymore
+pub fn free(self: *Self, allocation: Allocation) void {
+    if (allocation.memory == .null_handle) return;
+
+    self.mutex.lock();
+    defer self.mutex.unlock();
+
+    if (allocation.region == dedicated) {
+        self.dedicated_count -= 1;
+        self.dedicated_bytes -= allocation.size;
+        self.device.freeMemory(allocation.memory, null);
+    } else {
+        self.pools[allocation.pool].free(self.device, allocation.region);
+    }
+}
+
+pub fn getStats(self: *Self) Stats {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+
+    var stats = Stats {
+        .dedicated_count = self.dedicated_count,
+        .dedicated_bytes = self.dedicated_bytes,
+    };
+    for (&self.pools) |*pool| {
+        stats.block_count += pool.live_block_count;
+        stats.block_bytes += pool.live_block_count * pool.block_size;
+        stats.allocation_count += pool.allocation_count;
+        stats.allocated_bytes += pool.allocated_bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,214 @@
+// device timings of named scopes, e.g., acceleration structure builds or traces
+//
+// every command buffer of a profiled encoder records its scopes into a slot of its own,
+// which is read back once the device is done with it without ever waiting,
+// so results trail recording by however many command buffers are in flight
+
+const std = @import("std");
+const vk = @import("vulkan");
+
+const core = @import("./core.zig");
+const VulkanContext = core.VulkanContext;
+
+pub const max_scopes = 64; // per command buffer, further ones are not timed
+
+// must cover every command buffer in flight, plus the one being recorded
+const slot_count = 4;
+
+pub const Stat = struct {
+    name: [:0]const u8,
+    duration_ns: f64 = 0,
+    work: u64 = 0, // meaning depends on the scope, e.g., rays traced or primitives built
+    count: u32 = 0, // how many scopes went into this
+
+    // work per second
+    pub fn throughput(self: Stat) f64 {
+        if (self.duration_ns == 0) return 0;
+        return @as(f64, @floatFromInt(self.work)) * std.time.ns_per_s / self.duration_ns;
+    }
+};
+
+// scopes of the same name are merged
+pub const Stats = struct {
+    items: std.BoundedArray(Stat, max_scopes) = .{},
+
+    fn add(self: *Stats, stat: Stat) void {
+        for (self.items.slice()) |*existing| {
+            if (!std.mem.eql(u8, existing.name, stat.name)) continue;
+            existing.duration_ns += stat.duration_ns;
+            existing.work += stat.work;
+            existing.count += stat.count;
+            return;
+        }
+        self.items.append(stat) catch {};
+    }
+
+    pub fn slice(self: *const Stats) []const Stat {
+        return self.items.constSlice();
+    }
+
+    pub fn get(self: *const Stats, name: []const u8) ?Stat {
+        for (self.items.constSlice()) |stat| {
+            if (std.mem.eql(u8, stat.name, name)) return stat;
+        }
+        return null;
+    }
+};
+
+pub const Scope = struct {
+    slot: u8,
+    index: u8,
+};
+
+const Slot = struct {
+    query_pool: vk.QueryPool, // begin and end timestamp of each scope
+    names: [max_scopes][:0]const u8 = undefined,
+    work: [max_scopes]u64 = undefined,
+    count: u8 = 0,
+    open: std.bit_set.IntegerBitSet(max_scopes) = std.bit_set.IntegerBitSet(max_scopes).initEmpty(), // scopes not yet ended
+    state: enum { idle, recording, submitted } = .idle,
+};
+
+slots: [slot_count]Slot,
+current: ?u8 = null, // slot being recorded into
+next: u8 = 0,
+timestamp_period: f32,
+
+latest: Stats = .{}, // of the most recently resolved command buffer
+totals: Stats = .{}, // of everything resolved since creation or the last reset
+
+const Self = @This();
+
+pub fn create(vc: *const VulkanContext) !Self {
+    var properties = vk.PhysicalDeviceProperties2 {
+        .properties = undefined,
+    };
+    vc.instance.getPhysicalDeviceProperties2(vc.physical_device.handle, &properties);
+
+    var slots: [slot_count]Slot = undefined;
+    var created: usize = 0;
+    errdefer for (slots[0..created]) |slot| vc.device.destroyQueryPool(slot.query_pool, null);
+    for (&slots) |*slot| {
+        const query_pool = try vc.device.createQueryPool(&.{
+            .query_type = .timestamp,
+            .query_count = 2 * max_scopes,
+        }, null);
+        vc.device.resetQueryPool(query_pool, 0, 2 * max_scopes);
+        slot.* = Slot {
+            .query_pool = query_pool,
+        };
+        created += 1;
+    }
+
+    return Self {
+        .slots = slots,
+        .timestamp_period = properties.properties.limits.timestamp_period,
+    };
+}
+
+// queries must not be in use
+pub fn destroy(self: *Self, vc: *const VulkanContext) void {
+    for (self.slots) |slot| vc.device.destroyQueryPool(slot.query_pool, null);
+}
+
+pub fn reset(self: *Self) void {
+    self.latest = .{};
+    self.totals = .{};
+}
+
+// starts a slot for a command buffer that just began recording
+pub fn recordBeginCommands(self: *Self, command_buffer: VulkanContext.CommandBuffer) void {
+    const index = self.next;
+    self.next = (self.next + 1) % slot_count;
+    self.current = index;
+
+    // only happens if more command buffers are in flight than we have slots,
+    // in which case the old results are lost and its queries are reset on the device instead
+    const slot = &self.slots[index];
+    if (slot.state != .idle) command_buffer.resetQueryPool(slot.query_pool, 0, 2 * max_scopes);
+    slot.count = 0;
+    slot.open = @TypeOf(slot.open).initEmpty();
+    slot.state = .recording;
+}
+
+// ends scopes left open, e.g., by an early return, as their queries would otherwise never become available
+pub fn recordEndCommands(self: *Self, command_buffer: VulkanContext.CommandBuffer) void {
+    const index = self.current orelse return;
+    var open = self.slots[index].open.iterator(.{});
+    while (open.next()) |scope| self.recordEnd(command_buffer, Scope { .slot = index, .index = @intCast(scope) }, 0);
+}
+
+// the command buffer of the current slot has been submitted
+pub fn markSubmitted(self: *Self) void {
+    const index = self.current orelse return;
+    self.slots[index].state = .submitted;
+    self.current = null;
+}
+
+// scopes may be nested, but must begin and end in the same command buffer
+pub fn recordBegin(self: *Self, command_buffer: VulkanContext.CommandBuffer, name: [:0]const u8) ?Scope {
+    const index = self.current orelse return null;
+    const slot = &self.slots[index];
+    if (slot.count == max_scopes) return null;
+
+    const scope = Scope {
+        .slot = index,
+        .index = slot.count,
+    };
+    slot.names[scope.index] = name;
+    slot.work[scope.index] = 0;
+    slot.open.set(scope.index);
+    slot.count += 1;
+    command_buffer.writeTimestamp2(.{ .all_commands_bit = true }, slot.query_pool, 2 * @as(u32, scope.index));
+    return scope;
+}
+
+pub fn recordEnd(self: *Self, command_buffer: VulkanContext.CommandBuffer, maybe_scope: ?Scope, work: u64) void {
+    const scope = maybe_scope orelse return;
+    std.debug.assert(self.current == scope.slot);
+    const slot = &self.slots[scope.slot];
+    slot.work[scope.index] = work;
+    slot.open.unset(scope.index);
+    command_buffer.writeTimestamp2(.{ .all_commands_bit = true }, slot.query_pool, 2 * @as(u32, scope.index) + 1);
+}
+
+// collects the results of every submitted slot the device is done with, without waiting
+// returns whether `latest` changed
+pub fn resolve(self: *Self, vc: *const VulkanContext) !bool {
+    var resolved = false;
+
+    // oldest first, so that `latest` ends up with the most recent
+    for (0..slot_count) |i| {
+        const index = (self.next + i) % slot_count;
+        const slot = &self.slots[index];
+        if (slot.state != .submitted) continue;
+
+        if (slot.count != 0) {
+            var timestamps: [2 * max_scopes]u64 = undefined;
+            const query_count = 2 * @as(u32, slot.count);
+            const query_result = try vc.device.getQueryPoolResults(slot.query_pool, 0, query_count, query_count * @sizeOf(u64), &timestamps, @sizeOf(u64), .{ .@"64_bit" = true });
+            // command buffers finish in submission order, so later ones are not done either
+            if (query_result == .not_ready) break;
+
+            // the device is done with these queries, so they may be reset right away
+            vc.device.resetQueryPool(slot.query_pool, 0, query_count);
+
+            self.latest = .{};
+            for (0..slot.count) |scope| {
+                const stat = Stat {
+                    .name = slot.names[scope],
+                    .duration_ns = @as(f64, @floatFromInt(timestamps[2 * scope + 1] -% timestamps[2 * scope])) * self.timestamp_period,
+                    .work = slot.work[scope],
+                    .count = 1,
+                };
+                self.latest.add(stat);
+                self.totals.add(stat);
+            }
+            resolved = true;
+        }
+
+        slot.state = .idle;
+    }
+
+    return resolved;
+}
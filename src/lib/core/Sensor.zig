@@ -6,7 +6,30 @@ const VulkanContext =  engine.core.VulkanContext;
 const Encoder =  engine.core.Encoder;
 const Image = engine.core.Image;
 
+const F32x3 = engine.vector.Vec3(f32);
+
+// pixels are checked for convergence in square tiles this wide
+// must be kept in sync with convergenceTileSize in adaptive_sampling.hlsl
+pub const convergence_tile_size = 8;
+
+// direct light resampled for a pixel, two per pixel for alternating samples
+// must be kept in sync with LightReservoir in resampling.hlsl
+pub const LightReservoir = extern struct {
+    light_position: F32x3,
+    light_emission: [2]u32,
+    contribution_weight: f32,
+    sample_count: u32,
+    shading_position: F32x3,
+    shading_normal: u32,
+    light_normal: u32,
+};
+
+const LightReservoirBuffer = engine.core.mem.DeviceBuffer(LightReservoir, .{ .storage_buffer_bit = true, .transfer_dst_bit = true });
+
 image: Image,
+moments: Image, // average squared luminance of each pixel, for estimating its variance when sampling adaptively
+converged_tiles: engine.core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }), // nonzero for tiles that need no more samples, never unset until cleared
+light_reservoirs: LightReservoirBuffer = .{}, // only exists if set, emptied when cleared so a fresh capture reuses nothing
 extent: vk.Extent2D,
 sample_count: u32,
 
@@ -16,13 +39,41 @@ pub fn create(vc: *const VulkanContext, extent: vk.Extent2D, name: [:0]const u8)
     const image = try Image.create(vc, extent, .{ .storage_bit = true, .transfer_src_bit = true, }, .r32g32b32a32_sfloat, false, name);
     errdefer image.destroy(vc);
 
+    const moments = try Image.create(vc, extent, .{ .storage_bit = true }, .r32_sfloat, false, name);
+    errdefer moments.destroy(vc);
+
+    const converged_tiles = try engine.core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, tileCount(extent), name);
+    errdefer converged_tiles.destroy(vc);
+
     return Self {
         .image = image,
+        .moments = moments,
+        .converged_tiles = converged_tiles,
         .extent = extent,
         .sample_count = 0,
     };
 }
 
+// reservoirs are large and only needed when a pipeline reuses resampled light,
+// so they are only made when asked for and freed once no longer wanted
+// clears the sensor, as new reservoirs start out undefined
+pub fn setLightReservoirs(self: *Self, vc: *const VulkanContext, encoder: *Encoder, enabled: bool) !void {
+    if (enabled == (self.light_reservoirs.handle != .null_handle)) return;
+
+    if (enabled) {
+        self.light_reservoirs = try LightReservoirBuffer.create(vc, 2 * self.extent.width * self.extent.height, "light reservoirs");
+    } else {
+        // earlier captures may still be using them
+        try encoder.attachResource(self.light_reservoirs);
+        self.light_reservoirs = .{};
+    }
+    self.clear();
+}
+
+pub fn tileCount(extent: vk.Extent2D) u32 {
+    return (std.math.divCeil(u32, extent.width, convergence_tile_size) catch unreachable) * (std.math.divCeil(u32, extent.height, convergence_tile_size) catch unreachable);
+}
+
 // intended to be used in a loop, e.g
 //
 // while rendering:
@@ -30,25 +81,96 @@ pub fn create(vc: *const VulkanContext, extent: vk.Extent2D, name: [:0]const u8)
 //   ...
 //   recordPrepareForCopy(...)
 pub fn recordPrepareForCapture(self: *const Self, command_buffer: VulkanContext.CommandBuffer, capture_stage: vk.PipelineStageFlags2, copy_stage: vk.PipelineStageFlags2) void {
+    // a fresh capture starts with every tile unconverged and no light to reuse
+    if (self.sample_count == 0) {
+        command_buffer.pipelineBarrier2(&vk.DependencyInfo{
+            .memory_barrier_count = 1,
+            .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+                .src_stage_mask = capture_stage.merge(.{ .compute_shader_bit = true }),
+                .src_access_mask = .{ .shader_storage_write_bit = true },
+                .dst_stage_mask = .{ .clear_bit = true },
+                .dst_access_mask = .{ .transfer_write_bit = true },
+            }),
+        });
+        command_buffer.fillBuffer(self.converged_tiles.handle, 0, vk.WHOLE_SIZE, 0);
+        if (self.light_reservoirs.handle != .null_handle) command_buffer.fillBuffer(self.light_reservoirs.handle, 0, vk.WHOLE_SIZE, 0);
+    }
+
+    const color_range = vk.ImageSubresourceRange {
+        .aspect_mask = .{ .color_bit = true },
+        .base_mip_level = 0,
+        .level_count = 1,
+        .base_array_layer = 0,
+        .layer_count = vk.REMAINING_ARRAY_LAYERS,
+    };
     command_buffer.pipelineBarrier2(&vk.DependencyInfo{
-        .image_memory_barrier_count = 1,
-        .p_image_memory_barriers = @ptrCast(&vk.ImageMemoryBarrier2{
-            .src_stage_mask = copy_stage,
-            .src_access_mask = if (!std.meta.eql(copy_stage, .{})) .{ .transfer_read_bit = true } else .{},
-            .dst_stage_mask = capture_stage,
-            .dst_access_mask = if (self.sample_count == 0) .{ .shader_storage_write_bit = true } else .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
-            .old_layout = if (self.sample_count == 0) .undefined else .transfer_src_optimal,
-            .new_layout = .general,
-            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .image = self.image.handle,
-            .subresource_range = .{
-                .aspect_mask = .{ .color_bit = true },
-                .base_mip_level = 0,
-                .level_count = 1,
-                .base_array_layer = 0,
-                .layer_count = vk.REMAINING_ARRAY_LAYERS,
+        // the reservoir barrier is last, so that it can be left out along with the reservoirs
+        .buffer_memory_barrier_count = if (self.sample_count != 0) 0 else if (self.light_reservoirs.handle != .null_handle) 2 else 1,
+        .p_buffer_memory_barriers = &[2]vk.BufferMemoryBarrier2 {
+            .{
+                .src_stage_mask = .{ .clear_bit = true },
+                .src_access_mask = .{ .transfer_write_bit = true },
+                .dst_stage_mask = capture_stage,
+                .dst_access_mask = .{ .shader_storage_read_bit = true },
+                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .buffer = self.converged_tiles.handle,
+                .offset = 0,
+                .size = vk.WHOLE_SIZE,
+            },
+            .{
+                .src_stage_mask = .{ .clear_bit = true },
+                .src_access_mask = .{ .transfer_write_bit = true },
+                .dst_stage_mask = capture_stage,
+                .dst_access_mask = .{ .shader_storage_read_bit = true, .shader_storage_write_bit = true },
+                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .buffer = self.light_reservoirs.handle,
+                .offset = 0,
+                .size = vk.WHOLE_SIZE,
             },
+        },
+        .image_memory_barrier_count = 2,
+        .p_image_memory_barriers = &[2]vk.ImageMemoryBarrier2 {
+            .{
+                .src_stage_mask = copy_stage,
+                .src_access_mask = if (!std.meta.eql(copy_stage, .{})) .{ .transfer_read_bit = true } else .{},
+                .dst_stage_mask = capture_stage,
+                .dst_access_mask = if (self.sample_count == 0) .{ .shader_storage_write_bit = true } else .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+                .old_layout = if (self.sample_count == 0) .undefined else .transfer_src_optimal,
+                .new_layout = .general,
+                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .image = self.image.handle,
+                .subresource_range = color_range,
+            },
+            // moments stay in general layout, only waiting on the last capture
+            .{
+                .src_stage_mask = capture_stage,
+                .src_access_mask = if (self.sample_count == 0) .{} else .{ .shader_storage_write_bit = true },
+                .dst_stage_mask = capture_stage,
+                .dst_access_mask = if (self.sample_count == 0) .{ .shader_storage_write_bit = true } else .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+                .old_layout = if (self.sample_count == 0) .undefined else .general,
+                .new_layout = .general,
+                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .image = self.moments.handle,
+                .subresource_range = color_range,
+            },
+        },
+    });
+}
+
+// makes a capture visible to the next, as each sample accumulates onto the ones before it
+pub fn recordCaptureBarrier(self: *const Self, command_buffer: VulkanContext.CommandBuffer, capture_stage: vk.PipelineStageFlags2) void {
+    _ = self;
+    command_buffer.pipelineBarrier2(&vk.DependencyInfo{
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = capture_stage,
+            .src_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+            .dst_stage_mask = capture_stage,
+            .dst_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
         }),
     });
 }
@@ -83,4 +205,7 @@ pub fn clear(self: *Self) void {
 
 pub fn destroy(self: *Self, vc: *const VulkanContext) void {
     self.image.destroy(vc);
+    self.moments.destroy(vc);
+    self.converged_tiles.destroy(vc);
+    self.light_reservoirs.destroy(vc);
 }
@@ -3,6 +3,7 @@ const std = @import("std");
 const builtin = @import("builtin");
 
 const vk_helpers = @import("../engine.zig").core.vk_helpers;
+const MemoryAllocator = @import("../engine.zig").core.MemoryAllocator;
 
 const validate = @import("build_options").vk_validation;
 
@@ -36,6 +37,7 @@ const core_vulkan_functions = vk.ApiInfo {
         .createDevice = true,
         .getPhysicalDeviceMemoryProperties = true,
         .getPhysicalDeviceProperties2 = true,
+        .getPhysicalDeviceFeatures2 = true,
     },
     .device_commands = vk.DeviceCommandFlags {
         .getDeviceQueue = true,
@@ -86,6 +88,7 @@ const core_vulkan_functions = vk.ApiInfo {
         .destroyFence = true,
         .waitForFences = true,
         .resetFences = true,
+        .getFenceStatus = true,
         .queueSubmit2 = true,
         .cmdPushConstants = true,
         .cmdCopyBufferToImage = true,
@@ -95,12 +98,18 @@ const core_vulkan_functions = vk.ApiInfo {
         .resetQueryPool = true,
         .getQueryPoolResults = true,
         .destroyQueryPool = true,
+        .cmdWriteTimestamp2 = true,
+        .cmdResetQueryPool = true,
         .cmdCopyImageToBuffer = true,
         .cmdUpdateBuffer = true,
         .createComputePipelines = true,
         .cmdDispatch = true,
+        .cmdDispatchIndirect = true,
         .cmdPushDescriptorSetKHR = true,
         .getDeviceBufferMemoryRequirements = true,
+        .createPipelineCache = true,
+        .destroyPipelineCache = true,
+        .getPipelineCacheData = true,
     }
 };
 
@@ -256,12 +265,22 @@ device: Device,
 
 physical_device: PhysicalDevice,
 
+// the subset of the optional device extensions requested at creation that are enabled
+optional_device_extensions: std.BoundedArray([*:0]const u8, max_optional_device_extensions),
+
 debug_messenger: if (validate) vk.DebugUtilsMessengerEXT else void,
 
 queue: Queue,
 
+// all pipelines should be created through this, so that they are compiled once rather than every run
+pipeline_cache: vk.PipelineCache,
+pipeline_cache_path: ?[]const u8, // where the cache is saved, null if there is nowhere to
+
 memory_types: std.BoundedArray(vk.MemoryPropertyFlags, vk.MAX_MEMORY_TYPES),
 
+// buffers and images get their memory from this rather than allocating their own
+memory_allocator: *MemoryAllocator,
+
 const Self = @This();
 
 const QueueFamilyAcceptable = fn(vk.Instance, vk.PhysicalDevice, u32) bool;
@@ -271,7 +290,26 @@ const required_device_extensions = [_][*:0]const u8{
     vk.extensions.khr_push_descriptor.name,
 };
 
-pub fn create(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_extensions: []const [*:0]const u8, device_extensions: []const [*:0]const u8, features: ?*const anyopaque, comptime queueFamilyAcceptable: ?QueueFamilyAcceptable) !Self {
+const max_optional_device_extensions = 8;
+
+// device extension that is enabled if available but does not rule out devices without it
+pub const OptionalDeviceExtension = struct {
+    name: [*:0]const u8,
+
+    // features struct of the extension, with a null p_next
+    // filled in with what the device supports and enabled along with the extension
+    features: ?*vk.BaseOutStructure = null,
+};
+
+pub fn create(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_extensions: []const [*:0]const u8, device_extensions: []const [*:0]const u8, optional_device_extensions: []const OptionalDeviceExtension, features: ?*const anyopaque, comptime queueFamilyAcceptable: ?QueueFamilyAcceptable) !Self {
+    return createOnDevice(allocator, app_name, instance_extensions, device_extensions, optional_device_extensions, features, queueFamilyAcceptable, 0);
+}
+
+// like create, but on the `device_index`th suitable device rather than the first,
+// so that each device of a multi-device system may get its own context
+//
+// returns error.UnavailableDevices if there are not that many suitable devices
+pub fn createOnDevice(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_extensions: []const [*:0]const u8, device_extensions: []const [*:0]const u8, optional_device_extensions: []const OptionalDeviceExtension, features: ?*const anyopaque, comptime queueFamilyAcceptable: ?QueueFamilyAcceptable, device_index: u32) !Self {
     var base = try Base.new();
     errdefer base.destroy();
 
@@ -286,8 +324,34 @@ pub fn create(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_ex
 
     const all_device_extensions = try std.mem.concat(allocator, [*:0]const u8, &[_][]const [*:0]const u8{ &required_device_extensions, device_extensions });
     defer allocator.free(all_device_extensions);
-    const physical_device = try PhysicalDevice.pick(instance, allocator, if (queueFamilyAcceptable) |acc| acc else returnsTrue, all_device_extensions);
-    const device_handle = try physical_device.createLogicalDevice(instance, all_device_extensions, features);
+    const physical_device = try PhysicalDevice.pick(instance, allocator, if (queueFamilyAcceptable) |acc| acc else returnsTrue, all_device_extensions, device_index);
+
+    // add whatever optional extensions are available, chaining their features in front of the required ones
+    var enabled_optional_device_extensions = std.BoundedArray([*:0]const u8, max_optional_device_extensions) {};
+    var enabled_features = features;
+    for (optional_device_extensions) |extension| {
+        if (!try PhysicalDevice.deviceExtensionsAvailable(instance, physical_device.handle, allocator, &.{ extension.name })) continue;
+        try enabled_optional_device_extensions.append(extension.name);
+        if (extension.features) |extension_features| {
+            std.debug.assert(extension_features.p_next == null);
+            var features2 = vk.PhysicalDeviceFeatures2 {
+                .p_next = extension_features,
+                .features = .{},
+            };
+            instance.getPhysicalDeviceFeatures2(physical_device.handle, &features2);
+            extension_features.p_next = @ptrCast(@alignCast(@constCast(enabled_features)));
+            enabled_features = extension_features;
+        }
+    }
+
+    const enabled_device_extensions = try std.mem.concat(allocator, [*:0]const u8, &[_][]const [*:0]const u8{ all_device_extensions, enabled_optional_device_extensions.slice() });
+    defer allocator.free(enabled_device_extensions);
+    const device_handle = try physical_device.createLogicalDevice(instance, enabled_device_extensions, enabled_features);
+
+    // features structs are owned by the caller and may be reused for another context
+    for (optional_device_extensions) |extension| {
+        if (extension.features) |extension_features| extension_features.p_next = null;
+    }
     const device_dispatch = try allocator.create(DeviceDispatch);
     device_dispatch.* = try DeviceDispatch.load(device_handle, instance_dispatch.dispatch.vkGetDeviceProcAddr);
     const device = Device.init(device_handle, device_dispatch);
@@ -296,6 +360,11 @@ pub fn create(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_ex
     const queue_handle = device.getDeviceQueue(physical_device.queue_family_index, 0);
     const queue = Queue.init(queue_handle, device_dispatch);
 
+    const pipeline_cache_path = PipelineCache.path(allocator, instance, physical_device.handle) catch null;
+    errdefer if (pipeline_cache_path) |cache_path| allocator.free(cache_path);
+    const pipeline_cache = try PipelineCache.create(allocator, instance, device, physical_device.handle, pipeline_cache_path);
+    errdefer device.destroyPipelineCache(pipeline_cache, null);
+
     const properties = instance.getPhysicalDeviceMemoryProperties(physical_device.handle);
 
     var memory_types = std.BoundedArray(vk.MemoryPropertyFlags, vk.MAX_MEMORY_TYPES).init(properties.memory_type_count) catch unreachable;
@@ -304,6 +373,9 @@ pub fn create(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_ex
         dst.* = src.property_flags;
     }
 
+    const memory_allocator = try MemoryAllocator.create(allocator, device, properties);
+    errdefer memory_allocator.destroy();
+
     return Self {
         .base = base,
         .instance_dispatch = instance_dispatch,
@@ -312,13 +384,26 @@ pub fn create(allocator: std.mem.Allocator, app_name: [*:0]const u8, instance_ex
         .device_dispatch = device_dispatch,
         .device = device,
         .physical_device = physical_device,
+        .optional_device_extensions = enabled_optional_device_extensions,
 
         .queue = queue,
 
+        .pipeline_cache = pipeline_cache,
+        .pipeline_cache_path = pipeline_cache_path,
+
         .memory_types = memory_types,
+
+        .memory_allocator = memory_allocator,
     };
 }
 
+pub fn deviceExtensionEnabled(self: *const Self, name: [*:0]const u8) bool {
+    for (self.optional_device_extensions.slice()) |enabled_name| {
+        if (std.mem.orderZ(u8, enabled_name, name) == .eq) return true;
+    }
+    return false;
+}
+
 pub fn findMemoryType(self: Self, type_filter: u32, required_properties: vk.MemoryPropertyFlags) !std.meta.Int(.unsigned, vk.MAX_MEMORY_TYPES) {
     return for (self.memory_types.slice(), 0..) |avalable_properties, i| {
         if (type_filter & (@as(u32, 1) << @intCast(i)) != 0 and avalable_properties.contains(required_properties)) {
@@ -327,7 +412,18 @@ pub fn findMemoryType(self: Self, type_filter: u32, required_properties: vk.Memo
     } else error.UnavailbleMemoryType;
 }
 
+// writes out the pipeline cache, also done on destroy
+// worth calling once pipelines are created, as a host process may never get to destroy this
+pub fn savePipelineCache(self: Self, allocator: std.mem.Allocator) void {
+    const cache_path = self.pipeline_cache_path orelse return;
+    PipelineCache.save(allocator, self.device, self.pipeline_cache, cache_path) catch |err| std.log.warn("could not save pipeline cache to {s}: {}", .{ cache_path, err });
+}
+
 pub fn destroy(self: Self, allocator: std.mem.Allocator) void {
+    self.savePipelineCache(allocator);
+    if (self.pipeline_cache_path) |cache_path| allocator.free(cache_path);
+    self.device.destroyPipelineCache(self.pipeline_cache, null);
+    self.memory_allocator.destroy();
     self.device.destroyDevice(null);
     allocator.destroy(self.device_dispatch);
 
@@ -337,6 +433,79 @@ pub fn destroy(self: Self, allocator: std.mem.Allocator) void {
     self.base.destroy();
 }
 
+// compiled pipelines persisted across runs, so that only the first run on a driver waits on compiling them
+//
+// the driver keys entries on everything that goes into a pipeline, spec constants included, and the
+// file is keyed on the driver's cache UUID, so a driver update starts afresh rather than loading stale data
+const PipelineCache = struct {
+    // VkPipelineCacheHeaderVersionOne
+    const header_size = 16 + vk.UUID_SIZE;
+
+    fn path(allocator: std.mem.Allocator, instance: Instance, physical_device: vk.PhysicalDevice) ![]const u8 {
+        const properties = getProperties(instance, physical_device);
+
+        const dir = try std.fs.getAppDataDir(allocator, "moonshine");
+        defer allocator.free(dir);
+
+        var name_buffer: [64 + 2 * vk.UUID_SIZE]u8 = undefined;
+        const name = try std.fmt.bufPrint(&name_buffer, "pipeline_cache_{x:0>4}_{x:0>4}_{s}.bin", .{ properties.vendor_id, properties.device_id, std.fmt.fmtSliceHexLower(&properties.pipeline_cache_uuid) });
+
+        return try std.fs.path.join(allocator, &.{ dir, name });
+    }
+
+    fn getProperties(instance: Instance, physical_device: vk.PhysicalDevice) vk.PhysicalDeviceProperties {
+        var properties2 = vk.PhysicalDeviceProperties2 {
+            .properties = undefined,
+        };
+        instance.getPhysicalDeviceProperties2(physical_device, &properties2);
+        return properties2.properties;
+    }
+
+    // drivers should reject data from another driver themselves, but not all are robust to it
+    fn isCompatible(data: []const u8, properties: vk.PhysicalDeviceProperties) bool {
+        if (data.len < header_size) return false;
+        const length = std.mem.readInt(u32, data[0..4], builtin.cpu.arch.endian());
+        const version = std.mem.readInt(u32, data[4..8], builtin.cpu.arch.endian());
+        const vendor_id = std.mem.readInt(u32, data[8..12], builtin.cpu.arch.endian());
+        const device_id = std.mem.readInt(u32, data[12..16], builtin.cpu.arch.endian());
+        return length >= header_size and length <= data.len
+            and version == 1 // VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            and vendor_id == properties.vendor_id
+            and device_id == properties.device_id
+            and std.mem.eql(u8, data[16..header_size], &properties.pipeline_cache_uuid);
+    }
+
+    // starts empty if there is no usable saved cache
+    fn create(allocator: std.mem.Allocator, instance: Instance, device: Device, physical_device: vk.PhysicalDevice, maybe_path: ?[]const u8) !vk.PipelineCache {
+        const saved = if (maybe_path) |cache_path| std.fs.cwd().readFileAlloc(allocator, cache_path, std.math.maxInt(u32)) catch null else null;
+        defer if (saved) |data| allocator.free(data);
+
+        const initial_data: []const u8 = if (saved) |data| (if (isCompatible(data, getProperties(instance, physical_device))) data else &.{}) else &.{};
+
+        return try device.createPipelineCache(&.{
+            .initial_data_size = initial_data.len,
+            .p_initial_data = initial_data.ptr,
+        }, null);
+    }
+
+    // written to a temporary file first so that concurrent runs never see a partial cache
+    fn save(allocator: std.mem.Allocator, device: Device, cache: vk.PipelineCache, cache_path: []const u8) !void {
+        var size: usize = undefined;
+        _ = try device.getPipelineCacheData(cache, &size, null);
+        const data = try allocator.alloc(u8, size);
+        defer allocator.free(data);
+        _ = try device.getPipelineCacheData(cache, &size, data.ptr);
+
+        if (std.fs.path.dirname(cache_path)) |dir| try std.fs.cwd().makePath(dir);
+
+        const temp_path = try std.fmt.allocPrint(allocator, "{s}.{}.tmp", .{ cache_path, std.time.nanoTimestamp() });
+        defer allocator.free(temp_path);
+        try std.fs.cwd().writeFile(.{ .sub_path = temp_path, .data = data[0..size] });
+        errdefer std.fs.cwd().deleteFile(temp_path) catch {};
+        try std.fs.cwd().rename(temp_path, cache_path);
+    }
+};
+
 const PhysicalDevice = struct {
     handle: vk.PhysicalDevice,
     queue_family_index: u32,
@@ -357,11 +526,17 @@ const PhysicalDevice = struct {
         } else return VulkanContextError.UnavailableQueues;
     }
 
-    fn pick(instance: Instance, allocator: std.mem.Allocator, comptime queueFamilyAcceptable: QueueFamilyAcceptable, extensions: []const [*:0]const u8) !PhysicalDevice {
-        const devices = (try vk_helpers.getVkSliceBounded(4, Instance.enumeratePhysicalDevices, .{ instance })).slice();
+    // picks the `skip`th device with the extensions
+    fn pick(instance: Instance, allocator: std.mem.Allocator, comptime queueFamilyAcceptable: QueueFamilyAcceptable, extensions: []const [*:0]const u8, skip: u32) !PhysicalDevice {
+        const devices = (try vk_helpers.getVkSliceBounded(16, Instance.enumeratePhysicalDevices, .{ instance })).slice();
 
+        var to_skip = skip;
         return for (devices) |device| {
             if (try PhysicalDevice.deviceExtensionsAvailable(instance, device, allocator, extensions)) {
+                if (to_skip != 0) {
+                    to_skip -= 1;
+                    continue;
+                }
                 if (pickQueueFamily(instance, device, queueFamilyAcceptable)) |index| {
                     break PhysicalDevice {
                         .handle = device,
@@ -416,6 +591,7 @@ const PhysicalDevice = struct {
             .descriptor_binding_partially_bound = vk.TRUE,
             .host_query_reset = vk.TRUE,
             .descriptor_binding_update_unused_while_pending = vk.TRUE,
+            .descriptor_binding_variable_descriptor_count = vk.TRUE,
         };
 
         return try instance.createDevice(
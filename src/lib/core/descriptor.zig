@@ -14,7 +14,7 @@ pub const Binding = struct {
 pub fn DescriptorLayout(comptime bindings: []const Binding, comptime layout_flags: vk.DescriptorSetLayoutCreateFlags, comptime max_sets: comptime_int, comptime debug_name: [*:0]const u8) type {
     return struct {
         handle: vk.DescriptorSetLayout,
-        pool: if (is_push_descriptor) void else vk.DescriptorPool,
+        pool: if (has_pool) vk.DescriptorPool else void,
 
         const Self = @This();
 
@@ -30,6 +30,9 @@ pub fn DescriptorLayout(comptime bindings: []const Binding, comptime layout_flag
 
         const is_push_descriptor = layout_flags.contains(.{ .push_descriptor_bit_khr = true });
 
+        // without any sets the user manages their own pools, e.g. to allocate variable descriptor counts
+        const has_pool = !is_push_descriptor and max_sets != 0;
+
         pub fn create(vc: *const VulkanContext, samplers: [sampler_count]vk.Sampler) !Self {
             var vk_bindings: [bindings.len]vk.DescriptorSetLayoutBinding = undefined;
             const vk_binding_flags = blk: {
@@ -77,7 +80,7 @@ pub fn DescriptorLayout(comptime bindings: []const Binding, comptime layout_flag
 
             return Self {
                 .handle = handle,
-                .pool = if (is_push_descriptor) {} else try vc.device.createDescriptorPool(&.{
+                .pool = if (!has_pool) {} else try vc.device.createDescriptorPool(&.{
                     .flags = .{},
                     .max_sets = max_sets,
                     .pool_size_count = pool_sizes.len,
@@ -86,7 +89,7 @@ pub fn DescriptorLayout(comptime bindings: []const Binding, comptime layout_flag
             };
         }
 
-        pub usingnamespace if (is_push_descriptor) struct {} else struct {
+        pub usingnamespace if (!has_pool) struct {} else struct {
             pub fn allocate_set(self: *const Self, vc: *const VulkanContext, writes: [bindings.len]vk.WriteDescriptorSet) !vk.DescriptorSet {
                 var descriptor_set: vk.DescriptorSet = undefined;
 
@@ -122,7 +125,7 @@ pub fn DescriptorLayout(comptime bindings: []const Binding, comptime layout_flag
         };
 
         pub fn destroy(self: *Self, vc: *const VulkanContext) void {
-            if (!is_push_descriptor) vc.device.destroyDescriptorPool(self.pool, null);
+            if (has_pool) vc.device.destroyDescriptorPool(self.pool, null);
             vc.device.destroyDescriptorSetLayout(self.handle, null);
         }
     };
@@ -7,7 +7,7 @@ const vk_helpers = core.vk_helpers;
 
 const vk_map_memory_minimum_guaranteed_alignment = 64; // https://docs.vulkan.org/spec/latest/chapters/limits.html#limits-minmax may as well commuincate this to the compiler
 
-fn createRawBuffer(vc: *const VulkanContext, size: vk.DeviceSize, usage: vk.BufferUsageFlags, properties: vk.MemoryPropertyFlags, name: [:0]const u8) !std.meta.Tuple(&.{ vk.Buffer, vk.DeviceMemory }) {
+fn createRawBuffer(vc: *const VulkanContext, size: vk.DeviceSize, usage: vk.BufferUsageFlags, properties: vk.MemoryPropertyFlags, name: [:0]const u8) !std.meta.Tuple(&.{ vk.Buffer, core.MemoryAllocator.Allocation }) {
     const buffer = try vc.device.createBuffer(&.{
             .size = size,
             .usage = usage,
@@ -18,22 +18,12 @@ fn createRawBuffer(vc: *const VulkanContext, size: vk.DeviceSize, usage: vk.Buff
 
     const mem_requirements = vc.device.getBufferMemoryRequirements(buffer);
 
-    const allocate_info = vk.MemoryAllocateInfo {
-        .allocation_size = mem_requirements.size,
-        .memory_type_index = try vc.findMemoryType(mem_requirements.memory_type_bits, properties),
-        .p_next = if (usage.contains(.{ .shader_device_address_bit = true })) &vk.MemoryAllocateFlagsInfo {
-            .device_mask = 0,
-            .flags = .{ .device_address_bit = true },
-            } else null,
-    };
-
-    const memory = try vc.device.allocateMemory(&allocate_info, null);
-    errdefer vc.device.freeMemory(memory, null);
-    try vk_helpers.setDebugName(vc.device, memory, name);
+    const allocation = try vc.memory_allocator.allocate(mem_requirements, properties, .buffer, name);
+    errdefer vc.memory_allocator.free(allocation);
 
-    try vc.device.bindBufferMemory(buffer, memory, 0);
+    try vc.device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
 
-    return .{ buffer, memory };
+    return .{ buffer, allocation };
 }
 
 pub fn Buffer(comptime T: type, comptime memory_properties: vk.MemoryPropertyFlags, comptime usage: vk.BufferUsageFlags) type {
@@ -44,7 +34,7 @@ pub fn Buffer(comptime T: type, comptime memory_properties: vk.MemoryPropertyFla
 
     return struct {
         handle: vk.Buffer = .null_handle,
-        memory: vk.DeviceMemory = .null_handle,
+        allocation: core.MemoryAllocator.Allocation = .{},
         slice: if (host_visible) []T else void = if (host_visible) &.{} else {},
 
         const Self = @This();
@@ -53,16 +43,17 @@ pub fn Buffer(comptime T: type, comptime memory_properties: vk.MemoryPropertyFla
             if (count == 0) return Self {};
 
             const size =  @sizeOf(T) * count;
-            const buffer, const memory = try createRawBuffer(vc, size, usage, memory_properties, name);
+            const buffer, const allocation = try createRawBuffer(vc, size, usage, memory_properties, name);
 
+            // sub-allocations are at least this aligned within their persistently mapped block
             const slice = if (host_visible) blk: {
-                const ptr: [*]align(vk_map_memory_minimum_guaranteed_alignment) u8 = @alignCast(@ptrCast(try vc.device.mapMemory(memory, 0, vk.WHOLE_SIZE, .{})));
+                const ptr: [*]align(vk_map_memory_minimum_guaranteed_alignment) u8 = @alignCast(allocation.mapped.?);
                 break :blk @as([*]T, @ptrCast(ptr))[0..count];
             } else ({});
 
             return Self {
                 .handle = buffer,
-                .memory = memory,
+                .allocation = allocation,
                 .slice = slice,
             };
         }
@@ -70,7 +61,7 @@ pub fn Buffer(comptime T: type, comptime memory_properties: vk.MemoryPropertyFla
         pub fn destroy(self: Self, vc: *const VulkanContext) void {
             if (self.handle != .null_handle) {
                 vc.device.destroyBuffer(self.handle, null);
-                vc.device.freeMemory(self.memory, null);
+                vc.memory_allocator.free(self.allocation);
             }
         }
 
@@ -117,6 +108,80 @@ pub fn DeviceBuffer(comptime T: type, comptime usage: vk.BufferUsageFlags) type
     return Buffer(T, vk.MemoryPropertyFlags { .device_local_bit = true }, usage);
 }
 
+// device buffer for when the amount of elements is not known up front
+//
+// capacity doubles when it runs out so growing is amortised, and existing contents are
+// copied over on the device. the handle and address change when it grows, so they
+// must not be held on to across calls to ensureTotalCapacity
+pub fn GrowableDeviceBuffer(comptime T: type, comptime usage: vk.BufferUsageFlags) type {
+    const BufferType = DeviceBuffer(T, usage.merge(.{ .transfer_src_bit = true, .transfer_dst_bit = true }));
+
+    return struct {
+        buffer: BufferType = .{},
+        capacity: vk.DeviceSize = 0,
+        name: [:0]const u8,
+
+        const Self = @This();
+
+        pub fn create(vc: *const VulkanContext, capacity: vk.DeviceSize, name: [:0]const u8) !Self {
+            return Self {
+                .buffer = try BufferType.create(vc, capacity, name),
+                .capacity = capacity,
+                .name = name,
+            };
+        }
+
+        pub fn destroy(self: Self, vc: *const VulkanContext) void {
+            self.buffer.destroy(vc);
+        }
+
+        // makes room for at least `count` elements, returns whether the buffer was reallocated
+        // the old buffer is attached to the encoder, as earlier commands may still be using it
+        pub fn ensureTotalCapacity(self: *Self, vc: *const VulkanContext, encoder: *Encoder, count: vk.DeviceSize) !bool {
+            if (count <= self.capacity) return false;
+
+            var new_capacity = @max(self.capacity, 1);
+            while (new_capacity < count) new_capacity *= 2;
+
+            const new_buffer = try BufferType.create(vc, new_capacity, self.name);
+            errdefer new_buffer.destroy(vc);
+            try encoder.attachResource(self.buffer);
+
+            if (self.capacity != 0) {
+                encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+                    .memory_barrier_count = 1,
+                    .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+                        .src_stage_mask = .{ .all_commands_bit = true },
+                        .src_access_mask = .{ .memory_write_bit = true },
+                        .dst_stage_mask = .{ .copy_bit = true },
+                        .dst_access_mask = .{ .transfer_read_bit = true },
+                    }),
+                });
+                encoder.copyBuffer(self.buffer.handle, new_buffer.handle, &.{
+                    vk.BufferCopy {
+                        .src_offset = 0,
+                        .dst_offset = 0,
+                        .size = @sizeOf(T) * self.capacity,
+                    },
+                });
+                encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+                    .memory_barrier_count = 1,
+                    .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+                        .src_stage_mask = .{ .copy_bit = true },
+                        .src_access_mask = .{ .transfer_write_bit = true },
+                        .dst_stage_mask = .{ .all_commands_bit = true },
+                        .dst_access_mask = .{ .memory_read_bit = true, .memory_write_bit = true },
+                    }),
+                });
+            }
+
+            self.buffer = new_buffer;
+            self.capacity = new_capacity;
+            return true;
+        }
+    };
+}
+
 pub fn BufferSlice(comptime T: type) type {
     return struct {
         handle: vk.Buffer = .null_handle,
@@ -135,6 +200,116 @@ pub fn BufferSlice(comptime T: type) type {
     };
 }
 
+// collects many small writes to a device buffer so that they can be uploaded with a single copy,
+// merging writes that touch or overlap into contiguous ranges
+// where writes overlap, later ones win
+pub const BufferUpdates = struct {
+    const Write = struct {
+        offset: vk.DeviceSize, // in the destination buffer
+        data_offset: u32, // in `data`
+        size: u32,
+    };
+
+    writes: std.ArrayListUnmanaged(Write) = .{},
+    data: std.ArrayListUnmanaged(u8) = .{},
+
+    pub fn write(self: *BufferUpdates, allocator: std.mem.Allocator, offset: vk.DeviceSize, bytes: []const u8) !void {
+        try self.writes.append(allocator, Write {
+            .offset = offset,
+            .data_offset = @intCast(self.data.items.len),
+            .size = @intCast(bytes.len),
+        });
+        errdefer _ = self.writes.pop();
+        try self.data.appendSlice(allocator, bytes);
+    }
+
+    pub fn isEmpty(self: BufferUpdates) bool {
+        return self.writes.items.len == 0;
+    }
+
+    // drops every queued write
+    pub fn clear(self: *BufferUpdates) void {
+        self.writes.clearRetainingCapacity();
+        self.data.clearRetainingCapacity();
+    }
+
+    // records one copy into `buffer` covering every merged range, followed by a barrier over all of them
+    // afterwards, this is empty again
+    pub fn record(self: *BufferUpdates, allocator: std.mem.Allocator, encoder: *Encoder, buffer: vk.Buffer, dst_stage_mask: vk.PipelineStageFlags2, dst_access_mask: vk.AccessFlags2) !void {
+        if (self.isEmpty()) return;
+        defer self.clear();
+
+        const sorted = try allocator.dupe(Write, self.writes.items);
+        defer allocator.free(sorted);
+        std.mem.sort(Write, sorted, {}, struct {
+            fn lessThan(_: void, a: Write, b: Write) bool {
+                return a.offset < b.offset;
+            }
+        }.lessThan);
+
+        // src_offset is where in staging memory each range goes
+        var ranges = std.ArrayListUnmanaged(vk.BufferCopy) {};
+        defer ranges.deinit(allocator);
+        var staging_size: vk.DeviceSize = 0;
+        for (sorted) |w| {
+            if (ranges.items.len != 0 and w.offset <= ranges.items[ranges.items.len - 1].dst_offset + ranges.items[ranges.items.len - 1].size) {
+                const range = &ranges.items[ranges.items.len - 1];
+                const end = @max(range.dst_offset + range.size, w.offset + w.size);
+                staging_size += end - (range.dst_offset + range.size);
+                range.size = end - range.dst_offset;
+            } else {
+                try ranges.append(allocator, vk.BufferCopy {
+                    .src_offset = staging_size,
+                    .dst_offset = w.offset,
+                    .size = w.size,
+                });
+                staging_size += w.size;
+            }
+        }
+
+        // in order of writing, so later writes win
+        const staging = try encoder.uploadAllocator().alloc(u8, staging_size);
+        for (self.writes.items) |w| {
+            // last range starting at or before this write
+            var low: usize = 0;
+            var high: usize = ranges.items.len;
+            while (high - low > 1) {
+                const mid = low + (high - low) / 2;
+                if (ranges.items[mid].dst_offset <= w.offset) low = mid else high = mid;
+            }
+            const range = ranges.items[low];
+            const dst = staging[range.src_offset + (w.offset - range.dst_offset)..][0..w.size];
+            @memcpy(dst, self.data.items[w.data_offset..][0..w.size]);
+        }
+
+        const staging_slice = encoder.upload_allocator.getBufferSlice(staging);
+        for (ranges.items) |*range| range.src_offset += staging_slice.offset;
+        encoder.copyBuffer(staging_slice.handle, buffer, ranges.items);
+
+        const first = ranges.items[0];
+        const last = ranges.items[ranges.items.len - 1];
+        encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+            .buffer_memory_barrier_count = 1,
+            .p_buffer_memory_barriers = @ptrCast(&vk.BufferMemoryBarrier2 {
+                .src_stage_mask = .{ .copy_bit = true },
+                .src_access_mask = .{ .transfer_write_bit = true },
+                .dst_stage_mask = dst_stage_mask,
+                .dst_access_mask = dst_access_mask,
+                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
+                .buffer = buffer,
+                .offset = first.dst_offset,
+                .size = last.dst_offset + last.size - first.dst_offset,
+            }),
+        });
+    }
+
+    pub fn deinit(self: *BufferUpdates, allocator: std.mem.Allocator) void {
+        self.writes.deinit(allocator);
+        self.data.deinit(allocator);
+    }
+};
+
 fn sliceContainsPtr(container: []const u8, ptr: [*]const u8) bool {
     return @intFromPtr(ptr) >= @intFromPtr(container.ptr) and
         @intFromPtr(ptr) < (@intFromPtr(container.ptr) + container.len);
@@ -308,7 +308,7 @@ pub fn Pipeline(comptime options: struct {
             };
 
             const old_handle = self.handle;
-            _ = try vc.device.createComputePipelines(.null_handle, 1, @ptrCast(&create_info), null, @ptrCast(&self.handle));
+            _ = try vc.device.createComputePipelines(vc.pipeline_cache, 1, @ptrCast(&create_info), null, @ptrCast(&self.handle));
             errdefer vc.device.destroyPipeline(self.handle, null);
             try core.vk_helpers.setDebugName(vc.device, self.handle, options.shader_path);
 
@@ -329,6 +329,12 @@ pub fn Pipeline(comptime options: struct {
             command_buffer.dispatch(extent.width, extent.height, extent.depth);
         }
 
+        // dispatch size is read from a vk.DispatchIndirectCommand at `offset` in `buffer` when executed
+        pub fn recordDispatchIndirect(self: *const Self, command_buffer: VulkanContext.CommandBuffer, buffer: vk.Buffer, offset: vk.DeviceSize) void {
+            _ = self;
+            command_buffer.dispatchIndirect(buffer, offset);
+        }
+
         pub usingnamespace if (options.additional_descriptor_layout_count != 0) struct {
             pub fn recordBindAdditionalDescriptorSets(self: *const Self, command_buffer: VulkanContext.CommandBuffer, sets: [options.additional_descriptor_layout_count]vk.DescriptorSet) void {
                 command_buffer.bindDescriptorSets(.compute, self.bindings.layout, 1, sets.len, &sets, 0, undefined);
@@ -7,6 +7,7 @@ pub fn typeToObjectType(comptime in: type) vk.ObjectType {
     return switch(in) {
         vk.DescriptorSetLayout => .descriptor_set_layout,
         vk.DescriptorSet => .descriptor_set,
+        vk.DescriptorPool => .descriptor_pool,
         vk.Buffer => .buffer,
         vk.CommandBuffer => .command_buffer,
         vk.Image => .image,
@@ -17,6 +18,7 @@ pub fn typeToObjectType(comptime in: type) vk.ObjectType {
         vk.SwapchainKHR => .swapchain_khr,
         vk.ImageView => .image_view,
         vk.AccelerationStructureKHR => .acceleration_structure_khr,
+        vk.QueryPool => .query_pool,
         else => @compileError("unknown type " ++ @typeName(in)), // TODO: add more
     };
 }
@@ -31,18 +33,46 @@ pub fn setDebugName(device: VulkanContext.Device, object: anytype, name: [*:0]co
    }
 }
 
+// for block-compressed formats, this is the size of a whole block
 pub fn texelBlockSize(format: vk.Format) vk.DeviceSize {
     return switch (format) {
         .r8_unorm => 1,
         .r8g8_unorm => 2,
         .r8g8b8a8_srgb, .r8g8b8a8_unorm, .r32_sfloat => 4,
-        .r32g32_sfloat => 8,
+        .r16g16b16a16_sfloat, .r32g32_sfloat => 8,
         .r32g32b32_sfloat => 16,
         .r32g32b32a32_sfloat => 16,
+        .bc1_rgb_unorm_block, .bc1_rgb_srgb_block, .bc1_rgba_unorm_block, .bc1_rgba_srgb_block, .bc4_unorm_block, .bc4_snorm_block => 8,
+        .bc5_unorm_block, .bc5_snorm_block, .bc6h_ufloat_block, .bc6h_sfloat_block, .bc7_unorm_block, .bc7_srgb_block => 16,
         else => unreachable, // TODO
     };
 }
 
+pub fn texelBlockExtent(format: vk.Format) vk.Extent2D {
+    return switch (format) {
+        .bc1_rgb_unorm_block, .bc1_rgb_srgb_block, .bc1_rgba_unorm_block, .bc1_rgba_srgb_block,
+        .bc4_unorm_block, .bc4_snorm_block, .bc5_unorm_block, .bc5_snorm_block,
+        .bc6h_ufloat_block, .bc6h_sfloat_block, .bc7_unorm_block, .bc7_srgb_block => .{ .width = 4, .height = 4 },
+        else => .{ .width = 1, .height = 1 },
+    };
+}
+
+// size of the given mip level of an image, where partial blocks take up as much space as whole ones
+pub fn mipLevelSize(format: vk.Format, extent: vk.Extent2D, mip_level: u32) vk.DeviceSize {
+    const level_extent = mipLevelExtent(extent, mip_level);
+    const block_extent = texelBlockExtent(format);
+    const block_count = std.math.divCeil(vk.DeviceSize, level_extent.width, block_extent.width) catch unreachable
+        * (std.math.divCeil(vk.DeviceSize, level_extent.height, block_extent.height) catch unreachable);
+    return block_count * texelBlockSize(format);
+}
+
+pub fn mipLevelExtent(extent: vk.Extent2D, mip_level: u32) vk.Extent2D {
+    return vk.Extent2D {
+        .width = @max(extent.width >> @intCast(mip_level), 1),
+        .height = @max(extent.height >> @intCast(mip_level), 1),
+    };
+}
+
 pub fn typeToFormat(comptime in: type, comptime srgb: bool) vk.Format {
     const vector = @import("../engine.zig").vector;
     return switch (in) {
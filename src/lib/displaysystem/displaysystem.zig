@@ -1,6 +1,5 @@
 pub const Display = @import("./Display.zig");
 pub const Swapchain = @import("./Swapchain.zig");
-const metrics = @import("build_options").vk_metrics;
 
 const vk = @import("vulkan");
 
@@ -21,13 +20,7 @@ pub const required_vulkan_functions = [_]vk.ApiInfo {
             .destroySwapchainKHR = true,
         },
     },
-} ++ if (metrics) [_]vk.ApiInfo {
-    .{
-        .device_commands = .{
-            .cmdWriteTimestamp2 = true,
-        }
-    }
-} else [_]vk.ApiInfo {};
+};
 
 pub const required_device_extensions = [_][*:0]const u8{
     vk.extensions.khr_swapchain.name,
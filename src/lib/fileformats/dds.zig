@@ -1,6 +1,8 @@
 const vk = @import("vulkan");
 const std = @import("std");
 
+const vk_helpers = @import("../core/vk_helpers.zig");
+
 // https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-reference
 pub const PixelFormat = extern struct {
     size: u32,                  // expected to be 32
@@ -12,10 +14,12 @@ pub const PixelFormat = extern struct {
     b_bit_mask: u32,            // mask for blue data
     a_bit_mask: u32,            // mask for alpha data
 
-    fn verify(self: *const PixelFormat) void {
-        std.debug.assert(self.size == 32);
-        std.debug.assert(self.four_cc == comptime std.mem.readIntNative(u32, "DX10"));
+    fn verify(self: *const PixelFormat) !void {
+        if (self.size != 32) return error.InvalidDds;
+        if (self.flags & four_cc_flag == 0) return error.UnsupportedDdsFormat;
     }
+
+    const four_cc_flag = 0x4;
 };
 
 pub const Header = extern struct {
@@ -34,10 +38,12 @@ pub const Header = extern struct {
     caps4: u32,                 // unused
     reserved_2: u32,            // unused
 
-    fn verify(self: *const Header) void {
-        std.debug.assert(self.size == 124);
-        self.ddspf.verify();
+    fn verify(self: *const Header) !void {
+        if (self.size != 124) return error.InvalidDds;
+        try self.ddspf.verify();
     }
+
+    const mip_map_count_flag = 0x20000;
 };
 
 pub const HeaderDXT10 = extern struct {
@@ -48,15 +54,103 @@ pub const HeaderDXT10 = extern struct {
     misc_flags_2: u32,          // additional metadata
 };
 
+fn fourCC(comptime chars: *const [4]u8) u32 {
+    return std.mem.readInt(u32, chars, .little);
+}
+
+const magic = fourCC("DDS ");
+
+// a 2D texture along with its mip chain, each level tightly packed after the other starting with the largest
+pub const Texture = struct {
+    format: vk.Format,
+    extent: vk.Extent2D,
+    mip_level_count: u32,
+    data: []const u8, // points into the file
+
+    // only supports the block-compressed formats, either through legacy FourCCs or the DX10 header
+    pub fn fromBytes(bytes: []const u8) !Texture {
+        if (bytes.len < @sizeOf(u32) + @sizeOf(Header)) return error.InvalidDds;
+        if (std.mem.readInt(u32, bytes[0..4], .little) != magic) return error.InvalidDds;
+
+        var header: Header = undefined;
+        @memcpy(std.mem.asBytes(&header), bytes[4..][0..@sizeOf(Header)]);
+        try header.verify();
+
+        var data_offset: usize = @sizeOf(u32) + @sizeOf(Header);
+        const format: vk.Format = if (header.ddspf.four_cc == fourCC("DX10")) blk: {
+            if (bytes.len < data_offset + @sizeOf(HeaderDXT10)) return error.InvalidDds;
+            var header_10: HeaderDXT10 = undefined;
+            @memcpy(std.mem.asBytes(&header_10), bytes[data_offset..][0..@sizeOf(HeaderDXT10)]);
+            data_offset += @sizeOf(HeaderDXT10);
+            if (header_10.array_size > 1 or (header_10.misc_flag & cubemap_flag) != 0) return error.UnsupportedDdsFormat;
+            break :blk try dxgiToVk(header_10.dxgi_format);
+        } else if (header.ddspf.four_cc == fourCC("DXT1")) .bc1_rgba_unorm_block
+        else if (header.ddspf.four_cc == fourCC("ATI1") or header.ddspf.four_cc == fourCC("BC4U")) .bc4_unorm_block
+        else if (header.ddspf.four_cc == fourCC("ATI2") or header.ddspf.four_cc == fourCC("BC5U")) .bc5_unorm_block
+        else return error.UnsupportedDdsFormat;
+
+        const extent = vk.Extent2D {
+            .width = header.width,
+            .height = header.height,
+        };
+        if (extent.width == 0 or extent.height == 0) return error.InvalidDds;
+        const max_mip_level_count = std.math.log2(@max(extent.width, extent.height)) + 1;
+        const mip_level_count = if (header.flags & Header.mip_map_count_flag != 0) @max(header.mip_map_count, 1) else 1;
+        if (mip_level_count > max_mip_level_count) return error.InvalidDds;
+
+        var size: usize = 0;
+        for (0..mip_level_count) |level| size += @intCast(vk_helpers.mipLevelSize(format, extent, @intCast(level)));
+        if (bytes.len < data_offset + size) return error.InvalidDds;
+
+        return Texture {
+            .format = format,
+            .extent = extent,
+            .mip_level_count = mip_level_count,
+            .data = bytes[data_offset..][0..size],
+        };
+    }
+
+    // dds only says whether data is srgb in the DX10 header, so allow overriding it when the user knows better
+    pub fn withSrgb(self: Texture, srgb: bool) Texture {
+        var texture = self;
+        texture.format = switch (self.format) {
+            .bc1_rgba_unorm_block, .bc1_rgba_srgb_block => if (srgb) .bc1_rgba_srgb_block else .bc1_rgba_unorm_block,
+            .bc7_unorm_block, .bc7_srgb_block => if (srgb) .bc7_srgb_block else .bc7_unorm_block,
+            else => self.format,
+        };
+        return texture;
+    }
+};
+
+const cubemap_flag = 4;
+
+// https://learn.microsoft.com/en-us/windows/win32/api/dxgiformat/ne-dxgiformat-dxgi_format
+// typeless formats are treated as unorm
+fn dxgiToVk(dxgi_format: u32) !vk.Format {
+    return switch (dxgi_format) {
+        70, 71 => .bc1_rgba_unorm_block,
+        72 => .bc1_rgba_srgb_block,
+        79, 80 => .bc4_unorm_block,
+        81 => .bc4_snorm_block,
+        82, 83 => .bc5_unorm_block,
+        84 => .bc5_snorm_block,
+        94, 95 => .bc6h_ufloat_block,
+        96 => .bc6h_sfloat_block,
+        97, 98 => .bc7_unorm_block,
+        99 => .bc7_srgb_block,
+        else => error.UnsupportedDdsFormat,
+    };
+}
+
 pub const FileInfo = extern struct {
     magic: u32,                 // expected to be 542327876, hex for "DDS"
     header: Header,          // first header
     header_10: HeaderDXT10,  // second header
 
     // just some random sanity checks to make sure we actually are getting a DDS file
-    pub fn verify(self: *const FileInfo) void {
-        std.debug.assert(self.magic == 542327876);
-        self.header.verify();
+    pub fn verify(self: *const FileInfo) !void {
+        if (self.magic != magic) return error.InvalidDds;
+        try self.header.verify();
     }
 
     pub fn getExtent(self: *const FileInfo) vk.Extent2D {
@@ -66,18 +160,11 @@ pub const FileInfo = extern struct {
         };
     }
 
-    pub fn getFormat(self: *const FileInfo) vk.Format {
-        return switch (self.header_10.dxgi_format) {
-            71 => .bc1_rgb_srgb_block,
-            80 => .bc4_unorm_block,
-            83 => .bc5_unorm_block,
-            95 => .bc6h_ufloat_block,
-            96 => .bc6h_sfloat_block,
-            else => unreachable, // TODO
-        };
+    pub fn getFormat(self: *const FileInfo) !vk.Format {
+        return dxgiToVk(self.header_10.dxgi_format);
     }
 
     pub fn isCubemap(self: *const FileInfo) bool {
-        return self.header_10.misc_flag == 4;
+        return (self.header_10.misc_flag & cubemap_flag) != 0;
     }
 };
\ No newline at end of file
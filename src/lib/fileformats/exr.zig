@@ -135,35 +135,88 @@ pub const helpers = struct {
         }
 
         pub fn save(self: Rgba2D, allocator: std.mem.Allocator, out_filename: []const u8) !void {
-            const channel_count = 3;
+            var channels = try Rgb2D.create(allocator, self.extent);
+            defer channels.destroy(allocator);
 
-            var header: Header = undefined;
-            initExrHeader(&header);
+            channels.writeRegion(.{ .x = 0, .y = 0 }, self);
+            try channels.save(allocator, out_filename);
+        }
 
-            var image: Image = undefined;
-            initExrImage(&image);
+        pub fn load(allocator: std.mem.Allocator, filename: []const u8) !Rgba2D {
+            const file_content = try std.fs.cwd().readFileAlloc(allocator, filename, std.math.maxInt(usize));
+            defer allocator.free(file_content);
 
-            const pixel_count = self.extent.width * self.extent.height;
+            var out_rgba: [*c]f32 = undefined;
+            var width: c_int = undefined;
+            var height: c_int = undefined;
+            try loadEXRFromMemory(&out_rgba, &width, &height, file_content.ptr, file_content.len);
+            defer std.c.free(out_rgba);
+            const malloc_slice = Rgba2D {
+                .ptr = @ptrCast(out_rgba),
+                .extent = vk.Extent2D {
+                    .width = @intCast(width),
+                    .height = @intCast(height),
+                },
+            };
+            const out = Rgba2D {
+                .ptr = (try allocator.dupe([4]f32, malloc_slice.asSlice())).ptr, // copy into zig allocator
+                .extent = malloc_slice.extent,
+            };
+            return out;
+        }
+    };
 
-            const ImageChannels = std.MultiArrayList(struct {
-                r: f32,
-                g: f32,
-                b: f32,
-            });
-            var image_channels = ImageChannels {};
-            defer image_channels.deinit(allocator);
+    // RGB image stored in memory as one buffer per channel, like EXR wants it
+    //
+    // can be filled in a region at a time, for images put together from multiple renders
+    pub const Rgb2D = struct {
+        channels: std.MultiArrayList(struct {
+            r: f32,
+            g: f32,
+            b: f32,
+        }),
+        extent: vk.Extent2D,
 
-            try image_channels.ensureUnusedCapacity(allocator, pixel_count);
+        pub fn create(allocator: std.mem.Allocator, extent: vk.Extent2D) !Rgb2D {
+            var self = Rgb2D {
+                .channels = .{},
+                .extent = extent,
+            };
+            try self.channels.resize(allocator, extent.width * extent.height);
+            return self;
+        }
 
-            for (0..pixel_count) |i| {
-                image_channels.appendAssumeCapacity(.{
-                    .r = self.asSlice()[i][0],
-                    .g = self.asSlice()[i][1],
-                    .b = self.asSlice()[i][2],
-                });
+        // copies all of `region` to the pixels starting at `offset`, which must fit
+        pub fn writeRegion(self: *Rgb2D, offset: vk.Offset2D, region: Rgba2D) void {
+            const x: u32 = @intCast(offset.x);
+            const y: u32 = @intCast(offset.y);
+            std.debug.assert(x + region.extent.width <= self.extent.width and y + region.extent.height <= self.extent.height);
+
+            const channels = self.channels.slice();
+            const r = channels.items(.r);
+            const g = channels.items(.g);
+            const b = channels.items(.b);
+            for (0..region.extent.height) |row| {
+                const src = region.asSlice()[row * region.extent.width..][0..region.extent.width];
+                const dst_start = (y + row) * self.extent.width + x;
+                for (src, dst_start..) |pixel, i| {
+                    r[i] = pixel[0];
+                    g[i] = pixel[1];
+                    b[i] = pixel[2];
+                }
             }
+        }
+
+        pub fn save(self: Rgb2D, allocator: std.mem.Allocator, out_filename: []const u8) !void {
+            const channel_count = 3;
+
+            var header: Header = undefined;
+            initExrHeader(&header);
+
+            var image: Image = undefined;
+            initExrImage(&image);
 
-            const image_channels_slice = image_channels.slice();
+            const image_channels_slice = self.channels.slice();
             image.num_channels = channel_count;
             image.images = @constCast(&[3][*c]u8 {
                 image_channels_slice.ptrs[2],
@@ -205,27 +258,8 @@ pub const helpers = struct {
             try std.fs.cwd().writeFile(.{ .sub_path = out_filename, .data = data[0..file_size]});
         }
 
-        pub fn load(allocator: std.mem.Allocator, filename: []const u8) !Rgba2D {
-            const file_content = try std.fs.cwd().readFileAlloc(allocator, filename, std.math.maxInt(usize));
-            defer allocator.free(file_content);
-
-            var out_rgba: [*c]f32 = undefined;
-            var width: c_int = undefined;
-            var height: c_int = undefined;
-            try loadEXRFromMemory(&out_rgba, &width, &height, file_content.ptr, file_content.len);
-            defer std.c.free(out_rgba);
-            const malloc_slice = Rgba2D {
-                .ptr = @ptrCast(out_rgba),
-                .extent = vk.Extent2D {
-                    .width = @intCast(width),
-                    .height = @intCast(height),
-                },
-            };
-            const out = Rgba2D {
-                .ptr = (try allocator.dupe([4]f32, malloc_slice.asSlice())).ptr, // copy into zig allocator
-                .extent = malloc_slice.extent,
-            };
-            return out;
+        pub fn destroy(self: *Rgb2D, allocator: std.mem.Allocator) void {
+            self.channels.deinit(allocator);
         }
     };
 };
@@ -162,6 +162,20 @@ fn destroyDecoder(format: DecodableImageFileFormat, allocator: std.mem.Allocator
     } else unreachable;
 }
 
+// only decodes the header, for finding out how much space an image needs before actually decoding it
+pub fn loadDimensions(allocator: std.mem.Allocator, buffer: []const u8) !std.meta.Tuple(&.{u32, u32}) {
+    var src = c.wuffs_base__ptr_u8__reader(@constCast(buffer.ptr), buffer.len, true);
+    const format = (try guessFourCC(buffer)).toDecodableImageFileFormat() orelse return error.NotImage;
+
+    const decoder = try createDecoder(format, allocator);
+    defer destroyDecoder(format, allocator, decoder);
+
+    var ic: c.wuffs_base__image_config = undefined;
+    try statusToError(c.wuffs_base__image_decoder__decode_image_config(decoder, &ic, &src));
+
+    return .{ c.wuffs_base__pixel_config__width(&ic.pixcfg), c.wuffs_base__pixel_config__height(&ic.pixcfg) };
+}
+
 pub fn load(allocator: std.mem.Allocator, buffer: []const u8) !std.meta.Tuple(&.{[]const u8, u32, u32}) {
     var src = c.wuffs_base__ptr_u8__reader(@constCast(buffer.ptr), buffer.len, true);
     const format = (try guessFourCC(buffer)).toDecodableImageFileFormat() orelse return error.NotImage;
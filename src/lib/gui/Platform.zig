@@ -170,7 +170,7 @@ pub fn create(vc: *const VulkanContext, swapchain: Swapchain, window: Window, ex
         };
         const dynamic_states = [_]vk.DynamicState{ .viewport, .scissor };
         var pipeline: vk.Pipeline = undefined;
-        _ = try vc.device.createGraphicsPipelines(.null_handle, 1, @ptrCast(&vk.GraphicsPipelineCreateInfo{
+        _ = try vc.device.createGraphicsPipelines(vc.pipeline_cache, 1, @ptrCast(&vk.GraphicsPipelineCreateInfo{
             .stage_count = shader_stage_create_info.len,
             .p_stages = &shader_stage_create_info,
             .p_vertex_input_state = &vk.PipelineVertexInputStateCreateInfo{
@@ -5,8 +5,6 @@ const engine = @import("../engine.zig");
 const core = engine.core;
 const VulkanContext = core.VulkanContext;
 const Encoder = core.Encoder;
-const Image = core.Image;
-const vk_helpers = core.vk_helpers;
 
 const MeshManager = @import("./MeshManager.zig");
 const MaterialManager = @import("./MaterialManager.zig");
@@ -34,86 +32,200 @@ const F32x3 = vector.Vec3(f32);
 pub const Instance = struct {
     transform: Mat3x4, // transform of this instance
     visible: bool = true, // whether this instance is visible
+    build: BuildPreference = .fast_trace, // how the BLAS of this instance is built
     geometries: []const Geometry, // geometries in this instance
 };
 
+// what a BLAS is optimized for
+//
+// BLASes that prefer fast traces are compacted once built, while
+// those that prefer fast builds are meant for meshes that deform often
+pub const BuildPreference = enum {
+    fast_trace,
+    fast_build,
+
+    fn flags(self: BuildPreference) vk.BuildAccelerationStructureFlagsKHR {
+        return switch (self) {
+            .fast_trace => .{ .prefer_fast_trace_bit_khr = true, .allow_update_bit_khr = true, .allow_compaction_bit_khr = true },
+            .fast_build => .{ .prefer_fast_build_bit_khr = true, .allow_update_bit_khr = true },
+        };
+    }
+};
+
 pub const Geometry = extern struct {
     mesh: u32, // idx of mesh that this geometry uses
     material: u32, // idx of material that this geometry uses
 };
 
-const BottomLevelAccels = std.MultiArrayList(struct {
-    handle: vk.AccelerationStructureKHR,
+const BottomLevelAccel = struct {
+    handle: vk.AccelerationStructureKHR, // null until built by recordCommit
     buffer: core.mem.DeviceBuffer(u8, .{ .acceleration_structure_storage_bit_khr = true, .shader_device_address_bit = true }),
-});
+    size: vk.DeviceSize, // of the acceleration structure in buffer
+    geometries: []const Geometry, // owned, what this was built from, needed to refit
+    ref_count: u32, // instances using this, freed once this reaches zero
+    build: BuildPreference,
+    compaction_query: ?CompactionQuery, // set while its compacted size is being queried
+};
+
+const BottomLevelAccels = std.MultiArrayList(BottomLevelAccel);
+
+const CompactionQuery = struct {
+    pool: vk.QueryPool,
+    index: u32,
+};
+
+// BLASes built together have their compacted sizes queried into a single pool
+const CompactionBatch = struct {
+    query_pool: vk.QueryPool,
+    blases: []const u32, // owned, indices into blases in query order
+};
 
 const TrianglePowerPipeline = engine.core.pipeline.Pipeline(.{ .shader_path = "hrtsystem/mesh_sampling/power.hlsl",
     .PushConstants = extern struct {
-        instance_index: u32,
-        geometry_index: u32,
+        mesh_index: u32,
+        material_index: u32,
         triangle_count: u32,
+        triangle_power_offset: u32,
     },
     .PushSetBindings = struct {
-        instances: vk.Buffer,
-        world_to_instances: vk.Buffer,
         meshes: vk.Buffer,
-        geometries: vk.Buffer,
         material_values: vk.Buffer,
-        emissive_triangle_count: vk.Buffer,
-        dst_power: engine.core.pipeline.StorageImage,
-        dst_triangle_metadata: vk.Buffer,
+        dst_triangle_powers: vk.Buffer,
     },
     .additional_descriptor_layout_count = 1,
 });
 
-const TrianglePowerFoldPipeline = engine.core.pipeline.Pipeline(.{ .shader_path = "hrtsystem/mesh_sampling/fold.hlsl",
+const PowerFoldPipeline = engine.core.pipeline.Pipeline(.{ .shader_path = "hrtsystem/mesh_sampling/fold.hlsl",
     .PushSetBindings = struct {
-        src_mip: engine.core.pipeline.SampledImage,
-        dst_mip: engine.core.pipeline.StorageImage,
-        instances: vk.Buffer,
-        geometry_to_triangle_power_offset: vk.Buffer,
-        emissive_triangle_count: vk.Buffer,
+        powers: vk.Buffer,
     },
     .PushConstants = extern struct {
-        instance_index: u32,
-        geometry_index: u32,
-        triangle_count: u32,
+        src_offset: u32,
+        src_size: u32,
+    },
+});
+
+const GeometryPowerLeavesPipeline = engine.core.pipeline.Pipeline(.{ .shader_path = "hrtsystem/mesh_sampling/leaves.hlsl",
+    .PushSetBindings = struct {
+        triangle_powers: vk.Buffer,
+        geometry_power_infos: vk.Buffer,
+        geometry_powers: vk.Buffer,
+    },
+    .PushConstants = extern struct {
+        geometry_count: u32,
     },
 });
 
-const TriangleMetadata = extern struct {
+const GeometryPowerInfo = extern struct {
     instance_index: u32,
     geometry_index: u32,
-    area_: f32,
+    triangle_offset: u32, // maxInt if this geometry is not tracked for emissive light
+    triangle_count: u32,
+    power_scale: f32, // from the space of the mesh, which the triangle powers are in, to world space
+};
+
+// span of triangle_powers holding one power tree
+const TrianglePowerRange = struct {
+    offset: u32,
+    size: u32,
 };
 
+// triangle powers are in the space of the mesh, so all geometries
+// with the same mesh and material share one power tree
+const TrianglePowerKey = struct {
+    mesh: MeshManager.Handle,
+    material: MaterialManager.Handle,
+};
+
+const TrianglePowerTree = struct {
+    range: TrianglePowerRange,
+    triangle_count: u32,
+    ref_count: u32, // geometries using this, freed once this reaches zero
+    stale: bool, // (re)computed on the next commit
+};
+
+// a geometry tracked for emissive light
+const EmissiveGeometry = struct {
+    key: TrianglePowerKey,
+    info: GeometryPowerInfo, // as uploaded to geometry_power_infos
+};
+
+// emissive light is importance sampled with two levels of power trees, see power_tree.hlsl --
+// one over all flat geometries in geometry_powers, and one per mesh and material over its triangles in triangle_powers
+//
+// only geometries whose material may emit are tracked, and space in triangle_powers is handed out
+// on the host, so it can grow as needed and be reused once no geometry uses a tree anymore
+//
+// the geometry power tree is cheap to remake as a whole, so it is, on every commit that changes any geometry
 triangle_power_pipeline: TrianglePowerPipeline,
-triangle_power_fold_pipeline: TrianglePowerFoldPipeline,
-// TODO: this needs to be 2D and possibly aliased, or just a buffer rather than an image
-triangle_powers_meta: core.mem.DeviceBuffer(TriangleMetadata, .{ .storage_buffer_bit = true }),
-triangle_powers: Image,
-triangle_powers_mips: [std.math.log2(max_emissive_triangles) + 1]vk.ImageView,
-geometry_to_triangle_power_offset: core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }) = .{},
-emissive_triangle_count: core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }), // size 1
+power_fold_pipeline: PowerFoldPipeline,
+geometry_power_leaves_pipeline: GeometryPowerLeavesPipeline,
+triangle_powers: core.mem.GrowableDeviceBuffer(f32, .{ .storage_buffer_bit = true }),
+triangle_power_count: u32 = 0, // high-water mark of triangle_powers
+triangle_power_trees: std.AutoArrayHashMapUnmanaged(TrianglePowerKey, TrianglePowerTree) = .{},
+free_triangle_power_ranges: std.ArrayListUnmanaged(TrianglePowerRange) = .{},
+emissive_geometries: std.AutoArrayHashMapUnmanaged(u32, EmissiveGeometry) = .{}, // by flat geometry index
+geometry_powers: core.mem.DeviceBuffer(f32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }), // laid out for geometry_power_infos.capacity leaves
+geometry_power_infos: core.mem.GrowableDeviceBuffer(GeometryPowerInfo, .{ .storage_buffer_bit = true }),
+geometry_power_info_updates: core.mem.BufferUpdates = .{}, // uploaded on the next commit
 
 blases: BottomLevelAccels = .{},
+free_blases: std.ArrayListUnmanaged(u32) = .{}, // slots in blases that can be reused
+
+// in submission order, so once one is not ready the later ones are not either
+pending_compactions: std.ArrayListUnmanaged(CompactionBatch) = .{},
 
-instance_count: u32 = 0,
-instances_device: core.mem.DeviceBuffer(vk.AccelerationStructureInstanceKHR, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true, .storage_buffer_bit = true }),
-instances_host: core.mem.UploadBuffer(vk.AccelerationStructureInstanceKHR),
-instances_address: vk.DeviceAddress,
+// BLASes built together share one scratch buffer, each at an offset aligned to this
+scratch_alignment: vk.DeviceSize,
+
+instance_count: u32 = 0, // including destroyed ones, which stay in the TLAS as inactive instances
+instance_infos: []InstanceInfo, // host-side bookkeeping per instance
+free_instances: std.ArrayListUnmanaged(Handle) = .{}, // destroyed instances whose handles can be reused
+instances_device: core.mem.GrowableDeviceBuffer(vk.AccelerationStructureInstanceKHR, .{ .shader_device_address_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true, .storage_buffer_bit = true }),
+instances_host: []vk.AccelerationStructureInstanceKHR, // plain host memory, edits are staged through the encoder
+instances_address: vk.DeviceAddress, // changes whenever instances_device grows
 
 // keep track of inverse transform -- non-inverse we can get from instances_device
 // transforms provided by shader only in hit/intersection shaders but we need them
 // in raygen
 // ray queries provide them in any shader which would be a benefit of using them
-world_to_instance_device: core.mem.DeviceBuffer(Mat3x4, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }),
-world_to_instance_host: core.mem.UploadBuffer(Mat3x4),
+world_to_instance_device: core.mem.GrowableDeviceBuffer(Mat3x4, .{ .storage_buffer_bit = true }),
+world_to_instance_host: []Mat3x4,
+
+// ranges edited on the host that have not yet been
+// uploaded to the device, see recordCommit
+dirty_instances: ?DirtyRange = null,
+dirty_geometries: ?DirtyRange = null,
+
+// queued by queueInstances but not built yet
+pending_blases: std.ArrayListUnmanaged(u32) = .{},
+pending_instances: std.ArrayListUnmanaged(Handle) = .{}, // need their BLAS reference filled in
+
+// set when instances are queued or destroyed, as neither can be refit
+need_tlas_build: bool = false,
+
+// instances whose emissive light is looked at again on the next commit, e.g. as one of
+// their materials changed -- newly queued instances are looked at anyway
+dirty_power_instances: std.ArrayListUnmanaged(Handle) = .{},
+
+// alive instances with a geometry using each material, so that a material edit only looks at those
+material_instances: std.AutoHashMapUnmanaged(MaterialManager.Handle, std.AutoArrayHashMapUnmanaged(Handle, void)) = .{},
+
+// set whenever the leaves of the geometry power tree may have changed
+need_geometry_power_rebuild: bool = false,
+
+// meshes whose vertices changed since the last commit, BLASes using them get refit
+updated_meshes: std.AutoArrayHashMapUnmanaged(MeshManager.Handle, void) = .{},
 
 // flat jagged array for geometries --
 // use instanceCustomIndex + GeometryID() here to get geometry
+//
+// destroyed instances leave holes behind, which are squeezed out
+// by compactGeometries once there are enough of them
 geometry_count: u24 = 0,
-geometries: core.mem.DeviceBuffer(Geometry, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }),
+dead_geometry_count: u24 = 0, // geometries of destroyed instances not yet compacted away
+geometries: core.mem.GrowableDeviceBuffer(Geometry, .{ .storage_buffer_bit = true }),
+geometries_host: []Geometry,
 
 // tlas stuff
 tlas_handle: vk.AccelerationStructureKHR = .null_handle,
@@ -122,33 +234,135 @@ tlas_buffer: core.mem.DeviceBuffer(u8, .{ .acceleration_structure_storage_bit_kh
 tlas_update_scratch_buffer: core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }) = .{},
 tlas_update_scratch_address: vk.DeviceAddress = 0,
 
+// refits degrade trace performance over time as the TLAS drifts away from
+// the instances it was built for, so rebuild after this many of them
+max_tlas_refits: u32 = 32,
+tlas_refit_count: u32 = 0, // refits since the last full build
+
 const Self = @This();
 
-// TODO: resizable buffers
-const max_instances = std.math.powi(u32, 2, 12) catch unreachable;
-const max_geometries = std.math.powi(u32, 2, 12) catch unreachable;
-const max_emissive_triangles = std.math.powi(u32, 2, 15) catch unreachable;
+const InstanceInfo = struct {
+    blas: u32, // index into blases
+    geometry_count: u32, // first geometry is the instance custom index
+    alive: bool,
+};
+
+const DirtyRange = struct {
+    first: u32,
+    last: u32, // inclusive
+
+    fn extend(self: ?DirtyRange, index: u32) DirtyRange {
+        return if (self) |range| DirtyRange {
+            .first = @min(range.first, index),
+            .last = @max(range.last, index),
+        } else DirtyRange {
+            .first = index,
+            .last = index,
+        };
+    }
+};
+
+// instance and geometry buffers start out this big and grow as needed,
+// on the host when queueing and on the device when committing
+const initial_instance_capacity = std.math.powi(u32, 2, 12) catch unreachable;
+const initial_geometry_capacity = std.math.powi(u32, 2, 12) catch unreachable;
+const initial_triangle_power_capacity = std.math.powi(u32, 2, 16) catch unreachable; // nodes of all triangle power trees together
+const max_geometries = std.math.maxInt(u24); // limited by the size of the instance custom index
+
+// capacity to grow to so that it fits at least `count`, doubling to amortise reallocation
+fn growCapacity(capacity: usize, count: usize) usize {
+    var new_capacity = @max(capacity, 1);
+    while (new_capacity < count) new_capacity *= 2;
+    return new_capacity;
+}
 
+// number of nodes in a power tree over this many leaves, see power_tree.hlsl
+fn powerTreeSize(leaf_count: u32) u32 {
+    var size: u32 = 0;
+    var level_size = leaf_count;
+    while (level_size > 1) : (level_size = (level_size + 1) / 2) size += level_size;
+    return size + 1;
+}
+
+// fills in vulkan geometry descriptions of a list of geometries
+fn fillBlasGeometries(vc: *const VulkanContext, mesh_manager: MeshManager, list: []const Geometry, vk_geometries: []vk.AccelerationStructureGeometryKHR, build_ranges: []vk.AccelerationStructureBuildRangeInfoKHR, primitive_counts: []u32) void {
+    for (list, vk_geometries, build_ranges, primitive_counts) |geo, *geometry, *build_range, *primitive_count| {
+        const mesh = mesh_manager.meshes.get(geo.mesh);
+
+        geometry.* = vk.AccelerationStructureGeometryKHR {
+            .geometry_type = .triangles_khr,
+            .flags = .{ .opaque_bit_khr = true },
+            .geometry = .{
+                .triangles = .{
+                    .vertex_format = .r32g32b32_sfloat,
+                    .vertex_data = .{
+                        .device_address = mesh.position_buffer.getAddress(vc),
+                    },
+                    .vertex_stride = @sizeOf(F32x3),
+                    .max_vertex = @intCast(mesh.vertex_count - 1),
+                    .index_type = if (mesh.index_count != 0) .uint32 else .none_khr,
+                    .index_data = .{
+                        .device_address = mesh.index_buffer.getAddress(vc),
+                    },
+                    .transform_data = .{
+                        .device_address = 0,
+                    }
+                }
+            }
+        };
+
+        build_range.* =  vk.AccelerationStructureBuildRangeInfoKHR {
+            .primitive_count = @intCast(if (mesh.index_count != 0) mesh.index_count else @divExact(mesh.vertex_count, 3)),
+            .primitive_offset = 0,
+            .transform_offset = 0,
+            .first_vertex = 0,
+        };
+        primitive_count.* = build_range.primitive_count;
+    }
+}
+
+// makes one scratch buffer for a batch of builds, attached to the encoder
+// the builds each get their own part of it, so they may run concurrently
+fn assignScratch(self: *const Self, vc: *const VulkanContext, encoder: *Encoder, build_geometry_infos: []vk.AccelerationStructureBuildGeometryInfoKHR, scratch_sizes: []const vk.DeviceSize) !void {
+    var total_size: vk.DeviceSize = self.scratch_alignment - 1; // buffer address itself may not be aligned enough
+    for (scratch_sizes) |size| total_size += std.mem.alignForward(vk.DeviceSize, size, self.scratch_alignment);
+
+    const scratch_buffer = try core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }).create(vc, total_size, "blas scratch buffer");
+    try encoder.attachResource(scratch_buffer);
+
+    var address = std.mem.alignForward(vk.DeviceAddress, scratch_buffer.getAddress(vc), self.scratch_alignment);
+    for (build_geometry_infos, scratch_sizes) |*build_geometry_info, size| {
+        build_geometry_info.scratch_data.device_address = address;
+        address += std.mem.alignForward(vk.DeviceSize, size, self.scratch_alignment);
+    }
+}
+
+// builds the BLASes in pending_blases from their geometries, all in one go
+// those preferring fast traces have their compacted size queried, see recordCompactBlases
 // lots of temp memory allocations here
 // encoder must be in recording state
-// returns scratch buffers that must be kept alive until command is completed
-fn makeBlases(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, geometries: []const []const Geometry, blases: *BottomLevelAccels) !void {
-    const build_geometry_infos = try allocator.alloc(vk.AccelerationStructureBuildGeometryInfoKHR, geometries.len);
+fn makeBlases(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager) !void {
+    const indices = self.pending_blases.items;
+    const blases = self.blases.slice();
+
+    const build_geometry_infos = try allocator.alloc(vk.AccelerationStructureBuildGeometryInfoKHR, indices.len);
     defer allocator.free(build_geometry_infos);
     defer for (build_geometry_infos) |build_geometry_info| allocator.free(build_geometry_info.p_geometries.?[0..build_geometry_info.geometry_count]);
 
-    const build_infos = try allocator.alloc([*]vk.AccelerationStructureBuildRangeInfoKHR, geometries.len);
+    const build_infos = try allocator.alloc([*]vk.AccelerationStructureBuildRangeInfoKHR, indices.len);
     defer allocator.free(build_infos);
     defer for (build_infos, build_geometry_infos) |build_info, build_geometry_info| allocator.free(build_info[0..build_geometry_info.geometry_count]);
 
-    try blases.ensureUnusedCapacity(allocator, geometries.len);
+    const scratch_sizes = try allocator.alloc(vk.DeviceSize, indices.len);
+    defer allocator.free(scratch_sizes);
 
-    for (geometries, build_infos, build_geometry_infos) |list, *build_info, *build_geometry_info| {
+    for (indices, build_infos, build_geometry_infos, scratch_sizes) |index, *build_info, *build_geometry_info, *scratch_size| {
+        const list = blases.items(.geometries)[index];
         const vk_geometries = try allocator.alloc(vk.AccelerationStructureGeometryKHR, list.len);
 
         build_geometry_info.* = vk.AccelerationStructureBuildGeometryInfoKHR {
             .type = .bottom_level_khr,
-            .flags = .{ .prefer_fast_trace_bit_khr = true },
+            .flags = blases.items(.build)[index].flags(),
             .mode = .build_khr,
             .geometry_count = @intCast(vk_geometries.len),
             .p_geometries = vk_geometries.ptr,
@@ -158,47 +372,13 @@ fn makeBlases(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *
         const primitive_counts = try allocator.alloc(u32, list.len);
         defer allocator.free(primitive_counts);
 
-        build_info.* = (try allocator.alloc(vk.AccelerationStructureBuildRangeInfoKHR, list.len)).ptr;
-
-        for (list, vk_geometries, primitive_counts, 0..) |geo, *geometry, *primitive_count, j| {
-            const mesh = mesh_manager.meshes.get(geo.mesh);
-
-            geometry.* = vk.AccelerationStructureGeometryKHR {
-                .geometry_type = .triangles_khr,
-                .flags = .{ .opaque_bit_khr = true },
-                .geometry = .{
-                    .triangles = .{
-                        .vertex_format = .r32g32b32_sfloat,
-                        .vertex_data = .{
-                            .device_address = mesh.position_buffer.getAddress(vc),
-                        },
-                        .vertex_stride = @sizeOf(F32x3),
-                        .max_vertex = @intCast(mesh.vertex_count - 1),
-                        .index_type = if (mesh.index_count != 0) .uint32 else .none_khr,
-                        .index_data = .{
-                            .device_address = mesh.index_buffer.getAddress(vc),
-                        },
-                        .transform_data = .{
-                            .device_address = 0,
-                        }
-                    }
-                }
-            };
-
-            build_info.*[j] =  vk.AccelerationStructureBuildRangeInfoKHR {
-                .primitive_count = @intCast(if (mesh.index_count != 0) mesh.index_count else @divExact(mesh.vertex_count, 3)),
-                .primitive_offset = 0,
-                .transform_offset = 0,
-                .first_vertex = 0,
-            };
-            primitive_count.* = build_info.*[j].primitive_count;
-        }
+        const build_ranges = try allocator.alloc(vk.AccelerationStructureBuildRangeInfoKHR, list.len);
+        build_info.* = build_ranges.ptr;
 
-        const size_info = getBuildSizesInfo(vc, build_geometry_info, primitive_counts.ptr);
+        fillBlasGeometries(vc, mesh_manager, list, vk_geometries, build_ranges, primitive_counts);
 
-        const scratch_buffer = try core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }).create(vc, size_info.build_scratch_size, "blas scratch buffer");
-        try encoder.attachResource(scratch_buffer);
-        build_geometry_info.scratch_data.device_address = scratch_buffer.getAddress(vc);
+        const size_info = getBuildSizesInfo(vc, build_geometry_info, primitive_counts.ptr);
+        scratch_size.* = size_info.build_scratch_size;
 
         const buffer = try core.mem.DeviceBuffer(u8, .{ .acceleration_structure_storage_bit_khr = true, .shader_device_address_bit = true }).create(vc, size_info.acceleration_structure_size, "blas buffer");
         errdefer buffer.destroy(vc);
@@ -209,184 +389,563 @@ fn makeBlases(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *
             .size = size_info.acceleration_structure_size,
             .type = .bottom_level_khr,
         }, null);
-        errdefer vc.device.destroyAccelerationStructureKHR(build_geometry_info.dst_acceleration_structure, null);
 
-        blases.appendAssumeCapacity(.{
-            .handle = build_geometry_info.dst_acceleration_structure,
-            .buffer = buffer,
-        });
+        blases.items(.handle)[index] = build_geometry_info.dst_acceleration_structure;
+        blases.items(.buffer)[index] = buffer;
+        blases.items(.size)[index] = size_info.acceleration_structure_size;
     }
 
+    try self.assignScratch(vc, encoder, build_geometry_infos, scratch_sizes);
+    const scope = encoder.beginScope("blas build");
     encoder.buildAccelerationStructures(build_geometry_infos, build_infos);
+    encoder.endScope(scope, buildPrimitiveCount(build_geometry_infos, build_infos));
+
+    try self.recordQueryCompactedSizes(vc, allocator, encoder, indices);
+}
+
+// queries how small those of the just built BLASes that prefer fast traces could be made
+// the results are picked up without waiting by a later recordCompactBlases
+fn recordQueryCompactedSizes(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, indices: []const u32) !void {
+    const blases = self.blases.slice();
+
+    var compactable = std.ArrayListUnmanaged(u32) {};
+    defer compactable.deinit(allocator);
+    for (indices) |index| {
+        if (blases.items(.build)[index] == .fast_trace) try compactable.append(allocator, index);
+    }
+    if (compactable.items.len == 0) return;
+
+    try self.pending_compactions.ensureUnusedCapacity(allocator, 1);
+
+    const handles = try allocator.alloc(vk.AccelerationStructureKHR, compactable.items.len);
+    defer allocator.free(handles);
+    for (compactable.items, handles) |index, *handle| handle.* = blases.items(.handle)[index];
+
+    const query_pool = try vc.device.createQueryPool(&.{
+        .query_type = .acceleration_structure_compacted_size_khr,
+        .query_count = @intCast(handles.len),
+    }, null);
+    errdefer vc.device.destroyQueryPool(query_pool, null);
+    vc.device.resetQueryPool(query_pool, 0, @intCast(handles.len));
+
+    const batch_blases = try compactable.toOwnedSlice(allocator);
+
+    // sizes are only known once the builds are done
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
+            .src_access_mask = .{ .acceleration_structure_write_bit_khr = true },
+            .dst_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
+            .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true },
+        }),
+    });
+    encoder.buffer.writeAccelerationStructuresPropertiesKHR(@intCast(handles.len), handles.ptr, .acceleration_structure_compacted_size_khr, query_pool, 0);
+
+    for (batch_blases, 0..) |index, query_index| {
+        blases.items(.compaction_query)[index] = CompactionQuery {
+            .pool = query_pool,
+            .index = @intCast(query_index),
+        };
+    }
+    self.pending_compactions.appendAssumeCapacity(CompactionBatch {
+        .query_pool = query_pool,
+        .blases = batch_blases,
+    });
+}
+
+// replaces BLASes whose compacted size has come in by compacted copies
+// results are not waited on, whatever is not ready yet is left for a later commit
+//
+// the old BLASes are attached to the encoder and their instances are
+// pointed at the copies, which needs a full TLAS build
+fn recordCompactBlases(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder) !void {
+    var compacted = std.AutoArrayHashMapUnmanaged(u32, vk.DeviceAddress) {}; // BLAS index to address of its copy
+    defer compacted.deinit(allocator);
+
+    const scope = encoder.beginScope("blas compaction");
+    defer encoder.endScope(scope, compacted.count());
+
+    while (self.pending_compactions.items.len != 0) {
+        const batch = self.pending_compactions.items[0];
+
+        const sizes = try allocator.alloc(vk.DeviceSize, batch.blases.len);
+        defer allocator.free(sizes);
+        const result = try vc.device.getQueryPoolResults(batch.query_pool, 0, @intCast(sizes.len), sizes.len * @sizeOf(vk.DeviceSize), sizes.ptr, @sizeOf(vk.DeviceSize), .{ .@"64_bit" = true });
+        if (result == .not_ready) break;
+
+        try compacted.ensureUnusedCapacity(allocator, batch.blases.len);
+
+        const blases = self.blases.slice();
+        for (batch.blases, sizes, 0..) |index, compacted_size, query_index| {
+            // freed, rebuilt or refit since
+            const query = blases.items(.compaction_query)[index] orelse continue;
+            if (query.pool != batch.query_pool or query.index != query_index) continue;
+            blases.items(.compaction_query)[index] = null;
+
+            if (compacted_size >= blases.items(.size)[index]) continue;
+
+            // the builds were submitted earlier, but their writes must still be made visible
+            if (compacted.count() == 0) encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+                .memory_barrier_count = 1,
+                .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+                    .src_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
+                    .src_access_mask = .{ .acceleration_structure_write_bit_khr = true },
+                    .dst_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
+                    .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true },
+                }),
+            });
+
+            const buffer = try core.mem.DeviceBuffer(u8, .{ .acceleration_structure_storage_bit_khr = true, .shader_device_address_bit = true }).create(vc, compacted_size, "compacted blas buffer");
+            errdefer buffer.destroy(vc);
+            const handle = try vc.device.createAccelerationStructureKHR(&.{
+                .buffer = buffer.handle,
+                .offset = 0,
+                .size = compacted_size,
+                .type = .bottom_level_khr,
+            }, null);
+            errdefer vc.device.destroyAccelerationStructureKHR(handle, null);
+
+            // might still be in use by earlier commands
+            try encoder.attachResource(blases.items(.handle)[index]);
+            try encoder.attachResource(blases.items(.buffer)[index]);
+
+            encoder.buffer.copyAccelerationStructureKHR(&.{
+                .src = blases.items(.handle)[index],
+                .dst = handle,
+                .mode = .compact_khr,
+            });
+
+            blases.items(.handle)[index] = handle;
+            blases.items(.buffer)[index] = buffer;
+            blases.items(.size)[index] = compacted_size;
+            compacted.putAssumeCapacity(index, vc.device.getAccelerationStructureDeviceAddressKHR(&.{
+                .acceleration_structure = handle,
+            }));
+        }
+
+        try encoder.attachResource(batch.query_pool);
+        allocator.free(batch.blases);
+        _ = self.pending_compactions.orderedRemove(0);
+    }
+
+    if (compacted.count() == 0) return;
+
+    for (self.instance_infos[0..self.instance_count], 0..) |info, handle| {
+        if (!info.alive) continue;
+        const address = compacted.get(info.blas) orelse continue;
+        self.instances_host[handle].acceleration_structure_reference = address;
+        self.dirty_instances = DirtyRange.extend(self.dirty_instances, @intCast(handle));
+    }
+    self.need_tlas_build = true; // rather not rely on a refit picking up changed BLAS references
+}
+
+// refits every BLAS that uses one of updated_meshes in place
+fn recordRefitBlases(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager) !void {
+    defer self.updated_meshes.clearRetainingCapacity();
+
+    var build_geometry_infos = std.ArrayListUnmanaged(vk.AccelerationStructureBuildGeometryInfoKHR) {};
+    defer build_geometry_infos.deinit(allocator);
+    defer for (build_geometry_infos.items) |build_geometry_info| allocator.free(build_geometry_info.p_geometries.?[0..build_geometry_info.geometry_count]);
+
+    var build_infos = std.ArrayListUnmanaged([*]vk.AccelerationStructureBuildRangeInfoKHR) {};
+    defer build_infos.deinit(allocator);
+    defer for (build_infos.items, build_geometry_infos.items) |build_info, build_geometry_info| allocator.free(build_info[0..build_geometry_info.geometry_count]);
+
+    var scratch_sizes = std.ArrayListUnmanaged(vk.DeviceSize) {};
+    defer scratch_sizes.deinit(allocator);
+
+    const blases = self.blases.slice();
+    for (blases.items(.handle), blases.items(.geometries), blases.items(.build), blases.items(.compaction_query)) |handle, list, build, *compaction_query| {
+        if (handle == .null_handle) continue; // free, or built fresh anyway
+        const uses_updated_mesh = for (list) |geometry| {
+            if (self.updated_meshes.contains(geometry.mesh)) break true;
+        } else false;
+        if (!uses_updated_mesh) continue;
+
+        try build_geometry_infos.ensureUnusedCapacity(allocator, 1);
+        try build_infos.ensureUnusedCapacity(allocator, 1);
+        try scratch_sizes.ensureUnusedCapacity(allocator, 1);
+
+        const vk_geometries = try allocator.alloc(vk.AccelerationStructureGeometryKHR, list.len);
+        errdefer allocator.free(vk_geometries);
+        const build_ranges = try allocator.alloc(vk.AccelerationStructureBuildRangeInfoKHR, list.len);
+        errdefer allocator.free(build_ranges);
+        const primitive_counts = try allocator.alloc(u32, list.len);
+        defer allocator.free(primitive_counts);
+
+        fillBlasGeometries(vc, mesh_manager, list, vk_geometries, build_ranges, primitive_counts);
+
+        const build_geometry_info = vk.AccelerationStructureBuildGeometryInfoKHR {
+            .type = .bottom_level_khr,
+            .flags = build.flags(),
+            .mode = .update_khr,
+            .src_acceleration_structure = handle,
+            .dst_acceleration_structure = handle,
+            .geometry_count = @intCast(vk_geometries.len),
+            .p_geometries = vk_geometries.ptr,
+            .scratch_data = undefined,
+        };
+
+        const size_info = getBuildSizesInfo(vc, &build_geometry_info, primitive_counts.ptr);
+
+        build_geometry_infos.appendAssumeCapacity(build_geometry_info);
+        build_infos.appendAssumeCapacity(build_ranges.ptr);
+        scratch_sizes.appendAssumeCapacity(size_info.update_scratch_size);
+
+        // the queried size was for what was there before
+        compaction_query.* = null;
+    }
+
+    if (build_geometry_infos.items.len != 0) {
+        try self.assignScratch(vc, encoder, build_geometry_infos.items, scratch_sizes.items);
+        const scope = encoder.beginScope("blas refit");
+        encoder.buildAccelerationStructures(build_geometry_infos.items, build_infos.items);
+        encoder.endScope(scope, buildPrimitiveCount(build_geometry_infos.items, build_infos.items));
+    }
+}
+
+// BLASes using this mesh will be refit on the next commit, and its triangle powers recomputed
+// vertex data must have been updated in place with the same vertex count
+pub fn markMeshUpdated(self: *Self, allocator: std.mem.Allocator, mesh: MeshManager.Handle) !void {
+    try self.updated_meshes.put(allocator, mesh, {});
+    for (self.triangle_power_trees.keys(), self.triangle_power_trees.values()) |key, *tree| {
+        if (key.mesh == mesh) tree.stale = true;
+    }
+}
+
+// geometries using this material have their emissive light looked at again on the next commit,
+// for when its emissive texture or whether it may emit at all changed
+pub fn markMaterialUpdated(self: *Self, allocator: std.mem.Allocator, material: MaterialManager.Handle) !void {
+    for (self.triangle_power_trees.keys(), self.triangle_power_trees.values()) |key, *tree| {
+        if (key.material == material) tree.stale = true;
+    }
+    const instances = self.material_instances.get(material) orelse return;
+    try self.dirty_power_instances.appendSlice(allocator, instances.keys());
 }
 
 pub fn createEmpty(vc: *const VulkanContext, allocator: std.mem.Allocator, texture_descriptor_layout: MaterialManager.TextureManager.DescriptorLayout, encoder: *Encoder) !Self {
     var triangle_power_pipeline = try TrianglePowerPipeline.create(vc, allocator, .{}, .{}, .{ texture_descriptor_layout.handle });
     errdefer triangle_power_pipeline.destroy(vc);
 
-    var triangle_power_fold_pipeline = try TrianglePowerFoldPipeline.create(vc, allocator, .{}, .{}, .{});
-    errdefer triangle_power_fold_pipeline.destroy(vc);
+    var power_fold_pipeline = try PowerFoldPipeline.create(vc, allocator, .{}, .{}, .{});
+    errdefer power_fold_pipeline.destroy(vc);
 
-    const triangle_powers_meta = try core.mem.DeviceBuffer(TriangleMetadata, .{ .storage_buffer_bit = true }).create(vc, max_emissive_triangles, "triangle powers meta");
-    errdefer triangle_powers_meta.destroy(vc);
+    var geometry_power_leaves_pipeline = try GeometryPowerLeavesPipeline.create(vc, allocator, .{}, .{}, .{});
+    errdefer geometry_power_leaves_pipeline.destroy(vc);
 
-    const emissive_triangle_count = try core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, 1, "emissive triangle count");
-    errdefer emissive_triangle_count.destroy(vc);
-
-    const triangle_powers = try Image.create(vc, vk.Extent2D { .width = max_emissive_triangles, .height = 1 }, .{ .storage_bit = true, .sampled_bit = true, .transfer_dst_bit = true }, .r32_sfloat, true, "triangle powers");
+    const triangle_powers = try core.mem.GrowableDeviceBuffer(f32, .{ .storage_buffer_bit = true }).create(vc, initial_triangle_power_capacity, "triangle powers");
     errdefer triangle_powers.destroy(vc);
 
-    var triangle_powers_mips: [std.math.log2(max_emissive_triangles) + 1]vk.ImageView = undefined;
-    inline for (&triangle_powers_mips, 0..) |*view, level_index| {
-        view.* = try vc.device.createImageView(&vk.ImageViewCreateInfo {
-            .flags = .{},
-            .image = triangle_powers.handle,
-            .view_type = vk.ImageViewType.@"1d",
-            .format = .r32_sfloat,
-            .components = .{
-                .r = .identity,
-                .g = .identity,
-                .b = .identity,
-                .a = .identity,
-            },
-            .subresource_range = .{
-                .aspect_mask = .{ .color_bit = true },
-                .base_mip_level = @intCast(level_index),
-                .level_count = 1,
-                .base_array_layer = 0,
-                .layer_count = vk.REMAINING_ARRAY_LAYERS,
-            },
-        }, null);
-        try vk_helpers.setDebugName(vc.device, view.*, std.fmt.comptimePrint("triangle powers view {}", .{ level_index }));
-    }
-
-    const geometries = try core.mem.DeviceBuffer(Geometry, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, max_geometries, "geometries");
+    const geometries = try core.mem.GrowableDeviceBuffer(Geometry, .{ .storage_buffer_bit = true }).create(vc, initial_geometry_capacity, "geometries");
     errdefer geometries.destroy(vc);
-    const geometry_to_triangle_power_offset = try core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, max_geometries, "geometry to triangle power offset");
-    errdefer geometry_to_triangle_power_offset.destroy(vc);
-
-    const instances_device = try core.mem.DeviceBuffer(vk.AccelerationStructureInstanceKHR, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true, .storage_buffer_bit = true }).create(vc, max_instances, "instances");
+    const geometries_host = try allocator.alloc(Geometry, initial_geometry_capacity);
+    errdefer allocator.free(geometries_host);
+    const geometry_power_infos = try core.mem.GrowableDeviceBuffer(GeometryPowerInfo, .{ .storage_buffer_bit = true }).create(vc, initial_geometry_capacity, "geometry power infos");
+    errdefer geometry_power_infos.destroy(vc);
+    const geometry_powers = try core.mem.DeviceBuffer(f32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, powerTreeSize(initial_geometry_capacity), "geometry powers");
+    errdefer geometry_powers.destroy(vc);
+
+    const instances_device = try core.mem.GrowableDeviceBuffer(vk.AccelerationStructureInstanceKHR, .{ .shader_device_address_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true, .storage_buffer_bit = true }).create(vc, initial_instance_capacity, "instances");
     errdefer instances_device.destroy(vc);
-    const instances_host = try core.mem.UploadBuffer(vk.AccelerationStructureInstanceKHR).create(vc, max_instances, "instances");
-    errdefer instances_host.destroy(vc);
-    const instances_address = instances_device.getAddress(vc);
+    const instances_host = try allocator.alloc(vk.AccelerationStructureInstanceKHR, initial_instance_capacity);
+    errdefer allocator.free(instances_host);
+    const instances_address = instances_device.buffer.getAddress(vc);
 
-    const world_to_instance_device = try core.mem.DeviceBuffer(Mat3x4, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, max_instances, "world to instances");
+    const world_to_instance_device = try core.mem.GrowableDeviceBuffer(Mat3x4, .{ .storage_buffer_bit = true }).create(vc, initial_instance_capacity, "world to instances");
     errdefer world_to_instance_device.destroy(vc);
-    const world_to_instance_host = try core.mem.UploadBuffer(Mat3x4).create(vc, max_instances, "world to instances");
-    errdefer world_to_instance_host.destroy(vc);
+    const world_to_instance_host = try allocator.alloc(Mat3x4, initial_instance_capacity);
+    errdefer allocator.free(world_to_instance_host);
 
-    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-        .image_memory_barrier_count = 1,
-        .p_image_memory_barriers = &[1]vk.ImageMemoryBarrier2 {
-            .{
-                .dst_stage_mask = .{ .clear_bit = true },
-                .dst_access_mask = .{ .transfer_write_bit = true },
-                .old_layout = .undefined,
-                .new_layout = .transfer_dst_optimal,
-                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                .image = triangle_powers.handle,
-                .subresource_range = .{
-                    .aspect_mask = .{ .color_bit = true },
-                    .base_mip_level = 0,
-                    .level_count = vk.REMAINING_MIP_LEVELS,
-                    .base_array_layer = 0,
-                    .layer_count = vk.REMAINING_ARRAY_LAYERS,
-                },
-            }
-        },
-    });
-    encoder.clearColorImage(triangle_powers.handle, .transfer_dst_optimal, vk.ClearColorValue { .float_32 = .{ 0, 0, 0, 0 }});
-    encoder.fillBuffer(emissive_triangle_count.handle, 1, @as(u32, 0));
-    encoder.fillBuffer(geometry_to_triangle_power_offset.handle, max_geometries, @as(u32, std.math.maxInt(u32)));
-    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-        .image_memory_barrier_count = 1,
-        .p_image_memory_barriers = &[1]vk.ImageMemoryBarrier2 {
-            .{
-                .src_stage_mask = .{ .clear_bit = true },
-                .src_access_mask = .{ .transfer_write_bit = true },
-                .old_layout = .transfer_dst_optimal,
-                .new_layout = .shader_read_only_optimal,
-                .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                .image = triangle_powers.handle,
-                .subresource_range = .{
-                    .aspect_mask = .{ .color_bit = true },
-                    .base_mip_level = 0,
-                    .level_count = vk.REMAINING_MIP_LEVELS,
-                    .base_array_layer = 0,
-                    .layer_count = vk.REMAINING_ARRAY_LAYERS,
-                },
-            }
-        },
-    });
+    const instance_infos = try allocator.alloc(InstanceInfo, initial_instance_capacity);
+    errdefer allocator.free(instance_infos);
+
+    const scratch_alignment = blk: {
+        var accel_properties: vk.PhysicalDeviceAccelerationStructurePropertiesKHR = undefined;
+        accel_properties.s_type = .physical_device_acceleration_structure_properties_khr;
+        accel_properties.p_next = null;
 
-    return Self {
+        var properties2 = vk.PhysicalDeviceProperties2 {
+            .properties = undefined,
+            .p_next = &accel_properties,
+        };
+
+        vc.instance.getPhysicalDeviceProperties2(vc.physical_device.handle, &properties2);
+
+        break :blk accel_properties.min_acceleration_structure_scratch_offset_alignment;
+    };
+
+    const self = Self {
         .triangle_power_pipeline = triangle_power_pipeline,
-        .triangle_power_fold_pipeline = triangle_power_fold_pipeline,
-        .triangle_powers_meta = triangle_powers_meta,
+        .power_fold_pipeline = power_fold_pipeline,
+        .geometry_power_leaves_pipeline = geometry_power_leaves_pipeline,
         .triangle_powers = triangle_powers,
-        .triangle_powers_mips = triangle_powers_mips,
-        .emissive_triangle_count = emissive_triangle_count,
+        .geometry_powers = geometry_powers,
+        .geometry_power_infos = geometry_power_infos,
         .geometries = geometries,
-        .geometry_to_triangle_power_offset = geometry_to_triangle_power_offset,
+        .geometries_host = geometries_host,
         .instances_device = instances_device,
         .instances_host = instances_host,
+        .instance_infos = instance_infos,
         .instances_address = instances_address,
         .world_to_instance_device = world_to_instance_device,
         .world_to_instance_host = world_to_instance_host,
+        .scratch_alignment = scratch_alignment,
     };
+    self.recordClearPowers(encoder);
+
+    return self;
+}
+
+// resets the emissive light data on the device so that nothing is emissive
+fn recordClearPowers(self: *const Self, encoder: *Encoder) void {
+    // earlier power updates and traces may still be using these
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true },
+            .dst_stage_mask = .{ .clear_bit = true },
+            .dst_access_mask = .{ .transfer_write_bit = true },
+        }),
+    });
+    encoder.fillBuffer(self.geometry_powers.handle, powerTreeSize(@intCast(self.geometry_power_infos.capacity)), @as(f32, 0));
+    // only triangle_offset matters for untracked geometries
+    encoder.fillBuffer(self.geometry_power_infos.buffer.handle, self.geometry_power_infos.capacity * @sizeOf(GeometryPowerInfo) / @sizeOf(u32), @as(u32, std.math.maxInt(u32)));
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .clear_bit = true },
+            .src_access_mask = .{ .transfer_write_bit = true },
+            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true },
+            .dst_access_mask = .{ .shader_read_bit = true, .shader_write_bit = true },
+        }),
+    });
 }
 
-// accel must not be in use
 pub const Handle = u32;
-pub fn uploadInstance(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager, instance: Instance) !Handle {
-    std.debug.assert(self.geometry_count + instance.geometries.len <= max_geometries);
-    std.debug.assert(self.instance_count < max_instances);
 
-    try makeBlases(vc, allocator, encoder, mesh_manager, &.{ instance.geometries }, &self.blases);
+// queues instances that all share the same geometries but each have their own transform
+// nothing is uploaded or built until the next recordCommit, so many calls can be batched
+// handles of destroyed instances are reused, the new handles are written to `handles`
+// queues nothing if this would take the total past max_geometries
+pub fn queueInstances(self: *Self, allocator: std.mem.Allocator, geometries: []const Geometry, transforms: []const Mat3x4, visible: bool, build: BuildPreference, handles: []Handle) !void {
+    std.debug.assert(handles.len == transforms.len);
+    if (transforms.len == 0) return;
+
+    // rather reuse the space of dead geometries than grow
+    const added_geometry_count = geometries.len * transforms.len;
+    if (self.geometry_count + added_geometry_count > @min(self.geometries_host.len, max_geometries) and self.dead_geometry_count != 0) try self.compactGeometries(allocator);
+    if (self.geometry_count + added_geometry_count > max_geometries) return error.TooManyGeometries;
+    if (self.geometry_count + added_geometry_count > self.geometries_host.len) {
+        self.geometries_host = try allocator.realloc(self.geometries_host, growCapacity(self.geometries_host.len, self.geometry_count + added_geometry_count));
+    }
+
+    const new_instance_count = self.instance_count + transforms.len - @min(transforms.len, self.free_instances.items.len);
+    if (new_instance_count > self.instances_host.len) {
+        const capacity = growCapacity(self.instances_host.len, new_instance_count);
+        self.instance_infos = try allocator.realloc(self.instance_infos, capacity);
+        self.world_to_instance_host = try allocator.realloc(self.world_to_instance_host, capacity);
+        self.instances_host = try allocator.realloc(self.instances_host, capacity); // last, as its length is the capacity checked above
+    }
 
-    // update geometries flat jagged array
-    self.geometries.updateFrom(encoder, self.geometry_count, instance.geometries);
+    try self.pending_instances.ensureUnusedCapacity(allocator, transforms.len);
+    try self.pending_blases.ensureUnusedCapacity(allocator, 1);
+    for (geometries) |geometry| {
+        const instances = try self.material_instances.getOrPutValue(allocator, geometry.material, .{});
+        try instances.value_ptr.ensureUnusedCapacity(allocator, transforms.len);
+    }
+    const blas = try self.reserveBlas(allocator, geometries, @intCast(transforms.len), build);
+    self.pending_blases.appendAssumeCapacity(blas);
 
-    // upload instance
-    {
-        const vk_instance = vk.AccelerationStructureInstanceKHR {
+    for (transforms, handles) |transform, *handle| {
+        handle.* = self.free_instances.popOrNull() orelse blk: {
+            self.instance_count += 1;
+            break :blk self.instance_count - 1;
+        };
+        self.instances_host[handle.*] = vk.AccelerationStructureInstanceKHR {
             .transform = vk.TransformMatrixKHR {
-                .matrix = @bitCast(instance.transform),
+                .matrix = @bitCast(transform),
             },
             .instance_custom_index_and_mask = .{
                 .instance_custom_index = self.geometry_count,
-                .mask = if (instance.visible) 0xFF else 0x00,
+                .mask = if (visible) 0xFF else 0x00,
             },
             .instance_shader_binding_table_record_offset_and_flags = .{
                 .instance_shader_binding_table_record_offset = 0,
                 .flags = 0,
             },
-            .acceleration_structure_reference = vc.device.getAccelerationStructureDeviceAddressKHR(&.{
-                .acceleration_structure = self.blases.items(.handle)[self.blases.len - 1],
-            }),
+            .acceleration_structure_reference = 0, // filled in once BLAS exists
         };
+        self.world_to_instance_host[handle.*] = transform.inverse_affine();
+        self.instance_infos[handle.*] = InstanceInfo {
+            .blas = blas,
+            .geometry_count = @intCast(geometries.len),
+            .alive = true,
+        };
+        self.pending_instances.appendAssumeCapacity(handle.*);
+        for (geometries) |geometry| self.material_instances.getPtr(geometry.material).?.putAssumeCapacity(handle.*, {});
+
+        if (geometries.len != 0) {
+            @memcpy(self.geometries_host[self.geometry_count..][0..geometries.len], geometries);
+            self.dirty_geometries = DirtyRange.extend(self.dirty_geometries, self.geometry_count);
+            self.dirty_geometries = DirtyRange.extend(self.dirty_geometries, self.geometry_count + @as(u32, @intCast(geometries.len)) - 1);
+            self.geometry_count += @intCast(geometries.len);
+        }
+    }
+
+    self.need_tlas_build = true;
+}
+
+// uploads and builds a single instance immediately
+// prefer queueInstances and a single recordCommit when adding many
+pub fn uploadInstance(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager, instance: Instance) !Handle {
+    var handle: Handle = undefined;
+    try self.queueInstances(allocator, instance.geometries, &.{ instance.transform }, instance.visible, instance.build, (&handle)[0..1]);
+
+    try self.recordCommit(vc, allocator, encoder, mesh_manager, material_manager);
+
+    return handle;
+}
+
+// removes an instance, its handle may be handed out again by later queueInstances
+// its BLAS is freed once no instance uses it anymore, after the encoder is done with it
+pub fn destroyInstance(self: *Self, allocator: std.mem.Allocator, encoder: *Encoder, handle: Handle) !void {
+    const info = &self.instance_infos[handle];
+    std.debug.assert(info.alive);
+    try self.free_instances.ensureUnusedCapacity(allocator, 1);
+
+    // stays in the TLAS until its handle is reused, but inactive
+    self.instances_host[handle].instance_custom_index_and_mask.mask = 0x00;
+    self.instances_host[handle].acceleration_structure_reference = 0;
+    self.dirty_instances = DirtyRange.extend(self.dirty_instances, handle);
+    self.need_tlas_build = true; // instances may not become inactive in a refit
+
+    info.alive = false;
+    self.dead_geometry_count += @intCast(info.geometry_count);
+
+    // no longer emits from the next commit on, its geometries keep their slot until compacted away
+    const first = self.instances_host[handle].instance_custom_index_and_mask.instance_custom_index;
+    for (first..first + info.geometry_count) |flat_geometry_index| {
+        try self.removePower(allocator, @intCast(flat_geometry_index));
+    }
+    for (self.geometries_host[first..][0..info.geometry_count]) |geometry| {
+        _ = self.material_instances.getPtr(geometry.material).?.swapRemove(handle);
+    }
+
+    const ref_count = &self.blases.items(.ref_count)[info.blas];
+    ref_count.* -= 1;
+    if (ref_count.* == 0) try self.freeBlas(allocator, encoder, info.blas);
 
-        self.instances_host.slice[self.instance_count] = vk_instance;
+    self.free_instances.appendAssumeCapacity(handle);
+}
+
+// takes a slot in blases for a BLAS of these geometries, built on the next commit
+fn reserveBlas(self: *Self, allocator: std.mem.Allocator, geometries: []const Geometry, ref_count: u32, build: BuildPreference) !u32 {
+    const owned_list = try allocator.dupe(Geometry, geometries);
+    errdefer allocator.free(owned_list);
+
+    const blas = BottomLevelAccel {
+        .handle = .null_handle,
+        .buffer = .{},
+        .size = 0,
+        .geometries = owned_list,
+        .ref_count = ref_count,
+        .build = build,
+        .compaction_query = null,
+    };
+
+    if (self.free_blases.popOrNull()) |index| {
+        self.blases.set(index, blas);
+        return index;
+    } else {
+        try self.blases.append(allocator, blas);
+        return @intCast(self.blases.len - 1);
+    }
+}
+
+fn freeBlas(self: *Self, allocator: std.mem.Allocator, encoder: *Encoder, index: u32) !void {
+    try self.free_blases.ensureUnusedCapacity(allocator, 1);
+
+    const blases = self.blases.slice();
+
+    // might still be in use by earlier commands
+    try encoder.attachResource(blases.items(.handle)[index]);
+    try encoder.attachResource(blases.items(.buffer)[index]);
+    allocator.free(blases.items(.geometries)[index]);
+
+    blases.items(.handle)[index] = .null_handle;
+    blases.items(.buffer)[index] = .{};
+    blases.items(.size)[index] = 0;
+    blases.items(.geometries)[index] = &.{};
+    blases.items(.compaction_query)[index] = null;
+
+    // all of its instances were destroyed before it was ever built
+    if (std.mem.indexOfScalar(u32, self.pending_blases.items, index)) |pending_index| {
+        _ = self.pending_blases.swapRemove(pending_index);
+    }
 
-        self.instances_device.updateFrom(encoder, self.instance_count, &.{ vk_instance }); // TODO: can copy
+    self.free_blases.appendAssumeCapacity(index);
+}
+
+// squeezes the geometries of destroyed instances out of the flat geometry array
+//
+// this moves the geometries of live instances around, changing their custom index,
+// so everything is uploaded again
+//
+// triangle power trees do not depend on where their geometries are, so only
+// the power infos of emissive geometries that moved are written again
+fn compactGeometries(self: *Self, allocator: std.mem.Allocator) !void {
+    const compacted = try allocator.alloc(Geometry, self.geometries_host.len);
+    errdefer allocator.free(compacted);
+
+    var emissive_geometries = std.AutoArrayHashMapUnmanaged(u32, EmissiveGeometry) {};
+    errdefer emissive_geometries.deinit(allocator);
+    try emissive_geometries.ensureTotalCapacity(allocator, self.emissive_geometries.count());
+
+    var geometry_count: u24 = 0;
+    for (self.instances_host[0..self.instance_count], self.instance_infos[0..self.instance_count]) |*instance, info| {
+        if (!info.alive) continue;
+        const first = instance.instance_custom_index_and_mask.instance_custom_index;
+        @memcpy(compacted[geometry_count..][0..info.geometry_count], self.geometries_host[first..][0..info.geometry_count]);
+        if (self.emissive_geometries.count() != 0) for (0..info.geometry_count) |i| {
+            const emissive = self.emissive_geometries.get(@intCast(first + i)) orelse continue;
+            emissive_geometries.putAssumeCapacity(@intCast(geometry_count + i), emissive);
+        };
+        instance.instance_custom_index_and_mask.instance_custom_index = geometry_count;
+        geometry_count += @intCast(info.geometry_count);
     }
 
-    // upload world_to_instance matrix
-    {
-        self.world_to_instance_host.slice[self.instance_count] = instance.transform.inverse_affine();
-        self.world_to_instance_device.updateFrom(encoder, self.instance_count, &.{ instance.transform.inverse_affine() }); // TODO: can copy
+    // queued after anything written before, so these win
+    for (self.emissive_geometries.keys(), self.emissive_geometries.values()) |flat_geometry_index, emissive| {
+        if (emissive_geometries.contains(flat_geometry_index)) continue;
+        var untracked = emissive.info;
+        untracked.triangle_offset = std.math.maxInt(u32);
+        try self.writePowerInfo(allocator, flat_geometry_index, untracked);
+    }
+    for (emissive_geometries.keys(), emissive_geometries.values()) |flat_geometry_index, emissive| {
+        const old = self.emissive_geometries.get(flat_geometry_index);
+        if (old == null or !std.meta.eql(old.?.info, emissive.info)) try self.writePowerInfo(allocator, flat_geometry_index, emissive.info);
     }
 
-    self.instance_count += 1;
+    allocator.free(self.geometries_host);
+    self.geometries_host = compacted;
+    self.geometry_count = geometry_count;
+    self.dead_geometry_count = 0;
 
-    // update TLAS
+    self.emissive_geometries.deinit(allocator);
+    self.emissive_geometries = emissive_geometries;
+
+    self.dirty_geometries = if (geometry_count != 0) DirtyRange { .first = 0, .last = geometry_count - 1 } else null;
+    if (self.instance_count != 0) self.dirty_instances = DirtyRange { .first = 0, .last = self.instance_count - 1 };
+}
+
+// records a build of the TLAS from instances_device
+// a full build reallocates the TLAS, while an update refits the existing one in place
+fn recordTlasBuild(self: *Self, vc: *const VulkanContext, encoder: *Encoder, mode: vk.BuildAccelerationStructureModeKHR) !void {
     var geometry_info = vk.AccelerationStructureBuildGeometryInfoKHR {
         .type = .top_level_khr,
         .flags = .{ .prefer_fast_trace_bit_khr = true, .allow_update_bit_khr = true },
-        .mode = .build_khr,
+        .mode = mode,
         .geometry_count = 1,
         .p_geometries = @ptrCast(&vk.AccelerationStructureGeometryKHR {
             .geometry_type = .instances_khr,
@@ -403,162 +962,580 @@ pub fn uploadInstance(self: *Self, vc: *const VulkanContext, allocator: std.mem.
         .scratch_data = undefined,
     };
 
-    const size_info = getBuildSizesInfo(vc, &geometry_info, @ptrCast(&self.instance_count));
+    switch (mode) {
+        .build_khr => {
+            const size_info = getBuildSizesInfo(vc, &geometry_info, @ptrCast(&self.instance_count));
 
-    const scratch_buffer = try core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }).create(vc, size_info.build_scratch_size, "tlas scratch buffer");
-    try encoder.attachResource(scratch_buffer);
+            const scratch_buffer = try core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }).create(vc, size_info.build_scratch_size, "tlas scratch buffer");
+            try encoder.attachResource(scratch_buffer);
 
-    try encoder.attachResource(self.tlas_buffer); // might still be used if this function was called in a loop. TODO: do not needlessly rebuild TLAS in this situation
-    self.tlas_buffer = try core.mem.DeviceBuffer(u8, .{ .acceleration_structure_storage_bit_khr = true, .shader_device_address_bit = true }).create(vc, size_info.acceleration_structure_size, "tlas buffer");
+            // old ones might still be in use by earlier commands
+            try encoder.attachResource(self.tlas_buffer);
+            self.tlas_buffer = try core.mem.DeviceBuffer(u8, .{ .acceleration_structure_storage_bit_khr = true, .shader_device_address_bit = true }).create(vc, size_info.acceleration_structure_size, "tlas buffer");
 
-    try encoder.attachResource(self.tlas_handle); // might still be used if this function was called in a loop. TODO: do not needlessly rebuild TLAS in this situation
-    geometry_info.dst_acceleration_structure = try vc.device.createAccelerationStructureKHR(&.{
-        .buffer = self.tlas_buffer.handle,
-        .offset = 0,
-        .size = size_info.acceleration_structure_size,
-        .type = .top_level_khr,
-    }, null);
-    self.tlas_handle = geometry_info.dst_acceleration_structure;
+            try encoder.attachResource(self.tlas_handle);
+            geometry_info.dst_acceleration_structure = try vc.device.createAccelerationStructureKHR(&.{
+                .buffer = self.tlas_buffer.handle,
+                .offset = 0,
+                .size = size_info.acceleration_structure_size,
+                .type = .top_level_khr,
+            }, null);
+            self.tlas_handle = geometry_info.dst_acceleration_structure;
 
-    geometry_info.scratch_data.device_address = scratch_buffer.getAddress(vc);
+            geometry_info.scratch_data.device_address = scratch_buffer.getAddress(vc);
 
-    self.tlas_update_scratch_buffer.destroy(vc);
-    self.tlas_update_scratch_buffer = try core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }).create(vc, size_info.update_scratch_size, "tlas update scratch buffer");
-    self.tlas_update_scratch_address = self.tlas_update_scratch_buffer.getAddress(vc);
+            try encoder.attachResource(self.tlas_update_scratch_buffer);
+            self.tlas_update_scratch_buffer = try core.mem.DeviceBuffer(u8, .{ .storage_buffer_bit = true, .shader_device_address_bit = true }).create(vc, size_info.update_scratch_size, "tlas update scratch buffer");
+            self.tlas_update_scratch_address = self.tlas_update_scratch_buffer.getAddress(vc);
+
+            self.tlas_refit_count = 0;
+            self.need_tlas_build = false;
+        },
+        .update_khr => {
+            geometry_info.src_acceleration_structure = self.tlas_handle;
+            geometry_info.dst_acceleration_structure = self.tlas_handle;
+            geometry_info.scratch_data.device_address = self.tlas_update_scratch_address;
+
+            self.tlas_refit_count += 1;
+        },
+        else => unreachable,
+    }
 
+    const scope = encoder.beginScope("tlas build");
     encoder.buildAccelerationStructures(&.{ geometry_info }, &[_][*]const vk.AccelerationStructureBuildRangeInfoKHR{ @ptrCast(&vk.AccelerationStructureBuildRangeInfoKHR {
         .primitive_count = @intCast(self.instance_count),
         .first_vertex = 0,
         .primitive_offset = 0,
         .transform_offset = 0,
     })});
+    encoder.endScope(scope, self.instance_count);
 
-    encoder.barrier(&.{}, &[_]Encoder.BufferBarrier{
-        Encoder.BufferBarrier {
-            .src_stage_mask = .{ .all_commands_bit = true },
-            .src_access_mask = .{ .memory_write_bit = true, .memory_read_bit = true },
-            .dst_stage_mask = .{ .all_commands_bit = true },
-            .dst_access_mask = .{ .memory_write_bit = true, .memory_read_bit = true },
-            .buffer = self.instances_device.handle,
-        },
-        Encoder.BufferBarrier {
-            .src_stage_mask = .{ .all_commands_bit = true },
-            .src_access_mask = .{ .memory_write_bit = true, .memory_read_bit = true },
-            .dst_stage_mask = .{ .all_commands_bit = true },
-            .dst_access_mask = .{ .memory_write_bit = true, .memory_read_bit = true },
-            .buffer = self.geometries.handle,
-        },
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .acceleration_structure_build_bit_khr = true },
+            .src_access_mask = .{ .acceleration_structure_write_bit_khr = true },
+            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
+            .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true },
+        }),
     });
-    for (instance.geometries, 0..) |geometry, i| {
-        self.recordUpdatePower(encoder, mesh_manager, material_manager, @intCast(self.instance_count - 1), @intCast(i), geometry.mesh);
+}
+
+// edits instance on the host, only visible on the device after recordCommit
+pub fn setTransform(self: *Self, instance_idx: u32, new_transform: Mat3x4) void {
+    self.instances_host[instance_idx].transform = @bitCast(new_transform);
+    self.world_to_instance_host[instance_idx] = new_transform.inverse_affine();
+    self.dirty_instances = DirtyRange.extend(self.dirty_instances, instance_idx);
+}
+
+// edits instance on the host, only visible on the device after recordCommit
+pub fn setVisibility(self: *Self, instance_idx: u32, visible: bool) void {
+    self.instances_host[instance_idx].instance_custom_index_and_mask.mask = if (visible) 0xFF else 0x00;
+    self.dirty_instances = DirtyRange.extend(self.dirty_instances, instance_idx);
+}
+
+// makes everything queued or edited on the host since the last commit visible on the device
+//
+// queued instances get their BLASes built in one batch followed by a single TLAS build,
+// while edits to existing instances just refit the TLAS, falling back to a full rebuild
+// once max_tlas_refits is reached
+//
+// the emissive light data is brought up to date last, see recordCommitPowers
+pub fn recordCommit(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager) !void {
+    // once enough geometries are dead it is worth moving everything around to get rid of them
+    if (self.dead_geometry_count != 0 and self.dead_geometry_count >= self.geometry_count / 2) try self.compactGeometries(allocator);
+
+    // may dirty instances, so before checking whether there is anything to do
+    if (self.pending_compactions.items.len != 0) try self.recordCompactBlases(vc, allocator, encoder);
+
+    if (self.dirty_instances == null and self.dirty_geometries == null and self.pending_instances.items.len == 0 and self.updated_meshes.count() == 0) {
+        return self.recordCommitPowers(vc, allocator, encoder, mesh_manager, material_manager);
+    }
+
+    // the host side may have outgrown the device buffers since the last commit
+    if (try self.instances_device.ensureTotalCapacity(vc, encoder, self.instance_count)) self.instances_address = self.instances_device.buffer.getAddress(vc);
+    _ = try self.world_to_instance_device.ensureTotalCapacity(vc, encoder, self.instance_count);
+    _ = try self.geometries.ensureTotalCapacity(vc, encoder, self.geometry_count);
+    const old_geometry_power_capacity = self.geometry_power_infos.capacity;
+    if (try self.geometry_power_infos.ensureTotalCapacity(vc, encoder, self.geometry_count)) try self.recordGrowGeometryPowers(vc, encoder, old_geometry_power_capacity);
+
+    // earlier traces may still be reading what we are about to overwrite,
+    // BLAS builds read mesh data that may have just been copied,
+    // and refits may touch BLASes that were just compacted
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true, .copy_bit = true, .acceleration_structure_build_bit_khr = true },
+            .src_access_mask = .{ .transfer_write_bit = true, .acceleration_structure_write_bit_khr = true },
+            .dst_stage_mask = .{ .copy_bit = true, .acceleration_structure_build_bit_khr = true },
+            .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true, .acceleration_structure_write_bit_khr = true },
+        }),
+    });
+
+    // refit before building new ones, as those are already up to date
+    if (self.updated_meshes.count() != 0) try self.recordRefitBlases(vc, allocator, encoder, mesh_manager);
+
+    if (self.pending_blases.items.len != 0) {
+        try self.makeBlases(vc, allocator, encoder, mesh_manager);
+        self.pending_blases.clearRetainingCapacity();
+    }
+
+    if (self.pending_instances.items.len != 0) {
+        const blas_handles = self.blases.items(.handle);
+
+        // instances queued together share a BLAS and are next to each other here
+        var last_blas: ?u32 = null;
+        var blas_address: vk.DeviceAddress = 0;
+        for (self.pending_instances.items) |handle| {
+            const info = self.instance_infos[handle];
+            if (!info.alive) continue;
+            if (last_blas != info.blas) {
+                blas_address = vc.device.getAccelerationStructureDeviceAddressKHR(&.{
+                    .acceleration_structure = blas_handles[info.blas],
+                });
+                last_blas = info.blas;
+            }
+            self.instances_host[handle].acceleration_structure_reference = blas_address;
+            self.dirty_instances = DirtyRange.extend(self.dirty_instances, handle);
+            try self.updateInstancePower(vc, allocator, encoder, mesh_manager, material_manager, handle);
+        }
+
+        self.pending_instances.clearRetainingCapacity();
+    }
+
+    if (self.dirty_geometries) |range| {
+        self.dirty_geometries = null;
+
+        const geometries = try encoder.uploadAllocator().dupe(Geometry, self.geometries_host[range.first..range.last + 1]);
+        const geometries_slice = encoder.upload_allocator.getBufferSlice(geometries).asBytes();
+        encoder.copyBuffer(geometries_slice.handle, self.geometries.buffer.handle, &.{
+            vk.BufferCopy {
+                .src_offset = geometries_slice.offset,
+                .dst_offset = @sizeOf(Geometry) * range.first,
+                .size = geometries_slice.len,
+            },
+        });
+    }
+
+    if (self.dirty_instances) |range| {
+        self.dirty_instances = null;
+        try self.updatePowerScales(allocator, range);
+
+        // host data may be edited again while this is in flight, so stage a copy
+        const instances = try encoder.uploadAllocator().dupe(vk.AccelerationStructureInstanceKHR, self.instances_host[range.first..range.last + 1]);
+        const world_to_instances = try encoder.uploadAllocator().dupe(Mat3x4, self.world_to_instance_host[range.first..range.last + 1]);
+        const instances_slice = encoder.upload_allocator.getBufferSlice(instances).asBytes();
+        const world_to_instances_slice = encoder.upload_allocator.getBufferSlice(world_to_instances).asBytes();
+
+        encoder.copyBuffer(instances_slice.handle, self.instances_device.buffer.handle, &.{
+            vk.BufferCopy {
+                .src_offset = instances_slice.offset,
+                .dst_offset = @sizeOf(vk.AccelerationStructureInstanceKHR) * range.first,
+                .size = instances_slice.len,
+            },
+        });
+        encoder.copyBuffer(world_to_instances_slice.handle, self.world_to_instance_device.buffer.handle, &.{
+            vk.BufferCopy {
+                .src_offset = world_to_instances_slice.offset,
+                .dst_offset = @sizeOf(Mat3x4) * range.first,
+                .size = world_to_instances_slice.len,
+            },
+        });
     }
 
-    self.geometry_count += @intCast(instance.geometries.len);
+    // TLAS build must wait on both the copies above and any BLAS builds or refits
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .copy_bit = true, .acceleration_structure_build_bit_khr = true },
+            .src_access_mask = .{ .transfer_write_bit = true, .acceleration_structure_write_bit_khr = true },
+            .dst_stage_mask = .{ .acceleration_structure_build_bit_khr = true, .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true },
+            .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true, .shader_storage_read_bit = true },
+        }),
+    });
+
+    try self.recordTlasBuild(vc, encoder, if (self.need_tlas_build or self.tlas_refit_count >= self.max_tlas_refits) .build_khr else .update_khr);
 
-    return @intCast(self.instance_count - 1);
+    try self.recordCommitPowers(vc, allocator, encoder, mesh_manager, material_manager);
 }
 
-pub fn recordUpdatePower(self: *Self, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager, instance_index: u32, geometry_index: u32, mesh_index: u32) void {
-    const mesh = mesh_manager.meshes.get(mesh_index);
-    const primitive_count = if (mesh.index_count != 0) mesh.index_count else @divExact(mesh.vertex_count, 3);
+// the geometry power tree is laid out for a fixed number of leaves,
+// so it is remade whenever geometry_power_infos grows
+fn recordGrowGeometryPowers(self: *Self, vc: *const VulkanContext, encoder: *Encoder, old_capacity: vk.DeviceSize) !void {
+    const capacity = self.geometry_power_infos.capacity;
 
-    // this mesh is too big to importance sample...
-    // it may still emit without importance sampling, though
-    //
-    // TODO: technically this should check that the that total (in the whole scene) emissive triangle count is less than
-    // the maximum number of emissive triangles, but we don't have access to that info on the host.
-    // probably we will just get a GPU crash instead :(
-    if (primitive_count > max_emissive_triangles) return;
+    // geometries that did not fit before are not tracked for emissive light yet either
+    encoder.buffer.fillBuffer(self.geometry_power_infos.buffer.handle, @sizeOf(GeometryPowerInfo) * old_capacity, @sizeOf(GeometryPowerInfo) * (capacity - old_capacity), std.math.maxInt(u32));
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .clear_bit = true },
+            .src_access_mask = .{ .transfer_write_bit = true },
+            .dst_stage_mask = .{ .copy_bit = true, .compute_shader_bit = true },
+            .dst_access_mask = .{ .transfer_write_bit = true, .shader_read_bit = true },
+        }),
+    });
 
-    encoder.barrier(&[_]Encoder.ImageBarrier {
-        Encoder.ImageBarrier {
-            .src_stage_mask = .{ .compute_shader_bit = true },
-            .src_access_mask = .{ .shader_read_bit = true },
-            .dst_stage_mask = .{ .compute_shader_bit = true },
-            .dst_access_mask = .{ .shader_write_bit = true },
-            .old_layout = .shader_read_only_optimal,
-            .new_layout = .general,
-            .image = self.triangle_powers.handle,
-            .base_mip_level = 0,
-            .level_count = 1,
+    try encoder.attachResource(self.geometry_powers);
+    self.geometry_powers = try core.mem.DeviceBuffer(f32, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, powerTreeSize(@intCast(capacity)), "geometry powers");
+    self.need_geometry_power_rebuild = true;
+}
+
+// whether this handle refers to an instance that has not been destroyed
+pub fn isAlive(self: *const Self, handle: Handle) bool {
+    return handle < self.instance_count and self.instance_infos[handle].alive;
+}
+
+// how much areas grow from the space of an instance to world space
+// exact for transforms that scale uniformly, an average otherwise
+fn areaScale(transform: Mat3x4) f32 {
+    return std.math.pow(f32, @abs(transform.truncate().determinant()), 2.0 / 3.0);
+}
+
+// starts or stops tracking the geometries of an instance for emissive light, depending on whether their materials may emit
+// power trees that do not exist yet are only computed by the next recordCommitPowers
+fn updateInstancePower(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager, handle: Handle) !void {
+    const info = self.instance_infos[handle];
+    const first = self.instances_host[handle].instance_custom_index_and_mask.instance_custom_index;
+    const power_scale = areaScale(@bitCast(self.instances_host[handle].transform));
+
+    for (self.geometries_host[first..][0..info.geometry_count], first.., 0..) |geometry, flat_geometry_index, geometry_index| {
+        const mesh = mesh_manager.meshes.get(geometry.mesh);
+        const primitive_count = if (mesh.index_count != 0) mesh.index_count else @divExact(mesh.vertex_count, 3);
+        const key = TrianglePowerKey {
+            .mesh = geometry.mesh,
+            .material = geometry.material,
+        };
+
+        // may have been using another material before
+        const existing = self.emissive_geometries.get(@intCast(flat_geometry_index));
+        if (existing != null and !std.meta.eql(existing.?.key, key)) try self.removePower(allocator, @intCast(flat_geometry_index));
+
+        if (primitive_count == 0 or !material_manager.mayEmit(geometry.material)) {
+            try self.removePower(allocator, @intCast(flat_geometry_index));
+            continue;
         }
-    }, &.{});
+
+        try self.emissive_geometries.ensureUnusedCapacity(allocator, 1);
+        const tree = if (self.emissive_geometries.contains(@intCast(flat_geometry_index))) self.triangle_power_trees.get(key).? else try self.acquireTrianglePowers(vc, allocator, encoder, key, primitive_count);
+
+        const emissive = EmissiveGeometry {
+            .key = key,
+            .info = GeometryPowerInfo {
+                .instance_index = handle,
+                .geometry_index = @intCast(geometry_index),
+                .triangle_offset = tree.range.offset,
+                .triangle_count = tree.triangle_count,
+                .power_scale = power_scale,
+            },
+        };
+        if (existing == null or !std.meta.eql(existing.?, emissive)) {
+            self.emissive_geometries.putAssumeCapacity(@intCast(flat_geometry_index), emissive);
+            try self.writePowerInfo(allocator, @intCast(flat_geometry_index), emissive.info);
+        }
+    }
+}
+
+// emissive geometries of instances whose transforms may have changed have their power rescaled
+fn updatePowerScales(self: *Self, allocator: std.mem.Allocator, range: DirtyRange) !void {
+    if (self.emissive_geometries.count() == 0) return;
+
+    for (self.instances_host[range.first..range.last + 1], self.instance_infos[range.first..range.last + 1]) |instance, info| {
+        if (!info.alive) continue;
+        const power_scale = areaScale(@bitCast(instance.transform));
+        const first = instance.instance_custom_index_and_mask.instance_custom_index;
+        for (first..first + info.geometry_count) |flat_geometry_index| {
+            const emissive = self.emissive_geometries.getPtr(@intCast(flat_geometry_index)) orelse continue;
+            if (emissive.info.power_scale == power_scale) continue;
+            emissive.info.power_scale = power_scale;
+            try self.writePowerInfo(allocator, @intCast(flat_geometry_index), emissive.info);
+        }
+    }
+}
+
+// stops a geometry from being sampled for emissive light from the next commit on
+fn removePower(self: *Self, allocator: std.mem.Allocator, flat_geometry_index: u32) !void {
+    const entry = self.emissive_geometries.fetchSwapRemove(flat_geometry_index) orelse return;
+
+    const tree = self.triangle_power_trees.getPtr(entry.value.key).?;
+    tree.ref_count -= 1;
+    if (tree.ref_count == 0) {
+        try self.freeTrianglePowers(allocator, tree.range);
+        _ = self.triangle_power_trees.swapRemove(entry.value.key);
+    }
+
+    var info = entry.value.info;
+    info.triangle_offset = std.math.maxInt(u32);
+    try self.writePowerInfo(allocator, flat_geometry_index, info);
+}
+
+fn writePowerInfo(self: *Self, allocator: std.mem.Allocator, flat_geometry_index: u32, info: GeometryPowerInfo) !void {
+    try self.geometry_power_info_updates.write(allocator, @sizeOf(GeometryPowerInfo) * flat_geometry_index, std.mem.asBytes(&info));
+    self.need_geometry_power_rebuild = true;
+}
+
+// the power tree of this mesh and material, made room for if no geometry was using it yet
+fn acquireTrianglePowers(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, key: TrianglePowerKey, triangle_count: u32) !TrianglePowerTree {
+    try self.triangle_power_trees.ensureUnusedCapacity(allocator, 1);
+    const result = self.triangle_power_trees.getOrPutAssumeCapacity(key);
+    if (result.found_existing) {
+        result.value_ptr.ref_count += 1;
+    } else {
+        errdefer _ = self.triangle_power_trees.swapRemove(key);
+        result.value_ptr.* = TrianglePowerTree {
+            .range = try self.allocateTrianglePowers(vc, encoder, powerTreeSize(triangle_count)),
+            .triangle_count = triangle_count,
+            .ref_count = 1,
+            .stale = true,
+        };
+    }
+    return result.value_ptr.*;
+}
+
+// brings the emissive light data on the device up to date with what changed on the host
+//
+// triangle power trees are computed all together, folding one level of every tree at a time,
+// after which the geometry power tree is remade from them if any of its leaves changed
+fn recordCommitPowers(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager) !void {
+    for (self.dirty_power_instances.items) |handle| {
+        if (self.isAlive(handle)) try self.updateInstancePower(vc, allocator, encoder, mesh_manager, material_manager, handle);
+    }
+    self.dirty_power_instances.clearRetainingCapacity();
+
+    const any_stale = for (self.triangle_power_trees.values()) |tree| {
+        if (tree.stale) break true;
+    } else false;
+    if (!any_stale and self.geometry_power_info_updates.isEmpty() and !self.need_geometry_power_rebuild) return;
+
+    // earlier power updates and traces may still be using what is about to be overwritten,
+    // and triangle powers read mesh data that may have just been copied
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true, .copy_bit = true },
+            .src_access_mask = .{ .transfer_write_bit = true, .shader_write_bit = true },
+            .dst_stage_mask = .{ .compute_shader_bit = true, .copy_bit = true },
+            .dst_access_mask = .{ .shader_read_bit = true, .shader_write_bit = true, .transfer_write_bit = true },
+        }),
+    });
+
+    try self.recordTrianglePowers(allocator, encoder, mesh_manager, material_manager);
+
+    try self.geometry_power_info_updates.record(allocator, encoder, self.geometry_power_infos.buffer.handle, .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true }, .{ .shader_storage_read_bit = true });
+
+    if (self.need_geometry_power_rebuild) {
+        self.need_geometry_power_rebuild = false;
+        self.recordGeometryPowers(encoder);
+    }
+}
+
+// computes every stale triangle power tree
+fn recordTrianglePowers(self: *Self, allocator: std.mem.Allocator, encoder: *Encoder, mesh_manager: MeshManager, material_manager: MaterialManager) !void {
+    // what is left to fold of each tree
+    const Level = struct {
+        offset: u32,
+        size: u32,
+    };
+    var levels = std.ArrayListUnmanaged(Level) {};
+    defer levels.deinit(allocator);
+
+    var triangle_count: u64 = 0;
+    for (self.triangle_power_trees.values()) |tree| {
+        if (tree.stale) triangle_count += tree.triangle_count;
+    }
+    if (triangle_count == 0) return;
+
+    const scope = encoder.beginScope("triangle powers");
+    defer encoder.endScope(scope, triangle_count);
+
+    const shader_local_size = 32; // must be kept in sync with shader -- looks like HLSL doesn't support setting this via spec constants
 
     self.triangle_power_pipeline.recordBindPipeline(encoder.buffer);
     self.triangle_power_pipeline.recordBindAdditionalDescriptorSets(encoder.buffer, .{ material_manager.textures.descriptor_set });
     self.triangle_power_pipeline.recordPushDescriptors(encoder.buffer, .{
-        .instances = self.instances_device.handle,
-        .world_to_instances = self.world_to_instance_device.handle,
-        .meshes = mesh_manager.addresses_buffer.handle,
-        .geometries = self.geometries.handle,
-        .material_values = material_manager.materials.handle,
-        .emissive_triangle_count = self.emissive_triangle_count.handle,
-        .dst_power = .{ .view = self.triangle_powers_mips[0] },
-        .dst_triangle_metadata = self.triangle_powers_meta.handle,
+        .meshes = mesh_manager.addresses_buffer.buffer.handle,
+        .material_values = material_manager.materials.buffer.handle,
+        .dst_triangle_powers = self.triangle_powers.buffer.handle,
     });
-    self.triangle_power_pipeline.recordPushConstants(encoder.buffer, .{
-        .instance_index = instance_index,
-        .geometry_index = geometry_index,
-        .triangle_count = primitive_count,
+    for (self.triangle_power_trees.keys(), self.triangle_power_trees.values()) |key, *tree| {
+        if (!tree.stale) continue;
+        tree.stale = false;
+        try levels.append(allocator, Level {
+            .offset = tree.range.offset,
+            .size = tree.triangle_count,
+        });
+
+        self.triangle_power_pipeline.recordPushConstants(encoder.buffer, .{
+            .mesh_index = key.mesh,
+            .material_index = key.material,
+            .triangle_count = tree.triangle_count,
+            .triangle_power_offset = tree.range.offset,
+        });
+        const dispatch_size = std.math.divCeil(u32, tree.triangle_count, shader_local_size) catch unreachable;
+        self.triangle_power_pipeline.recordDispatch(encoder.buffer, .{ .width = dispatch_size, .height = 1, .depth = 1 });
+    }
+
+    // sum up level by level, each one right after the one before it
+    self.power_fold_pipeline.recordBindPipeline(encoder.buffer);
+    self.power_fold_pipeline.recordPushDescriptors(encoder.buffer, .{
+        .powers = self.triangle_powers.buffer.handle,
     });
+    while (true) {
+        const folding = for (levels.items) |level| {
+            if (level.size > 1) break true;
+        } else false;
+        if (!folding) break;
+
+        encoder.barrier(&.{}, &[_]Encoder.BufferBarrier {
+            Encoder.BufferBarrier {
+                .src_stage_mask = .{ .compute_shader_bit = true },
+                .src_access_mask = .{ .shader_write_bit = true },
+                .dst_stage_mask = .{ .compute_shader_bit = true },
+                .dst_access_mask = .{ .shader_read_bit = true, .shader_write_bit = true },
+                .buffer = self.triangle_powers.buffer.handle,
+            }
+        });
+        for (levels.items) |*level| {
+            if (level.size <= 1) continue;
+            self.power_fold_pipeline.recordPushConstants(encoder.buffer, .{
+                .src_offset = level.offset,
+                .src_size = level.size,
+            });
+            const dst_size = (level.size + 1) / 2;
+            const dispatch_size = std.math.divCeil(u32, dst_size, shader_local_size) catch unreachable;
+            self.power_fold_pipeline.recordDispatch(encoder.buffer, .{ .width = dispatch_size, .height = 1, .depth = 1 });
+            level.offset += level.size;
+            level.size = dst_size;
+        }
+    }
+
+    // roots are read by the geometry power tree and everything by light sampling
+    encoder.barrier(&.{}, &[_]Encoder.BufferBarrier {
+        Encoder.BufferBarrier {
+            .src_stage_mask = .{ .compute_shader_bit = true },
+            .src_access_mask = .{ .shader_write_bit = true },
+            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true },
+            .dst_access_mask = .{ .shader_read_bit = true },
+            .buffer = self.triangle_powers.buffer.handle,
+        }
+    });
+}
+
+// remakes the whole geometry power tree, first its leaves from the roots
+// of the triangle power trees and then level by level up to its root
+fn recordGeometryPowers(self: *const Self, encoder: *Encoder) void {
+    const capacity: u32 = @intCast(self.geometry_power_infos.capacity);
+
+    const scope = encoder.beginScope("geometry powers");
+    defer encoder.endScope(scope, capacity);
+
     const shader_local_size = 32; // must be kept in sync with shader -- looks like HLSL doesn't support setting this via spec constants
-    const dispatch_size = std.math.divCeil(u32, primitive_count, shader_local_size) catch unreachable;
-    self.triangle_power_pipeline.recordDispatch(encoder.buffer, .{ .width = dispatch_size, .height = 1, .depth = 1 });
-    self.triangle_power_fold_pipeline.recordBindPipeline(encoder.buffer);
 
-    for (1..self.triangle_powers_mips.len) |dst_mip_level| {
-        encoder.barrier(&[_]Encoder.ImageBarrier {
-            Encoder.ImageBarrier {
+    self.geometry_power_leaves_pipeline.recordBindPipeline(encoder.buffer);
+    self.geometry_power_leaves_pipeline.recordPushDescriptors(encoder.buffer, .{
+        .triangle_powers = self.triangle_powers.buffer.handle,
+        .geometry_power_infos = self.geometry_power_infos.buffer.handle,
+        .geometry_powers = self.geometry_powers.handle,
+    });
+    self.geometry_power_leaves_pipeline.recordPushConstants(encoder.buffer, .{
+        .geometry_count = capacity,
+    });
+    self.geometry_power_leaves_pipeline.recordDispatch(encoder.buffer, .{ .width = std.math.divCeil(u32, capacity, shader_local_size) catch unreachable, .height = 1, .depth = 1 });
+
+    self.power_fold_pipeline.recordBindPipeline(encoder.buffer);
+    self.power_fold_pipeline.recordPushDescriptors(encoder.buffer, .{
+        .powers = self.geometry_powers.handle,
+    });
+    var src_offset: u32 = 0;
+    var src_size = capacity;
+    while (src_size > 1) {
+        encoder.barrier(&.{}, &[_]Encoder.BufferBarrier {
+            Encoder.BufferBarrier {
                 .src_stage_mask = .{ .compute_shader_bit = true },
                 .src_access_mask = .{ .shader_write_bit = true },
                 .dst_stage_mask = .{ .compute_shader_bit = true },
-                .dst_access_mask = .{ .shader_read_bit = true },
-                .old_layout = .general,
-                .new_layout = .shader_read_only_optimal,
-                .image = self.triangle_powers.handle,
-                .base_mip_level = @intCast(dst_mip_level - 1),
-                .level_count = 1,
-            },
-            Encoder.ImageBarrier {
-                .dst_stage_mask = .{ .compute_shader_bit = true },
-                .dst_access_mask = .{ .shader_write_bit = true },
-                .old_layout = .shader_read_only_optimal,
-                .new_layout = .general,
-                .image = self.triangle_powers.handle,
-                .base_mip_level = @intCast(dst_mip_level),
-                .level_count = 1,
+                .dst_access_mask = .{ .shader_read_bit = true, .shader_write_bit = true },
+                .buffer = self.geometry_powers.handle,
             }
-        }, &.{});
-        self.triangle_power_fold_pipeline.recordPushDescriptors(encoder.buffer, .{
-            .src_mip = .{ .view = self.triangle_powers_mips[dst_mip_level - 1] },
-            .dst_mip = .{ .view = self.triangle_powers_mips[dst_mip_level] },
-            .instances = self.instances_device.handle,
-            .geometry_to_triangle_power_offset = self.geometry_to_triangle_power_offset.handle,
-            .emissive_triangle_count = self.emissive_triangle_count.handle,
         });
-        self.triangle_power_fold_pipeline.recordPushConstants(encoder.buffer, .{
-            .instance_index = instance_index,
-            .geometry_index = geometry_index,
-            .triangle_count = primitive_count,
+        self.power_fold_pipeline.recordPushConstants(encoder.buffer, .{
+            .src_offset = src_offset,
+            .src_size = src_size,
         });
-        const dst_mip_size = std.math.pow(u32, 2, @intCast(self.triangle_powers_mips.len - dst_mip_level));
-        const mip_dispatch_size = std.math.divCeil(u32, dst_mip_size, shader_local_size) catch unreachable;
-        self.triangle_power_fold_pipeline.recordDispatch(encoder.buffer, .{ .width = mip_dispatch_size, .height = 1, .depth = 1 });
+        const dst_size = (src_size + 1) / 2;
+        self.power_fold_pipeline.recordDispatch(encoder.buffer, .{ .width = std.math.divCeil(u32, dst_size, shader_local_size) catch unreachable, .height = 1, .depth = 1 });
+        src_offset += src_size;
+        src_size = dst_size;
     }
+    std.debug.assert(src_offset + 1 == powerTreeSize(capacity));
 
-    encoder.barrier(&[_]Encoder.ImageBarrier {
-        Encoder.ImageBarrier {
+    encoder.barrier(&.{}, &[_]Encoder.BufferBarrier {
+        Encoder.BufferBarrier {
             .src_stage_mask = .{ .compute_shader_bit = true },
             .src_access_mask = .{ .shader_write_bit = true },
-            .dst_stage_mask = .{ .compute_shader_bit = true },
+            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true },
             .dst_access_mask = .{ .shader_read_bit = true },
-            .old_layout = .general,
-            .new_layout = .shader_read_only_optimal,
-            .image = self.triangle_powers.handle,
-            .base_mip_level = self.triangle_powers_mips.len - 1,
-            .level_count = 1,
+            .buffer = self.geometry_powers.handle,
+        }
+    });
+}
+
+// finds room for a power tree in triangle_powers, growing it if there is none
+fn allocateTrianglePowers(self: *Self, vc: *const VulkanContext, encoder: *Encoder, size: u32) !TrianglePowerRange {
+    for (self.free_triangle_power_ranges.items, 0..) |*free, i| {
+        if (free.size < size) continue;
+        const range = TrianglePowerRange {
+            .offset = free.offset,
+            .size = size,
+        };
+        if (free.size == size) {
+            _ = self.free_triangle_power_ranges.orderedRemove(i);
+        } else {
+            free.offset += size;
+            free.size -= size;
         }
-    }, &.{});
+        return range;
+    }
+
+    _ = try self.triangle_powers.ensureTotalCapacity(vc, encoder, self.triangle_power_count + size);
+    const range = TrianglePowerRange {
+        .offset = self.triangle_power_count,
+        .size = size,
+    };
+    self.triangle_power_count += size;
+    return range;
+}
+
+// free ranges are kept sorted by offset and merged with their neighbours, so freed space
+// does not splinter into ranges too small for any tree, and none ends at the high-water mark
+fn freeTrianglePowers(self: *Self, allocator: std.mem.Allocator, range: TrianglePowerRange) !void {
+    const ranges = &self.free_triangle_power_ranges;
+    var i: usize = 0;
+    while (i < ranges.items.len and ranges.items[i].offset < range.offset) i += 1;
+
+    var merged = range;
+    const merge_previous = i != 0 and ranges.items[i - 1].offset + ranges.items[i - 1].size == merged.offset;
+    if (merge_previous) {
+        i -= 1;
+        merged.offset = ranges.items[i].offset;
+        merged.size += ranges.items[i].size;
+    }
+    const next = if (merge_previous) i + 1 else i;
+    const merge_next = next < ranges.items.len and merged.offset + merged.size == ranges.items[next].offset;
+    if (merge_next) merged.size += ranges.items[next].size;
+
+    // keep the high-water mark low where possible
+    if (merged.offset + merged.size == self.triangle_power_count) {
+        self.triangle_power_count = merged.offset;
+        if (merge_previous) _ = ranges.orderedRemove(i);
+    } else if (merge_previous) {
+        ranges.items[i] = merged;
+        if (merge_next) _ = ranges.orderedRemove(i + 1);
+    } else if (merge_next) {
+        ranges.items[i] = merged;
+    } else {
+        try ranges.insert(allocator, i, merged);
+    }
 }
 
 // probably bad idea if you're changing many
@@ -567,8 +1544,11 @@ pub fn recordUpdateSingleTransform(self: *Self, command_buffer: VulkanContext.Co
     const offset = @sizeOf(vk.AccelerationStructureInstanceKHR) * instance_idx + @offsetOf(vk.AccelerationStructureInstanceKHR, "transform");
     const offset_inverse = @sizeOf(Mat3x4) * instance_idx;
     const size = @sizeOf(vk.TransformMatrixKHR);
-    command_buffer.updateBuffer(self.instances_device.handle, offset, size, &new_transform);
-    command_buffer.updateBuffer(self.world_to_instance_device.handle, offset_inverse, size, &new_transform.inverse_affine());
+    command_buffer.updateBuffer(self.instances_device.buffer.handle, offset, size, &new_transform);
+    command_buffer.updateBuffer(self.world_to_instance_device.buffer.handle, offset_inverse, size, &new_transform.inverse_affine());
+    // keep host in sync so later commits do not revert this
+    self.instances_host[instance_idx].transform = @bitCast(new_transform);
+    self.world_to_instance_host[instance_idx] = new_transform.inverse_affine();
     const barriers = [_]vk.BufferMemoryBarrier2 {
         .{
             .src_stage_mask = .{ .clear_bit = true }, // cmdUpdateBuffer seems to be clear for some reason
@@ -577,7 +1557,7 @@ pub fn recordUpdateSingleTransform(self: *Self, command_buffer: VulkanContext.Co
             .dst_access_mask = .{ .acceleration_structure_read_bit_khr = true, .shader_storage_read_bit = true },
             .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
             .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .buffer = self.instances_device.handle,
+            .buffer = self.instances_device.buffer.handle,
             .offset = offset,
             .size = size,
         },
@@ -588,7 +1568,7 @@ pub fn recordUpdateSingleTransform(self: *Self, command_buffer: VulkanContext.Co
             .dst_access_mask = .{ .shader_storage_read_bit = true },
             .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
             .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .buffer = self.world_to_instance_device.handle,
+            .buffer = self.world_to_instance_device.buffer.handle,
             .offset = offset_inverse,
             .size = size,
         },
@@ -599,16 +1579,23 @@ pub fn recordUpdateSingleTransform(self: *Self, command_buffer: VulkanContext.Co
     });
 }
 
-// TODO: get it working
-pub fn updateVisibility(self: *Self, instance_idx: u32, visible: bool) void {
-    self.instances_host.data[instance_idx].instance_custom_index_and_mask.mask = if (visible) 0xFF else 0x00;
-}
-
 // probably bad idea if you're changing many
-pub fn recordUpdateSingleMaterial(self: Self, command_buffer: VulkanContext.CommandBuffer, geometry_idx: u32, new_material_idx: u32) void {
+pub fn recordUpdateSingleMaterial(self: *Self, allocator: std.mem.Allocator, command_buffer: VulkanContext.CommandBuffer, instance: Handle, geometry_index: u32, new_material_idx: u32) !void {
+    const first = self.instances_host[instance].instance_custom_index_and_mask.instance_custom_index;
+    const geometry_idx = first + geometry_index;
+    const old_material_idx = self.geometries_host[geometry_idx].material;
+    const instances = try self.material_instances.getOrPutValue(allocator, new_material_idx, .{});
+    try instances.value_ptr.put(allocator, instance, {});
+
     const offset = @sizeOf(Geometry) * geometry_idx + @offsetOf(Geometry, "material");
     const size = @sizeOf(u32);
-    command_buffer.updateBuffer(self.geometries.handle, offset, size, &new_material_idx);
+    command_buffer.updateBuffer(self.geometries.buffer.handle, offset, size, &new_material_idx);
+    // keep host in sync so later compactions do not revert this
+    self.geometries_host[geometry_idx].material = new_material_idx;
+    // another geometry of this instance may still use the old material
+    for (self.geometries_host[first..][0..self.instance_infos[instance].geometry_count]) |geometry| {
+        if (geometry.material == old_material_idx) break;
+    } else _ = self.material_instances.getPtr(old_material_idx).?.swapRemove(instance);
     command_buffer.pipelineBarrier2(&vk.DependencyInfo {
         .buffer_memory_barrier_count = 1,
         .p_buffer_memory_barriers = @ptrCast(&vk.BufferMemoryBarrier2 {
@@ -618,7 +1605,7 @@ pub fn recordUpdateSingleMaterial(self: Self, command_buffer: VulkanContext.Comm
             .dst_access_mask = .{ .shader_storage_read_bit = true },
             .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
             .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .buffer = self.geometries.handle,
+            .buffer = self.geometries.buffer.handle,
             .offset = offset,
             .size = size,
         }),
@@ -679,40 +1666,67 @@ pub fn recordRebuild(self: *Self, command_buffer: VulkanContext.CommandBuffer) !
 
 pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
     self.instances_device.destroy(vc);
-    self.instances_host.destroy(vc);
+    allocator.free(self.instances_host);
     self.world_to_instance_device.destroy(vc);
-    self.world_to_instance_host.destroy(vc);
+    allocator.free(self.world_to_instance_host);
+    allocator.free(self.instance_infos);
+    self.free_instances.deinit(allocator);
 
     self.geometries.destroy(vc);
+    allocator.free(self.geometries_host);
 
     self.triangle_powers.destroy(vc);
-    self.triangle_powers_meta.destroy(vc);
-    self.geometry_to_triangle_power_offset.destroy(vc);
-    self.emissive_triangle_count.destroy(vc);
+    self.triangle_power_trees.deinit(allocator);
+    self.free_triangle_power_ranges.deinit(allocator);
+    self.emissive_geometries.deinit(allocator);
+    self.geometry_powers.destroy(vc);
+    self.geometry_power_infos.destroy(vc);
+    self.geometry_power_info_updates.deinit(allocator);
+    self.dirty_power_instances.deinit(allocator);
+    var material_instances = self.material_instances.valueIterator();
+    while (material_instances.next()) |instances| instances.deinit(allocator);
+    self.material_instances.deinit(allocator);
 
     self.triangle_power_pipeline.destroy(vc);
-    self.triangle_power_fold_pipeline.destroy(vc);
+    self.power_fold_pipeline.destroy(vc);
+    self.geometry_power_leaves_pipeline.destroy(vc);
 
     self.tlas_update_scratch_buffer.destroy(vc);
 
-    for (self.triangle_powers_mips) |view| {
-        vc.device.destroyImageView(view, null);
-    }
-
     const blases_slice = self.blases.slice();
     const blases_handles = blases_slice.items(.handle);
     const blases_buffers = blases_slice.items(.buffer);
+    const blases_geometries = blases_slice.items(.geometries);
 
     for (0..self.blases.len) |i| {
         vc.device.destroyAccelerationStructureKHR(blases_handles[i], null);
         blases_buffers[i].destroy(vc);
+        allocator.free(blases_geometries[i]);
     }
     self.blases.deinit(allocator);
+    self.free_blases.deinit(allocator);
+    for (self.pending_compactions.items) |batch| {
+        vc.device.destroyQueryPool(batch.query_pool, null);
+        allocator.free(batch.blases);
+    }
+    self.pending_compactions.deinit(allocator);
+    self.pending_blases.deinit(allocator);
+    self.pending_instances.deinit(allocator);
+    self.updated_meshes.deinit(allocator);
 
     vc.device.destroyAccelerationStructureKHR(self.tlas_handle, null);
     self.tlas_buffer.destroy(vc);
 }
 
+// what builds are profiled in
+fn buildPrimitiveCount(infos: []const vk.AccelerationStructureBuildGeometryInfoKHR, build_range_infos: []const [*]const vk.AccelerationStructureBuildRangeInfoKHR) u64 {
+    var count: u64 = 0;
+    for (infos, build_range_infos) |info, ranges| {
+        for (ranges[0..info.geometry_count]) |range| count += range.primitive_count;
+    }
+    return count;
+}
+
 fn getBuildSizesInfo(vc: *const VulkanContext, geometry_info: *const vk.AccelerationStructureBuildGeometryInfoKHR, max_primitive_count: [*]const u32) vk.AccelerationStructureBuildSizesInfoKHR {
     var size_info: vk.AccelerationStructureBuildSizesInfoKHR = undefined;
     size_info.s_type = .acceleration_structure_build_sizes_info_khr;
@@ -265,13 +265,17 @@ pub fn addBackground(self: *Self, vc: *const VulkanContext, allocator: std.mem.A
         },
     });
 
+    const luminance_scope = encoder.beginScope("background luminance");
     self.luminance_pipeline.recordBindPipeline(encoder.buffer);
     self.luminance_pipeline.recordPushDescriptors(encoder.buffer, .{
         .src_color_image = .{ .view = equal_area_image.view },
         .dst_luminance_image = .{ .view = luminance_image.view },
     });
     self.luminance_pipeline.recordDispatch(encoder.buffer, .{ .width = dispatch_size, .height = dispatch_size, .depth = 1 });
+    encoder.endScope(luminance_scope, equal_area_map_size * equal_area_map_size);
 
+    const fold_scope = encoder.beginScope("background fold");
+    var folded_texels: u64 = 0;
     self.fold_pipeline.recordBindPipeline(encoder.buffer);
     for (1..luminance_mips_views.len) |dst_mip_level| {
         encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
@@ -304,7 +308,9 @@ pub fn addBackground(self: *Self, vc: *const VulkanContext, allocator: std.mem.A
         const dst_mip_size = std.math.pow(u32, 2, @intCast(luminance_mips_views.len - dst_mip_level));
         const mip_dispatch_size = if (dst_mip_size > shader_local_size) @divExact(dst_mip_size, shader_local_size) else 1;
         self.fold_pipeline.recordDispatch(encoder.buffer, .{ .width = mip_dispatch_size, .height = mip_dispatch_size, .depth = 1 });
+        folded_texels += dst_mip_size * dst_mip_size;
     }
+    encoder.endScope(fold_scope, folded_texels);
     encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
         .image_memory_barrier_count = 1,
         .p_image_memory_barriers = &[1]vk.ImageMemoryBarrier2 {
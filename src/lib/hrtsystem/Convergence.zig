@@ -0,0 +1,73 @@
+// adaptive sampling, stopping pixels once their noise is below a threshold
+//
+// convergence is tracked per tile of Sensor.convergence_tile_size pixels, with the
+// integrators skipping tiles marked converged in the sensor
+const std = @import("std");
+const vk = @import("vulkan");
+
+const engine = @import("../engine.zig");
+const core = engine.core;
+const VulkanContext = core.VulkanContext;
+const Sensor = core.Sensor;
+
+const Pipeline = engine.hrtsystem.pipeline.Convergence;
+
+const Self = @This();
+
+// checking every sample would cost more than it saves
+pub const default_update_interval = 16;
+pub const default_min_sample_count = 16;
+
+pipeline: Pipeline,
+
+pub fn create(vc: *const VulkanContext, allocator: std.mem.Allocator) !Self {
+    return Self {
+        .pipeline = try Pipeline.create(vc, allocator, .{}, .{}, .{}),
+    };
+}
+
+// marks tiles of the first `extent` pixels of `sensor` whose relative error is below `noise_threshold`
+// as converged, waiting on and then making them visible to captures at `capture_stage`
+pub fn recordUpdate(self: *const Self, command_buffer: VulkanContext.CommandBuffer, sensor: *const Sensor, extent: vk.Extent2D, capture_stage: vk.PipelineStageFlags2, noise_threshold: f32, min_sample_count: u32) void {
+    command_buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = capture_stage,
+            .src_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+            .dst_stage_mask = .{ .compute_shader_bit = true },
+            .dst_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+        }),
+    });
+
+    self.pipeline.recordBindPipeline(command_buffer);
+    self.pipeline.recordPushDescriptors(command_buffer, .{
+        .output_image = .{ .view = sensor.image.view },
+        .output_moments_image = .{ .view = sensor.moments.view },
+        .converged_tiles = sensor.converged_tiles.handle,
+    });
+    self.pipeline.recordPushConstants(command_buffer, .{
+        .noise_threshold = noise_threshold,
+        .min_sample_count = min_sample_count,
+        .sample_count = sensor.sample_count,
+        .extent = extent,
+    });
+    self.pipeline.recordDispatch(command_buffer, .{
+        .width = std.math.divCeil(u32, extent.width, Sensor.convergence_tile_size) catch unreachable,
+        .height = std.math.divCeil(u32, extent.height, Sensor.convergence_tile_size) catch unreachable,
+        .depth = 1,
+    });
+
+    command_buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .compute_shader_bit = true },
+            .src_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+            .dst_stage_mask = capture_stage,
+            .dst_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
+        }),
+    });
+}
+
+pub fn destroy(self: *Self, vc: *const VulkanContext) void {
+    self.pipeline.destroy(vc);
+}
@@ -29,6 +29,10 @@ pub const Material = struct {
     emissive: TextureManager.Handle,
 
     bsdf: PolymorphicBSDF,
+
+    // false if emissive is known to be black, which keeps geometries
+    // using this material out of light sampling altogether
+    may_emit: bool = true,
 };
 
 pub const GpuMaterial = extern struct {
@@ -107,30 +111,52 @@ fn StructFromTaggedUnion(comptime Union: type, comptime InnerFn: fn(type) type)
 
 fn VariantBuffer(comptime T: type) type {
     return struct {
-        buffer: core.mem.DeviceBuffer(T, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }) = .{},
-        addr: vk.DeviceAddress = 0,
+        buffer: core.mem.GrowableDeviceBuffer(T, .{ .shader_device_address_bit = true }) = .{ .name = std.fmt.comptimePrint("material {s}", .{ variantName(T) }) },
+        addr: vk.DeviceAddress = 0, // of `buffer`, which every material of this variant points into
         len: vk.DeviceSize = 0,
+        free: std.ArrayListUnmanaged(u32) = .{}, // slots of destroyed materials, reused first
     };
 }
 
+// where in the variant buffers each material lives, so it can be freed
+const VariantSlot = struct {
+    bsdf: BSDF,
+    index: u32,
+};
+
 const VariantBuffers = StructFromTaggedUnion(PolymorphicBSDF, VariantBuffer);
 
+fn VariantUpdates(comptime T: type) type {
+    _ = T;
+    return core.mem.BufferUpdates;
+}
+
+// edits to existing materials, uploaded all at once by recordUpdates
+const Updates = struct {
+    materials: core.mem.BufferUpdates = .{},
+    variants: StructFromTaggedUnion(PolymorphicBSDF, VariantUpdates) = .{},
+};
+
 material_count: u32,
 textures: TextureManager,
-materials: core.mem.DeviceBuffer(GpuMaterial, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }),
+materials: core.mem.GrowableDeviceBuffer(GpuMaterial, .{ .storage_buffer_bit = true }),
 
 variant_buffers: VariantBuffers,
 
+variant_slots: std.ArrayListUnmanaged(VariantSlot) = .{}, // per material
+may_emit: std.ArrayListUnmanaged(bool) = .{}, // per material, see Material.may_emit
+free_handles: std.ArrayListUnmanaged(Handle) = .{}, // destroyed materials, reused by upload
+
+updates: Updates = .{},
+
 pub const Handle = u32;
 
 const Self = @This();
 
-const max_materials = 2048; // TODO: resizable buffers
-
 pub fn createEmpty(vc: *const VulkanContext) !Self {
     return Self {
         .material_count = 0,
-        .materials = .{},
+        .materials = .{ .name = "materials" },
         .variant_buffers = .{},
         .textures = try TextureManager.create(vc),
     };
@@ -138,63 +164,137 @@ pub fn createEmpty(vc: *const VulkanContext) !Self {
 
 // you can either do this or create below, but not both
 // texture handles must've been already added to the MaterialManager's textures
+// handles and variant slots of destroyed materials are reused, most recently destroyed first
+// buffers grow as needed, so this only fails if there is no memory for that
 pub fn upload(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, info: Material, name: [:0]const u8) !Handle {
-    std.debug.assert(self.material_count < max_materials);
+    _ = name; // buffers are shared between all materials, so are named after what they hold instead
+
+    const handle: Handle = if (self.free_handles.items.len != 0) self.free_handles.items[self.free_handles.items.len - 1] else self.material_count;
+    try self.variant_slots.ensureTotalCapacity(allocator, self.material_count + 1);
+    try self.may_emit.ensureTotalCapacity(allocator, self.material_count + 1);
+    _ = try self.materials.ensureTotalCapacity(vc, encoder, @as(vk.DeviceSize, handle) + 1);
+
+    var slot = VariantSlot {
+        .bsdf = std.meta.activeTag(info.bsdf),
+        .index = 0,
+    };
 
     inline for (@typeInfo(PolymorphicBSDF).@"union".fields, 0..) |field, field_idx| {
         if (@as(BSDF, @enumFromInt(field_idx)) == std.meta.activeTag(info.bsdf)) {
             if (@sizeOf(field.type) != 0) {
                 const variant_buffer = &@field(self.variant_buffers, field.name);
-                if (variant_buffer.buffer.isNull()) {
-                    const buffer_name = try std.fmt.allocPrintZ(allocator, "material {s} {s}", .{ name, field.name });
-                    defer allocator.free(buffer_name);
-                    variant_buffer.buffer = try core.mem.DeviceBuffer(field.type, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }).create(vc, max_materials, buffer_name);
-                    variant_buffer.addr = variant_buffer.buffer.getAddress(vc);
+                slot.index = if (variant_buffer.free.items.len != 0) variant_buffer.free.items[variant_buffer.free.items.len - 1] else @intCast(variant_buffer.len);
+                if (try variant_buffer.buffer.ensureTotalCapacity(vc, encoder, @as(vk.DeviceSize, slot.index) + 1)) {
+                    variant_buffer.addr = variant_buffer.buffer.buffer.getAddress(vc);
+                    self.recordVariantAddresses(encoder, std.meta.activeTag(info.bsdf), field.type);
                 }
-                variant_buffer.buffer.updateFrom(encoder, variant_buffer.len, &.{ @field(info.bsdf, field.name) });
-                variant_buffer.len += 1;
+                variant_buffer.buffer.buffer.updateFrom(encoder, slot.index, &.{ @field(info.bsdf, field.name) });
+                if (slot.index == variant_buffer.len) variant_buffer.len += 1 else _ = variant_buffer.free.pop();
             }
 
             const gpu_material = GpuMaterial {
                 .normal = info.normal,
                 .emissive = info.emissive,
                 .type = std.meta.activeTag(info.bsdf),
-                .addr = if (@sizeOf(field.type) != 0) @field(self.variant_buffers, field.name).addr + (@field(self.variant_buffers, field.name).len - 1) * @sizeOf(field.type) else 0,
+                .addr = if (@sizeOf(field.type) != 0) @field(self.variant_buffers, field.name).addr + @as(vk.DeviceSize, slot.index) * @sizeOf(field.type) else 0,
             };
-            if (self.materials.isNull()) self.materials = try core.mem.DeviceBuffer(GpuMaterial, .{ .storage_buffer_bit = true, .transfer_dst_bit = true }).create(vc, max_materials, "materials");
-            self.materials.updateFrom(encoder, self.material_count, &.{ gpu_material });
+            self.materials.buffer.updateFrom(encoder, handle, &.{ gpu_material });
         }
     }
 
-    self.material_count += 1;
-    return self.material_count - 1;
+    if (handle == self.material_count) {
+        self.variant_slots.appendAssumeCapacity(slot);
+        self.may_emit.appendAssumeCapacity(info.may_emit);
+        self.material_count += 1;
+    } else {
+        self.variant_slots.items[handle] = slot;
+        self.may_emit.items[handle] = info.may_emit;
+        _ = self.free_handles.pop();
+    }
+    return handle;
+}
+
+// points every material of this variant at the variant buffer again, after it moved
+// stale handles are rewritten too, which is harmless as nothing refers to them
+fn recordVariantAddresses(self: *const Self, encoder: *Encoder, bsdf: BSDF, comptime VariantType: type) void {
+    const addr = @field(self.variant_buffers, variantName(VariantType)).addr;
+    for (self.variant_slots.items, 0..) |slot, handle| {
+        if (slot.bsdf != bsdf) continue;
+        const slot_addr = addr + @as(vk.DeviceSize, slot.index) * @sizeOf(VariantType);
+        encoder.buffer.updateBuffer(self.materials.buffer.handle, @sizeOf(GpuMaterial) * handle + @offsetOf(GpuMaterial, "addr"), @sizeOf(vk.DeviceAddress), &slot_addr);
+    }
 }
 
-pub fn recordUpdateSingleVariant(self: *Self, comptime VariantType: type, command_buffer: VulkanContext.CommandBuffer, variant_idx: u32, new_data: VariantType) void {
-    const variant_name = inline for (@typeInfo(PolymorphicBSDF).@"union".fields) |union_field| {
+// where in its variant buffer this material lives, e.g., for updateVariantField
+pub fn variantIndex(self: *const Self, handle: Handle) u32 {
+    return self.variant_slots.items[handle].index;
+}
+
+// lets later uploads reuse this material's handle and variant slot
+// nothing may refer to this material anymore, so geometries using it must have been destroyed first
+pub fn destroyMaterial(self: *Self, allocator: std.mem.Allocator, handle: Handle) !void {
+    try self.free_handles.ensureUnusedCapacity(allocator, 1);
+
+    const slot = self.variant_slots.items[handle];
+    inline for (@typeInfo(PolymorphicBSDF).@"union".fields, 0..) |field, field_idx| {
+        if (@sizeOf(field.type) != 0 and @as(BSDF, @enumFromInt(field_idx)) == slot.bsdf) {
+            try @field(self.variant_buffers, field.name).free.append(allocator, slot.index);
+        }
+    }
+
+    self.free_handles.appendAssumeCapacity(handle);
+}
+
+// whether geometries using this material need to be considered for light sampling
+pub fn mayEmit(self: *const Self, handle: Handle) bool {
+    return self.may_emit.items[handle];
+}
+
+// only takes effect for geometries already using this material once they are looked at again, see Accel.markMaterialUpdated
+pub fn setMayEmit(self: *Self, handle: Handle, may_emit: bool) void {
+    self.may_emit.items[handle] = may_emit;
+}
+
+fn variantName(comptime VariantType: type) []const u8 {
+    return inline for (@typeInfo(PolymorphicBSDF).@"union".fields) |union_field| {
         if (union_field.type == VariantType) {
             break union_field.name;
         }
     } else @compileError("Not a material variant: " ++ @typeName(VariantType));
+}
+
+// queues a write of a single field of a material, uploaded by the next recordUpdates
+pub fn updateMaterialField(self: *Self, allocator: std.mem.Allocator, handle: Handle, comptime field: std.meta.FieldEnum(GpuMaterial), value: std.meta.FieldType(GpuMaterial, field)) !void {
+    const offset = @sizeOf(GpuMaterial) * handle + @offsetOf(GpuMaterial, @tagName(field));
+    try self.updates.materials.write(allocator, offset, std.mem.asBytes(&value));
+}
+
+// queues a write of a single field of a variant, uploaded by the next recordUpdates
+pub fn updateVariantField(self: *Self, allocator: std.mem.Allocator, comptime VariantType: type, variant_idx: u32, comptime field: std.meta.FieldEnum(VariantType), value: std.meta.FieldType(VariantType, field)) !void {
+    const offset = @sizeOf(VariantType) * variant_idx + @offsetOf(VariantType, @tagName(field));
+    try @field(self.updates.variants, variantName(VariantType)).write(allocator, offset, std.mem.asBytes(&value));
+}
 
+// queues a write of a whole variant, uploaded by the next recordUpdates
+pub fn updateVariant(self: *Self, allocator: std.mem.Allocator, comptime VariantType: type, variant_idx: u32, new_data: VariantType) !void {
     const offset = @sizeOf(VariantType) * variant_idx;
-    const size = @sizeOf(VariantType);
-    command_buffer.updateBuffer(@field(self.variant_buffers, variant_name).buffer.handle, offset, size, &new_data);
-
-    command_buffer.pipelineBarrier2(&vk.DependencyInfo {
-        .buffer_memory_barrier_count = 1,
-        .p_buffer_memory_barriers = @ptrCast(&vk.BufferMemoryBarrier2 {
-            .src_stage_mask = .{ .clear_bit = true }, // cmdUpdateBuffer seems to be clear for some reason
-            .src_access_mask = .{ .transfer_write_bit = true },
-            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-            .dst_access_mask = .{ .shader_storage_read_bit = true },
-            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-            .buffer = @field(self.variant_buffers, variant_name).buffer.handle,
-            .offset = offset,
-            .size = size,
-        }),
-    });
+    try @field(self.updates.variants, variantName(VariantType)).write(allocator, offset, std.mem.asBytes(&new_data));
+}
+
+// records one copy per buffer with queued writes, with neighbouring writes merged
+pub fn recordUpdates(self: *Self, allocator: std.mem.Allocator, encoder: *Encoder) !void {
+    const dst_stage_mask = vk.PipelineStageFlags2 { .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true };
+    const dst_access_mask = vk.AccessFlags2 { .shader_storage_read_bit = true };
+
+    try self.updates.materials.record(allocator, encoder, self.materials.buffer.handle, dst_stage_mask, dst_access_mask);
+    inline for (@typeInfo(VariantBuffers).@"struct".fields) |field| {
+        try @field(self.updates.variants, field.name).record(allocator, encoder, @field(self.variant_buffers, field.name).buffer.buffer.handle, dst_stage_mask, dst_access_mask);
+    }
+}
+
+pub fn recordUpdateSingleVariant(self: *Self, comptime VariantType: type, allocator: std.mem.Allocator, encoder: *Encoder, variant_idx: u32, new_data: VariantType) !void {
+    try self.updateVariant(allocator, VariantType, variant_idx, new_data);
+    try self.recordUpdates(allocator, encoder);
 }
 
 pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
@@ -203,73 +303,171 @@ pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocat
 
     inline for (@typeInfo(VariantBuffers).@"struct".fields) |field| {
         @field(self.variant_buffers, field.name).buffer.destroy(vc);
+        @field(self.variant_buffers, field.name).free.deinit(allocator);
+        @field(self.updates.variants, field.name).deinit(allocator);
     }
+    self.updates.materials.deinit(allocator);
+
+    self.variant_slots.deinit(allocator);
+    self.may_emit.deinit(allocator);
+    self.free_handles.deinit(allocator);
 }
 
 pub const TextureManager = struct {
-    const max_descriptors = 8192; // TODO: consider using VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT, reallocation
+    // the texture binding has a variable descriptor count, so this is just the upper bound --
+    // the descriptor set only has room for descriptor_capacity textures,
+    // and is reallocated with twice the room whenever that runs out
+    const max_descriptors = std.math.powi(u32, 2, 16) catch unreachable;
+    const initial_descriptor_capacity = 1024;
+
     // must be kept in sync with shader
+    // variable descriptor count binding must come last
     pub const DescriptorLayout = core.descriptor.DescriptorLayout(&.{
         .{
-            .descriptor_type = .sampled_image,
-            .descriptor_count = max_descriptors,
+            .descriptor_type = .sampler,
+            .descriptor_count = 1,
             .stage_flags = .{ .raygen_bit_khr = true, .compute_bit = true },
-            .binding_flags = .{ .partially_bound_bit = true, .update_unused_while_pending_bit = true },
         },
         .{
-            .descriptor_type = .sampler,
-            .descriptor_count = 1,
+            .descriptor_type = .sampled_image,
+            .descriptor_count = max_descriptors,
             .stage_flags = .{ .raygen_bit_khr = true, .compute_bit = true },
-        }
-    }, .{}, 1, "Textures");
+            .binding_flags = .{ .partially_bound_bit = true, .update_unused_while_pending_bit = true, .variable_descriptor_count_bit = true },
+        },
+    }, .{}, 0, "Textures");
 
     data: std.MultiArrayList(Image),
+    free_handles: std.ArrayListUnmanaged(Handle), // destroyed textures, reused by upload
     descriptor_layout: DescriptorLayout,
-    descriptor_set: vk.DescriptorSet,
+    descriptor_pool: vk.DescriptorPool,
+    descriptor_set: vk.DescriptorSet, // changes when it grows, so bind it again every time
+    descriptor_capacity: u32,
     sampler: vk.Sampler,
 
     pub fn create(vc: *const VulkanContext) !TextureManager {
         const sampler = try createSampler(vc);
-        const descriptor_layout = try DescriptorLayout.create(vc, .{ sampler });
+        errdefer vc.device.destroySampler(sampler, null);
+        var descriptor_layout = try DescriptorLayout.create(vc, .{ sampler });
+        errdefer descriptor_layout.destroy(vc);
 
-        var descriptor_set: vk.DescriptorSet = undefined;
-        try vc.device.allocateDescriptorSets(&vk.DescriptorSetAllocateInfo {
-            .descriptor_pool = descriptor_layout.pool,
-            .descriptor_set_count = 1,
-            .p_set_layouts = @ptrCast(&descriptor_layout.handle),
-        }, @ptrCast(&descriptor_set));
-        try vk_helpers.setDebugName(vc.device, descriptor_set, "textures");
+        const descriptor_pool, const descriptor_set = try createDescriptorSet(vc, descriptor_layout, initial_descriptor_capacity);
 
         return TextureManager {
             .data = .{},
+            .free_handles = .{},
             .descriptor_layout = descriptor_layout,
+            .descriptor_pool = descriptor_pool,
             .descriptor_set = descriptor_set,
+            .descriptor_capacity = initial_descriptor_capacity,
             .sampler = sampler,
         };
     }
 
+    // each set gets its own pool just big enough for it
+    fn createDescriptorSet(vc: *const VulkanContext, descriptor_layout: DescriptorLayout, capacity: u32) !std.meta.Tuple(&.{ vk.DescriptorPool, vk.DescriptorSet }) {
+        const pool_sizes = [_]vk.DescriptorPoolSize {
+            .{
+                .type = .sampler,
+                .descriptor_count = 1,
+            },
+            .{
+                .type = .sampled_image,
+                .descriptor_count = capacity,
+            },
+        };
+        const pool = try vc.device.createDescriptorPool(&.{
+            .flags = .{},
+            .max_sets = 1,
+            .pool_size_count = pool_sizes.len,
+            .p_pool_sizes = &pool_sizes,
+        }, null);
+        errdefer vc.device.destroyDescriptorPool(pool, null);
+
+        var descriptor_set: vk.DescriptorSet = undefined;
+        try vc.device.allocateDescriptorSets(&vk.DescriptorSetAllocateInfo {
+            .p_next = &vk.DescriptorSetVariableDescriptorCountAllocateInfo {
+                .descriptor_set_count = 1,
+                .p_descriptor_counts = @ptrCast(&capacity),
+            },
+            .descriptor_pool = pool,
+            .descriptor_set_count = 1,
+            .p_set_layouts = @ptrCast(&descriptor_layout.handle),
+        }, @ptrCast(&descriptor_set));
+        try vk_helpers.setDebugName(vc.device, descriptor_set, "textures");
+
+        return .{ pool, descriptor_set };
+    }
+
+    // moves all textures into a new descriptor set with twice the room
+    // the old one is attached to the encoder, as earlier commands may still be using it
+    fn growDescriptorSet(self: *TextureManager, vc: *const VulkanContext, encoder: *Encoder) !void {
+        const new_capacity = @min(self.descriptor_capacity * 2, max_descriptors);
+        const descriptor_pool, const descriptor_set = try createDescriptorSet(vc, self.descriptor_layout, new_capacity);
+        errdefer vc.device.destroyDescriptorPool(descriptor_pool, null);
+        try encoder.attachResource(self.descriptor_pool);
+
+        if (self.data.len != 0) vc.device.updateDescriptorSets(0, null, 1, @ptrCast(&vk.CopyDescriptorSet {
+            .src_set = self.descriptor_set,
+            .src_binding = 1,
+            .src_array_element = 0,
+            .dst_set = descriptor_set,
+            .dst_binding = 1,
+            .dst_array_element = 0,
+            .descriptor_count = @intCast(self.data.len),
+        }));
+
+        self.descriptor_pool = descriptor_pool;
+        self.descriptor_set = descriptor_set;
+        self.descriptor_capacity = new_capacity;
+    }
+
     pub const Handle = u32;
 
     pub fn upload(self: *TextureManager, vc: *const VulkanContext, comptime T: type, allocator: std.mem.Allocator, encoder: *Encoder, src: core.mem.BufferSlice(T), extent: vk.Extent2D, name: [:0]const u8, comptime srgb: bool) !TextureManager.Handle {
-        const format = comptime vk_helpers.typeToFormat(T, srgb);
+        return self.uploadMips(vc, allocator, encoder, src.asBytes(), comptime vk_helpers.typeToFormat(T, srgb), extent, 1, name);
+    }
+
+    // `src` holds `mip_level_count` levels tightly packed one after the other, starting with the largest,
+    // as they are laid out in e.g., DDS files
+    // this is also how block-compressed textures are uploaded, in which case it is blocks that are packed
+    pub fn uploadMips(self: *TextureManager, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, src: core.mem.BufferSlice(u8), format: vk.Format, extent: vk.Extent2D, mip_level_count: u32, name: [:0]const u8) !TextureManager.Handle {
+        const image = try createTexture(vc, encoder, src, format, extent, mip_level_count, name);
+        errdefer image.destroy(vc);
+        return try self.insert(vc, allocator, encoder, image);
+    }
 
+    // creates the image of a texture and records its upload into `encoder`
+    // touches nothing shared, so many threads may do this at once as long as each has its own encoder
+    pub fn createTexture(vc: *const VulkanContext, encoder: *Encoder, src: core.mem.BufferSlice(u8), format: vk.Format, extent: vk.Extent2D, mip_level_count: u32, name: [:0]const u8) !Image {
         // > If dstImage does not have either a depth/stencil format or a multi-planar format,
         // > then for each element of pRegions, bufferOffset must be a multiple of the texel block size
         // https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/vkCmdCopyBufferToImage.html
         std.debug.assert(src.offset % vk_helpers.texelBlockSize(format) == 0);
+        std.debug.assert(mip_level_count >= 1 and mip_level_count <= std.math.log2(@max(extent.width, extent.height)) + 1);
 
-        const texture_index: TextureManager.Handle = @intCast(self.data.len);
-        std.debug.assert(texture_index < max_descriptors);
-
-        const image = try Image.create(vc, extent, .{ .transfer_dst_bit = true, .sampled_bit = true }, format, false, name);
-        try self.data.append(allocator, image);
+        const image = try Image.createWithMipLevels(vc, extent, .{ .transfer_dst_bit = true, .sampled_bit = true }, format, mip_level_count, name);
+        encoder.uploadMipsToImage(src, image.handle, format, extent, mip_level_count, .shader_read_only_optimal);
+        return image;
+    }
 
-        encoder.uploadDataToImage(T, src, image.handle, extent, .shader_read_only_optimal);
+    // gives a created texture a handle, after which it is owned by this
+    // `encoder` must be submitted after the one the texture was created with, if they differ
+    pub fn insert(self: *TextureManager, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, image: Image) !TextureManager.Handle {
+        const texture_index: TextureManager.Handle = if (self.free_handles.items.len != 0) self.free_handles.items[self.free_handles.items.len - 1] else @intCast(self.data.len);
+        if (texture_index == max_descriptors) return error.TooManyTextures;
+        if (texture_index == self.descriptor_capacity) try self.growDescriptorSet(vc, encoder);
+
+        if (texture_index == self.data.len) {
+            try self.data.append(allocator, image);
+        } else {
+            self.data.set(texture_index, image);
+            _ = self.free_handles.pop();
+        }
 
         vc.device.updateDescriptorSets(1, @ptrCast(&.{
             vk.WriteDescriptorSet {
                 .dst_set = self.descriptor_set,
-                .dst_binding = 0,
+                .dst_binding = 1,
                 .dst_array_element = texture_index,
                 .descriptor_count = 1,
                 .descriptor_type = .sampled_image,
@@ -286,12 +484,29 @@ pub const TextureManager = struct {
         return texture_index;
     }
 
+    // frees the image of a texture once the encoder is done with it, its handle may be reused by later uploads
+    // nothing may refer to this texture anymore, so materials using it must have been changed or destroyed first
+    pub fn destroyTexture(self: *TextureManager, allocator: std.mem.Allocator, encoder: *Encoder, handle: Handle) !void {
+        try self.free_handles.ensureUnusedCapacity(allocator, 1);
+
+        try encoder.attachResource(self.data.get(handle));
+        self.data.set(handle, .{
+            .handle = .null_handle,
+            .view = .null_handle,
+            .allocation = .{},
+        });
+
+        self.free_handles.appendAssumeCapacity(handle);
+    }
+
     pub fn destroy(self: *TextureManager, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
         for (0..self.data.len) |i| {
             const image = self.data.get(i);
             image.destroy(vc);
         }
         self.data.deinit(allocator);
+        self.free_handles.deinit(allocator);
+        vc.device.destroyDescriptorPool(self.descriptor_pool, null);
         self.descriptor_layout.destroy(vc);
         vc.device.destroySampler(self.sampler, null);
     }
@@ -311,7 +526,7 @@ pub const TextureManager = struct {
             .compare_enable = vk.FALSE,
             .compare_op = .always,
             .min_lod = 0.0,
-            .max_lod = 0.0,
+            .max_lod = vk.LOD_CLAMP_NONE,
             .border_color = .float_opaque_white,
             .unnormalized_coordinates = vk.FALSE,
         }, null);
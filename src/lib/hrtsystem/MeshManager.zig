@@ -20,51 +20,135 @@ pub const Mesh = struct {
     normals: ?core.mem.BufferSlice(F32x3),
     texcoords: ?core.mem.BufferSlice(F32x2),
 
+    // takes the place of the above two if set, see `encodeAttributes`
+    attributes: ?CompactAttributes = null,
+
     // indices
     indices: ?core.mem.BufferSlice(U32x3),
 };
 
+// normal and texcoord of a vertex in 8 bytes rather than 20
+// must be kept in sync with loadNormal and loadTexcoord in world.hlsl
+pub const CompactAttribute = extern struct {
+    normal: u32, // octahedral, two snorm16
+    texcoord: [2]f16,
+};
+
+pub const CompactAttributes = struct {
+    data: core.mem.BufferSlice(CompactAttribute),
+    // which of the attributes are meaningful
+    normals: bool,
+    texcoords: bool,
+};
+
+pub const AttributeEncoding = enum(u64) {
+    full, // separate f32 normal and texcoord buffers
+    compact, // one interleaved CompactAttribute buffer
+};
+
+fn encodeSnorm16(x: f32) u16 {
+    const snorm: i16 = @intFromFloat(@round(std.math.clamp(x, -1.0, 1.0) * 32767.0));
+    return @bitCast(snorm);
+}
+
+// A Survey of Efficient Representations for Independent Unit Vectors, Cigolle et al. 2014
+fn encodeOctahedral(normal: F32x3) u32 {
+    const l1 = @abs(normal.x) + @abs(normal.y) + @abs(normal.z);
+    if (l1 == 0) return 0;
+    var x = normal.x / l1;
+    var y = normal.y / l1;
+    if (normal.z < 0) {
+        const folded_x = (1.0 - @abs(y)) * @as(f32, if (x >= 0) 1.0 else -1.0);
+        y = (1.0 - @abs(x)) * @as(f32, if (y >= 0) 1.0 else -1.0);
+        x = folded_x;
+    }
+    return @as(u32, encodeSnorm16(x)) | (@as(u32, encodeSnorm16(y)) << 16);
+}
+
+// packs `normals` and `texcoords`, either of which may be absent, into staging memory of `encoder`
+// texcoords lose precision past a few thousand texels, so this is meant for meshes where memory matters more
+pub fn encodeAttributes(encoder: *Encoder, vertex_count: usize, normals: ?[]const F32x3, texcoords: ?[]const F32x2) !CompactAttributes {
+    const attributes = try encoder.uploadAllocator().alloc(CompactAttribute, vertex_count);
+    for (attributes, 0..) |*attribute, i| {
+        attribute.* = CompactAttribute {
+            .normal = if (normals) |n| encodeOctahedral(n[i]) else 0,
+            .texcoord = if (texcoords) |t| .{ @floatCast(t[i].x), @floatCast(t[i].y) } else .{ 0, 0 },
+        };
+    }
+    return CompactAttributes {
+        .data = encoder.upload_allocator.getBufferSlice(attributes),
+        .normals = normals != null,
+        .texcoords = texcoords != null,
+    };
+}
+
 // actual data we have per each mesh, GPU-side info
 // probably doesn't make sense to cache addresses?
-const Meshes = std.MultiArrayList(struct {
+pub const GpuMesh = struct {
     position_buffer: core.mem.DeviceBuffer(F32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true }),
     texcoord_buffer: core.mem.DeviceBuffer(F32x2, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }),
     normal_buffer: core.mem.DeviceBuffer(F32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }),
 
+    // compact meshes have this instead of the two above
+    attribute_buffer: core.mem.DeviceBuffer(CompactAttribute, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }),
+    attribute_normals: bool,
+    attribute_texcoords: bool,
+
     vertex_count: u32,
 
     index_buffer: core.mem.DeviceBuffer(U32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true }),
     index_count: u32,
-});
+
+    pub fn hasNormals(self: GpuMesh) bool {
+        return !self.normal_buffer.isNull() or (!self.attribute_buffer.isNull() and self.attribute_normals);
+    }
+
+    pub fn hasTexcoords(self: GpuMesh) bool {
+        return !self.texcoord_buffer.isNull() or (!self.attribute_buffer.isNull() and self.attribute_texcoords);
+    }
+
+    pub fn attributeEncoding(self: GpuMesh) AttributeEncoding {
+        return if (self.attribute_buffer.isNull()) .full else .compact;
+    }
+};
+
+const Meshes = std.MultiArrayList(GpuMesh);
 
 // store seperately to be able to get pointers to geometry data in shader
+// compact texcoord and normal addresses point into the same interleaved buffer
 const MeshAddresses = packed struct {
     position_address: vk.DeviceAddress,
     texcoord_address: vk.DeviceAddress,
     normal_address: vk.DeviceAddress,
 
     index_address: vk.DeviceAddress,
+
+    attribute_encoding: AttributeEncoding,
 };
 
 meshes: Meshes = .{},
+free_handles: std.ArrayListUnmanaged(Handle) = .{}, // destroyed meshes, reused by upload
 
-addresses_buffer: core.mem.DeviceBuffer(MeshAddresses, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .storage_buffer_bit = true }) = .{},
+addresses_buffer: core.mem.GrowableDeviceBuffer(MeshAddresses, .{ .shader_device_address_bit = true, .storage_buffer_bit = true }) = .{ .name = "mesh addresses" },
 
 const Self = @This();
 
-const max_meshes = 4096; // TODO: resizable buffers
-
 pub const Handle = u32;
 
 pub fn upload(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, host_mesh: Mesh) !Handle {
-    std.debug.assert(self.meshes.len < max_meshes);
+    const gpu_mesh = try createMesh(vc, allocator, encoder, host_mesh);
+    errdefer destroyGpuMesh(vc, gpu_mesh);
+    return try self.insert(vc, allocator, encoder, gpu_mesh);
+}
 
+// creates the buffers of a mesh and records their upload into `encoder`
+// touches nothing shared, so many threads may do this at once as long as each has its own encoder
+// `allocator` must be thread-safe for that
+pub fn createMesh(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, host_mesh: Mesh) !GpuMesh {
     const position_buffer = blk: {
         const buffer_name = try std.fmt.allocPrintZ(allocator, "mesh {s} positions", .{ host_mesh.name });
         defer allocator.free(buffer_name);
         const gpu_buffer = try core.mem.DeviceBuffer(F32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true }).create(vc, host_mesh.positions.len, buffer_name);
-        gpu_buffer.uploadFrom(encoder, host_mesh.positions);
-
         break :blk gpu_buffer;
     };
     errdefer position_buffer.destroy(vc);
@@ -74,7 +158,6 @@ pub fn upload(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocato
             const buffer_name = try std.fmt.allocPrintZ(allocator, "mesh {s} texcoords", .{ host_mesh.name });
             defer allocator.free(buffer_name);
             const gpu_buffer = try core.mem.DeviceBuffer(F32x2, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }).create(vc, texcoords.len, buffer_name);
-            gpu_buffer.uploadFrom(encoder, texcoords);
             break :blk gpu_buffer;
         } else {
             break :blk core.mem.DeviceBuffer(F32x2, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }) {};
@@ -87,7 +170,6 @@ pub fn upload(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocato
             const buffer_name = try std.fmt.allocPrintZ(allocator, "mesh {s} normals", .{ host_mesh.name });
             defer allocator.free(buffer_name);
             const gpu_buffer = try core.mem.DeviceBuffer(F32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }).create(vc, normals.len, buffer_name);
-            gpu_buffer.uploadFrom(encoder, normals);
             break :blk gpu_buffer;
         } else {
             break :blk core.mem.DeviceBuffer(F32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }) {};
@@ -95,42 +177,161 @@ pub fn upload(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocato
     };
     errdefer normal_buffer.destroy(vc);
 
+    const attribute_buffer = blk: {
+        if (host_mesh.attributes) |attributes| {
+            std.debug.assert(host_mesh.normals == null and host_mesh.texcoords == null);
+            const buffer_name = try std.fmt.allocPrintZ(allocator, "mesh {s} attributes", .{ host_mesh.name });
+            defer allocator.free(buffer_name);
+            const gpu_buffer = try core.mem.DeviceBuffer(CompactAttribute, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }).create(vc, attributes.data.len, buffer_name);
+            break :blk gpu_buffer;
+        } else {
+            break :blk core.mem.DeviceBuffer(CompactAttribute, .{ .shader_device_address_bit = true, .transfer_dst_bit = true }) {};
+        }
+    };
+    errdefer attribute_buffer.destroy(vc);
+
     const index_buffer = blk: {
         if (host_mesh.indices) |indices| {
             const buffer_name = try std.fmt.allocPrintZ(allocator, "mesh {s} incides", .{ host_mesh.name });
             defer allocator.free(buffer_name);
             const gpu_buffer = try core.mem.DeviceBuffer(U32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true }).create(vc, indices.len, buffer_name);
-            gpu_buffer.uploadFrom(encoder, indices);
             break :blk gpu_buffer;
         } else {
             break :blk core.mem.DeviceBuffer(U32x3, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .acceleration_structure_build_input_read_only_bit_khr = true }) {};
         }
     };
-    errdefer index_buffer.destroy(vc);
 
-    const addresses = MeshAddresses {
-        .position_address = position_buffer.getAddress(vc),
-        .texcoord_address = texcoord_buffer.getAddress(vc),
-        .normal_address = normal_buffer.getAddress(vc) ,
+    // only record copies once nothing can fail anymore, as the buffers would be destroyed before they run otherwise
+    position_buffer.uploadFrom(encoder, host_mesh.positions);
+    if (host_mesh.texcoords) |texcoords| texcoord_buffer.uploadFrom(encoder, texcoords);
+    if (host_mesh.normals) |normals| normal_buffer.uploadFrom(encoder, normals);
+    if (host_mesh.attributes) |attributes| attribute_buffer.uploadFrom(encoder, attributes.data);
+    if (host_mesh.indices) |indices| index_buffer.uploadFrom(encoder, indices);
 
-        .index_address = index_buffer.getAddress(vc),
-    };
-
-    if (self.addresses_buffer.isNull()) self.addresses_buffer = try core.mem.DeviceBuffer(MeshAddresses, .{ .shader_device_address_bit = true, .transfer_dst_bit = true, .storage_buffer_bit = true }).create(vc, max_meshes, "mesh addresses");
-    self.addresses_buffer.updateFrom(encoder, self.meshes.len, &.{ addresses });
-
-    try self.meshes.append(allocator, .{
+    return GpuMesh {
         .position_buffer = position_buffer,
         .texcoord_buffer = texcoord_buffer,
         .normal_buffer = normal_buffer,
 
+        .attribute_buffer = attribute_buffer,
+        .attribute_normals = if (host_mesh.attributes) |attributes| attributes.normals else false,
+        .attribute_texcoords = if (host_mesh.attributes) |attributes| attributes.texcoords else false,
+
         .vertex_count = @intCast(host_mesh.positions.len),
 
         .index_buffer = index_buffer,
         .index_count = if (host_mesh.indices) |indices| @intCast(indices.len) else 0,
+    };
+}
+
+// for meshes created but never inserted
+pub fn destroyGpuMesh(vc: *const VulkanContext, gpu_mesh: GpuMesh) void {
+    gpu_mesh.position_buffer.destroy(vc);
+    gpu_mesh.texcoord_buffer.destroy(vc);
+    gpu_mesh.normal_buffer.destroy(vc);
+    gpu_mesh.attribute_buffer.destroy(vc);
+    gpu_mesh.index_buffer.destroy(vc);
+}
+
+// for meshes created but never inserted, whose copies may not have run yet
+// destroys them once `encoder` is done
+pub fn attachGpuMesh(encoder: *Encoder, gpu_mesh: GpuMesh) !void {
+    try encoder.attachResource(gpu_mesh.position_buffer);
+    try encoder.attachResource(gpu_mesh.texcoord_buffer);
+    try encoder.attachResource(gpu_mesh.normal_buffer);
+    try encoder.attachResource(gpu_mesh.attribute_buffer);
+    try encoder.attachResource(gpu_mesh.index_buffer);
+}
+
+// gives a created mesh a handle, after which it is owned by this
+// `encoder` must be submitted after the one the mesh was created with, if they differ
+pub fn insert(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, gpu_mesh: GpuMesh) !Handle {
+    const addresses = switch (gpu_mesh.attributeEncoding()) {
+        .full => MeshAddresses {
+            .position_address = gpu_mesh.position_buffer.getAddress(vc),
+            .texcoord_address = gpu_mesh.texcoord_buffer.getAddress(vc),
+            .normal_address = gpu_mesh.normal_buffer.getAddress(vc) ,
+
+            .index_address = gpu_mesh.index_buffer.getAddress(vc),
+
+            .attribute_encoding = .full,
+        },
+        .compact => blk: {
+            const attribute_address = gpu_mesh.attribute_buffer.getAddress(vc);
+            break :blk MeshAddresses {
+                .position_address = gpu_mesh.position_buffer.getAddress(vc),
+                .texcoord_address = if (gpu_mesh.attribute_texcoords) attribute_address + @offsetOf(CompactAttribute, "texcoord") else 0,
+                .normal_address = if (gpu_mesh.attribute_normals) attribute_address + @offsetOf(CompactAttribute, "normal") else 0,
+
+                .index_address = gpu_mesh.index_buffer.getAddress(vc),
+
+                .attribute_encoding = .compact,
+            };
+        },
+    };
+
+    const handle: Handle = if (self.free_handles.items.len != 0) self.free_handles.items[self.free_handles.items.len - 1] else @intCast(self.meshes.len);
+
+    _ = try self.addresses_buffer.ensureTotalCapacity(vc, encoder, handle + 1);
+    self.addresses_buffer.buffer.updateFrom(encoder, handle, &.{ addresses });
+
+    if (handle == self.meshes.len) {
+        try self.meshes.append(allocator, gpu_mesh);
+    } else {
+        self.meshes.set(handle, gpu_mesh);
+        _ = self.free_handles.pop();
+    }
+
+    return handle;
+}
+
+// frees the buffers of a mesh once the encoder is done with them, its handle may be reused by later uploads
+// nothing may refer to this mesh anymore, so instances using it must have been destroyed first
+pub fn destroyMesh(self: *Self, allocator: std.mem.Allocator, encoder: *Encoder, handle: Handle) !void {
+    try self.free_handles.ensureUnusedCapacity(allocator, 1);
+
+    const mesh = self.meshes.get(handle);
+    try encoder.attachResource(mesh.position_buffer);
+    try encoder.attachResource(mesh.texcoord_buffer);
+    try encoder.attachResource(mesh.normal_buffer);
+    try encoder.attachResource(mesh.attribute_buffer);
+    try encoder.attachResource(mesh.index_buffer);
+
+    self.meshes.set(handle, .{
+        .position_buffer = .{},
+        .texcoord_buffer = .{},
+        .normal_buffer = .{},
+
+        .attribute_buffer = .{},
+        .attribute_normals = false,
+        .attribute_texcoords = false,
+
+        .vertex_count = 0,
+
+        .index_buffer = .{},
+        .index_count = 0,
+    });
+
+    self.free_handles.appendAssumeCapacity(handle);
+}
+
+// overwrites the positions of an existing mesh in place, vertex count must stay the same
+// BLASes built from this mesh must be refit before they see the change
+pub fn recordUpdatePositions(self: *Self, encoder: *Encoder, handle: Handle, positions: core.mem.BufferSlice(F32x3)) void {
+    std.debug.assert(positions.len == self.meshes.items(.vertex_count)[handle]);
+
+    const position_buffer = self.meshes.items(.position_buffer)[handle];
+
+    // earlier work may still be reading the old positions
+    encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .ray_tracing_shader_bit_khr = true, .compute_shader_bit = true, .acceleration_structure_build_bit_khr = true },
+            .dst_stage_mask = .{ .copy_bit = true },
+        }),
     });
 
-    return @intCast(self.meshes.len - 1);
+    position_buffer.uploadFrom(encoder, positions);
 }
 
 pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
@@ -138,15 +339,18 @@ pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocat
     const position_buffers = slice.items(.position_buffer);
     const texcoord_buffers = slice.items(.texcoord_buffer);
     const normal_buffers = slice.items(.normal_buffer);
+    const attribute_buffers = slice.items(.attribute_buffer);
     const index_buffers = slice.items(.index_buffer);
 
-    for (position_buffers, texcoord_buffers, normal_buffers, index_buffers) |position_buffer, texcoord_buffer, normal_buffer, index_buffer| {
+    for (position_buffers, texcoord_buffers, normal_buffers, attribute_buffers, index_buffers) |position_buffer, texcoord_buffer, normal_buffer, attribute_buffer, index_buffer| {
         position_buffer.destroy(vc);
         texcoord_buffer.destroy(vc);
         normal_buffer.destroy(vc);
+        attribute_buffer.destroy(vc);
         index_buffer.destroy(vc);
     }
     self.meshes.deinit(allocator);
+    self.free_handles.deinit(allocator);
 
     self.addresses_buffer.destroy(vc);
 }
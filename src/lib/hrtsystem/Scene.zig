@@ -65,18 +65,20 @@ pub fn fromGltfExr(vc: *const VulkanContext, allocator: std.mem.Allocator, encod
 pub fn pushDescriptors(self: *const Self, sensor: u32, background: u32) engine.hrtsystem.pipeline.StandardBindings {
     return engine.hrtsystem.pipeline.StandardBindings {
         .tlas = self.world.accel.tlas_handle,
-        .instances = self.world.accel.instances_device.handle,
-        .world_to_instances = self.world.accel.world_to_instance_device.handle,
-        .meshes = self.world.meshes.addresses_buffer.handle,
-        .geometries = self.world.accel.geometries.handle,
-        .material_values = self.world.materials.materials.handle,
-        .triangle_power_image = .{ .view = self.world.accel.triangle_powers.view },
-        .triangle_meta = self.world.accel.triangle_powers_meta.handle,
-        .geometry_to_triangle_power_offset = self.world.accel.geometry_to_triangle_power_offset.handle,
-        .emissive_triangle_count = self.world.accel.emissive_triangle_count.handle,
+        .instances = self.world.accel.instances_device.buffer.handle,
+        .world_to_instances = self.world.accel.world_to_instance_device.buffer.handle,
+        .meshes = self.world.meshes.addresses_buffer.buffer.handle,
+        .geometries = self.world.accel.geometries.buffer.handle,
+        .material_values = self.world.materials.materials.buffer.handle,
+        .triangle_powers = self.world.accel.triangle_powers.buffer.handle,
+        .geometry_powers = self.world.accel.geometry_powers.handle,
+        .geometry_power_infos = self.world.accel.geometry_power_infos.buffer.handle,
         .background_rgb_image = .{ .view = self.background.data.items[background].rgb_image.view },
         .background_luminance_image = .{ .view = self.background.data.items[background].luminance_image.view },
         .output_image = .{ .view = self.camera.sensors.items[sensor].image.view },
+        .output_moments_image = .{ .view = self.camera.sensors.items[sensor].moments.view },
+        .converged_tiles = self.camera.sensors.items[sensor].converged_tiles.handle,
+        .light_reservoirs = self.camera.sensors.items[sensor].light_reservoirs.handle,
     };
 }
 
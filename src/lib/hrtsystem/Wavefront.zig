@@ -0,0 +1,362 @@
+// path tracer split into stages that each run over a queue of paths,
+// an alternative to the PathTracing megakernel producing the same image
+//
+// each bounce is
+// * extend: trace the queued rays, binning their hits by BSDF type
+// * shade: one dispatch per BSDF type, taking light samples and sampling the next ray
+// * shadow: trace the light samples
+//
+// every stage is launched indirectly, but an empty bounce still costs its barriers and launches,
+// so bounces are recorded in chunks and the host stops once no paths are left after one
+//
+// the path count of a chunk is kept until the chunk after next overwrites it, so the host
+// can record and submit the next chunk before it waits on the count of the one before
+
+const std = @import("std");
+const vk = @import("vulkan");
+
+const engine = @import("../engine.zig");
+const core = engine.core;
+const VulkanContext = core.VulkanContext;
+const Encoder = core.Encoder;
+const Sensor = core.Sensor;
+
+const hrtsystem = engine.hrtsystem;
+const pipeline = hrtsystem.pipeline;
+const Camera = hrtsystem.Camera;
+const MaterialManager = hrtsystem.MaterialManager;
+
+const vector = engine.vector;
+const F32x2 = vector.Vec2(f32);
+const F32x3 = vector.Vec3(f32);
+
+const Self = @This();
+
+pub const SpecConstants = pipeline.PathTracing.SpecConstants;
+
+const bsdf_type_count = @typeInfo(MaterialManager.BSDF).@"enum".fields.len;
+
+// bounces recorded between checks of how many paths are left
+//
+// most paths are gone after a few bounces due to russian roulette,
+// so this trades a submit per chunk against recording bounces for nobody
+pub const bounces_per_chunk = 8;
+
+// must be kept in sync with PathState in wavefront/shared.hlsl
+const PathState = extern struct {
+    ray_origin: F32x3,
+    ray_direction: F32x3,
+    ray_pdf: f32,
+    throughput: [4]f32,
+    radiance: [4]f32,
+    wavelength: [4]f32,
+    wavelength_pdf: [4]f32,
+    bounce_count: u32,
+    hero_only: u32,
+    rng_state: [4]u32,
+};
+
+// must be kept in sync with Hit in wavefront/shared.hlsl
+const Hit = extern struct {
+    instance_index: u32,
+    geometry_index: u32,
+    primitive_index: u32,
+    barycentrics: F32x2,
+};
+
+// must be kept in sync with ShadowRay in shading.hlsl
+const ShadowRay = extern struct {
+    origin: F32x3,
+    connection: F32x3,
+    contribution: [4]f32,
+};
+
+// must be kept in sync with Counters in wavefront/shared.hlsl
+const Counters = extern struct {
+    const ShadeQueue = extern struct {
+        dispatch: vk.DispatchIndirectCommand = .{ .x = 0, .y = 1, .z = 1 },
+        length: u32 = 0,
+    };
+
+    const empty_queue = vk.TraceRaysIndirectCommandKHR { .width = 0, .height = 1, .depth = 1 };
+
+    ray_queues: [2]vk.TraceRaysIndirectCommandKHR = .{ empty_queue } ** 2,
+    shadow_queue: vk.TraceRaysIndirectCommandKHR = empty_queue,
+    shade_queues: [bsdf_type_count]ShadeQueue = .{ ShadeQueue {} } ** bsdf_type_count,
+};
+
+generate: pipeline.WavefrontGenerate,
+extend: pipeline.WavefrontExtend,
+shade: pipeline.WavefrontShade,
+shadow: pipeline.WavefrontShadow,
+accumulate: pipeline.WavefrontAccumulate,
+
+constants: SpecConstants,
+
+// sized for `path_capacity` paths, grown as needed
+// contents do not survive a sample so they are simply recreated
+paths: core.mem.DeviceBuffer(PathState, .{ .storage_buffer_bit = true }) = .{},
+hits: core.mem.DeviceBuffer(Hit, .{ .storage_buffer_bit = true }) = .{},
+ray_queues: core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true }) = .{},
+shade_queues: core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true }) = .{},
+shadow_rays: core.mem.DeviceBuffer(ShadowRay, .{ .storage_buffer_bit = true }) = .{},
+shadow_queue: core.mem.DeviceBuffer(u32, .{ .storage_buffer_bit = true }) = .{},
+path_capacity: u32 = 0,
+
+counters: core.mem.DeviceBuffer(Counters, .{ .storage_buffer_bit = true, .indirect_buffer_bit = true, .shader_device_address_bit = true, .transfer_src_bit = true, .transfer_dst_bit = true }),
+live_paths: core.mem.DownloadBuffer(u32), // length of the ray queue after each of the two most recent chunks
+
+pub fn create(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, additional_descriptor_layouts: [2]vk.DescriptorSetLayout, constants: SpecConstants, background_sampler: vk.Sampler) !Self {
+    var generate = try pipeline.WavefrontGenerate.create(vc, allocator, constants, .{ background_sampler }, additional_descriptor_layouts);
+    errdefer generate.destroy(vc);
+
+    var extend = try pipeline.WavefrontExtend.create(vc, allocator, encoder, additional_descriptor_layouts, constants, .{ background_sampler });
+    errdefer extend.destroy(vc);
+
+    var shade = try pipeline.WavefrontShade.create(vc, allocator, constants, .{ background_sampler }, additional_descriptor_layouts);
+    errdefer shade.destroy(vc);
+
+    var shadow = try pipeline.WavefrontShadow.create(vc, allocator, encoder, additional_descriptor_layouts, constants, .{ background_sampler });
+    errdefer shadow.destroy(vc);
+
+    var accumulate = try pipeline.WavefrontAccumulate.create(vc, allocator, constants, .{ background_sampler }, additional_descriptor_layouts);
+    errdefer accumulate.destroy(vc);
+
+    const counters = try core.mem.DeviceBuffer(Counters, .{ .storage_buffer_bit = true, .indirect_buffer_bit = true, .shader_device_address_bit = true, .transfer_src_bit = true, .transfer_dst_bit = true }).create(vc, 1, "wavefront counters");
+    errdefer counters.destroy(vc);
+
+    const live_paths = try core.mem.DownloadBuffer(u32).create(vc, 2, "wavefront live paths");
+    errdefer live_paths.destroy(vc);
+
+    return Self {
+        .generate = generate,
+        .extend = extend,
+        .shade = shade,
+        .shadow = shadow,
+        .accumulate = accumulate,
+
+        .constants = constants,
+
+        .counters = counters,
+        .live_paths = live_paths,
+    };
+}
+
+pub fn destroy(self: *Self, vc: *const VulkanContext) void {
+    self.generate.destroy(vc);
+    self.extend.destroy(vc);
+    self.shade.destroy(vc);
+    self.shadow.destroy(vc);
+    self.accumulate.destroy(vc);
+
+    self.destroyPathBuffers(vc);
+    self.counters.destroy(vc);
+    self.live_paths.destroy(vc);
+}
+
+fn destroyPathBuffers(self: *Self, vc: *const VulkanContext) void {
+    self.paths.destroy(vc);
+    self.hits.destroy(vc);
+    self.ray_queues.destroy(vc);
+    self.shade_queues.destroy(vc);
+    self.shadow_rays.destroy(vc);
+    self.shadow_queue.destroy(vc);
+}
+
+fn ensurePathCapacity(self: *Self, vc: *const VulkanContext, encoder: *Encoder, count: u32) !void {
+    if (count <= self.path_capacity) return;
+
+    const shadow_rays_per_path = self.constants.env_samples_per_bounce + self.constants.mesh_samples_per_bounce;
+
+    const paths = try @TypeOf(self.paths).create(vc, count, "wavefront paths");
+    errdefer paths.destroy(vc);
+    const hits = try @TypeOf(self.hits).create(vc, count, "wavefront hits");
+    errdefer hits.destroy(vc);
+    const ray_queues = try @TypeOf(self.ray_queues).create(vc, count * 2, "wavefront ray queues");
+    errdefer ray_queues.destroy(vc);
+    const shade_queues = try @TypeOf(self.shade_queues).create(vc, count * bsdf_type_count, "wavefront shade queues");
+    errdefer shade_queues.destroy(vc);
+    const shadow_rays = try @TypeOf(self.shadow_rays).create(vc, @max(count * shadow_rays_per_path, 1), "wavefront shadow rays");
+    errdefer shadow_rays.destroy(vc);
+    const shadow_queue = try @TypeOf(self.shadow_queue).create(vc, count, "wavefront shadow queue");
+    errdefer shadow_queue.destroy(vc);
+
+    // earlier samples may still be using the old ones
+    try encoder.attachResource(self.paths);
+    try encoder.attachResource(self.hits);
+    try encoder.attachResource(self.ray_queues);
+    try encoder.attachResource(self.shade_queues);
+    try encoder.attachResource(self.shadow_rays);
+    try encoder.attachResource(self.shadow_queue);
+
+    self.paths = paths;
+    self.hits = hits;
+    self.ray_queues = ray_queues;
+    self.shade_queues = shade_queues;
+    self.shadow_rays = shadow_rays;
+    self.shadow_queue = shadow_queue;
+    self.path_capacity = count;
+}
+
+// makes everything written by the previous stage visible to the next one, including indirect arguments and copies
+fn recordStageBarrier(command_buffer: VulkanContext.CommandBuffer) void {
+    command_buffer.pipelineBarrier2(&vk.DependencyInfo {
+        .memory_barrier_count = 1,
+        .p_memory_barriers = @ptrCast(&vk.MemoryBarrier2 {
+            .src_stage_mask = .{ .compute_shader_bit = true, .ray_tracing_shader_bit_khr = true, .all_transfer_bit = true },
+            .src_access_mask = .{ .shader_storage_write_bit = true, .transfer_write_bit = true },
+            .dst_stage_mask = .{ .draw_indirect_bit = true, .compute_shader_bit = true, .ray_tracing_shader_bit_khr = true, .all_transfer_bit = true },
+            .dst_access_mask = .{ .indirect_command_read_bit = true, .shader_storage_read_bit = true, .shader_storage_write_bit = true, .transfer_read_bit = true, .transfer_write_bit = true },
+        }),
+    });
+}
+
+fn recordResetCounters(self: *const Self, command_buffer: VulkanContext.CommandBuffer, comptime field: []const u8) void {
+    const counters = Counters {};
+    const value = &@field(counters, field);
+    command_buffer.updateBuffer(self.counters.handle, @offsetOf(Counters, field), @sizeOf(@TypeOf(value.*)), value);
+}
+
+fn recordResetRayQueue(self: *const Self, command_buffer: VulkanContext.CommandBuffer, queue: u32) void {
+    command_buffer.updateBuffer(self.counters.handle, @offsetOf(Counters, "ray_queues") + queue * @sizeOf(vk.TraceRaysIndirectCommandKHR), @sizeOf(vk.TraceRaysIndirectCommandKHR), &Counters.empty_queue);
+}
+
+fn wavefrontBindings(self: *const Self, standard_bindings: pipeline.StandardBindings) pipeline.WavefrontBindings {
+    var bindings: pipeline.WavefrontBindings = undefined;
+    inline for (@typeInfo(pipeline.StandardBindings).@"struct".fields) |field| {
+        @field(bindings, field.name) = @field(standard_bindings, field.name);
+    }
+    bindings.paths = self.paths.handle;
+    bindings.hits = self.hits.handle;
+    bindings.ray_queues = self.ray_queues.handle;
+    bindings.shade_queues = self.shade_queues.handle;
+    bindings.shadow_rays = self.shadow_rays.handle;
+    bindings.shadow_queue = self.shadow_queue.handle;
+    bindings.counters = self.counters.handle;
+    return bindings;
+}
+
+// every bounce a path could possibly make
+// the trailing one only collects emission and misses, like the megakernel
+pub fn bounceCount(self: *const Self) u32 {
+    return self.constants.max_bounces + 2;
+}
+
+// a sample of every unconverged pixel of the first `extent` of `sensor`, which captures `region` of the image,
+// is recorded as recordBeginSample, then recordBounces until it returns null, then recordEndSample
+//
+// recordBounces may be followed by a submit, after which livePathCount tells whether
+// the bounces after that chunk have anything to do; if not, recordEndSample may come right after
+// the chunks recorded since, as those extend nothing
+//
+// `standard_bindings` must be those of `sensor`, already prepared for capture
+// from both compute and ray tracing shaders, and be the same for every part of a sample
+
+// starts a path for every pixel
+pub fn recordBeginSample(self: *Self, vc: *const VulkanContext, encoder: *Encoder, standard_bindings: pipeline.StandardBindings, sets: [2]vk.DescriptorSet, lens: Camera.Lens, sensor: *const Sensor, region: pipeline.Region, extent: vk.Extent2D) !void {
+    // paths are indexed by their pixel in the sensor
+    try self.ensurePathCapacity(vc, encoder, sensor.extent.width * sensor.extent.height);
+
+    const bindings = self.wavefrontBindings(standard_bindings);
+    const command_buffer = encoder.buffer;
+
+    command_buffer.updateBuffer(self.counters.handle, 0, @sizeOf(Counters), &Counters {});
+    recordStageBarrier(command_buffer);
+
+    self.generate.recordBindPipeline(command_buffer);
+    self.generate.recordBindAdditionalDescriptorSets(command_buffer, sets);
+    self.generate.recordPushDescriptors(command_buffer, bindings);
+    self.generate.recordPushConstants(command_buffer, .{ .lens = lens, .sample_count = sensor.sample_count, .region = region });
+    self.generate.recordDispatch(command_buffer, .{
+        .width = std.math.divCeil(u32, extent.width, 8) catch unreachable,
+        .height = std.math.divCeil(u32, extent.height, 8) catch unreachable,
+        .depth = 1,
+    });
+    recordStageBarrier(command_buffer);
+}
+
+// records up to `bounces_per_chunk` bounces starting at `first_bounce`, followed by a copy of how many paths are left
+// returns the bounce the next chunk starts at, or null if this was the last one
+pub fn recordBounces(self: *const Self, vc: *const VulkanContext, encoder: *Encoder, standard_bindings: pipeline.StandardBindings, sets: [2]vk.DescriptorSet, first_bounce: u32) ?u32 {
+    const bindings = self.wavefrontBindings(standard_bindings);
+    const counters_address = self.counters.getAddress(vc);
+    const command_buffer = encoder.buffer;
+
+    const end_bounce = @min(first_bounce + bounces_per_chunk, self.bounceCount());
+    for (first_bounce..end_bounce) |bounce| {
+        const ray_queue: u32 = @intCast(bounce % 2);
+        const next_ray_queue = 1 - ray_queue;
+
+        // extend
+        self.recordResetCounters(command_buffer, "shade_queues");
+        recordStageBarrier(command_buffer);
+
+        self.extend.recordBindPipeline(command_buffer);
+        self.extend.recordBindAdditionalDescriptorSets(command_buffer, sets);
+        self.extend.recordPushDescriptors(command_buffer, bindings);
+        self.extend.recordPushConstants(command_buffer, .{ .ray_queue = ray_queue });
+        self.extend.recordTraceRaysIndirect(command_buffer, counters_address + @offsetOf(Counters, "ray_queues") + ray_queue * @sizeOf(vk.TraceRaysIndirectCommandKHR));
+        recordStageBarrier(command_buffer);
+
+        // shade
+        self.recordResetRayQueue(command_buffer, next_ray_queue);
+        self.recordResetCounters(command_buffer, "shadow_queue");
+        recordStageBarrier(command_buffer);
+
+        self.shade.recordBindPipeline(command_buffer);
+        self.shade.recordBindAdditionalDescriptorSets(command_buffer, sets);
+        self.shade.recordPushDescriptors(command_buffer, bindings);
+        for (0..bsdf_type_count) |bsdf_type| {
+            self.shade.recordPushConstants(command_buffer, .{ .bsdf_type = @intCast(bsdf_type), .next_ray_queue = next_ray_queue });
+            self.shade.recordDispatchIndirect(command_buffer, self.counters.handle, @offsetOf(Counters, "shade_queues") + bsdf_type * @sizeOf(Counters.ShadeQueue));
+        }
+        recordStageBarrier(command_buffer);
+
+        // shadow
+        self.shadow.recordBindPipeline(command_buffer);
+        self.shadow.recordBindAdditionalDescriptorSets(command_buffer, sets);
+        self.shadow.recordPushDescriptors(command_buffer, bindings);
+        self.shadow.recordPushConstants(command_buffer, .{ .ray_queue = ray_queue });
+        self.shadow.recordTraceRaysIndirect(command_buffer, counters_address + @offsetOf(Counters, "shadow_queue"));
+        recordStageBarrier(command_buffer);
+    }
+
+    if (end_bounce == self.bounceCount()) return null;
+
+    // the queue the next chunk traces, already made visible to copies by the last barrier
+    encoder.copyBuffer(self.counters.handle, self.live_paths.handle, &.{
+        vk.BufferCopy {
+            .src_offset = @offsetOf(Counters, "ray_queues") + (end_bounce % 2) * @sizeOf(vk.TraceRaysIndirectCommandKHR) + @offsetOf(vk.TraceRaysIndirectCommandKHR, "width"),
+            .dst_offset = livePathSlot(end_bounce) * @sizeOf(u32),
+            .size = @sizeOf(u32),
+        },
+    });
+    return end_bounce;
+}
+
+// chunks start at multiples of bounces_per_chunk, so consecutive ones alternate slots
+fn livePathSlot(bounce: u32) u32 {
+    return (bounce / bounces_per_chunk) % 2;
+}
+
+// how many paths the chunk starting at `bounce`, as returned by recordBounces, would extend
+// only meaningful once the device is done with the chunk before it, and until the chunk after it is done
+pub fn livePathCount(self: *const Self, bounce: u32) u32 {
+    return self.live_paths.slice[livePathSlot(bounce)];
+}
+
+// writes out what every path gathered
+pub fn recordEndSample(self: *const Self, encoder: *Encoder, standard_bindings: pipeline.StandardBindings, sets: [2]vk.DescriptorSet, sensor: *const Sensor, extent: vk.Extent2D) void {
+    const bindings = self.wavefrontBindings(standard_bindings);
+    const command_buffer = encoder.buffer;
+
+    self.accumulate.recordBindPipeline(command_buffer);
+    self.accumulate.recordBindAdditionalDescriptorSets(command_buffer, sets);
+    self.accumulate.recordPushDescriptors(command_buffer, bindings);
+    self.accumulate.recordPushConstants(command_buffer, .{ .sample_count = sensor.sample_count });
+    self.accumulate.recordDispatch(command_buffer, .{
+        .width = std.math.divCeil(u32, extent.width, 8) catch unreachable,
+        .height = std.math.divCeil(u32, extent.height, 8) catch unreachable,
+        .depth = 1,
+    });
+}
@@ -46,65 +46,205 @@ constant_specta: ConstantSpectra,
 
 const Self = @This();
 
-fn loadImage(allocator: std.mem.Allocator, image: Gltf.Image, gltf_directory: ?[]const u8) !std.meta.Tuple(&.{[]const U8x3, u32, u32}) {
-    const buffer, const free = if (image.data) |data| .{data, false} else if (image.uri) |uri| blk: {
-        const filepath = if (gltf_directory) |dir| try std.fs.path.join(allocator, &.{ dir, uri }) else uri;
-        defer if (gltf_directory != null) allocator.free(filepath);
-        const buffer = try std.fs.cwd().readFileAlloc(allocator, filepath, std.math.maxInt(usize));
-        break :blk .{buffer, true};
-    } else return error.EmptyImage;
-    defer if (free) allocator.free(buffer);
-
-    const img, const width, const height = try engine.fileformats.wuffs.load(allocator, buffer);
-    const img_u8x3 = @as([*]const U8x3, @ptrCast(img.ptr))[0..img.len / 3];
-    return .{ img_u8x3, width, height };
-}
+// every texture that may be made from a glTF image, each a different conversion of its rgb channels
+const ImageTexture = enum {
+    normal,
+    emissive,
+    color,
+    metalness,
+    roughness,
+
+    fn Texel(comptime self: ImageTexture) type {
+        return switch (self) {
+            .normal, .emissive, .color => U8x4,
+            .metalness, .roughness => u8,
+        };
+    }
 
-// TODO: consider just uploading all textures upfront rather than as part of this function
-fn gltfMaterialToMaterial(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, gltf: Gltf, gltf_directory: ?[]const u8, gltf_material: Gltf.Material, textures: *TextureManager) !Material {
-    // stuff that is in every material
-    var material = blk: {
-        var material: Material = undefined;
-        material.normal = if (gltf_material.normal_texture) |texture| normal: {
-            const image = gltf.data.images.items[gltf.data.textures.items[texture.index].source.?];
+    fn srgb(comptime self: ImageTexture) bool {
+        return switch (self) {
+            .emissive, .color => true,
+            .normal, .metalness, .roughness => false,
+        };
+    }
+
+    fn convert(comptime self: ImageTexture, src: U8x3) Texel(self) {
+        return switch (self) {
+            .normal => U8x4.new(src.x, src.y, src.z, std.math.maxInt(u8)),
+            .emissive, .color => U8x4.new(src.x, src.y, src.z, 0),
+            // only need g (roughness) and b (metalness) channels
+            // theoretically gltf spec claims these values should already be linear
+            .metalness => src.z,
+            .roughness => src.y,
+        };
+    }
+};
+
+// all textures made from glTF images, each uploaded once no matter how many materials use it
+//
+// images are decoded on a thread pool straight into staging memory,
+// while the main thread records the upload of each as soon as it is ready
+const GltfImages = struct {
+    const Image = struct {
+        textures: std.EnumSet(ImageTexture) = .{},
+        file: []const u8 = &.{},
+        owns_file: bool = false,
+        extent: vk.Extent2D = .{ .width = 0, .height = 0 },
+        staging: std.EnumArray(ImageTexture, []u8) = std.EnumArray(ImageTexture, []u8).initFill(&.{}),
+        decoded: std.Thread.ResetEvent = .{},
+        err: ?anyerror = null,
+
+        fn read(self: *Image, allocator: std.mem.Allocator, image: Gltf.Image, gltf_directory: ?[]const u8) void {
+            self.readFallible(allocator, image, gltf_directory) catch |err| {
+                self.err = err;
+            };
+        }
+
+        fn readFallible(self: *Image, allocator: std.mem.Allocator, image: Gltf.Image, gltf_directory: ?[]const u8) !void {
+            if (image.data) |data| {
+                self.file = data;
+            } else if (image.uri) |uri| {
+                const filepath = if (gltf_directory) |dir| try std.fs.path.join(allocator, &.{ dir, uri }) else uri;
+                defer if (gltf_directory != null) allocator.free(filepath);
+                self.file = try std.fs.cwd().readFileAlloc(allocator, filepath, std.math.maxInt(usize));
+                self.owns_file = true;
+            } else return error.EmptyImage;
+
+            const width, const height = try engine.fileformats.wuffs.loadDimensions(allocator, self.file);
+            self.extent = vk.Extent2D { .width = width, .height = height };
+        }
+
+        fn decode(self: *Image, allocator: std.mem.Allocator) void {
+            defer self.decoded.set();
+            if (self.err != null) return;
+            self.decodeFallible(allocator) catch |err| {
+                self.err = err;
+            };
+        }
 
-            const img, const width, const height = try loadImage(allocator, image, gltf_directory);
+        fn decodeFallible(self: *Image, allocator: std.mem.Allocator) !void {
+            const img, const width, const height = try engine.fileformats.wuffs.load(allocator, self.file);
             defer allocator.free(img);
+            if (width != self.extent.width or height != self.extent.height) return error.InconsistentImageDimensions;
 
-            const rgba = try encoder.uploadAllocator().alloc(U8x4, img.len);
-            for (rgba, img) |*dst, src| {
-                dst.* = U8x4.new(src.x, src.y, src.z, std.math.maxInt(u8));
+            const rgb = @as([*]const U8x3, @ptrCast(img.ptr))[0..img.len / 3];
+            inline for (comptime std.enums.values(ImageTexture)) |texture| {
+                if (self.textures.contains(texture)) {
+                    for (std.mem.bytesAsSlice(texture.Texel(), self.staging.get(texture)), rgb) |*dst, src| {
+                        dst.* = texture.convert(src);
+                    }
+                }
             }
-            const debug_name = try std.fmt.allocPrintZ(allocator, "{s} normal", .{ gltf_material.name });
-            defer allocator.free(debug_name);
-            break :normal try textures.upload(vc, U8x4, allocator, encoder, encoder.upload_allocator.getBufferSlice(rgba), vk.Extent2D { .width = width, .height = height }, debug_name, false);
-        } else normal: {
-            const rg: *F32x3 = @ptrCast(try encoder.uploadAllocator().alignedAlloc(u8, vk_helpers.texelBlockSize(vk_helpers.typeToFormat(F32x3, false)), @sizeOf(F32x3)));
-            rg.* = Material.default_normal;
-            break :normal try textures.upload(vc, F32x3, allocator, encoder, encoder.upload_allocator.getBufferSlice(rg), vk.Extent2D { .width = 1, .height = 1 }, "default normal", false);
+        }
+    };
+
+    handles: []std.EnumArray(ImageTexture, TextureManager.Handle), // indexed by glTF image
+
+    fn upload(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, gltf: Gltf, gltf_directory: ?[]const u8, textures: *TextureManager) !GltfImages {
+        var thread_safe_allocator = std.heap.ThreadSafeAllocator {
+            .child_allocator = allocator,
         };
+        const worker_allocator = thread_safe_allocator.allocator();
 
-        material.emissive = if (gltf_material.emissive_texture) |texture| emissive: {
-            const image = gltf.data.images.items[gltf.data.textures.items[texture.index].source.?];
+        const images = try allocator.alloc(Image, gltf.data.images.items.len);
+        defer allocator.free(images);
+        @memset(images, .{});
+        defer for (images) |image| {
+            if (image.owns_file) worker_allocator.free(image.file);
+        };
 
-            const img, const width, const height = try loadImage(allocator, image, gltf_directory);
-            defer allocator.free(img);
+        // must mirror which textures gltfMaterialToMaterial asks for
+        for (gltf.data.materials.items) |material| {
+            if (material.normal_texture) |texture| images[gltf.data.textures.items[texture.index].source.?].textures.insert(.normal);
+            if (material.emissive_texture) |texture| images[gltf.data.textures.items[texture.index].source.?].textures.insert(.emissive);
+            if (material.transmission_factor > 0.999) continue;
+            if (material.metallic_roughness.base_color_texture) |texture| images[gltf.data.textures.items[texture.index].source.?].textures.insert(.color);
+            if (material.metallic_roughness.metallic_roughness_texture) |texture| {
+                images[gltf.data.textures.items[texture.index].source.?].textures.insert(.metalness);
+                images[gltf.data.textures.items[texture.index].source.?].textures.insert(.roughness);
+            }
+        }
 
-            const rgba = try encoder.uploadAllocator().alloc(U8x4, img.len);
-            for (rgba, img) |*dst, src| {
-                dst.* = U8x4.new(src.x, src.y, src.z, 0);
+        var pool: std.Thread.Pool = undefined;
+        try pool.init(.{ .allocator = worker_allocator });
+        defer pool.deinit();
+
+        // first just read files and headers so staging memory can be allocated upfront
+        {
+            var wait_group = std.Thread.WaitGroup {};
+            for (images, gltf.data.images.items) |*image, gltf_image| {
+                if (image.textures.count() != 0) pool.spawnWg(&wait_group, Image.read, .{ image, worker_allocator, gltf_image, gltf_directory });
             }
+            pool.waitAndWork(&wait_group);
+        }
 
-            const debug_name = try std.fmt.allocPrintZ(allocator, "{s} emissive", .{ gltf_material.name });
-            defer allocator.free(debug_name);
-            break :emissive try textures.upload(vc, U8x4, allocator, encoder, encoder.upload_allocator.getBufferSlice(rgba), vk.Extent2D { .width = width, .height = height }, debug_name, true);
-        } else emissive: {
+        for (images) |*image| {
+            if (image.err) |err| return err;
+            inline for (comptime std.enums.values(ImageTexture)) |texture| {
+                if (image.textures.contains(texture)) {
+                    const alignment = comptime vk_helpers.texelBlockSize(vk_helpers.typeToFormat(texture.Texel(), texture.srgb()));
+                    image.staging.set(texture, try encoder.uploadAllocator().alignedAlloc(u8, alignment, image.extent.width * image.extent.height * @sizeOf(texture.Texel())));
+                }
+            }
+        }
+
+        for (images) |*image| {
+            if (image.textures.count() != 0) try pool.spawn(Image.decode, .{ image, worker_allocator }) else image.decoded.set();
+        }
+        // workers write into images and staging memory, so must not return before they are done
+        defer for (images) |*image| image.decoded.wait();
+
+        const handles = try allocator.alloc(std.EnumArray(ImageTexture, TextureManager.Handle), images.len);
+        errdefer allocator.free(handles);
+
+        for (images, handles, 0..) |*image, *image_handles, image_index| {
+            if (image.textures.count() == 0) continue;
+
+            image.decoded.wait();
+            if (image.err) |err| return err;
+
+            inline for (comptime std.enums.values(ImageTexture)) |texture| {
+                if (image.textures.contains(texture)) {
+                    const debug_name = try std.fmt.allocPrintZ(allocator, "image {} {s}", .{ image_index, @tagName(texture) });
+                    defer allocator.free(debug_name);
+                    const staging = std.mem.bytesAsSlice(texture.Texel(), image.staging.get(texture));
+                    image_handles.set(texture, try textures.upload(vc, texture.Texel(), allocator, encoder, encoder.upload_allocator.getBufferSlice(staging), image.extent, debug_name, texture.srgb()));
+                }
+            }
+        }
+
+        return GltfImages {
+            .handles = handles,
+        };
+    }
+
+    fn get(self: GltfImages, gltf: Gltf, texture_index: usize, texture: ImageTexture) TextureManager.Handle {
+        return self.handles[gltf.data.textures.items[texture_index].source.?].get(texture);
+    }
+
+    fn destroy(self: GltfImages, allocator: std.mem.Allocator) void {
+        allocator.free(self.handles);
+    }
+};
+
+fn gltfMaterialToMaterial(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, gltf: Gltf, images: GltfImages, gltf_material: Gltf.Material, textures: *TextureManager) !Material {
+    // stuff that is in every material
+    var material = blk: {
+        var material: Material = undefined;
+        material.normal = if (gltf_material.normal_texture) |texture| images.get(gltf, texture.index, .normal) else normal: {
+            const rg: *F32x3 = @ptrCast(try encoder.uploadAllocator().alignedAlloc(u8, vk_helpers.texelBlockSize(vk_helpers.typeToFormat(F32x3, false)), @sizeOf(F32x3)));
+            rg.* = Material.default_normal;
+            break :normal try textures.upload(vc, F32x3, allocator, encoder, encoder.upload_allocator.getBufferSlice(rg), vk.Extent2D { .width = 1, .height = 1 }, "default normal", false);
+        };
+
+        material.emissive = if (gltf_material.emissive_texture) |texture| images.get(gltf, texture.index, .emissive) else emissive: {
             const constant: *F32x4 = @ptrCast(try encoder.uploadAllocator().alignedAlloc(u8, vk_helpers.texelBlockSize(vk_helpers.typeToFormat(F32x4, true)), @sizeOf(F32x4)));
             constant.* = F32x4.new(gltf_material.emissive_factor[0], gltf_material.emissive_factor[1], gltf_material.emissive_factor[2], std.math.nan(f32)).mul_scalar(gltf_material.emissive_strength);
             const debug_name = try std.fmt.allocPrintZ(allocator, "{s} constant emissive {}", .{ gltf_material.name, constant });
             defer allocator.free(debug_name);
             break :emissive try textures.upload(vc, F32x4, allocator, encoder, encoder.upload_allocator.getBufferSlice(constant), vk.Extent2D { .width = 1, .height = 1 }, debug_name, true);
         };
+        material.may_emit = gltf_material.emissive_texture != null or (gltf_material.emissive_strength != 0 and !std.mem.allEqual(f32, &gltf_material.emissive_factor, 0));
 
         break :blk material;
     };
@@ -130,20 +270,7 @@ fn gltfMaterialToMaterial(vc: *const VulkanContext, allocator: std.mem.Allocator
         return material;
     }
 
-    standard_pbr.color = if (gltf_material.metallic_roughness.base_color_texture) |texture| blk: {
-        const image = gltf.data.images.items[gltf.data.textures.items[texture.index].source.?];
-
-        const img, const width, const height = try loadImage(allocator, image, gltf_directory);
-        defer allocator.free(img);
-        const rgba = try encoder.uploadAllocator().alloc(U8x4, img.len);
-        for (rgba, img) |*dst, src| {
-            dst.* = U8x4.new(src.x, src.y, src.z, 0);
-        }
-
-        const debug_name = try std.fmt.allocPrintZ(allocator, "{s} color", .{ gltf_material.name });
-        defer allocator.free(debug_name);
-        break :blk try textures.upload(vc, U8x4, allocator, encoder, encoder.upload_allocator.getBufferSlice(rgba), vk.Extent2D { .width = width, .height = height }, debug_name, true);
-    } else blk: {
+    standard_pbr.color = if (gltf_material.metallic_roughness.base_color_texture) |texture| images.get(gltf, texture.index, .color) else blk: {
         const constant: *F32x4 = @ptrCast(try encoder.uploadAllocator().alignedAlloc(u8, vk_helpers.texelBlockSize(vk_helpers.typeToFormat(F32x4, true)), @sizeOf(F32x4)));
         constant.* = F32x4.new(gltf_material.metallic_roughness.base_color_factor[0], gltf_material.metallic_roughness.base_color_factor[1], gltf_material.metallic_roughness.base_color_factor[2], std.math.nan(f32));
         const debug_name = try std.fmt.allocPrintZ(allocator, "{s} constant color {}", .{ gltf_material.name, constant });
@@ -152,25 +279,8 @@ fn gltfMaterialToMaterial(vc: *const VulkanContext, allocator: std.mem.Allocator
     };
 
     if (gltf_material.metallic_roughness.metallic_roughness_texture) |texture| {
-        const image = gltf.data.images.items[gltf.data.textures.items[texture.index].source.?];
-
-        // this gives us rgb --> only need g (roughness) and b (metalness) channels
-        // theoretically gltf spec claims these values should already be linear
-        const img, const width, const height = try loadImage(allocator, image, gltf_directory);
-        defer allocator.free(img);
-
-        const metalness = try encoder.uploadAllocator().alloc(u8, img.len);
-        const roughness = try encoder.uploadAllocator().alloc(u8, img.len);
-        for (metalness, roughness, img) |*dst1, *dst2, src| {
-            dst1.* = src.z;
-            dst2.* = src.y;
-        }
-        const debug_name_metalness = try std.fmt.allocPrintZ(allocator, "{s} metalness", .{ gltf_material.name });
-        defer allocator.free(debug_name_metalness);
-        standard_pbr.metalness = try textures.upload(vc, u8, allocator, encoder, encoder.upload_allocator.getBufferSlice(metalness), vk.Extent2D { .width = width, .height = height }, debug_name_metalness, false);
-        const debug_name_roughness = try std.fmt.allocPrintZ(allocator, "{s} roughness", .{ gltf_material.name });
-        defer allocator.free(debug_name_roughness);
-        standard_pbr.roughness = try textures.upload(vc, u8, allocator, encoder, encoder.upload_allocator.getBufferSlice(roughness), vk.Extent2D { .width = width, .height = height }, debug_name_roughness, false);
+        standard_pbr.metalness = images.get(gltf, texture.index, .metalness);
+        standard_pbr.roughness = images.get(gltf, texture.index, .roughness);
         material.bsdf = .{ .standard_pbr = standard_pbr };
         return material;
     } else {
@@ -211,14 +321,17 @@ pub fn fromGltf(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder:
         var materials = try MaterialManager.createEmpty(vc);
         errdefer materials.destroy(vc, allocator);
 
+        const images = try GltfImages.upload(vc, allocator, encoder, gltf, gltf_directory, &materials.textures);
+        defer images.destroy(allocator);
+
         for (gltf.data.materials.items) |material| {
-            const mat = try gltfMaterialToMaterial(vc, allocator, encoder, gltf, gltf_directory, material, &materials.textures);
+            const mat = try gltfMaterialToMaterial(vc, allocator, encoder, gltf, images, material, &materials.textures);
             const namez = try allocator.dupeZ(u8, material.name);
             defer allocator.free(namez);
             _ = try materials.upload(vc, allocator, encoder, mat, namez);
         }
 
-        const default_material = try gltfMaterialToMaterial(vc, allocator, encoder, gltf, gltf_directory, Gltf.Material {
+        const default_material = try gltfMaterialToMaterial(vc, allocator, encoder, gltf, images, Gltf.Material {
             .name = "default",
         }, &materials.textures);
         _ = try materials.upload(vc, allocator, encoder, default_material, "default");
@@ -391,8 +504,10 @@ pub fn fromGltf(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder:
     var accel = try Accel.createEmpty(vc, allocator, materials.textures.descriptor_layout, encoder);
     errdefer accel.destroy(vc, allocator);
     for (instances.items) |instance| {
-        _ = try accel.uploadInstance(vc, allocator, encoder, meshes, materials, instance);
+        var handle: Accel.Handle = undefined; // a fresh accel hands these out in order
+        try accel.queueInstances(allocator, instance.geometries, &.{ instance.transform }, instance.visible, instance.build, (&handle)[0..1]);
     }
+    try accel.recordCommit(vc, allocator, encoder, meshes, materials);
 
     return Self {
         .materials = materials,
@@ -415,11 +530,11 @@ pub fn createEmpty(vc: *const VulkanContext, allocator: std.mem.Allocator, encod
 }
 
 pub fn updateTransform(self: *Self, index: u32, new_transform: Mat3x4) void {
-    self.accel.updateTransform(index, new_transform);
+    self.accel.setTransform(index, new_transform);
 }
 
 pub fn updateVisibility(self: *Self, index: u32, visible: bool) void {
-    self.accel.updateVisibility(index, visible);
+    self.accel.setVisibility(index, visible);
 }
 
 pub fn destroy(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator) void {
@@ -7,9 +7,12 @@ pub const ObjectPicker = @import("ObjectPicker.zig");
 pub const pipeline = @import("pipeline.zig");
 pub const World = @import("World.zig");
 pub const Scene = @import("Scene.zig");
+pub const Wavefront = @import("Wavefront.zig");
+pub const Convergence = @import("Convergence.zig");
 pub const ConstantSpectra = @import("ConstantSpectra.zig");
 
 const vk = @import("vulkan");
+const core = @import("../engine.zig").core;
 
 pub const required_device_extensions = [_][*:0]const u8{
     vk.extensions.khr_deferred_host_operations.name,
@@ -17,6 +20,16 @@ pub const required_device_extensions = [_][*:0]const u8{
     vk.extensions.khr_ray_tracing_pipeline.name,
 };
 
+var invocation_reorder_features = vk.PhysicalDeviceRayTracingInvocationReorderFeaturesNV {};
+
+// shader execution reordering, used by pipelines with a reorder variant if enabled
+pub const optional_device_extensions = [_]core.VulkanContext.OptionalDeviceExtension {
+    .{
+        .name = vk.extensions.nv_ray_tracing_invocation_reorder.name,
+        .features = @ptrCast(&invocation_reorder_features),
+    },
+};
+
 pub const required_device_features = vk.PhysicalDeviceRayTracingPipelineFeaturesKHR {
     .p_next = @constCast(&vk.PhysicalDeviceAccelerationStructureFeaturesKHR {
         .acceleration_structure = vk.TRUE,
@@ -35,6 +48,7 @@ pub const required_vulkan_functions = [_]vk.ApiInfo {
             .getAccelerationStructureDeviceAddressKHR = true,
             .getRayTracingShaderGroupHandlesKHR = true,
             .cmdTraceRaysKHR = true,
+            .cmdTraceRaysIndirectKHR = true,
             .cmdWriteAccelerationStructuresPropertiesKHR = true,
             .cmdCopyAccelerationStructureKHR = true,
             .cmdClearColorImage = true,
@@ -61,6 +61,9 @@ pub fn Pipeline(comptime options: struct {
     PushSetBindings: type,
     additional_descriptor_layout_count: comptime_int = 0,
     stages: []const Stage,
+    // variant of shader_path that reorders threads with shader execution reordering,
+    // used instead when SpecConstants.reorder_threads is set and the device supports it
+    reorder_shader_path: ?[:0]const u8 = null,
 }) type {
 
     return struct {
@@ -73,13 +76,15 @@ pub fn Pipeline(comptime options: struct {
         const Bindings = core.pipeline.PipelineBindings(options.shader_path, .{ .raygen_bit_khr = true }, options.PushConstants, options.PushSetBindings, options.additional_descriptor_layout_count);
 
         pub const SpecConstants = options.SpecConstants;
+        pub const PushConstants = options.PushConstants;
         pub const PushSetBindings = options.PushSetBindings;
 
         pub fn create(vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, additional_descriptor_layouts: [options.additional_descriptor_layout_count]vk.DescriptorSetLayout, constants: SpecConstants, samplers: [Bindings.sampler_count]vk.Sampler) !Self {
             var bindings = try Bindings.create(vc, samplers, additional_descriptor_layouts);
             errdefer bindings.destroy(vc);
 
-            const module = try core.pipeline.createShaderModule(vc, options.shader_path, allocator, .ray_tracing);
+            var supported_constants = constants;
+            const module = try createShaderModule(vc, allocator, &supported_constants);
             defer vc.device.destroyShaderModule(module, null);
 
             var vk_stages: [options.stages.len]vk.PipelineShaderStageCreateInfo = undefined;
@@ -118,7 +123,7 @@ pub fn Pipeline(comptime options: struct {
                             .map_entry_count = map_entries.len,
                             .p_map_entries = &map_entries,
                             .data_size = @sizeOf(SpecConstants),
-                            .p_data = &constants,
+                            .p_data = &supported_constants,
                         };
                     }
                 }
@@ -135,7 +140,7 @@ pub fn Pipeline(comptime options: struct {
                 .base_pipeline_index = -1,
             };
             var handle: vk.Pipeline = undefined;
-            _ = try vc.device.createRayTracingPipelinesKHR(.null_handle, .null_handle, 1, @ptrCast(&create_info), null, @ptrCast(&handle));
+            _ = try vc.device.createRayTracingPipelinesKHR(.null_handle, vc.pipeline_cache, 1, @ptrCast(&create_info), null, @ptrCast(&handle));
             errdefer vc.device.destroyPipeline(handle, null);
             try core.vk_helpers.setDebugName(vc.device, handle, options.shader_path);
 
@@ -151,9 +156,20 @@ pub fn Pipeline(comptime options: struct {
             };
         }
 
+        // falls back to the regular shader if the reorder variant is not asked for or
+        // the device does not support it, turning off `reorder_threads` in the latter case
+        fn createShaderModule(vc: *const VulkanContext, allocator: std.mem.Allocator, constants: *SpecConstants) !vk.ShaderModule {
+            if (options.reorder_shader_path) |reorder_shader_path| {
+                if (!vc.deviceExtensionEnabled(vk.extensions.nv_ray_tracing_invocation_reorder.name)) constants.reorder_threads = vk.FALSE;
+                if (constants.reorder_threads != vk.FALSE) return core.pipeline.createShaderModule(vc, reorder_shader_path, allocator, .ray_tracing);
+            }
+            return core.pipeline.createShaderModule(vc, options.shader_path, allocator, .ray_tracing);
+        }
+
         // returns old handle which must be cleaned up
         pub fn recreate(self: *Self, vc: *const VulkanContext, allocator: std.mem.Allocator, encoder: *Encoder, constants: SpecConstants) !vk.Pipeline {
-            const module = try core.pipeline.createShaderModule(vc, options.shader_path, allocator, .ray_tracing);
+            var supported_constants = constants;
+            const module = try createShaderModule(vc, allocator, &supported_constants);
             defer vc.device.destroyShaderModule(module, null);
 
             var vk_stages: [options.stages.len]vk.PipelineShaderStageCreateInfo = undefined;
@@ -192,7 +208,7 @@ pub fn Pipeline(comptime options: struct {
                             .map_entry_count = map_entries.len,
                             .p_map_entries = &map_entries,
                             .data_size = @sizeOf(SpecConstants),
-                            .p_data = &constants,
+                            .p_data = &supported_constants,
                         };
                     }
                 }
@@ -209,7 +225,7 @@ pub fn Pipeline(comptime options: struct {
                 .base_pipeline_index = -1,
             };
             const old_handle = self.handle;
-            _ = try vc.device.createRayTracingPipelinesKHR(.null_handle, .null_handle, 1, @ptrCast(&create_info), null, @ptrCast(&self.handle));
+            _ = try vc.device.createRayTracingPipelinesKHR(.null_handle, vc.pipeline_cache, 1, @ptrCast(&create_info), null, @ptrCast(&self.handle));
             errdefer vc.device.destroyPipeline(self.handle, null);
             try core.vk_helpers.setDebugName(vc.device, self.handle, options.shader_path);
 
@@ -245,6 +261,11 @@ pub fn Pipeline(comptime options: struct {
             command_buffer.traceRaysKHR(&self.sbt.getRaygenSBT(), &self.sbt.getMissSBT(), &self.sbt.getHitSBT(), &self.sbt.getCallableSBT(), extent.width, extent.height, 1);
         }
 
+        // extent is read from a vk.TraceRaysIndirectCommandKHR at `address` when executed
+        pub fn recordTraceRaysIndirect(self: *const Self, command_buffer: VulkanContext.CommandBuffer, address: vk.DeviceAddress) void {
+            command_buffer.traceRaysIndirectKHR(&self.sbt.getRaygenSBT(), &self.sbt.getMissSBT(), &self.sbt.getHitSBT(), &self.sbt.getCallableSBT(), address);
+        }
+
         pub fn recordPushDescriptors(self: *const Self, command_buffer: VulkanContext.CommandBuffer, bindings: options.PushSetBindings) void {
             const writes = core.pipeline.pushDescriptorDataToWriteDescriptor(options.PushSetBindings, bindings);
             command_buffer.pushDescriptorSetKHR(.ray_tracing_khr, self.bindings.layout, 0, @intCast(writes.len), &writes.buffer);
@@ -277,25 +298,46 @@ pub const StandardBindings = struct {
     meshes: ?vk.Buffer,
     geometries: ?vk.Buffer,
     material_values: ?vk.Buffer,
-    triangle_power_image: core.pipeline.SampledImage,
-    triangle_meta: vk.Buffer,
-    geometry_to_triangle_power_offset: vk.Buffer,
-    emissive_triangle_count: vk.Buffer,
+    triangle_powers: vk.Buffer,
+    geometry_powers: vk.Buffer,
+    geometry_power_infos: vk.Buffer,
     background_rgb_image: core.pipeline.CombinedImageSampler,
     background_luminance_image: core.pipeline.SampledImage,
     output_image: core.pipeline.StorageImage,
+    output_moments_image: core.pipeline.StorageImage,
+    converged_tiles: vk.Buffer,
+    light_reservoirs: vk.Buffer,
+};
+
+// where a dispatch is within the whole image, for when a sensor is too small to capture all of it at once
+//
+// pixel (0, 0) of the sensor captures pixel `offset` of the image
+pub const Region = extern struct {
+    offset: vk.Offset2D = .{ .x = 0, .y = 0 },
+    image_extent: vk.Extent2D = .{ .width = 0, .height = 0 }, // zero if the dispatch covers the whole image
 };
 
 pub const PathTracing = Pipeline(.{
     .shader_path = "hrtsystem/main_pt.hlsl",
+    .reorder_shader_path = "hrtsystem/main_pt_reorder.hlsl",
     .SpecConstants = extern struct {
         max_bounces: u32 = 4,
         env_samples_per_bounce: u32 = 1,
         mesh_samples_per_bounce: u32 = 1,
+        reorder_threads: vk.Bool32 = vk.FALSE, // reorder by material and hit before shading, if supported
+        direct_light_candidates: u32 = 0, // resample direct light from this many candidates rather than taking independent samples, zero to not
+        temporal_reuse: vk.Bool32 = vk.FALSE, // resampled primary hits reuse the reservoir of the last sample of their pixel
+        spatial_reuse_neighbours: u32 = 0, // resampled primary hits reuse the reservoirs of this many nearby pixels
+
+        // whether sensors need light reservoirs to render with this, see Sensor.setLightReservoirs
+        pub fn reusesLight(self: @This()) bool {
+            return self.direct_light_candidates != 0 and (self.temporal_reuse == vk.TRUE or self.spatial_reuse_neighbours != 0);
+        }
     },
     .PushConstants = extern struct {
         lens: Camera.Lens,
         sample_count: u32,
+        region: Region = .{},
     },
     .additional_descriptor_layout_count = 2,
     .PushSetBindings = StandardBindings,
@@ -317,6 +359,7 @@ pub const DirectLighting = Pipeline(.{
     .PushConstants = extern struct {
         lens: Camera.Lens,
         sample_count: u32,
+        region: Region = .{},
     },
     .additional_descriptor_layout_count = 2,
     .PushSetBindings = StandardBindings,
@@ -328,6 +371,112 @@ pub const DirectLighting = Pipeline(.{
     }
 });
 
+// everything a wavefront stage may access, the StandardBindings followed by the wavefront state
+// see hrtsystem/wavefront/shared.hlsl
+pub const WavefrontBindings = struct {
+    tlas: ?vk.AccelerationStructureKHR,
+    instances: ?vk.Buffer,
+    world_to_instances: ?vk.Buffer,
+    meshes: ?vk.Buffer,
+    geometries: ?vk.Buffer,
+    material_values: ?vk.Buffer,
+    triangle_powers: vk.Buffer,
+    geometry_powers: vk.Buffer,
+    geometry_power_infos: vk.Buffer,
+    background_rgb_image: core.pipeline.CombinedImageSampler,
+    background_luminance_image: core.pipeline.SampledImage,
+    output_image: core.pipeline.StorageImage,
+    output_moments_image: core.pipeline.StorageImage,
+    converged_tiles: vk.Buffer,
+    light_reservoirs: vk.Buffer,
+    paths: vk.Buffer,
+    hits: vk.Buffer,
+    ray_queues: vk.Buffer,
+    shade_queues: vk.Buffer,
+    shadow_rays: vk.Buffer,
+    shadow_queue: vk.Buffer,
+    counters: vk.Buffer,
+};
+
+pub const WavefrontGenerate = core.pipeline.Pipeline(.{
+    .shader_path = "hrtsystem/wavefront/generate.hlsl",
+    .SpecConstants = PathTracing.SpecConstants,
+    .PushConstants = extern struct {
+        lens: Camera.Lens,
+        sample_count: u32,
+        region: Region = .{},
+    },
+    .additional_descriptor_layout_count = 2,
+    .PushSetBindings = WavefrontBindings,
+});
+
+pub const WavefrontExtend = Pipeline(.{
+    .shader_path = "hrtsystem/wavefront/trace.hlsl",
+    .SpecConstants = PathTracing.SpecConstants,
+    .PushConstants = extern struct {
+        ray_queue: u32,
+    },
+    .additional_descriptor_layout_count = 2,
+    .PushSetBindings = WavefrontBindings,
+    .stages = &[_]Stage {
+        .{ .type = .raygen, .entrypoint = "extend" },
+        .{ .type = .miss, .entrypoint = "miss" },
+        .{ .type = .miss, .entrypoint = "shadowmiss" },
+        .{ .type = .closest_hit, .entrypoint = "closesthit" },
+    }
+});
+
+pub const WavefrontShade = core.pipeline.Pipeline(.{
+    .shader_path = "hrtsystem/wavefront/shade.hlsl",
+    .SpecConstants = PathTracing.SpecConstants,
+    .PushConstants = extern struct {
+        bsdf_type: u32,
+        next_ray_queue: u32,
+    },
+    .additional_descriptor_layout_count = 2,
+    .PushSetBindings = WavefrontBindings,
+});
+
+// same push constants as extend as they share a shader
+pub const WavefrontShadow = Pipeline(.{
+    .shader_path = "hrtsystem/wavefront/trace.hlsl",
+    .SpecConstants = PathTracing.SpecConstants,
+    .PushConstants = WavefrontExtend.PushConstants,
+    .additional_descriptor_layout_count = 2,
+    .PushSetBindings = WavefrontBindings,
+    .stages = &[_]Stage {
+        .{ .type = .raygen, .entrypoint = "shadow" },
+        .{ .type = .miss, .entrypoint = "miss" },
+        .{ .type = .miss, .entrypoint = "shadowmiss" },
+        .{ .type = .closest_hit, .entrypoint = "closesthit" },
+    }
+});
+
+pub const WavefrontAccumulate = core.pipeline.Pipeline(.{
+    .shader_path = "hrtsystem/wavefront/accumulate.hlsl",
+    .SpecConstants = PathTracing.SpecConstants,
+    .PushConstants = extern struct {
+        sample_count: u32,
+    },
+    .additional_descriptor_layout_count = 2,
+    .PushSetBindings = WavefrontBindings,
+});
+
+pub const Convergence = core.pipeline.Pipeline(.{
+    .shader_path = "hrtsystem/convergence.hlsl",
+    .PushConstants = extern struct {
+        noise_threshold: f32,
+        min_sample_count: u32,
+        sample_count: u32,
+        extent: vk.Extent2D,
+    },
+    .PushSetBindings = struct {
+        output_image: core.pipeline.StorageImage,
+        output_moments_image: core.pipeline.StorageImage,
+        converged_tiles: vk.Buffer,
+    },
+});
+
 const ShaderInfo = struct {
     raygen_count: u32,
     miss_count: u32,
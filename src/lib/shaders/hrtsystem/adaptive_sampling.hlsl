@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../utils/math.hlsl"
+
+// pixels are checked for convergence in square tiles this wide
+// must be kept in sync with convergence_tile_size in Sensor.zig
+static const uint convergenceTileSize = 8;
+
+uint convergenceTileIndex(uint2 imageCoords, uint2 imageSize) {
+    const uint tilesPerRow = (imageSize.x + convergenceTileSize - 1) / convergenceTileSize;
+    const uint2 tile = imageCoords / convergenceTileSize;
+    return tile.y * tilesPerRow + tile.x;
+}
+
+// a converged tile stops receiving samples, so the average of its pixels
+// stays what it was at `sampleCount` when it converged
+bool isConverged(StructuredBuffer<uint> convergedTiles, uint2 imageCoords, uint2 imageSize) {
+    return convergedTiles[convergenceTileIndex(imageCoords, imageSize)] != 0;
+}
+
+// adds `newSample` to the running averages of the pixel at `imageCoords`
+void accumulateSample(RWTexture2D<float4> outputImage, RWTexture2D<float> outputMoments, uint2 imageCoords, float3 newSample, uint sampleCount) {
+    const float3 priorSampleAverage = sampleCount == 0 ? 0 : outputImage[imageCoords].xyz;
+    outputImage[imageCoords] = float4(accumulate(priorSampleAverage, newSample, sampleCount), 1);
+
+    const float priorMoment = sampleCount == 0 ? 0 : outputMoments[imageCoords];
+    outputMoments[imageCoords] = accumulate(priorMoment, pow2(luminance(newSample)), sampleCount);
+}
@@ -0,0 +1,46 @@
+#include "adaptive_sampling.hlsl"
+
+// marks tiles whose pixels are all below the noise threshold as converged,
+// so the integrators skip them from then on
+
+[[vk::binding(0, 0)]] RWTexture2D<float4> dOutputImage;
+[[vk::binding(1, 0)]] RWTexture2D<float> dOutputMoments;
+[[vk::binding(2, 0)]] RWStructuredBuffer<uint> dConvergedTiles;
+
+struct PushConsts {
+	float noiseThreshold;   // largest relative standard error of a pixel that counts as converged
+	uint minSampleCount;    // no tile converges before this many samples
+	uint sampleCount;       // samples so far in every unconverged pixel
+	uint2 extent;           // part of the image captured, the rest holding nothing meaningful
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+groupshared uint tileError;
+
+// relative standard error of the mean luminance of a pixel
+float relativeError(uint2 imageCoords) {
+    const float mean = luminance(dOutputImage[imageCoords].xyz);
+    const float variance = max(dOutputMoments[imageCoords] - pow2(mean), 0) / float(pushConsts.sampleCount - 1);
+    return sqrt(variance) / (mean + 0.001);
+}
+
+// one group per tile
+[numthreads(convergenceTileSize, convergenceTileSize, 1)]
+void main(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID, uint groupIndex : SV_GroupIndex) {
+    uint2 imageSize;
+    dOutputImage.GetDimensions(imageSize.x, imageSize.y);
+    const uint2 extent = min(pushConsts.extent, imageSize);
+    const uint2 imageCoords = groupId.xy * convergenceTileSize + groupThreadId.xy;
+    const uint tileIndex = convergenceTileIndex(groupId.xy * convergenceTileSize, imageSize);
+
+    if (dConvergedTiles[tileIndex] != 0 || pushConsts.sampleCount < max(pushConsts.minSampleCount, 2)) return;
+
+    if (groupIndex == 0) tileError = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    // errors are non-negative so compare the same as integers
+    if (all(imageCoords < extent)) InterlockedMax(tileError, asuint(relativeError(imageCoords)));
+    GroupMemoryBarrierWithGroupSync();
+
+    if (groupIndex == 0 && asfloat(tileError) < pushConsts.noiseThreshold) dConvergedTiles[tileIndex] = 1;
+}
@@ -6,65 +6,31 @@
 #include "material.hlsl"
 #include "world.hlsl"
 #include "light.hlsl"
+#include "shading.hlsl"
+#include "reorder.hlsl"
 #include "ray.hlsl"
 #include "spectrum.hlsl"
-
-// with
-//   power == 1 this becomes balance heuristic
-//   power == 0 this becomes uniform weighting
-float powerHeuristic2(const uint fCount, const float fPdf2, const uint gCount, const float gPdf) {
-    return fPdf2 / (fCount * fPdf2 + gCount * pow2(gPdf));
-}
-
-float misWeight(const uint fCount, const float fPdf, const uint gCount, const float gPdf) {
-    if (fPdf == 1.#INF) return 1.0 / fCount; // delta distribution for f, g not relevant
-    return powerHeuristic2(fCount, pow2(fPdf), gCount, gPdf);
-}
+#include "resampling.hlsl"
 
 // estimates direct lighting from light + brdf via MIS
 // only samples light
 template <class Light, class BSDF>
-float estimateDirectMISLight(RaytracingAccelerationStructure accel, Frame frame, Light light, BSDF material, float3 outgoingDirFs, float λ, float3 positionWs, float3 triangleNormalDirWs, float spawnOffset, float2 rand, uint lightSamplesTaken, uint brdfSamplesTaken) {
-    const LightSample lightSample = light.sample(λ, positionWs, rand);
-
-    if (lightSample.eval.radiance > NEARzero) {
-        const float3 lightDirWs = normalize(lightSample.connection);
-        const BSDFEvaluation bsdfEval = material.evaluate(frame.worldToFrame(lightDirWs), outgoingDirFs);
-        if (bsdfEval.reflectance > NEARzero) {
-            float3 dir = faceForward(triangleNormalDirWs, lightDirWs) * spawnOffset;
-            if (!ShadowIntersection::hit(accel, positionWs + dir, lightSample.connection - dir)) {                
-                return lightSample.eval.radiance * bsdfEval.reflectance * misWeight(lightSamplesTaken, lightSample.eval.pdf, brdfSamplesTaken, bsdfEval.pdf);
-            }
-        }
-    }
+float4 estimateDirectMISLight(RaytracingAccelerationStructure accel, Frame frame, Light light, BSDF material, float3 outgoingDirFs, float4 λ, float3 positionWs, float3 triangleNormalDirWs, float spawnOffset, float2 rand, uint lightSamplesTaken, uint brdfSamplesTaken) {
+    const ShadowRay ray = sampleDirectMISLight(frame, light, material, outgoingDirFs, λ, positionWs, triangleNormalDirWs, spawnOffset, rand, lightSamplesTaken, brdfSamplesTaken);
 
-    return 0;
-}
-
-// selects a shading normal based on the most preferred normal that is plausible
-Frame selectFrame(const SurfacePoint surface, const Material material, const float3 outgoingDirWs) {
-    const Frame textureFrame = material.getTextureFrame(surface.texcoord, surface.frame);
-    Frame shadingFrame;
-    int sign0 = sign(dot(surface.triangleFrame.n, outgoingDirWs));
-    if (sign0 == sign(dot(outgoingDirWs, textureFrame.n))) {
-        // prefer texture normal if we can
-        shadingFrame = textureFrame;
-    } else if (sign0 == sign(dot(outgoingDirWs, surface.frame.n))) {
-        // if texture normal not valid, try shading normal
-        shadingFrame = surface.frame;
-    } else {
-        // otherwise fall back to triangle normal
-        shadingFrame = surface.triangleFrame;
+    if (any(ray.contribution > 0) && !ShadowIntersection::hit(accel, ray.origin, ray.connection)) {
+        return ray.contribution;
     }
 
-    return shadingFrame;
+    return 0;
 }
 
 struct Path {
     Ray ray;
-    float throughput;
-    float radiance;
+    float4 throughput;
+    float4 radiance;
     uint bounceCount;
+    bool heroOnly; // whether the secondary wavelengths have been terminated
 
     static Path create(const Ray ray) {
         Path p;
@@ -72,41 +38,61 @@ struct Path {
         p.throughput = 1;
         p.radiance = 0;
         p.bounceCount = 0;
+        p.heroOnly = false;
         return p;
     }
 };
 
 interface Integrator {
-    float incomingRadiance(const Scene scene, const Ray initialRay, const float λ, inout Rng rng);
+    float4 incomingRadiance(const Scene scene, const Ray initialRay, const float4 λ, inout Rng rng);
 };
 
 struct PathTracingIntegrator : Integrator {
     uint maxBounces;
     uint envSamplesPerBounce;
     uint meshSamplesPerBounce;
+    bool reorderThreads;
+    LightResampling resampling; // if enabled, replaces the independent env and mesh samples, whose counts then only say which lights to resample
 
-    static PathTracingIntegrator create(uint maxBounces, uint envSamplesPerBounce, uint meshSamplesPerBounce) {
+    static PathTracingIntegrator create(uint maxBounces, uint envSamplesPerBounce, uint meshSamplesPerBounce, bool reorderThreads, LightResampling resampling) {
         PathTracingIntegrator integrator;
         integrator.maxBounces = maxBounces;
         integrator.envSamplesPerBounce = envSamplesPerBounce;
         integrator.meshSamplesPerBounce = meshSamplesPerBounce;
+        integrator.reorderThreads = reorderThreads;
+        integrator.resampling = resampling;
         return integrator;
     }
 
-    float incomingRadiance(const Scene scene, const Ray initialRay, const float λ, inout Rng rng) {
+    bool resamplesLight() {
+        return resampling.enabled() && (envSamplesPerBounce > 0 || meshSamplesPerBounce > 0);
+    }
+
+    // chance of a resampled candidate being from the env map rather than emissive meshes
+    float envResampleProbability(const Scene scene) {
+        if (envSamplesPerBounce == 0) return 0;
+        if (meshSamplesPerBounce == 0 || scene.meshLights.integral() < NEARzero) return 1;
+        return 0.5;
+    }
+
+    float4 incomingRadiance(const Scene scene, const Ray initialRay, const float4 λ, inout Rng rng) {
         Path path = Path::create(initialRay);
 
         for (Intersection its = Intersection::find(scene.tlas, path.ray.desc()); its.hit(); its = Intersection::find(scene.tlas, path.ray.desc())) {
 
             // decode mesh attributes and material from intersection
-            const SurfacePoint surface = scene.world.surfacePoint(its.instanceIndex, its.geometryIndex, its.primitiveIndex, its.barycentrics);
             const Material material = scene.world.material(its.instanceIndex, its.geometryIndex);
 
+            // regroup threads so that those shading similar materials run together
+            if (reorderThreads) reorderThread(its, material);
+
+            const SurfacePoint surface = scene.world.surfacePoint(its.instanceIndex, its.geometryIndex, its.primitiveIndex, its.barycentrics);
+
             // collect light from emissive meshes
             if(meshSamplesPerBounce > 0)
             {
                 const float lightPdf = areaMeasureToSolidAngleMeasure(surface.position, path.ray.origin, path.ray.direction, surface.triangleFrame.n) * scene.meshLights.areaPdf(its.instanceIndex, its.geometryIndex, its.primitiveIndex);
-                const float weight = misWeight(1, path.ray.pdf, meshSamplesPerBounce, lightPdf);
+                const float weight = resamplesLight() ? resampling.emissionWeight(path.ray.pdf) : misWeight(1, path.ray.pdf, meshSamplesPerBounce, lightPdf);
                 path.radiance += path.throughput * material.getEmissive(λ, surface.texcoord) * weight;
             } else path.radiance += path.throughput * material.getEmissive(λ, surface.texcoord); 
 
@@ -116,7 +102,7 @@ struct PathTracingIntegrator : Integrator {
             // max bounce cutoff needs to be before NEE below, and after light contribution above, otherwise MIS would need to be adjusted
             if(path.bounceCount > 3)
             {
-                const float pSurvive = min(0.95, path.throughput);
+                const float pSurvive = min(0.95, maxComponent(path.throughput));
                 if (rng.getFloat() > pSurvive) return path.radiance;
                 path.throughput /= pSurvive;
             }
@@ -127,7 +113,11 @@ struct PathTracingIntegrator : Integrator {
             const Frame shadingFrame = selectFrame(surface, material, outgoingDirWs);
             const float3 outgoingDirSs = shadingFrame.worldToFrame(outgoingDirWs);
 
-            if (!bsdf.isDelta()) {
+            if (!bsdf.isDelta() && resamplesLight()) {
+                // one shadow ray to the light resampled from many candidates
+                const ShadingPoint p = ShadingPoint::create(surface, shadingFrame, outgoingDirSs);
+                path.radiance += path.throughput * resampling.estimate(scene, p, bsdf, λ, envResampleProbability(scene), path.bounceCount == 0, initialRay.origin, rng);
+            } else if (!bsdf.isDelta()) {
                 // accumulate direct light samples from env map
                 for (uint directCount = 0; directCount < envSamplesPerBounce; directCount++) {
                     float2 rand = rng.getFloat2();
@@ -143,13 +133,17 @@ struct PathTracingIntegrator : Integrator {
 
             // sample direction for next bounce
             const BSDFSample sample = bsdf.sample(outgoingDirSs, rng.getFloat2());
-            if (sample.eval.reflectance < NEARzero) return path.radiance;
+            if (all(sample.eval.reflectance < NEARzero)) return path.radiance;
 
             // set up info for next bounce
             path.ray.direction = shadingFrame.frameToWorld(sample.dirFs);
             path.ray.origin = surface.position + faceForward(surface.triangleFrame.n, path.ray.direction) * surface.spawnOffset;
             path.ray.pdf = sample.eval.pdf;
             path.throughput *= sample.eval.reflectance;
+            if (sample.dispersed && !path.heroOnly) {
+                path.throughput = Spectrum::heroOnly(path.throughput);
+                path.heroOnly = true;
+            }
             path.bounceCount += 1;
         }
 
@@ -159,7 +153,7 @@ struct PathTracingIntegrator : Integrator {
         if(envSamplesPerBounce > 0)
         {
             const LightEvaluation l = scene.envMap.evaluate(λ, path.ray.direction);
-            const float weight = misWeight(1, path.ray.pdf, envSamplesPerBounce, l.pdf);
+            const float weight = resamplesLight() ? resampling.emissionWeight(path.ray.pdf) : misWeight(1, path.ray.pdf, envSamplesPerBounce, l.pdf);
             path.radiance += path.throughput * l.radiance * weight;
         }
 
@@ -182,8 +176,8 @@ struct DirectLightIntegrator : Integrator {
         return integrator;
     }
 
-    float incomingRadiance(const Scene scene, const Ray initialRay, const float λ, inout Rng rng) {
-        float pathRadiance = 0;
+    float4 incomingRadiance(const Scene scene, const Ray initialRay, const float4 λ, inout Rng rng) {
+        float4 pathRadiance = 0;
 
         Intersection its = Intersection::find(scene.tlas, initialRay.desc());
         if (its.hit()) {
@@ -215,7 +209,8 @@ struct DirectLightIntegrator : Integrator {
 
             for (uint brdfSampleCount = 0; brdfSampleCount < brdfSamples; brdfSampleCount++) {
                 const BSDFSample sample = bsdf.sample(outgoingDirSs, rng.getFloat2());
-                if (sample.eval.reflectance > NEARzero) {
+                if (any(sample.eval.reflectance > NEARzero)) {
+                    const float4 reflectance = sample.dispersed ? Spectrum::heroOnly(sample.eval.reflectance) : sample.eval.reflectance;
                     Ray ray = initialRay;
                     ray.direction = shadingFrame.frameToWorld(sample.dirFs);
                     ray.origin = surface.position + faceForward(surface.triangleFrame.n, ray.direction) * surface.spawnOffset;
@@ -225,12 +220,12 @@ struct DirectLightIntegrator : Integrator {
                         const SurfacePoint surface = scene.world.surfacePoint(its.instanceIndex, its.geometryIndex, its.primitiveIndex, its.barycentrics);
                         const float lightPdf = areaMeasureToSolidAngleMeasure(surface.position, ray.origin, ray.direction, surface.triangleFrame.n) * scene.meshLights.areaPdf(its.instanceIndex, its.geometryIndex, its.primitiveIndex);
                         const float weight = misWeight(brdfSamples, sample.eval.pdf, meshSamples, lightPdf);
-                        pathRadiance += sample.eval.reflectance * scene.world.material(its.instanceIndex, its.geometryIndex).getEmissive(λ, surface.texcoord) * weight;
+                        pathRadiance += reflectance * scene.world.material(its.instanceIndex, its.geometryIndex).getEmissive(λ, surface.texcoord) * weight;
                     } else {
                         // miss -- collect light from env map
                         const LightEvaluation l = scene.envMap.evaluate(λ, ray.direction);
                         const float weight = misWeight(brdfSamples, sample.eval.pdf, envSamples, l.pdf);
-                        pathRadiance += sample.eval.reflectance * l.radiance * weight;
+                        pathRadiance += reflectance * l.radiance * weight;
                     }
                 }
             }
@@ -4,9 +4,10 @@
 #include "material.hlsl"
 #include "spectrum.hlsl"
 #include "../utils/reservoir.hlsl"
+#include "../utils/power_tree.hlsl"
 
 struct LightEvaluation {
-    float radiance;
+    float4 radiance; // one per hero wavelength
     float pdf;
 
     static LightEvaluation empty() {
@@ -19,20 +20,26 @@ struct LightEvaluation {
 
 struct LightSample {
     float3 connection; // connection vector in world space from initial position to sampled position
+    float3 emission; // rgb that eval.radiance was sampled from, for evaluating it at other wavelengths
+    float3 normal; // of the light surface at the sampled position, zero for the env map
     LightEvaluation eval;
 };
 
-struct TriangleMetadata {
+// per flat geometry, where to find the power tree of its triangles
+// geometries sharing a mesh and material share that tree
+struct GeometryPowerInfo {
 	uint instanceIndex;
 	uint geometryIndex;
-	float area_;
+	uint triangleOffset; // MAX_UINT if this geometry is not tracked for emissive light
+	uint triangleCount;
+	float powerScale; // from the space of the mesh, which the triangle powers are in, to world space
 };
 
 interface Light {
     // samples a light direction based on given position, returns
     // radiance at that point from light and pdf of this direction + radiance, ignoring visibility
-    LightSample sample(float λ, float3 positionWs, float2 square);
-    LightSample sample(float λ, float3 positionWs, float2 square, float area_);
+    LightSample sample(float4 λ, float3 positionWs, float2 square);
+    LightSample sample(float4 λ, float3 positionWs, float2 square, float area_);
 };
 
 struct EnvMap : Light {
@@ -48,7 +55,7 @@ struct EnvMap : Light {
         return map;
     }
 
-    LightSample sample(float λ, float3 positionWs, float2 rand) {
+    LightSample sample(float4 λ, float3 positionWs, float2 rand) {
         const uint size = textureDimensions(luminanceTexture).x;
         const uint mipCount = log2(size) + 1;
         float reservour_rand = rand.x;
@@ -68,8 +75,10 @@ struct EnvMap : Light {
         }
 
         LightSample lightSample;
-        lightSample.eval.radiance = Spectrum::sampleEmission(λ, rgbTexture[idx]);
-		if(lightSample.eval.radiance > NEARzero) {
+        lightSample.emission = rgbTexture[idx];
+        lightSample.normal = 0;
+        lightSample.eval.radiance = Spectrum::sampleEmission(λ, lightSample.emission);
+		if(any(lightSample.eval.radiance > NEARzero)) {
 			const float integral = luminanceTexture.Load(uint3(0, 0, mipCount - 1));
 
 			const float discretePdf = luminanceTexture[idx] * float(size * size) / integral;
@@ -84,12 +93,12 @@ struct EnvMap : Light {
         return lightSample;
     }
 
-    LightSample sample(float λ, float3 positionWs, float2 rand, float area_) {
+    LightSample sample(float4 λ, float3 positionWs, float2 rand, float area_) {
         return sample(λ, positionWs, rand);
     }
 
     // pdf is with respect to solid angle (no trace)
-    LightEvaluation evaluate(float λ, float3 dirWs) {
+    LightEvaluation evaluate(float4 λ, float3 dirWs) {
         const uint size = textureDimensions(luminanceTexture).x;
         const uint mipCount = log2(size) + 1;
         const float integral = luminanceTexture.Load(uint3(0, 0, mipCount - 1));
@@ -126,13 +135,15 @@ struct TriangleLight: Light {
         return light;
     }
 
-    LightSample sample(float λ, float3 positionWs, float2 rand, float area_) {
+    LightSample sample(float4 λ, float3 positionWs, float2 rand, float area_) {
         const float2 barycentrics = squareToTriangle(rand);
         const SurfacePoint surface = t.surfacePoint(barycentrics, toWorld, toMesh);
 
         LightSample lightSample;
-        lightSample.eval.radiance = material.getEmissive(λ, surface.texcoord);
-		if(lightSample.eval.radiance > NEARzero) {
+        lightSample.emission = material.getEmissiveRgb(surface.texcoord);
+        lightSample.normal = surface.triangleFrame.n;
+        lightSample.eval.radiance = Spectrum::sampleEmission(λ, lightSample.emission);
+		if(any(lightSample.eval.radiance > NEARzero)) {
 			lightSample.connection = surface.position - positionWs;
 			lightSample.connection += faceForward(surface.triangleFrame.n, -lightSample.connection) * surface.spawnOffset;
 			lightSample.eval.pdf = areaMeasureToSolidAngleMeasure(surface.position, positionWs, normalize(lightSample.connection), surface.triangleFrame.n) * area_;
@@ -142,57 +153,48 @@ struct TriangleLight: Light {
         return lightSample;
     }
 
-    LightSample sample(float λ, float3 positionWs, float2 rand) {
+    LightSample sample(float4 λ, float3 positionWs, float2 rand) {
         float area_;
         return sample(λ, positionWs, rand, area_);
     }
 };
 
 // all mesh lights in scene
+//
+// two levels of power trees, one over all geometries and
+// one per geometry over its triangles, see PowerTree
 struct MeshLights : Light {
-    Texture1D<float> power;
-    StructuredBuffer<TriangleMetadata> metadata;
-    StructuredBuffer<uint> geometryToTrianglePowerOffset;
-    uint emissiveTriangleCount;
+    StructuredBuffer<float> trianglePowers;
+    StructuredBuffer<float> geometryPowers;
+    StructuredBuffer<GeometryPowerInfo> geometryPowerInfos;
     World world;
 
-    static MeshLights create(Texture1D<float> power, StructuredBuffer<TriangleMetadata> metadata, StructuredBuffer<uint> geometryToTrianglePowerOffset, uint emissiveTriangleCount, World world) {
+    static MeshLights create(StructuredBuffer<float> trianglePowers, StructuredBuffer<float> geometryPowers, StructuredBuffer<GeometryPowerInfo> geometryPowerInfos, World world) {
         MeshLights lights;
-        lights.power = power;
-        lights.metadata = metadata;
-        lights.geometryToTrianglePowerOffset = geometryToTrianglePowerOffset;
-        lights.emissiveTriangleCount = emissiveTriangleCount;
+        lights.trianglePowers = trianglePowers;
+        lights.geometryPowers = geometryPowers;
+        lights.geometryPowerInfos = geometryPowerInfos;
         lights.world = world;
         return lights;
     }
 
-    LightSample sample(float λ, float3 positionWs, float2 rand) {
+    LightSample sample(float4 λ, float3 positionWs, float2 rand) {
         LightSample lightSample;
+        lightSample.emission = 0;
+        lightSample.normal = 0;
         lightSample.eval = LightEvaluation::empty();
 
         if (integral() < NEARzero) return lightSample;
 
-        const uint mipCount = uint(ceil(log2(emissiveTriangleCount))) + 1;
         float reservour_rand = rand.x;
-
-        uint idx = 0;
-        for (uint level = mipCount; level-- > 0;) {
-            Reservoir<uint> r = Reservoir<uint>::empty();
-            for (uint i = 0; i < 2; i++) {
-                const uint coord = idx + idx + i;
-                r.update(coord, power.Load(uint2(coord, level)), reservour_rand);
-            }
-            idx = r.selected;
-        }
-        const TriangleMetadata meta = metadata[idx];
-
-        const uint instanceID = world.instances[meta.instanceIndex].instanceCustomIndex;
-        const uint primitiveIndex = idx - geometryToTrianglePowerOffset[instanceID + meta.geometryIndex];
-
-        const TriangleLight inner = TriangleLight::create(meta.instanceIndex, meta.geometryIndex, primitiveIndex, world);
-        lightSample = inner.sample(λ, positionWs, rand, meta.area_);
-		if(lightSample.eval.radiance > NEARzero) {
-			float selPdf = selectionPdf(meta.instanceIndex, meta.geometryIndex, primitiveIndex);
+        const uint flatGeometryIndex = PowerTree::sample(geometryPowers, 0, geometryCount(), reservour_rand);
+        const GeometryPowerInfo info = geometryPowerInfos[flatGeometryIndex];
+        const uint primitiveIndex = PowerTree::sample(trianglePowers, info.triangleOffset, info.triangleCount, reservour_rand);
+
+        const TriangleLight inner = TriangleLight::create(info.instanceIndex, info.geometryIndex, primitiveIndex, world);
+        lightSample = inner.sample(λ, positionWs, rand, 1.0 / world.triangleArea(info.instanceIndex, info.geometryIndex, primitiveIndex));
+		if(any(lightSample.eval.radiance > NEARzero)) {
+			float selPdf = selectionPdf(info.instanceIndex, info.geometryIndex, primitiveIndex);
 			lightSample.eval.pdf *= selPdf;
 			lightSample.eval.radiance /= selPdf;
 		}
@@ -200,7 +202,7 @@ struct MeshLights : Light {
         return lightSample;
     }
 
-    LightSample sample(float λ, float3 positionWs, float2 rand, float area_) {
+    LightSample sample(float4 λ, float3 positionWs, float2 rand, float area_) {
         return sample(λ, positionWs, rand);
     }
 
@@ -208,26 +210,26 @@ struct MeshLights : Light {
         float integral_ = integral();
         if (integral_ < NEARzero) return 0.0; // no lights
         const uint instanceID = world.instances[instanceIndex].instanceCustomIndex;
-        const uint offset = geometryToTrianglePowerOffset[instanceID + geometryIndex];
-        if (offset == MAX_UINT) return 0.0; // no light at this triangle
-        const uint idx = offset + primitiveIndex;
-        return power.Load(uint2(idx, 0)) / integral_;
+        const GeometryPowerInfo info = geometryPowerInfos[instanceID + geometryIndex];
+        if (info.triangleOffset == MAX_UINT) return 0.0; // no light at this triangle
+        return trianglePowers[info.triangleOffset + primitiveIndex] * info.powerScale / integral_;
     }
 
     float areaPdf(uint instanceIndex, uint geometryIndex, uint primitiveIndex) {
-        float integral_ = integral();
-        if (integral_ < NEARzero) return 0.0; // no lights
-        const uint instanceID = world.instances[instanceIndex].instanceCustomIndex;
-        const uint offset = geometryToTrianglePowerOffset[instanceID + geometryIndex];
-        if (offset == MAX_UINT) return 0.0; // no light at this triangle
-        const uint idx = offset + primitiveIndex;
-        return power.Load(uint2(idx, 0)) * metadata[idx].area_ / integral_;
+        const float selPdf = selectionPdf(instanceIndex, geometryIndex, primitiveIndex);
+        if (selPdf == 0.0) return 0.0;
+        return selPdf / world.triangleArea(instanceIndex, geometryIndex, primitiveIndex);
     }
 
-    float integral() {
-        if (emissiveTriangleCount == 0) return 0;
+    // leaves of the geometry power tree, one per flat geometry
+    uint geometryCount() {
+        uint count;
+        uint stride;
+        geometryPowerInfos.GetDimensions(count, stride);
+        return count;
+    }
 
-        const uint mipCount = uint(ceil(log2(emissiveTriangleCount))) + 1;
-        return power.Load(uint2(0, mipCount - 1));
+    float integral() {
+        return geometryPowers[PowerTree::root(0, geometryCount())];
     }
 };
@@ -3,10 +3,15 @@
 [[vk::constant_id(0)]] const uint dMaxBounces = 4;
 [[vk::constant_id(1)]] const uint dEnvSamplesPerBounce = 1;  // how many times the environment map should be sampled per bounce for light
 [[vk::constant_id(2)]] const uint dMeshSamplesPerBounce = 1; // how many times emissive meshes should be sampled per bounce for light
+[[vk::constant_id(3)]] const bool dReorderThreads = false;   // whether to reorder threads before shading, only does anything in main_pt_reorder.hlsl
+[[vk::constant_id(4)]] const uint dLightCandidates = 0;      // resample direct light from this many candidates per bounce rather than taking independent samples, zero to not
+[[vk::constant_id(5)]] const bool dTemporalReuse = false;    // whether resampled primary hits reuse the reservoir of the last sample of their pixel
+[[vk::constant_id(6)]] const uint dSpatialReuseNeighbours = 0; // how many reservoirs of nearby pixels resampled primary hits reuse
 
 [shader("raygeneration")]
 void raygen() {
-    const PathTracingIntegrator integrator = PathTracingIntegrator::create(dMaxBounces, dEnvSamplesPerBounce, dMeshSamplesPerBounce);
+    const LightResampling resampling = LightResampling::create(dLightCandidates, dTemporalReuse, dSpatialReuseNeighbours, dLightReservoirs, pushConsts.sampleCount);
+    const PathTracingIntegrator integrator = PathTracingIntegrator::create(dMaxBounces, dEnvSamplesPerBounce, dMeshSamplesPerBounce, dReorderThreads, resampling);
     integrate(integrator);
 }
 
@@ -0,0 +1,4 @@
+// main_pt.hlsl with shader execution reordering compiled in,
+// for devices that support VK_NV_ray_tracing_invocation_reorder
+#define REORDER_THREADS
+#include "main_pt.hlsl"
@@ -2,6 +2,7 @@
 #include "camera.hlsl"
 #include "scene.hlsl"
 #include "integrator.hlsl"
+#include "adaptive_sampling.hlsl"
 
 // I use the `d` prefix to indicate a descriptor variable
 // because as a functional programmer impure functions scare me
@@ -15,30 +16,45 @@
 [[vk::binding(5, 0)]] StructuredBuffer<Material> dMaterials;
 
 // EMISSIVE TRIANGLES
-[[vk::binding(6, 0)]] Texture1D<float> dTrianglePower;
-[[vk::binding(7, 0)]] StructuredBuffer<TriangleMetadata> dTriangleMetadata;
-[[vk::binding(8, 0)]] StructuredBuffer<uint> dGeometryToTrianglePowerOffset;
-[[vk::binding(9, 0)]] StructuredBuffer<uint> dEmissiveTriangleCount;
+[[vk::binding(6, 0)]] StructuredBuffer<float> dTrianglePowers;
+[[vk::binding(7, 0)]] StructuredBuffer<float> dGeometryPowers;
+[[vk::binding(8, 0)]] StructuredBuffer<GeometryPowerInfo> dGeometryPowerInfos;
 
 // BACKGROUND
-[[vk::combinedImageSampler]] [[vk::binding(10, 0)]] Texture2D<float3> dBackgroundRgbTexture;
-[[vk::combinedImageSampler]] [[vk::binding(10, 0)]] SamplerState dBackgroundSampler;
-[[vk::binding(11, 0)]] Texture2D<float> dBackgroundLuminanceTexture;
+[[vk::combinedImageSampler]] [[vk::binding(9, 0)]] Texture2D<float3> dBackgroundRgbTexture;
+[[vk::combinedImageSampler]] [[vk::binding(9, 0)]] SamplerState dBackgroundSampler;
+[[vk::binding(10, 0)]] Texture2D<float> dBackgroundLuminanceTexture;
 
 // OUTPUT
-[[vk::binding(12, 0)]] RWTexture2D<float4> dOutputImage;
+[[vk::binding(11, 0)]] RWTexture2D<float4> dOutputImage;
+[[vk::binding(12, 0)]] RWTexture2D<float> dOutputMoments;
+
+// ADAPTIVE SAMPLING
+[[vk::binding(13, 0)]] StructuredBuffer<uint> dConvergedTiles;
+
+// LIGHT RESAMPLING
+[[vk::binding(14, 0)]] RWStructuredBuffer<LightReservoir> dLightReservoirs;
 
 // PUSH CONSTANTS
 struct PushConsts {
 	Camera camera;
 	uint sampleCount;
+	int2 regionOffset; // where the dispatch is within the image
+	uint2 imageSize;   // zero if the dispatch covers the whole image
 };
 [[vk::push_constant]] PushConsts pushConsts;
 
 template <class Integrator>
 void integrate(Integrator integrator) {
-    const uint2 imageCoords = DispatchRaysIndex().xy;
-    const uint2 imageSize = DispatchRaysDimensions().xy;
+    const uint2 sensorCoords = DispatchRaysIndex().xy;
+    uint2 sensorSize;
+    dOutputImage.GetDimensions(sensorSize.x, sensorSize.y);
+
+    if (isConverged(dConvergedTiles, sensorCoords, sensorSize)) return;
+
+    // the sensor may only capture a region of the whole image
+    const uint2 imageCoords = sensorCoords + pushConsts.regionOffset;
+    const uint2 imageSize = all(pushConsts.imageSize == 0) ? DispatchRaysDimensions().xy : pushConsts.imageSize;
 
     World world;
     world.instances = dInstances;
@@ -51,7 +67,7 @@ void integrate(Integrator integrator) {
     scene.tlas = dTLAS;
     scene.world = world;
     scene.envMap = EnvMap::create(dBackgroundRgbTexture, dBackgroundSampler, dBackgroundLuminanceTexture);
-    scene.meshLights = MeshLights::create(dTrianglePower, dTriangleMetadata, dGeometryToTrianglePowerOffset, dEmissiveTriangleCount[0], world);
+    scene.meshLights = MeshLights::create(dTrianglePowers, dGeometryPowers, dGeometryPowerInfos, world);
 
     Rng rng = Rng::fromSeed(uint3(pushConsts.sampleCount, imageCoords.x, imageCoords.y));
 
@@ -63,11 +79,10 @@ void integrate(Integrator integrator) {
 
     // trace the ray
     WavelengthSample w = WavelengthSample::sampleVisible(rng.getFloat());
-    const float newSample = integrator.incomingRadiance(scene, initialRay, w.λ, rng);
+    const float4 newSample = integrator.incomingRadiance(scene, initialRay, w.λ, rng);
 
     // accumulate
-    const float3 priorSampleAverage = pushConsts.sampleCount == 0 ? 0 : dOutputImage[imageCoords].xyz;
-    dOutputImage[imageCoords] = float4(accumulate(priorSampleAverage, Spectrum::toLinearSRGB(w.λ, newSample) / w.pdf, pushConsts.sampleCount), 1);
+    accumulateSample(dOutputImage, dOutputMoments, sensorCoords, Spectrum::toLinearSRGB(w.λ, newSample / w.pdf), pushConsts.sampleCount);
 }
 
 struct Attributes
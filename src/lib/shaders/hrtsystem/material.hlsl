@@ -1,7 +1,7 @@
 #pragma once
 
-[[vk::binding(0, 1)]] Texture2D dTextures[];
-[[vk::binding(1, 1)]] SamplerState dTextureSampler;
+[[vk::binding(0, 1)]] SamplerState dTextureSampler;
+[[vk::binding(1, 1)]] Texture2D dTextures[];
 
 #include "../utils/math.hlsl"
 #include "../utils/mappings.hlsl"
@@ -36,8 +36,12 @@ struct Material {
         return createTextureFrame(normalWorldSpace, tangentFrame);
     }
 
-    float getEmissive(float λ, float2 texcoords) {
-        return Spectrum::sampleEmission(λ, dTextures[NonUniformResourceIndex(emissive)].SampleLevel(dTextureSampler, texcoords, 0).rgb);
+    float3 getEmissiveRgb(float2 texcoords) {
+        return dTextures[NonUniformResourceIndex(emissive)].SampleLevel(dTextureSampler, texcoords, 0).rgb;
+    }
+
+    float4 getEmissive(float4 λ, float2 texcoords) {
+        return Spectrum::sampleEmission(λ, getEmissiveRgb(texcoords));
     }
 };
 
@@ -136,6 +140,11 @@ namespace Fresnel {
         return lerp(schlickWeight(cosTheta), 1, R0);
     }
 
+    float4 schlick(float cosTheta, float4 R0) {
+        const float4 weight = schlickWeight(cosTheta);
+        return lerp(weight, (float4) 1, R0);
+    }
+
     // boundary of two dielectric surfaces
     // PBRT version
     float dielectric(float cosThetaI, float ηi, float ηt) {
@@ -175,8 +184,9 @@ namespace Fresnel {
     }
 };
 
+// spectral quantities hold one value per hero wavelength, see WavelengthSample
 struct BSDFEvaluation {
-    float reflectance;
+    float4 reflectance;
     float pdf;
 
     static BSDFEvaluation empty() {
@@ -190,6 +200,7 @@ struct BSDFEvaluation {
 struct BSDFSample {
     float3 dirFs;
     BSDFEvaluation eval;
+    bool dispersed; // dirFs depends on the hero wavelength, so the others cannot follow it
 };
 
 interface BSDF {
@@ -199,15 +210,15 @@ interface BSDF {
 
 // evenly diffuse lambertian material
 struct Lambert : BSDF {
-    float reflectance; // fraction of light that is reflected
+    float4 reflectance; // fraction of light that is reflected
 
-    static Lambert create(float reflectance) {
+    static Lambert create(float4 reflectance) {
         Lambert lambert;
         lambert.reflectance = reflectance;
         return lambert;
     }
 
-    static Lambert load(const uint64_t addr, const float2 texcoords, float λ) {
+    static Lambert load(const uint64_t addr, const float2 texcoords, float4 λ) {
         uint colorTextureIndex = vk::RawBufferLoad<uint>(addr);
 
         Lambert material;
@@ -241,6 +252,7 @@ struct Lambert : BSDF {
         BSDFSample sample;
         sample.dirFs = w_i;
         sample.eval = evaluateShort(w_i, w_o);
+        sample.dispersed = false;
         return sample;
     }
 
@@ -254,12 +266,12 @@ struct Lambert : BSDF {
 struct StandardPBR : BSDF {
     GGX distr;      // microfacet distribution used by this material
 
-    float reflectance; // reflectance - everywhere within [0, 1]
+    float4 reflectance; // reflectance - everywhere within [0, 1]
     float metalness; // metalness - k_s - part it is specular. diffuse is (1 - specular); [0, 1]
     float ior; // ior - internal index of refraction; [0, inf)pSpecularSample
     float pSpecularSample;
 
-    static StandardPBR load(const uint64_t addr, const float2 texcoords, const float λ) {
+    static StandardPBR load(const uint64_t addr, const float2 texcoords, const float4 λ) {
         uint colorTextureIndex = vk::RawBufferLoad<uint>(addr);
         uint metalnessTextureIndex = vk::RawBufferLoad<uint>(addr + sizeof(uint) * 1);
         uint roughnessTextureIndex = vk::RawBufferLoad<uint>(addr + sizeof(uint) * 2);
@@ -298,13 +310,15 @@ struct StandardPBR : BSDF {
         sample.eval = evaluate(sample.dirFs, w_o);
         // ideally we would never sample something with a zero pdf...
         // not sure if there's a bug here currently or if this is to be expected
-        sample.eval.reflectance = sample.eval.pdf > 0 ? sample.eval.reflectance / sample.eval.pdf : 0;
+        if (sample.eval.pdf > 0) sample.eval.reflectance /= sample.eval.pdf;
+        else sample.eval.reflectance = 0;
+        sample.dispersed = false;
         return sample;
     }
 
     BSDFEvaluation evaluate(float3 w_i, float3 w_o) {
         BSDFEvaluation diffuseEvaluation = Lambert::create(reflectance).evaluate(w_i, w_o);
-        float diffuse = diffuseEvaluation.reflectance;
+        float4 diffuse = diffuseEvaluation.reflectance;
 
         BSDFEvaluation eval;
         eval.reflectance = (1.0 - metalness) * diffuse;
@@ -319,7 +333,8 @@ struct StandardPBR : BSDF {
             float dot_w_i_h = dot(w_i, h);
             float fDielectric = Fresnel::dielectric(dot_w_i_h, AIR_IOR, ior);
 
-            float F = metalness > NEARzero ? lerp(fDielectric, Fresnel::schlick(dot_w_i_h, reflectance), metalness) : fDielectric;
+            float4 F = fDielectric;
+            if (metalness > NEARzero) F = lerp(F, Fresnel::schlick(dot_w_i_h, reflectance), metalness);
             float G = distr.G(w_i, w_o);
             float D = distr.D(h);
             eval.reflectance += (F * G * D) / (4 * abs(Frame::cosTheta(w_o)));
@@ -338,6 +353,7 @@ struct PerfectMirror : BSDF {
         sample.dirFs = float3(-w_o.xy, w_o.z);
         sample.eval.reflectance = 1;
         sample.eval.pdf = 1.#INF;
+        sample.dispersed = false;
         return sample;
     }
 
@@ -361,14 +377,18 @@ float cauchyIOR(const float a, const float b, const float λ) {
     return a + b / (λ * λ);
 }
 
+// the IOR is that of the hero wavelength, so refraction is only
+// exact for it unless the glass is not dispersive at all
 struct Glass : BSDF {
     float intIOR;
+    bool dispersive;
 
-    static Glass load(const uint64_t addr, const float λ) {
+    static Glass load(const uint64_t addr, const float4 λ) {
         Glass material;
         const float a = vk::RawBufferLoad<float>(addr);
         const float b = vk::RawBufferLoad<float>(addr + sizeof(float));
-        material.intIOR = cauchyIOR(a, b, λ);
+        material.intIOR = cauchyIOR(a, b, λ.x);
+        material.dispersive = b != 0;
         return material;
     }
 
@@ -397,6 +417,7 @@ struct Glass : BSDF {
         } else {
             sample.eval = BSDFEvaluation::empty();
         }
+        sample.dispersed = dispersive;
         return sample;
     }
 
@@ -413,9 +434,9 @@ struct PolymorphicBSDF : BSDF {
     BSDFType type;
     uint64_t addr;
     float2 texcoords;
-    float λ;
+    float4 λ;
 
-    static PolymorphicBSDF load(Material material, float2 texcoords, float λ) {
+    static PolymorphicBSDF load(Material material, float2 texcoords, float4 λ) {
         PolymorphicBSDF bsdf;
         bsdf.type = material.type;
         bsdf.addr = material.addr;
@@ -1,50 +1,24 @@
 #include "../../utils/helpers.hlsl"
-#include "../world.hlsl"
 
-[[vk::binding(0, 0)]] Texture1D<float> srcMip;
-[[vk::binding(1, 0)]] RWTexture1D<float> dstMip;
-[[vk::binding(2, 0)]] StructuredBuffer<Instance> instances;
-[[vk::binding(3, 0)]] RWStructuredBuffer<uint> dGeometryToTrianglePowerOffset;
-[[vk::binding(4, 0)]] RWStructuredBuffer<uint> emissiveTriangleCount;
+[[vk::binding(0, 0)]] RWStructuredBuffer<float> dPowers;
 
+// one level of a power tree, the next one is built right after it
 struct PushConsts {
-	uint instanceIndex;
-	uint geometryIndex;
-	uint triangleCount;
+	uint srcOffset;
+	uint srcSize;
 };
 [[vk::push_constant]] PushConsts pushConsts;
 
 [numthreads(32, 1, 1)]
 void main(uint3 dispatchXYZ: SV_DispatchThreadID) {
-	#define dstIndex		(dispatchXYZ.x)
-	#define dstImageSize	(textureDimensions(dstMip))
+	#define dstIndex	(dispatchXYZ.x)
 
-	if (any(dstIndex >= dstImageSize)) return;
-	const uint dstIndex2 = dstIndex + dstIndex;
+	const uint dstSize = (pushConsts.srcSize + 1) / 2;
+	if (dstIndex >= dstSize) return;
 
-	if (dstImageSize == 1) {
-		const float newSum = srcMip[dstIndex2] + srcMip[dstIndex2 + 1];
-		const float oldSum = dstMip[dstIndex];
-		// if this conditional fails it means this mesh is not actually emissive at all
-		// in this case, not adding it to our sum will effectively cull it
-		if (newSum != oldSum) {
-			const uint flatGeometryIndex = instances[pushConsts.instanceIndex].instanceCustomIndex + pushConsts.geometryIndex;
-			const uint existingOffset = dGeometryToTrianglePowerOffset[flatGeometryIndex];
-
-			// only update offset and emissive triangle count if this geometry is not already tracked for emissive light
-			const uint invalidOffset = 0xFFFFFFFF;
-			if (existingOffset == invalidOffset) {
-				// TODO: emissiveTriangleCount has a relatively small (32k maximum), which will probably only show up as a crash.
-				// need to make maximum higher so this isn't a feasible problem.
-				dGeometryToTrianglePowerOffset[flatGeometryIndex] = emissiveTriangleCount[0];
-				emissiveTriangleCount[0] += pushConsts.triangleCount;
-			}
-		}
-	}
-
-	dstMip[dstIndex] = srcMip[dstIndex2]
-	                 + srcMip[dstIndex2 + 1];
+	const uint srcIndex = pushConsts.srcOffset + dstIndex + dstIndex;
+	const float right = dstIndex + dstIndex + 1 < pushConsts.srcSize ? dPowers[srcIndex + 1] : 0.0;
+	dPowers[pushConsts.srcOffset + pushConsts.srcSize + dstIndex] = dPowers[srcIndex] + right;
 
 	#undef dstIndex
-	#undef dstImageSize
-}
\ No newline at end of file
+}
@@ -0,0 +1,26 @@
+#include "../../utils/math.hlsl"
+#include "../light.hlsl"
+
+[[vk::binding(0, 0)]] StructuredBuffer<float> dTrianglePowers;
+[[vk::binding(1, 0)]] StructuredBuffer<GeometryPowerInfo> dGeometryPowerInfos;
+[[vk::binding(2, 0)]] RWStructuredBuffer<float> dGeometryPowers;
+
+// sets every leaf of the geometry power tree to the root of the triangle power tree
+// of its geometry scaled to world space, or to zero if it has none
+// the levels above are folded afterwards
+struct PushConsts {
+	uint geometryCount; // leaves in the geometry power tree
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+[numthreads(32, 1, 1)]
+void main(uint3 dispatchXYZ: SV_DispatchThreadID) {
+	#define geometryIndex	(dispatchXYZ.x)
+
+	if (geometryIndex >= pushConsts.geometryCount) return;
+
+	const GeometryPowerInfo info = dGeometryPowerInfos[geometryIndex];
+	dGeometryPowers[geometryIndex] = info.triangleOffset != MAX_UINT ? dTrianglePowers[PowerTree::root(info.triangleOffset, info.triangleCount)] * info.powerScale : 0.0;
+
+	#undef geometryIndex
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../utils/random.hlsl"
+#include "intersection.hlsl"
+#include "material.hlsl"
+
+// shader execution reordering, via SPV_NV_shader_invocation_reorder
+//
+// the instruction requires a capability that devices without it refuse
+// to load, so it is only compiled in with REORDER_THREADS defined and
+// reorderThread is a no-op otherwise
+
+#ifdef REORDER_THREADS
+[[vk::ext_extension("SPV_NV_shader_invocation_reorder")]]
+[[vk::ext_capability(5383)]] // ShaderInvocationReorderNV
+[[vk::ext_instruction(5280)]] // OpReorderThreadWithHintNV
+void spvReorderThreadWithHint(uint hint, uint bits);
+#endif
+
+static const uint reorderHintBits = 10;
+
+// sorts by BSDF type first, then by material and lastly by instance,
+// so threads that end up next to each other load and evaluate similar things
+uint reorderHint(const Intersection its, const Material material) {
+    const uint materialHash = Hash::xxhash32(uint3(uint(material.addr), uint(material.addr >> 32), material.emissive)) & 0xF;
+    return (uint(material.type) << 8) | (materialHash << 4) | (its.instanceIndex & 0xF);
+}
+
+void reorderThread(const Intersection its, const Material material) {
+#ifdef REORDER_THREADS
+    spvReorderThreadWithHint(reorderHint(its, material), reorderHintBits);
+#endif
+}
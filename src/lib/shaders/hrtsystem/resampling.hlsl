@@ -0,0 +1,312 @@
+#pragma once
+
+#include "../utils/math.hlsl"
+#include "../utils/mappings.hlsl"
+#include "../utils/random.hlsl"
+#include "../utils/reservoir.hlsl"
+#include "intersection.hlsl"
+#include "reflection_frame.hlsl"
+#include "material.hlsl"
+#include "world.hlsl"
+#include "light.hlsl"
+#include "scene.hlsl"
+#include "shading.hlsl"
+#include "spectrum.hlsl"
+
+// resampled importance sampling of direct light, in the manner of ReSTIR
+//
+// many cheap candidates from the env map and emissive meshes are streamed
+// through a reservoir with their unshadowed contribution as target, and only
+// the selected one is tested for visibility
+//
+// reservoirs of primary hits may be kept per pixel, so that later samples reuse
+// those of the same pixel (temporal) and nearby ones (spatial). reused contribution
+// weights are moved to the solid angle of the shading point reusing them, but
+// reservoirs are still weighed by their sample count without checking that every
+// one of them could have produced the light, so reuse is biased, which is fine for
+// the viewport it is meant for
+
+// a light sample that may be evaluated from any shading point at any wavelengths
+struct LightCandidate {
+    float3 position; // on the light, far away for the env map
+    float3 emission; // rgb
+    float3 normal;   // of the light surface, zero for the env map
+
+    float4 radiance(const float4 λ) {
+        return Spectrum::sampleEmission(λ, emission);
+    }
+
+    // how much larger the solid angle of a patch of light around this is at `to` than at `from`,
+    // which turns a contribution weight resampled at `from` into one for `to`
+    // one for the env map, which is equally far from everywhere
+    float jacobian(const float3 from, const float3 to) {
+        if (all(normal == 0)) return 1;
+        const float3 fromConnection = position - from;
+        const float3 toConnection = position - to;
+        const float fromDistanceSquared = dot(fromConnection, fromConnection);
+        const float toDistanceSquared = dot(toConnection, toConnection);
+        const float fromCos = abs(dot(normal, fromConnection)) * rsqrt(fromDistanceSquared);
+        const float toCos = abs(dot(normal, toConnection)) * rsqrt(toDistanceSquared);
+        if (fromCos * toDistanceSquared < NEARzero) return 0;
+        return (toCos * fromDistanceSquared) / (fromCos * toDistanceSquared);
+    }
+};
+
+struct ShadingPoint {
+    Frame frame;
+    float3 position;
+    float3 triangleNormal;
+    float spawnOffset;
+    float3 outgoingDirFs;
+
+    static ShadingPoint create(const SurfacePoint surface, const Frame frame, const float3 outgoingDirFs) {
+        ShadingPoint p;
+        p.frame = frame;
+        p.position = surface.position;
+        p.triangleNormal = surface.triangleFrame.n;
+        p.spawnOffset = surface.spawnOffset;
+        p.outgoingDirFs = outgoingDirFs;
+        return p;
+    }
+};
+
+// packed light normal of the env map, halves that are both NaN, which no coordinates are
+static const uint noLightNormal = 0xFFFFFFFF;
+
+// per pixel state kept between samples, packed to keep the sensor small
+// must be kept in sync with LightReservoir in Sensor.zig
+struct LightReservoir {
+    float3 lightPosition;
+    uint2 lightEmission;      // rgb as halves
+    float contributionWeight; // W, estimate is unshadowed contribution of the light times this
+    uint sampleCount;         // M, how many candidates this reservoir stands for
+    float3 shadingPosition;   // where this was resampled, to check neighbours are similar enough to reuse, and for the jacobian
+    uint shadingNormal;       // equal area sphere coordinates as halves
+    uint lightNormal;         // equal area sphere coordinates as halves, noLightNormal for the env map
+
+    static LightReservoir empty() {
+        LightReservoir r;
+        r.lightPosition = 0;
+        r.lightEmission = 0;
+        r.contributionWeight = 0;
+        r.sampleCount = 0;
+        r.shadingPosition = 0;
+        r.shadingNormal = 0;
+        r.lightNormal = noLightNormal;
+        return r;
+    }
+
+    LightCandidate candidate() {
+        LightCandidate c;
+        c.position = lightPosition;
+        c.emission = float3(f16tof32(lightEmission.x), f16tof32(lightEmission.x >> 16), f16tof32(lightEmission.y));
+        c.normal = lightNormal == noLightNormal ? 0 : squareToEqualAreaSphere(float2(f16tof32(lightNormal), f16tof32(lightNormal >> 16)));
+        return c;
+    }
+
+    float3 normal() {
+        return squareToEqualAreaSphere(float2(f16tof32(shadingNormal), f16tof32(shadingNormal >> 16)));
+    }
+
+    bool valid() {
+        return sampleCount > 0;
+    }
+
+    // whether this may be reused at `p`, `cameraPosition` scaling how far apart they may be
+    bool similar(const ShadingPoint p, const float3 cameraPosition) {
+        return dot(normal(), p.triangleNormal) > 0.9 && length(shadingPosition - p.position) < 0.05 * length(p.position - cameraPosition);
+    }
+
+    static LightReservoir create(const LightCandidate c, const float contributionWeight, const uint sampleCount, const ShadingPoint p) {
+        LightReservoir r;
+        r.lightPosition = c.position;
+        r.lightEmission = uint2(f32tof16(c.emission.r) | (f32tof16(c.emission.g) << 16), f32tof16(c.emission.b));
+        r.contributionWeight = contributionWeight;
+        r.sampleCount = sampleCount;
+        r.shadingPosition = p.position;
+        const float2 uv = squareToEqualAreaSphereInverse(p.triangleNormal);
+        r.shadingNormal = f32tof16(uv.x) | (f32tof16(uv.y) << 16);
+        if (all(c.normal == 0)) {
+            r.lightNormal = noLightNormal;
+        } else {
+            const float2 lightUv = squareToEqualAreaSphereInverse(c.normal);
+            r.lightNormal = f32tof16(lightUv.x) | (f32tof16(lightUv.y) << 16);
+        }
+        return r;
+    }
+};
+
+// unshadowed contribution of `c` at `p`, along with the scalar target used to resample it
+template <class BSDF>
+float targetFunction(const ShadingPoint p, BSDF bsdf, const float4 λ, const LightCandidate c, out float4 contribution) {
+    const float3 lightDirWs = normalize(c.position - p.position);
+    const BSDFEvaluation eval = bsdf.evaluate(p.frame.worldToFrame(lightDirWs), p.outgoingDirFs);
+    contribution = eval.reflectance * c.radiance(λ);
+    return dot(contribution, float4(0.25, 0.25, 0.25, 0.25));
+}
+
+template <class BSDF>
+float targetFunction(const ShadingPoint p, BSDF bsdf, const float4 λ, const LightCandidate c) {
+    float4 contribution;
+    return targetFunction(p, bsdf, λ, c, contribution);
+}
+
+// turns a reservoir that has seen `sampleCount` candidates into one that can be shaded or reused
+template <class BSDF>
+LightReservoir finalizeReservoir(const Reservoir<LightCandidate> r, const uint sampleCount, const ShadingPoint p, BSDF bsdf, const float4 λ) {
+    if (!r.valid()) return LightReservoir::create(r.selected, 0, sampleCount, p);
+    const float target = targetFunction(p, bsdf, λ, r.selected);
+    return LightReservoir::create(r.selected, target > NEARzero ? r.weightSum / (sampleCount * target) : 0, sampleCount, p);
+}
+
+// streams `candidateCount` light samples, each from the env map with probability `envProbability`
+// and from emissive meshes otherwise
+template <class BSDF>
+LightReservoir resampleLights(const Scene scene, const ShadingPoint p, BSDF bsdf, const float4 λ, const uint candidateCount, const float envProbability, inout Rng rng) {
+    Reservoir<LightCandidate> r = Reservoir<LightCandidate>::empty();
+    r.selected.position = 0;
+    r.selected.emission = 0;
+    r.selected.normal = 0;
+
+    for (uint i = 0; i < candidateCount; i++) {
+        const bool fromEnv = rng.getFloat() < envProbability;
+        const float2 rand = rng.getFloat2();
+        LightSample lightSample;
+        if (fromEnv) lightSample = scene.envMap.sample(λ, p.position, rand);
+        else lightSample = scene.meshLights.sample(λ, p.position, rand);
+
+        if (any(lightSample.eval.radiance > NEARzero)) {
+            LightCandidate c;
+            c.position = p.position + lightSample.connection;
+            c.emission = lightSample.emission;
+            c.normal = lightSample.normal;
+
+            // sampled radiance is already divided by the pdf of its light, so this is target over source pdf
+            const BSDFEvaluation eval = bsdf.evaluate(p.frame.worldToFrame(normalize(lightSample.connection)), p.outgoingDirFs);
+            const float weight = dot(eval.reflectance * lightSample.eval.radiance, float4(0.25, 0.25, 0.25, 0.25)) / (fromEnv ? envProbability : 1 - envProbability);
+            if (weight > 0) {
+                float selectRand = rng.getFloat();
+                r.update(c, weight, selectRand);
+            }
+        }
+    }
+
+    return finalizeReservoir(r, candidateCount, p, bsdf, λ);
+}
+
+// adds `other`, resampled at some other shading point, to the reservoir being merged at `p`
+// its contribution weight is in the solid angle measure of where it was resampled, so is moved to that of `p`
+template <class BSDF>
+void mergeReservoir(inout Reservoir<LightCandidate> merged, inout uint mergedCount, const LightReservoir other, const uint maxSampleCount, const ShadingPoint p, BSDF bsdf, const float4 λ, inout Rng rng) {
+    if (!other.valid()) return;
+    const uint sampleCount = min(other.sampleCount, maxSampleCount);
+    const LightCandidate c = other.candidate();
+    const float weight = targetFunction(p, bsdf, λ, c) * other.contributionWeight * c.jacobian(other.shadingPosition, p.position) * sampleCount;
+    if (weight > 0) {
+        float rand = rng.getFloat();
+        merged.update(c, weight, rand);
+    }
+    mergedCount += sampleCount;
+}
+
+// the shadow ray that tests the light selected by `r`, itself weighted by the reservoir
+template <class BSDF>
+ShadowRay reservoirShadowRay(const LightReservoir r, const ShadingPoint p, BSDF bsdf, const float4 λ) {
+    ShadowRay ray = ShadowRay::none();
+    if (r.contributionWeight <= 0) return ray;
+
+    const LightCandidate c = r.candidate();
+    float4 contribution;
+    targetFunction(p, bsdf, λ, c, contribution);
+    if (any(contribution > NEARzero)) {
+        const float3 dir = faceForward(p.triangleNormal, c.position - p.position) * p.spawnOffset;
+        ray.origin = p.position + dir;
+        ray.connection = c.position - ray.origin;
+        ray.contribution = contribution * r.contributionWeight;
+    }
+    return ray;
+}
+
+// direct lighting of the PathTracingIntegrator by resampling rather than independent light samples
+struct LightResampling {
+    uint candidateCount; // zero if not resampling
+    bool temporalReuse;
+    uint spatialNeighbours;
+    RWStructuredBuffer<LightReservoir> reservoirs; // two per pixel, the last sample's and the current one's
+    uint sampleCount;
+
+    static LightResampling create(uint candidateCount, bool temporalReuse, uint spatialNeighbours, RWStructuredBuffer<LightReservoir> reservoirs, uint sampleCount) {
+        LightResampling resampling;
+        resampling.candidateCount = candidateCount;
+        resampling.temporalReuse = temporalReuse;
+        resampling.spatialNeighbours = spatialNeighbours;
+        resampling.reservoirs = reservoirs;
+        resampling.sampleCount = sampleCount;
+        return resampling;
+    }
+
+    bool enabled() {
+        return candidateCount > 0;
+    }
+
+    bool reuses() {
+        return temporalReuse || spatialNeighbours > 0;
+    }
+
+    // reservoirs of even and odd samples alternate halves, so that
+    // neighbours are only ever read from the last sample
+    uint reservoirIndex(uint2 pixel, uint sample) {
+        const uint2 size = DispatchRaysDimensions().xy;
+        return (sample & 1) * size.x * size.y + pixel.y * size.x + pixel.x;
+    }
+
+    // resampled light is the only light non-delta bounces get, as there
+    // is no pdf of it to weigh the BSDF sampled light against
+    float emissionWeight(const float bsdfPdf) {
+        return bsdfPdf == 1.#INF ? 1 : 0;
+    }
+
+    float4 estimate(const Scene scene, const ShadingPoint p, const PolymorphicBSDF bsdf, const float4 λ, const float envProbability, const bool primary, const float3 cameraPosition, inout Rng rng) {
+        LightReservoir r = resampleLights(scene, p, bsdf, λ, candidateCount, envProbability, rng);
+
+        const bool reuse = primary && reuses();
+        if (reuse && sampleCount > 0) {
+            // older reservoirs may not be trusted more than a few times what we just sampled
+            const uint maxSampleCount = 20 * candidateCount;
+            const uint2 pixel = DispatchRaysIndex().xy;
+            const int2 size = int2(DispatchRaysDimensions().xy);
+
+            Reservoir<LightCandidate> merged = Reservoir<LightCandidate>::empty();
+            merged.selected = r.candidate();
+            uint mergedCount = 0;
+            mergeReservoir(merged, mergedCount, r, r.sampleCount, p, bsdf, λ, rng);
+
+            if (temporalReuse) {
+                const LightReservoir previous = reservoirs[reservoirIndex(pixel, sampleCount - 1)];
+                if (previous.similar(p, cameraPosition)) mergeReservoir(merged, mergedCount, previous, maxSampleCount, p, bsdf, λ, rng);
+            }
+
+            for (uint i = 0; i < spatialNeighbours; i++) {
+                const float2 offset = squareToUniformDiskConcentric(rng.getFloat2()) * 16;
+                const int2 neighbour = int2(pixel) + int2(offset);
+                if (any(neighbour < 0) || any(neighbour >= size) || all(neighbour == int2(pixel))) continue;
+                const LightReservoir other = reservoirs[reservoirIndex(uint2(neighbour), sampleCount - 1)];
+                if (other.similar(p, cameraPosition)) mergeReservoir(merged, mergedCount, other, maxSampleCount, p, bsdf, λ, rng);
+            }
+
+            r = finalizeReservoir(merged, mergedCount, p, bsdf, λ);
+        }
+
+        const ShadowRay ray = reservoirShadowRay(r, p, bsdf, λ);
+        const bool visible = any(ray.contribution > 0) && !ShadowIntersection::hit(scene.tlas, ray.origin, ray.connection);
+
+        if (reuse) {
+            // occluded lights are not worth passing on
+            if (!visible) r.contributionWeight = 0;
+            reservoirs[reservoirIndex(DispatchRaysIndex().xy, sampleCount)] = r;
+        }
+
+        if (!visible) return 0;
+        return ray.contribution;
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../utils/math.hlsl"
+#include "reflection_frame.hlsl"
+#include "material.hlsl"
+#include "world.hlsl"
+#include "light.hlsl"
+
+// shading logic that does not trace any rays itself,
+// shared between the megakernel integrators and the wavefront stages
+
+// with
+//   power == 1 this becomes balance heuristic
+//   power == 0 this becomes uniform weighting
+float powerHeuristic2(const uint fCount, const float fPdf2, const uint gCount, const float gPdf) {
+    return fPdf2 / (fCount * fPdf2 + gCount * pow2(gPdf));
+}
+
+float misWeight(const uint fCount, const float fPdf, const uint gCount, const float gPdf) {
+    if (fPdf == 1.#INF) return 1.0 / fCount; // delta distribution for f, g not relevant
+    return powerHeuristic2(fCount, pow2(fPdf), gCount, gPdf);
+}
+
+// a connection to a light sample along with what it contributes if unoccluded
+struct ShadowRay {
+    float3 origin;
+    float3 connection;
+    float4 contribution; // zero if there is nothing to trace
+
+    static ShadowRay none() {
+        ShadowRay ray;
+        ray.origin = 0;
+        ray.connection = 0;
+        ray.contribution = 0;
+        return ray;
+    }
+};
+
+// samples direct lighting from light + brdf via MIS
+// only samples light, the visibility test of the returned ray is up to the caller
+template <class Light, class BSDF>
+ShadowRay sampleDirectMISLight(Frame frame, Light light, BSDF material, float3 outgoingDirFs, float4 λ, float3 positionWs, float3 triangleNormalDirWs, float spawnOffset, float2 rand, uint lightSamplesTaken, uint brdfSamplesTaken) {
+    ShadowRay ray = ShadowRay::none();
+
+    const LightSample lightSample = light.sample(λ, positionWs, rand);
+
+    if (any(lightSample.eval.radiance > NEARzero)) {
+        const float3 lightDirWs = normalize(lightSample.connection);
+        const BSDFEvaluation bsdfEval = material.evaluate(frame.worldToFrame(lightDirWs), outgoingDirFs);
+        if (any(bsdfEval.reflectance > NEARzero)) {
+            float3 dir = faceForward(triangleNormalDirWs, lightDirWs) * spawnOffset;
+            ray.origin = positionWs + dir;
+            ray.connection = lightSample.connection - dir;
+            ray.contribution = lightSample.eval.radiance * bsdfEval.reflectance * misWeight(lightSamplesTaken, lightSample.eval.pdf, brdfSamplesTaken, bsdfEval.pdf);
+        }
+    }
+
+    return ray;
+}
+
+// selects a shading normal based on the most preferred normal that is plausible
+Frame selectFrame(const SurfacePoint surface, const Material material, const float3 outgoingDirWs) {
+    const Frame textureFrame = material.getTextureFrame(surface.texcoord, surface.frame);
+    Frame shadingFrame;
+    int sign0 = sign(dot(surface.triangleFrame.n, outgoingDirWs));
+    if (sign0 == sign(dot(outgoingDirWs, textureFrame.n))) {
+        // prefer texture normal if we can
+        shadingFrame = textureFrame;
+    } else if (sign0 == sign(dot(outgoingDirWs, surface.frame.n))) {
+        // if texture normal not valid, try shading normal
+        shadingFrame = surface.frame;
+    } else {
+        // otherwise fall back to triangle normal
+        shadingFrame = surface.triangleFrame;
+    }
+
+    return shadingFrame;
+}
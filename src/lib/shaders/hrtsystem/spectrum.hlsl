@@ -35,6 +35,12 @@ namespace Spectrum {
         return dot(rgb, reflectance);
     }
 
+    float4 sampleReflectance(const float4 λ, const float3 reflectance) {
+        float4 s;
+        for (uint i = 0; i < 4; i++) s[i] = sampleReflectance(λ[i], reflectance);
+        return s;
+    }
+
     // a somewhat roundabout way of doing this but I believe it's correct
     float sampleEmission(const float λ, const float3 emission) {
         const float sampledReflectance = sampleReflectance(λ, emission);
@@ -42,6 +48,12 @@ namespace Spectrum {
         return sampledReflectance * sampledD65;
     }
 
+    float4 sampleEmission(const float4 λ, const float3 emission) {
+        float4 s;
+        for (uint i = 0; i < 4; i++) s[i] = sampleEmission(λ[i], emission);
+        return s;
+    }
+
     float3 toXYZ(const float λ, const float s) {
         const float λdelta = (λ - 360) * XYZdelta_;
         const float3 rgb = float3(
@@ -57,23 +69,45 @@ namespace Spectrum {
         const float3x3 XYZtoLinearSRGB = { 0.03276749869518854, -0.015543557073358668, -0.00504115364541362, -0.009800789737065342, 0.018969392573362078, 0.00042019608374440075, 0.0005626856849785213, -0.0020631808449212427, 0.010691028014591895 };
         return mul(XYZtoLinearSRGB, xyz);
     }
+
+    // estimate from a hero wavelength sample, `s` must already be divided by the pdf of each wavelength
+    float3 toLinearSRGB(const float4 λ, const float4 s) {
+        float3 rgb = 0;
+        for (uint i = 0; i < 4; i++) rgb += toLinearSRGB(λ[i], s[i]);
+        return rgb / 4;
+    }
+
+    // keeps only the hero wavelength of `s`, for when a path stops being valid for the others,
+    // scaled so that the hero alone carries the whole estimate of the toLinearSRGB above
+    float4 heroOnly(const float4 s) {
+        return float4(s.x * 4, 0, 0, 0);
+    }
 };
 
+// hero wavelength sampling
+//
+// the hero wavelength comes from `rand`, the other three are placed at
+// equal offsets from it in sample space so that together they stratify the
+// distribution, each on its own still being distributed according to it
 struct WavelengthSample {
-    float λ;
-    float pdf;
+    float4 λ;
+    float4 pdf;
 
     static WavelengthSample sampleUniform(const float start, const float end, const float rand) {
         WavelengthSample s;
-        s.λ = lerp(start, end, rand);
-        s.pdf = 1 / (end - start);
+        for (uint i = 0; i < 4; i++) {
+            s.λ[i] = lerp(start, end, frac(rand + i * 0.25));
+            s.pdf[i] = 1 / (end - start);
+        }
         return s;
     }
 
     static WavelengthSample sampleVisible(const float rand) {
         WavelengthSample s;
-        s.λ = 538 - 138.888889f * atanh(0.85691062f - 1.82750197f * rand);
-        s.pdf = 0.0039398042f / pow2(cosh(0.0072f * (s.λ - 538)));
+        for (uint i = 0; i < 4; i++) {
+            s.λ[i] = 538 - 138.888889f * atanh(0.85691062f - 1.82750197f * frac(rand + i * 0.25));
+            s.pdf[i] = 0.0039398042f / pow2(cosh(0.0072f * (s.λ[i] - 538)));
+        }
         return s;
     }
 };
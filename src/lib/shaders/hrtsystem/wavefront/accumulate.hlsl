@@ -0,0 +1,22 @@
+#include "shared.hlsl"
+
+// adds the radiance gathered by the path of each pixel to the output image
+
+struct PushConsts {
+	uint sampleCount;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchXYZ: SV_DispatchThreadID) {
+    const uint2 imageCoords = dispatchXYZ.xy;
+    uint2 imageSize;
+    dOutputImage.GetDimensions(imageSize.x, imageSize.y);
+
+    if (any(imageCoords >= imageSize) || isConverged(dConvergedTiles, imageCoords, imageSize)) return;
+
+    const PathState path = dPaths[imageCoords.y * imageSize.x + imageCoords.x];
+    const float3 newSample = Spectrum::toLinearSRGB(path.λ, path.radiance / path.λPdf);
+
+    accumulateSample(dOutputImage, dOutputMoments, imageCoords, newSample, pushConsts.sampleCount);
+}
@@ -0,0 +1,48 @@
+#include "../camera.hlsl"
+#include "shared.hlsl"
+
+// starts a new path for every pixel and queues all of them to be extended
+
+struct PushConsts {
+	Camera camera;
+	uint sampleCount;
+	int2 regionOffset; // where the dispatch is within the image
+	uint2 imageSize;   // zero if the sensor covers the whole image
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchXYZ: SV_DispatchThreadID) {
+    const uint2 sensorCoords = dispatchXYZ.xy;
+    uint2 sensorSize;
+    dOutputImage.GetDimensions(sensorSize.x, sensorSize.y);
+
+    if (any(sensorCoords >= sensorSize) || isConverged(dConvergedTiles, sensorCoords, sensorSize)) return;
+
+    // the sensor may only capture a region of the whole image
+    const uint2 imageCoords = sensorCoords + pushConsts.regionOffset;
+    const uint2 imageSize = all(pushConsts.imageSize == 0) ? sensorSize : pushConsts.imageSize;
+
+    Rng rng = Rng::fromSeed(uint3(pushConsts.sampleCount, imageCoords.x, imageCoords.y));
+
+    // set up initial ray, same as the megakernel integrators
+    const float2 jitter = rng.getFloat2();
+    const float2 imageUV = (imageCoords + jitter) / imageSize;
+    const float aspect = float(imageSize.x) / float(imageSize.y);
+    const Ray initialRay = pushConsts.camera.generateRay(aspect, imageUV, rng.getFloat2());
+    const WavelengthSample w = WavelengthSample::sampleVisible(rng.getFloat());
+
+    PathState path;
+    path.ray = initialRay;
+    path.throughput = 1;
+    path.radiance = 0;
+    path.λ = w.λ;
+    path.λPdf = w.pdf;
+    path.bounceCount = 0;
+    path.heroOnly = 0;
+    path.rngState = rng.state;
+
+    const uint pathIndex = sensorCoords.y * sensorSize.x + sensorCoords.x;
+    dPaths[pathIndex] = path;
+    pushRayQueue(0, pathIndex);
+}
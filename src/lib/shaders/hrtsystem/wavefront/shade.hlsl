@@ -0,0 +1,98 @@
+#include "shared.hlsl"
+
+// shades the paths in the queue of a single BSDFType
+//
+// takes light samples for the shadow stage to test and samples
+// the next direction for the extend stage to trace
+
+struct PushConsts {
+	uint bsdfType;
+	uint nextRayQueue; // which of the ray queues surviving paths should be pushed to
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+[numthreads(shadeGroupSize, 1, 1)]
+void main(uint3 dispatchXYZ: SV_DispatchThreadID) {
+    const BSDFType type = (BSDFType) pushConsts.bsdfType;
+    if (dispatchXYZ.x >= dCounters[Counters::shadeQueueLength(type)]) return;
+
+    const uint pathIndex = dShadeQueues[uint(type) * pathCapacity() + dispatchXYZ.x];
+    PathState path = dPaths[pathIndex];
+    const Hit hit = dHits[pathIndex];
+    const Scene scene = loadScene();
+
+    Rng rng;
+    rng.state = path.rngState;
+
+    // decode mesh attributes and material from intersection
+    const SurfacePoint surface = scene.world.surfacePoint(hit.instanceIndex, hit.geometryIndex, hit.primitiveIndex, hit.barycentrics);
+    const Material material = scene.world.material(hit.instanceIndex, hit.geometryIndex);
+
+    // collect light from emissive meshes
+    if (dMeshSamplesPerBounce > 0) {
+        const float lightPdf = areaMeasureToSolidAngleMeasure(surface.position, path.ray.origin, path.ray.direction, surface.triangleFrame.n) * scene.meshLights.areaPdf(hit.instanceIndex, hit.geometryIndex, hit.primitiveIndex);
+        const float weight = misWeight(1, path.ray.pdf, dMeshSamplesPerBounce, lightPdf);
+        path.radiance += path.throughput * material.getEmissive(path.λ, surface.texcoord) * weight;
+    } else path.radiance += path.throughput * material.getEmissive(path.λ, surface.texcoord);
+
+    bool terminated = path.bounceCount > dMaxBounces;
+
+    // possibly terminate if lose at russian roulette
+    // same order as the megakernel, see PathTracingIntegrator
+    if (!terminated && path.bounceCount > 3) {
+        const float pSurvive = min(0.95, maxComponent(path.throughput));
+        if (rng.getFloat() > pSurvive) terminated = true;
+        else path.throughput /= pSurvive;
+    }
+
+    if (!terminated) {
+        // every invocation of this dispatch has the same type, so the
+        // dispatch within the polymorphic BSDF does not diverge
+        const PolymorphicBSDF bsdf = PolymorphicBSDF::load(material, surface.texcoord, path.λ);
+
+        const float3 outgoingDirWs = -path.ray.direction;
+        const Frame shadingFrame = selectFrame(surface, material, outgoingDirWs);
+        const float3 outgoingDirSs = shadingFrame.worldToFrame(outgoingDirWs);
+
+        bool anyLightSamples = false;
+        for (uint directCount = 0; directCount < shadowRaysPerPath(); directCount++) {
+            ShadowRay ray = ShadowRay::none();
+            if (!bsdf.isDelta()) {
+                const float2 rand = rng.getFloat2();
+                if (directCount < dEnvSamplesPerBounce) {
+                    // direct light sample from env map
+                    ray = sampleDirectMISLight(shadingFrame, scene.envMap, bsdf, outgoingDirSs, path.λ, surface.position, surface.triangleFrame.n, surface.spawnOffset, rand, dEnvSamplesPerBounce, 1);
+                } else {
+                    // direct light sample from emissive meshes
+                    ray = sampleDirectMISLight(shadingFrame, scene.meshLights, bsdf, outgoingDirSs, path.λ, surface.position, surface.triangleFrame.n, surface.spawnOffset, rand, dMeshSamplesPerBounce, 1);
+                }
+                ray.contribution *= path.throughput;
+            }
+            anyLightSamples = anyLightSamples || any(ray.contribution > 0);
+            dShadowRays[pathIndex * shadowRaysPerPath() + directCount] = ray;
+        }
+        if (anyLightSamples) pushShadowQueue(pathIndex);
+
+        // sample direction for next bounce
+        const BSDFSample sample = bsdf.sample(outgoingDirSs, rng.getFloat2());
+        if (all(sample.eval.reflectance < NEARzero)) {
+            terminated = true;
+        } else {
+            // set up info for next bounce
+            path.ray.direction = shadingFrame.frameToWorld(sample.dirFs);
+            path.ray.origin = surface.position + faceForward(surface.triangleFrame.n, path.ray.direction) * surface.spawnOffset;
+            path.ray.pdf = sample.eval.pdf;
+            path.throughput *= sample.eval.reflectance;
+            if (sample.dispersed && path.heroOnly == 0) {
+                path.throughput = Spectrum::heroOnly(path.throughput);
+                path.heroOnly = 1;
+            }
+            path.bounceCount += 1;
+        }
+    }
+
+    path.rngState = rng.state;
+    dPaths[pathIndex] = path;
+
+    if (!terminated) pushRayQueue(pushConsts.nextRayQueue, pathIndex);
+}
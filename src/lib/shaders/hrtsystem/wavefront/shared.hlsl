@@ -0,0 +1,143 @@
+#pragma once
+
+#include "../../utils/random.hlsl"
+#include "../ray.hlsl"
+#include "../scene.hlsl"
+#include "../shading.hlsl"
+#include "../adaptive_sampling.hlsl"
+
+// state shared by all stages of the wavefront integrator
+//
+// rather than following a single path from start to finish like the
+// megakernel integrators do, every stage is run over a queue of paths
+// to keep invocations of a dispatch doing the same work
+
+// GEOMETRY
+[[vk::binding(0, 0)]] RaytracingAccelerationStructure dTLAS;
+[[vk::binding(1, 0)]] StructuredBuffer<Instance> dInstances;
+[[vk::binding(2, 0)]] StructuredBuffer<row_major float3x4> dWorldToInstance;
+[[vk::binding(3, 0)]] StructuredBuffer<Mesh> dMeshes;
+[[vk::binding(4, 0)]] StructuredBuffer<Geometry> dGeometries;
+[[vk::binding(5, 0)]] StructuredBuffer<Material> dMaterials;
+
+// EMISSIVE TRIANGLES
+[[vk::binding(6, 0)]] StructuredBuffer<float> dTrianglePowers;
+[[vk::binding(7, 0)]] StructuredBuffer<float> dGeometryPowers;
+[[vk::binding(8, 0)]] StructuredBuffer<GeometryPowerInfo> dGeometryPowerInfos;
+
+// BACKGROUND
+[[vk::combinedImageSampler]] [[vk::binding(9, 0)]] Texture2D<float3> dBackgroundRgbTexture;
+[[vk::combinedImageSampler]] [[vk::binding(9, 0)]] SamplerState dBackgroundSampler;
+[[vk::binding(10, 0)]] Texture2D<float> dBackgroundLuminanceTexture;
+
+// OUTPUT
+[[vk::binding(11, 0)]] RWTexture2D<float4> dOutputImage;
+[[vk::binding(12, 0)]] RWTexture2D<float> dOutputMoments;
+
+// ADAPTIVE SAMPLING
+[[vk::binding(13, 0)]] StructuredBuffer<uint> dConvergedTiles;
+
+// binding 14 holds the light reservoirs of the megakernel, wavefront does not resample light
+
+// path of each pixel, indexed by its position in the image
+struct PathState {
+    Ray ray;
+    float4 throughput;
+    float4 radiance;
+    float4 λ;
+    float4 λPdf;
+    uint bounceCount;
+    uint heroOnly; // whether the secondary wavelengths have been terminated
+    uint4 rngState;
+};
+
+// closest hit of the last extended ray of a path
+struct Hit {
+    uint instanceIndex;
+    uint geometryIndex;
+    uint primitiveIndex;
+    float2 barycentrics;
+};
+
+// WAVEFRONT
+[[vk::binding(15, 0)]] RWStructuredBuffer<PathState> dPaths;
+[[vk::binding(16, 0)]] RWStructuredBuffer<Hit> dHits;
+[[vk::binding(17, 0)]] RWStructuredBuffer<uint> dRayQueues;      // two ping-ponged queues of paths to extend
+[[vk::binding(18, 0)]] RWStructuredBuffer<uint> dShadeQueues;    // one queue of paths to shade per BSDFType
+[[vk::binding(19, 0)]] RWStructuredBuffer<ShadowRay> dShadowRays; // light samples of each path of the current bounce
+[[vk::binding(20, 0)]] RWStructuredBuffer<uint> dShadowQueue;    // paths with light samples to test
+[[vk::binding(21, 0)]] RWStructuredBuffer<uint> dCounters;
+
+[[vk::constant_id(0)]] const uint dMaxBounces = 4;
+[[vk::constant_id(1)]] const uint dEnvSamplesPerBounce = 1;  // how many times the environment map should be sampled per bounce for light
+[[vk::constant_id(2)]] const uint dMeshSamplesPerBounce = 1; // how many times emissive meshes should be sampled per bounce for light
+
+static const uint shadeGroupSize = 64;
+
+// layout of dCounters, must be kept in sync with WavefrontCounters in pipeline.zig
+//
+// ray and shadow queues are vk::TraceRaysIndirectCommandKHR with the queue length as width,
+// shade queues are a vk::DispatchIndirectCommand followed by the queue length
+namespace Counters {
+    uint rayQueue(uint queue) {
+        return queue * 3;
+    }
+
+    uint shadowQueue() {
+        return 6;
+    }
+
+    uint shadeQueueGroups(BSDFType type) {
+        return 9 + uint(type) * 4;
+    }
+
+    uint shadeQueueLength(BSDFType type) {
+        return shadeQueueGroups(type) + 3;
+    }
+}
+
+uint pathCapacity() {
+    uint count;
+    uint stride;
+    dPaths.GetDimensions(count, stride);
+    return count;
+}
+
+uint shadowRaysPerPath() {
+    return dEnvSamplesPerBounce + dMeshSamplesPerBounce;
+}
+
+void pushRayQueue(uint queue, uint pathIndex) {
+    uint slot;
+    InterlockedAdd(dCounters[Counters::rayQueue(queue)], 1, slot);
+    dRayQueues[queue * pathCapacity() + slot] = pathIndex;
+}
+
+void pushShadeQueue(BSDFType type, uint pathIndex) {
+    uint slot;
+    InterlockedAdd(dCounters[Counters::shadeQueueLength(type)], 1, slot);
+    if (slot % shadeGroupSize == 0) InterlockedAdd(dCounters[Counters::shadeQueueGroups(type)], 1);
+    dShadeQueues[uint(type) * pathCapacity() + slot] = pathIndex;
+}
+
+void pushShadowQueue(uint pathIndex) {
+    uint slot;
+    InterlockedAdd(dCounters[Counters::shadowQueue()], 1, slot);
+    dShadowQueue[slot] = pathIndex;
+}
+
+Scene loadScene() {
+    World world;
+    world.instances = dInstances;
+    world.worldToInstance = dWorldToInstance;
+    world.meshes = dMeshes;
+    world.geometries = dGeometries;
+    world.materials = dMaterials;
+
+    Scene scene;
+    scene.tlas = dTLAS;
+    scene.world = world;
+    scene.envMap = EnvMap::create(dBackgroundRgbTexture, dBackgroundSampler, dBackgroundLuminanceTexture);
+    scene.meshLights = MeshLights::create(dTrianglePowers, dGeometryPowers, dGeometryPowerInfos, world);
+    return scene;
+}
@@ -0,0 +1,76 @@
+#include "../intersection.hlsl"
+#include "shared.hlsl"
+
+// the stages that trace rays, each invocation handling one queue entry
+
+struct PushConsts {
+	uint rayQueue; // which of the ray queues to extend
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+// finds the closest hit of each queued path and bins it by the
+// material it hit, so that shading runs over one BSDFType at a time
+[shader("raygeneration")]
+void extend() {
+    const uint pathIndex = dRayQueues[pushConsts.rayQueue * pathCapacity() + DispatchRaysIndex().x];
+    const Ray ray = dPaths[pathIndex].ray;
+
+    const Intersection its = Intersection::find(dTLAS, ray.desc());
+    if (its.hit()) {
+        Hit hit;
+        hit.instanceIndex = its.instanceIndex;
+        hit.geometryIndex = its.geometryIndex;
+        hit.primitiveIndex = its.primitiveIndex;
+        hit.barycentrics = its.barycentrics;
+        dHits[pathIndex] = hit;
+
+        const Scene scene = loadScene();
+        pushShadeQueue(scene.world.material(its.instanceIndex, its.geometryIndex).type, pathIndex);
+    } else if (dEnvSamplesPerBounce > 0) {
+        // path is done, handle env map
+        const PathState path = dPaths[pathIndex];
+        const Scene scene = loadScene();
+        const LightEvaluation l = scene.envMap.evaluate(path.λ, ray.direction);
+        const float weight = misWeight(1, ray.pdf, dEnvSamplesPerBounce, l.pdf);
+        dPaths[pathIndex].radiance = path.radiance + path.throughput * l.radiance * weight;
+    }
+}
+
+// tests the light samples taken by the shade stage for visibility
+[shader("raygeneration")]
+void shadow() {
+    const uint pathIndex = dShadowQueue[DispatchRaysIndex().x];
+
+    float4 radiance = 0;
+    for (uint i = 0; i < shadowRaysPerPath(); i++) {
+        const ShadowRay ray = dShadowRays[pathIndex * shadowRaysPerPath() + i];
+        if (any(ray.contribution > 0) && !ShadowIntersection::hit(dTLAS, ray.origin, ray.connection)) {
+            radiance += ray.contribution;
+        }
+    }
+
+    dPaths[pathIndex].radiance += radiance;
+}
+
+struct Attributes
+{
+    float2 barycentrics;
+};
+
+[shader("closesthit")]
+void closesthit(inout Intersection its, in Attributes attribs) {
+    its.instanceIndex = InstanceIndex();
+    its.geometryIndex = GeometryIndex();
+    its.primitiveIndex = PrimitiveIndex();
+    its.barycentrics = attribs.barycentrics;
+}
+
+[shader("miss")]
+void miss(inout Intersection its) {
+    its = Intersection::createMiss();
+}
+
+[shader("miss")]
+void shadowmiss(inout ShadowIntersection its) {
+    its.inShadow = false;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../utils/mappings.hlsl"
 #include "reflection_frame.hlsl"
 #include "material.hlsl"
 
@@ -23,8 +24,13 @@ struct Mesh {
     uint64_t normalAddress; // may be zero, for no vertex normals
 
     uint64_t indexAddress; // may be zero, for unindexed geometry
+
+    uint64_t attributeEncoding; // ATTRIBUTE_ENCODING_*, must match AttributeEncoding in MeshManager.zig
 };
 
+#define ATTRIBUTE_ENCODING_FULL 0
+#define ATTRIBUTE_ENCODING_COMPACT 1 // normals and texcoords interleaved in 8 bytes per vertex
+
 struct SurfacePoint {
     float3 position;
     float2 texcoord;
@@ -39,11 +45,21 @@ float3 loadPosition(uint64_t addr, uint index) {
     return vk::RawBufferLoad<float3>(addr + sizeof(float3) * index);
 }
 
-float2 loadTexcoord(uint64_t addr, uint index) {
+// compact attributes are a uint of octahedral normal followed by a uint of half texcoords
+static const uint compactAttributeStride = 8;
+
+float2 loadTexcoord(uint64_t addr, uint index, uint64_t encoding) {
+    if (encoding == ATTRIBUTE_ENCODING_COMPACT) {
+        const uint packed = vk::RawBufferLoad<uint>(addr + compactAttributeStride * index);
+        return float2(f16tof32(packed), f16tof32(packed >> 16));
+    }
     return vk::RawBufferLoad<float2>(addr + sizeof(float2) * index);
 }
 
-float3 loadNormal(uint64_t addr, uint index) {
+float3 loadNormal(uint64_t addr, uint index, uint64_t encoding) {
+    if (encoding == ATTRIBUTE_ENCODING_COMPACT) {
+        return octahedralToSphere(vk::RawBufferLoad<uint>(addr + compactAttributeStride * index));
+    }
     return vk::RawBufferLoad<float3>(addr + sizeof(float3) * index);
 }
 
@@ -139,6 +155,46 @@ struct TriangleLocalSpace {
     }
 };
 
+// vertex attributes of a triangle of a mesh, in the space of the mesh
+TriangleLocalSpace meshTriangle(const Mesh mesh, const uint primitiveIndex) {
+    TriangleLocalSpace t;
+
+    const uint primitiveIndex3 = primitiveIndex * 3;
+    const uint3 ind = mesh.indexAddress != 0 ? vk::RawBufferLoad<uint3>(mesh.indexAddress + sizeof(uint3) * primitiveIndex) : uint3(primitiveIndex3, primitiveIndex3 + 1, primitiveIndex3 + 2);
+
+    // positions always available
+    t.positions[0] = loadPosition(mesh.positionAddress, ind.x);
+    t.positions[1] = loadPosition(mesh.positionAddress, ind.y);
+    t.positions[2] = loadPosition(mesh.positionAddress, ind.z);
+
+    // texcoords optional
+    if (mesh.texcoordAddress != 0) {
+        t.texcoords[0] = loadTexcoord(mesh.texcoordAddress, ind.x, mesh.attributeEncoding);
+        t.texcoords[1] = loadTexcoord(mesh.texcoordAddress, ind.y, mesh.attributeEncoding);
+        t.texcoords[2] = loadTexcoord(mesh.texcoordAddress, ind.z, mesh.attributeEncoding);
+    } else {
+        // sane defaults for constant textures
+        t.texcoords[0] = float2(0, 0);
+        t.texcoords[1] = float2(1, 0);
+        t.texcoords[2] = float2(1, 1);
+    }
+
+    // normals optional
+    if (mesh.normalAddress != 0) {
+        t.normals[0] = loadNormal(mesh.normalAddress, ind.x, mesh.attributeEncoding);
+        t.normals[1] = loadNormal(mesh.normalAddress, ind.y, mesh.attributeEncoding);
+        t.normals[2] = loadNormal(mesh.normalAddress, ind.z, mesh.attributeEncoding);
+    } else {
+        // use triangle normal
+        const float3 normal = normalize(cross(t.positions[1] - t.positions[0], t.positions[2] - t.positions[0]));
+        t.normals[0] = normal;
+        t.normals[1] = normal;
+        t.normals[2] = normal;
+    }
+
+    return t;
+}
+
 struct World {
     StructuredBuffer<Instance> instances;
     StructuredBuffer<row_major float3x4> worldToInstance;
@@ -167,44 +223,7 @@ struct World {
     }
 
     TriangleLocalSpace triangleLocalSpace(uint instanceIndex, uint geometryIndex, uint primitiveIndex) {
-        TriangleLocalSpace t;
-
-        Mesh mesh = this.mesh(instanceIndex, geometryIndex);
-
-        const uint primitiveIndex3 = primitiveIndex * 3;
-        const uint3 ind = mesh.indexAddress != 0 ? vk::RawBufferLoad<uint3>(mesh.indexAddress + sizeof(uint3) * primitiveIndex) : uint3(primitiveIndex3, primitiveIndex3 + 1, primitiveIndex3 + 2);
-
-        // positions always available
-        t.positions[0] = loadPosition(mesh.positionAddress, ind.x);
-        t.positions[1] = loadPosition(mesh.positionAddress, ind.y);
-        t.positions[2] = loadPosition(mesh.positionAddress, ind.z);
-
-        // texcoords optional
-        if (mesh.texcoordAddress != 0) {
-            t.texcoords[0] = loadTexcoord(mesh.texcoordAddress, ind.x);
-            t.texcoords[1] = loadTexcoord(mesh.texcoordAddress, ind.y);
-            t.texcoords[2] = loadTexcoord(mesh.texcoordAddress, ind.z);
-        } else {
-            // sane defaults for constant textures
-            t.texcoords[0] = float2(0, 0);
-            t.texcoords[1] = float2(1, 0);
-            t.texcoords[2] = float2(1, 1);
-        }
-
-        // normals optional
-        if (mesh.normalAddress != 0) {
-            t.normals[0] = loadNormal(mesh.normalAddress, ind.x);
-            t.normals[1] = loadNormal(mesh.normalAddress, ind.y);
-            t.normals[2] = loadNormal(mesh.normalAddress, ind.z);
-        } else {
-            // use triangle normal
-            const float3 normal = normalize(cross(t.positions[1] - t.positions[0], t.positions[2] - t.positions[0]));
-            t.normals[0] = normal;
-            t.normals[1] = normal;
-            t.normals[2] = normal;
-        }
-
-        return t;
+        return meshTriangle(this.mesh(instanceIndex, geometryIndex), primitiveIndex);
     }
 
     TriangleLocalSpace triangleLocalSpacePos(uint instanceIndex, uint geometryIndex, uint primitiveIndex) {
@@ -82,6 +82,17 @@ float2 squareToEqualAreaSphereInverse(float3 dir) {
 	return float2(1.0 + uv.x, 1.0 + uv.y) * 0.5;
 }
 
+// inverse of the octahedral encoding in MeshManager.zig, two snorm16 packed in a uint
+// A Survey of Efficient Representations for Independent Unit Vectors, Cigolle et al. 2014
+float3 octahedralToSphere(uint packed) {
+	const float2 p = max(float2(int2(packed << 16, packed) >> 16) / 32767.0, -1.0);
+	float3 n = float3(p, 1.0 - abs(p.x) - abs(p.y));
+	const float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 // selects true with probability p (false otherwise),
 // remapping rand back into (0..1)
 bool coinFlipRemap(float p, inout float rand) {
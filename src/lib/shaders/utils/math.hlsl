@@ -24,6 +24,8 @@ float	pow5(float x) { return x * x * x * x * x; }
 
 #define luminance(color) ( dot(float3(0.212671, 0.715160, 0.072169), (color)) )
 
+#define maxComponent(v) ( max(max((v).x, (v).y), max((v).z, (v).w)) )
+
 #define faceForward(n, d) ( dot((n), (d)) > 0 ? (n) : -(n) )
 
 // https://www.nu42.com/2015/03/how-you-average-numbers.html
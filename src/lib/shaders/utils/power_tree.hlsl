@@ -0,0 +1,50 @@
+#pragma once
+
+#include "reservoir.hlsl"
+
+// binary sum tree over `leafCount` non-negative weights, flattened into a buffer
+// one level after the other starting with the leaves, so the single root is last
+//
+// level l has ceil(leafCount / 2^l) nodes, where node i is the sum of
+// nodes 2i and 2i + 1 of the level below, the latter possibly missing
+//
+// must be kept in sync with powerTreeSize in Accel.zig
+struct PowerTree {
+    static uint levelCount(uint leafCount) {
+        return leafCount <= 1 ? 1 : firstbithigh(leafCount - 1) + 2;
+    }
+
+    static uint levelSize(uint leafCount, uint level) {
+        return ((leafCount - 1) >> level) + 1;
+    }
+
+    static uint size(uint leafCount) {
+        uint total = 0;
+        for (uint level = 0; level < levelCount(leafCount); level++) {
+            total += levelSize(leafCount, level);
+        }
+        return total;
+    }
+
+    static uint root(uint offset, uint leafCount) {
+        return offset + size(leafCount) - 1;
+    }
+
+    // picks a leaf with probability proportional to its weight, remapping `rand` so that it may be reused
+    // the tree must not sum to zero
+    static uint sample(StructuredBuffer<float> tree, uint offset, uint leafCount, inout float rand) {
+        uint levelOffset = root(offset, leafCount);
+        uint idx = 0;
+        for (uint level = levelCount(leafCount) - 1; level-- > 0;) {
+            const uint nodeCount = levelSize(leafCount, level);
+            levelOffset -= nodeCount;
+            Reservoir<uint> r = Reservoir<uint>::empty();
+            for (uint i = 0; i < 2; i++) {
+                const uint child = idx + idx + i;
+                if (child < nodeCount) r.update(child, tree[levelOffset + child], rand);
+            }
+            idx = r.selected;
+        }
+        return idx;
+    }
+};
@@ -7,6 +7,7 @@ const core = engine.core;
 const VulkanContext = core.VulkanContext;
 const Encoder = core.Encoder;
 const Pipeline = engine.hrtsystem.pipeline.PathTracing;
+const Wavefront = engine.hrtsystem.Wavefront;
 const Scene = engine.hrtsystem.Scene;
 const World = engine.hrtsystem.World;
 const MeshManager = engine.hrtsystem.MeshManager;
@@ -34,7 +35,7 @@ const TestingContext = struct {
     output_buffer: core.mem.DownloadBuffer([4]f32),
 
     fn create(allocator: std.mem.Allocator, extent: vk.Extent2D) !TestingContext {
-        const vc = try VulkanContext.create(allocator, "engine-tests", &.{}, &engine.hrtsystem.required_device_extensions, &engine.hrtsystem.required_device_features, null);
+        const vc = try VulkanContext.create(allocator, "engine-tests", &.{}, &engine.hrtsystem.required_device_extensions, &engine.hrtsystem.optional_device_extensions, &engine.hrtsystem.required_device_features, null);
         errdefer vc.destroy(allocator);
 
         var encoder = try Encoder.create(&vc, "main");
@@ -69,31 +70,7 @@ const TestingContext = struct {
             pipeline.recordTraceRays(self.encoder.buffer, scene.camera.sensors.items[0].extent);
 
             // if not last invocation, need barrier cuz we write to images
-            if (sample_count != spp) {
-                self.encoder.buffer.pipelineBarrier2(&vk.DependencyInfo {
-                    .image_memory_barrier_count = 1,
-                    .p_image_memory_barriers = &[_]vk.ImageMemoryBarrier2 {
-                        .{
-                            .src_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-                            .src_access_mask = if (sample_count == 0) .{ .shader_storage_write_bit = true } else .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
-                            .dst_stage_mask = .{ .ray_tracing_shader_bit_khr = true },
-                            .dst_access_mask = .{ .shader_storage_write_bit = true, .shader_storage_read_bit = true },
-                            .old_layout = .general,
-                            .new_layout = .general,
-                            .src_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                            .dst_queue_family_index = vk.QUEUE_FAMILY_IGNORED,
-                            .image = scene.camera.sensors.items[0].image.handle,
-                            .subresource_range = .{
-                                .aspect_mask = .{ .color_bit = true },
-                                .base_mip_level = 0,
-                                .level_count = 1,
-                                .base_array_layer = 0,
-                                .layer_count = vk.REMAINING_ARRAY_LAYERS,
-                            },
-                        }
-                    },
-                });
-            }
+            if (sample_count != spp) scene.camera.sensors.items[0].recordCaptureBarrier(self.encoder.buffer, .{ .ray_tracing_shader_bit_khr = true });
             scene.camera.sensors.items[0].sample_count += 1;
         }
 
@@ -106,6 +83,38 @@ const TestingContext = struct {
         try self.encoder.submitAndIdleUntilDone(&self.vc);
     }
 
+    // same as renderToOutput, but starting over with the wavefront integrator, which should give the same image
+    // waits after every chunk of bounces, as that is simplest and test images are small
+    fn renderWavefrontToOutput(self: *TestingContext, wavefront: *Wavefront, scene: *Scene, spp: usize) !void {
+        const sensor = &scene.camera.sensors.items[0];
+        const bindings = scene.pushDescriptors(0, 0);
+        const sets = [2]vk.DescriptorSet { scene.world.materials.textures.descriptor_set, scene.world.constant_specta.descriptor_set };
+        sensor.clear();
+
+        try self.encoder.begin();
+        sensor.recordPrepareForCapture(self.encoder.buffer, .{ .compute_shader_bit = true, .ray_tracing_shader_bit_khr = true }, .{});
+
+        for (0..spp) |_| {
+            try wavefront.recordBeginSample(&self.vc, &self.encoder, bindings, sets, scene.camera.lenses.items[0], sensor, .{}, sensor.extent);
+            var next_bounce: ?u32 = 0;
+            while (next_bounce) |first_bounce| {
+                next_bounce = wavefront.recordBounces(&self.vc, &self.encoder, bindings, sets, first_bounce);
+                const bounce = next_bounce orelse break;
+
+                try self.encoder.submitAndIdleUntilDone(&self.vc);
+                try self.encoder.begin();
+                if (wavefront.livePathCount(bounce) == 0) break;
+            }
+            wavefront.recordEndSample(&self.encoder, bindings, sets, sensor, sensor.extent);
+            sensor.sample_count += 1;
+        }
+
+        sensor.recordPrepareForCopy(self.encoder.buffer, .{ .compute_shader_bit = true }, .{ .copy_bit = true });
+        self.encoder.copyImageToBuffer(sensor.image.handle, .transfer_src_optimal, sensor.extent, self.output_buffer.handle);
+
+        try self.encoder.submitAndIdleUntilDone(&self.vc);
+    }
+
     fn destroy(self: *TestingContext, allocator: std.mem.Allocator) void {
         self.output_buffer.destroy(&self.vc);
         self.encoder.destroy(&self.vc);
@@ -379,6 +388,21 @@ test "white sphere on white background is white" {
 
     try tc.renderToOutput(&pipeline, &scene, 512);
     try assertWhiteFurnaceImage(tc.output_buffer.slice);
+
+    // and both again with the wavefront integrator
+    for ([_]u32 { 0, 1 }) |env_samples_per_bounce| {
+        try tc.encoder.begin();
+        var wavefront = try Wavefront.create(&tc.vc, allocator, &tc.encoder, .{ scene.world.materials.textures.descriptor_layout.handle, scene.world.constant_specta.descriptor_layout.handle }, .{
+            .max_bounces = 1024,
+            .env_samples_per_bounce = env_samples_per_bounce,
+            .mesh_samples_per_bounce = 0,
+        }, scene.background.sampler);
+        defer wavefront.destroy(&tc.vc);
+        try tc.encoder.submitAndIdleUntilDone(&tc.vc);
+
+        try tc.renderWavefrontToOutput(&wavefront, &scene, 512);
+        try assertWhiteFurnaceImage(tc.output_buffer.slice);
+    }
 }
 
 test "inside illuminating sphere is white" {
@@ -482,4 +506,19 @@ test "inside illuminating sphere is white" {
 
     try tc.renderToOutput(&pipeline, &scene, 1024);
     try assertWhiteFurnaceImage(tc.output_buffer.slice);
+
+    // and both again with the wavefront integrator
+    for ([_]u32 { 0, 1 }) |mesh_samples_per_bounce| {
+        try tc.encoder.begin();
+        var wavefront = try Wavefront.create(&tc.vc, allocator, &tc.encoder, .{ scene.world.materials.textures.descriptor_layout.handle, scene.world.constant_specta.descriptor_layout.handle }, .{
+            .max_bounces = 1024,
+            .env_samples_per_bounce = 0,
+            .mesh_samples_per_bounce = mesh_samples_per_bounce,
+        }, scene.background.sampler);
+        defer wavefront.destroy(&tc.vc);
+        try tc.encoder.submitAndIdleUntilDone(&tc.vc);
+
+        try tc.renderWavefrontToOutput(&wavefront, &scene, 1024);
+        try assertWhiteFurnaceImage(tc.output_buffer.slice);
+    }
 }